@@ -0,0 +1,213 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file antidote_trace.c
+ * \brief Decoder of binary trace dumps.
+ *
+ * Prints, in time order, the records of a file written by trace_dump()
+ * (e.g. by running a program with ANTIDOTE_TRACE=file).
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 22, 2011
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "src/util/trace.h"
+#include "src/communication/fsm.h"
+
+/**
+ * Orders records by timestamp, then by ring.
+ */
+static int compare_records(const void *a, const void *b)
+{
+	const TraceRecord *ra = a;
+	const TraceRecord *rb = b;
+
+	if (ra->timestamp != rb->timestamp)
+		return ra->timestamp < rb->timestamp ? -1 : 1;
+
+	return (int) ra->ring - (int) rb->ring;
+}
+
+/**
+ * Returns the name of an APDU choice.
+ */
+static const char *apdu_name(const TraceRecord *record)
+{
+	int choice;
+
+	if (record->length < 2)
+		return "?";
+
+	choice = (record->payload[0] << 8) | record->payload[1];
+
+	switch (choice) {
+	case AARQ_CHOSEN:
+		return "AARQ";
+	case AARE_CHOSEN:
+		return "AARE";
+	case RLRQ_CHOSEN:
+		return "RLRQ";
+	case RLRE_CHOSEN:
+		return "RLRE";
+	case ABRT_CHOSEN:
+		return "ABRT";
+	case PRST_CHOSEN:
+		return "PRST";
+	}
+
+	return "?";
+}
+
+/**
+ * Prints the kept head of an APDU in hex.
+ */
+static void print_apdu(const TraceRecord *record)
+{
+	unsigned int kept = record->length;
+	unsigned int i;
+
+	if (kept > TRACE_PAYLOAD_SIZE)
+		kept = TRACE_PAYLOAD_SIZE;
+
+	printf("%s len=%u", apdu_name(record), record->length);
+
+	for (i = 0; i < kept; i++) {
+		printf("%s%.2X", i ? " " : " [", record->payload[i]);
+	}
+
+	printf("%s\n", record->length > kept ? " ...]" : (kept ? "]" : ""));
+}
+
+/**
+ * Prints a record.
+ *
+ * @param record the record
+ * @param start timestamp of the first record
+ */
+static void print_record(const TraceRecord *record, uint64_t start)
+{
+	uint64_t t = record->timestamp - start;
+
+	printf("%6llu.%09llu %2u %u:%llu ",
+	       (unsigned long long) (t / 1000000000ULL),
+	       (unsigned long long) (t % 1000000000ULL),
+	       record->ring, record->plugin,
+	       (unsigned long long) record->connid);
+
+	switch (record->code) {
+	case TRACE_APDU_RECEIVED:
+		printf("recv ");
+		print_apdu(record);
+		break;
+	case TRACE_APDU_SENT:
+		printf("send ");
+		print_apdu(record);
+		break;
+	case TRACE_DECODE_ERROR:
+		printf("decode error\n");
+		break;
+	case TRACE_FSM_EVENT:
+		printf("fsm <%s> event <%s>\n",
+		       fsm_state_to_string(record->payload[0]),
+		       fsm_event_to_string(record->payload[1]));
+		break;
+	case TRACE_FSM_TRANSITION:
+		printf("fsm <%s> -> <%s> on <%s>\n",
+		       fsm_state_to_string(record->payload[0]),
+		       fsm_state_to_string(record->payload[1]),
+		       fsm_event_to_string(record->payload[2]));
+		break;
+	case TRACE_TIMEOUT:
+		printf("timeout\n");
+		break;
+	default:
+		printf("unknown event %u\n", record->code);
+	}
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+	char magic[sizeof(TRACE_FILE_MAGIC)] = "";
+	TraceRecord *records = NULL;
+	intu32 record_size = 0;
+	size_t size = 0;
+	size_t count = 0;
+	size_t i;
+	FILE *f;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+		return 1;
+	}
+
+	f = fopen(argv[1], "rb");
+
+	if (!f) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	if (fread(magic, 1, strlen(TRACE_FILE_MAGIC), f) != strlen(TRACE_FILE_MAGIC)
+	    || strcmp(magic, TRACE_FILE_MAGIC) != 0
+	    || fread(&record_size, sizeof(record_size), 1, f) != 1
+	    || record_size != sizeof(TraceRecord)) {
+		fprintf(stderr, "%s: not a trace file of this platform\n", argv[1]);
+		fclose(f);
+		return 1;
+	}
+
+	while (1) {
+		if (count == size) {
+			size = size ? size * 2 : 4096;
+			records = realloc(records, size * sizeof(TraceRecord));
+
+			if (!records) {
+				fprintf(stderr, "out of memory\n");
+				fclose(f);
+				return 1;
+			}
+		}
+
+		if (fread(&records[count], sizeof(TraceRecord), 1, f) != 1)
+			break;
+
+		count++;
+	}
+
+	fclose(f);
+
+	qsort(records, count, sizeof(TraceRecord), compare_records);
+
+	for (i = 0; i < count; i++) {
+		print_record(&records[i], records[0].timestamp);
+	}
+
+	free(records);
+
+	return 0;
+}
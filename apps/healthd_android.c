@@ -174,6 +174,18 @@ void healthd_idle_add(void* f, void *param)
 	DEBUG("TODO healthd_idle_add");
 }
 
+/**
+ * Runs a job right away; there is no worker pool on Android yet
+ */
+void healthd_work_add(void *work, void *done, void *param)
+{
+	if (work) {
+		((void (*)(void*)) work)(param);
+	}
+
+	((void (*)(void*)) done)(param);
+}
+
 /************* Agent method call proxies ***************/
 
 /**
@@ -39,11 +39,15 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <ieee11073.h>
 #include "src/util/log.h"
 #include "src/util/linkedlist.h"
+#include "src/util/journal.h"
 #include "src/communication/service.h"
 #include "src/dim/pmstore_req.h"
 #include "healthd_ipc.h"
@@ -52,51 +56,371 @@
 extern healthd_ipc ipc;
 
 /**
- * Callback for when new data has been received.
+ * Asks the IPC whether a message will reach anybody, so data lists
+ * nobody subscribed to are not encoded at all.
  *
- * @param ctx current context.
- * @param list a pointer to data list.
+ * @param topic message type, e.g. "MEASUREMENT"
+ * @param id device context
+ * @param list data list that would be encoded
+ * @return 1 if message is wanted, 0 otherwise
  */
-void new_data_received(Context *ctx, DataList *list)
+static int ipc_wants(const char *topic, ContextId id, DataList *list)
 {
-	DEBUG("Medical Device System Data");
+	if (!ipc.wants) {
+		return 1;
+	}
+
+	return ipc.wants(topic, id, list);
+}
+
+/**
+ * Measurement journal, flushed to disk by a thread of its own so that
+ * many records share one fsync (group commit)
+ */
+static struct {
+	Journal *journal;
+	unsigned int sync_ms;
+	unsigned long long max_bytes;
+	int quit;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} journal = {NULL, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER,
+	     PTHREAD_COND_INITIALIZER};
+
+/**
+ * Reads the wall clock.
+ *
+ * @return current time in nanoseconds since the epoch
+ */
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Journal sync thread
+ */
+static void *healthd_journal_thread(void *arg)
+{
+	struct timespec deadline;
+	unsigned long long end;
+
+	pthread_mutex_lock(&journal.mutex);
 
-	char *data = xml_encode_data_list(list);
+	while (!journal.quit) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += journal.sync_ms / 1000;
+		deadline.tv_nsec += (journal.sync_ms % 1000) * 1000000L;
 
-	if (data) {
-		ipc.call_agent_measurementdata(ctx->id, data);
-		free(data);
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		while (!journal.quit && pthread_cond_timedwait(&journal.cond,
+				&journal.mutex, &deadline) != ETIMEDOUT)
+			;
+
+		pthread_mutex_unlock(&journal.mutex);
+
+		if (!journal_sync(journal.journal)) {
+			ERROR("journal: sync failed");
+		}
+
+		end = journal_end(journal.journal);
+
+		/* whole segments older than the retained bytes go away */
+		if (journal.max_bytes && end > journal.max_bytes) {
+			journal_trim(journal.journal, end - journal.max_bytes);
+		}
+
+		pthread_mutex_lock(&journal.mutex);
 	}
+
+	pthread_mutex_unlock(&journal.mutex);
+
+	return NULL;
 }
 
+/**
+ * Starts journaling measurements and PM-Segment data to disk, so that
+ * clients can catch up on what they missed by reading the journal.
+ * Must be called before the manager starts.
+ *
+ * @param dir journal directory
+ * @param sync_ms interval between flushes to disk, in milliseconds;
+ *        records received in the interval may be lost on a crash
+ * @param max_bytes size of the most recent records kept, older
+ *        segments are deleted; 0 keeps everything
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int healthd_journal_open(const char *dir, unsigned int sync_ms,
+			 unsigned long long max_bytes)
+{
+	journal.journal = journal_open(dir, 0);
+
+	if (!journal.journal) {
+		return 0;
+	}
+
+	journal.sync_ms = sync_ms ? sync_ms : 1;
+	journal.max_bytes = max_bytes;
+	journal.quit = 0;
+
+	if (pthread_create(&journal.thread, NULL, healthd_journal_thread,
+			   NULL) != 0) {
+		journal_close(journal.journal);
+		journal.journal = NULL;
+		return 0;
+	}
+
+	DEBUG("journal: %s, sync every %u ms, keep %llu bytes", dir,
+	      journal.sync_ms, journal.max_bytes);
+
+	return 1;
+}
+
+/**
+ * Flushes and closes the journal
+ */
+void healthd_journal_close()
+{
+	if (!journal.journal) {
+		return;
+	}
+
+	pthread_mutex_lock(&journal.mutex);
+	journal.quit = 1;
+	pthread_cond_signal(&journal.cond);
+	pthread_mutex_unlock(&journal.mutex);
+
+	pthread_join(journal.thread, NULL);
+
+	journal_close(journal.journal);
+	journal.journal = NULL;
+}
+
+/**
+ * Kinds of IPC event
+ */
+enum {
+	IPC_MEASUREMENT,
+	IPC_SEGMENTDATA,
+	IPC_ASSOCIATED,
+	IPC_CONNECTED,
+	IPC_DISCONNECTED,
+	IPC_DISASSOCIATED,
+	IPC_ATTRIBUTES,
+	IPC_PMSTOREDATA,
+	IPC_SEGMENTINFO,
+	IPC_SEGMENTDATARESPONSE,
+	IPC_SEGMENTCLEARED
+};
+
+/**
+ * IPC event, waiting for its XML to be encoded and for the events
+ * before it to be delivered
+ */
 typedef struct {
+	int type;
 	ContextId id;
-	int handle;
-	int instnumber;
+	unsigned int handle;
+	unsigned int instnumber;
+	unsigned int status;
+	unsigned long long timestamp;
+	char *addr;
 	DataList *list;
-} segment_data_evt;
+	char *xml;
+} ipc_evt;
 
 /**
- * Delayed PM-Segment data handling
+ * Message type of events whose delivery depends on subscriptions
+ *
+ * @param type event kind
+ * @return message type, or NULL if event is always delivered
+ */
+static const char *ipc_topic(int type)
+{
+	switch (type) {
+	case IPC_MEASUREMENT:
+		return "MEASUREMENT";
+	case IPC_SEGMENTDATA:
+		return "SEGMENTDATA";
+	case IPC_ASSOCIATED:
+		return "DESCRIPTION";
+	case IPC_ATTRIBUTES:
+		return "ATTRIBUTES";
+	}
+
+	return NULL;
+}
+
+static ipc_evt *ipc_evt_new(int type, ContextId id)
+{
+	ipc_evt *evt = calloc(1, sizeof(ipc_evt));
+	evt->type = type;
+	evt->id = id;
+	evt->timestamp = now_ns();
+	return evt;
+}
+
+static void ipc_evt_del(ipc_evt *evt)
+{
+	data_list_del(evt->list);
+	free(evt->xml);
+	free(evt->addr);
+	free(evt);
+}
+
+/**
+ * Encodes the data list of an event. Runs in a worker thread.
  *
  * @param data pointer to event struct
- * @return always FALSE
  */
-static void segment_data_received_phase2(void *revt)
+static void ipc_evt_encode(void *data)
 {
-	segment_data_evt *evt = revt;
+	ipc_evt *evt = data;
 
-	DEBUG("PM-Segment Data phase 2");
+	evt->xml = xml_encode_data_list(evt->list);
+}
+
+/**
+ * Writes measurements and PM-Segment data to the journal, if enabled.
+ *
+ * @param evt the event, with its XML already encoded
+ */
+static void ipc_evt_journal(ipc_evt *evt)
+{
+	JournalRecord record;
 
-	char *data = xml_encode_data_list(evt->list);
+	if (!journal.journal || !evt->xml) {
+		return;
+	}
 
-	if (data) {
-		ipc.call_agent_segmentdata(evt->id, evt->handle, evt->instnumber, data);
-		free(data);
+	memset(&record, 0, sizeof(record));
+
+	switch (evt->type) {
+	case IPC_MEASUREMENT:
+		record.type = JOURNAL_MEASUREMENT;
+		break;
+	case IPC_SEGMENTDATA:
+		record.type = JOURNAL_SEGMENT_DATA;
+		record.handle = evt->handle;
+		record.instnumber = evt->instnumber;
+		break;
+	default:
+		return;
 	}
 
-	data_list_del(evt->list);
-	free(revt);
+	record.plugin = evt->id.plugin;
+	record.connid = evt->id.connid;
+	record.timestamp = evt->timestamp;
+	record.data = evt->xml;
+	record.length = strlen(evt->xml);
+
+	if (!journal_append(journal.journal, &record)) {
+		ERROR("journal: record lost");
+	}
+}
+
+/**
+ * Delivers an event to the IPC. Runs in the main loop, in the order
+ * events were posted.
+ *
+ * @param data pointer to event struct
+ */
+static void ipc_evt_emit(void *data)
+{
+	ipc_evt *evt = data;
+	const char *topic = ipc_topic(evt->type);
+	char *xml = evt->xml;
+
+	ipc_evt_journal(evt);
+
+	// Subscriptions may have changed while the XML was encoded
+	if (xml && topic && !ipc_wants(topic, evt->id, evt->list)) {
+		xml = NULL;
+	}
+
+	switch (evt->type) {
+	case IPC_MEASUREMENT:
+		if (xml)
+			ipc.call_agent_measurementdata(evt->id, xml);
+		break;
+	case IPC_SEGMENTDATA:
+		if (xml)
+			ipc.call_agent_segmentdata(evt->id, evt->handle,
+						   evt->instnumber, xml);
+		break;
+	case IPC_ASSOCIATED:
+		ipc.call_agent_associated(evt->id, xml ? xml : "");
+		break;
+	case IPC_CONNECTED:
+		ipc.call_agent_connected(evt->id, evt->addr);
+		break;
+	case IPC_DISCONNECTED:
+		ipc.call_agent_disconnected(evt->id, evt->addr);
+		break;
+	case IPC_DISASSOCIATED:
+		ipc.call_agent_disassociated(evt->id);
+		break;
+	case IPC_ATTRIBUTES:
+		if (xml)
+			ipc.call_agent_deviceattributes(evt->id, xml);
+		break;
+	case IPC_PMSTOREDATA:
+		ipc.call_agent_pmstoredata(evt->id, evt->handle, xml ? xml : "");
+		break;
+	case IPC_SEGMENTINFO:
+		if (xml)
+			ipc.call_agent_segmentinfo(evt->id, evt->handle, xml);
+		break;
+	case IPC_SEGMENTDATARESPONSE:
+		ipc.call_agent_segmentdataresponse(evt->id, evt->handle,
+						   evt->instnumber, evt->status);
+		break;
+	case IPC_SEGMENTCLEARED:
+		ipc.call_agent_segmentcleared(evt->id, evt->handle,
+					      evt->instnumber, evt->status);
+		break;
+	}
+
+	ipc_evt_del(evt);
+}
+
+/**
+ * Queues an event for delivery. Its data list, if any, is owned by the
+ * event and encoded to XML off the main loop.
+ *
+ * @param evt the event
+ */
+static void ipc_post(ipc_evt *evt)
+{
+	healthd_work_add(evt->list ? ipc_evt_encode : NULL, ipc_evt_emit, evt);
+}
+
+/**
+ * Callback for when new data has been received.
+ *
+ * @param ctx current context.
+ * @param list a pointer to data list.
+ */
+void new_data_received(Context *ctx, DataList *list)
+{
+	DEBUG("Medical Device System Data");
+
+	if (!journal.journal && !ipc_wants("MEASUREMENT", ctx->id, list)) {
+		return;
+	}
+
+	ipc_evt *evt = ipc_evt_new(IPC_MEASUREMENT, ctx->id);
+
+	// list belongs to the core
+	evt->list = data_list_copy(list);
+	ipc_post(evt);
 }
 
 /**
@@ -110,24 +434,28 @@ static void segment_data_received_phase2(void *revt)
 void segment_data_received(Context *ctx, int handle, int instnumber, DataList *list)
 {
 	DEBUG("PM-Segment Data");
-	segment_data_evt *evt = calloc(1, sizeof(segment_data_evt));
 
 	// Different from other callback events, "list" is not freed by core, but
 	// it is passed ownership instead.
 
+	if (!journal.journal && !ipc_wants("SEGMENTDATA", ctx->id, list)) {
+		data_list_del(list);
+		return;
+	}
+
+	ipc_evt *evt = ipc_evt_new(IPC_SEGMENTDATA, ctx->id);
+
 	// Encoding a whole PM-Segment to XML may take a *LONG* time. If the program
 	// is single-threaded, encoding here would block the 11073 stack, causing
 	// the agent to abort because it didn't get confirmation in time.
 
-	// So, encoding XML from data list is better left to a thread, or, at very
-	// least, delayed until there are no pending events.
+	// So, encoding XML from data list is left to a worker thread.
 
-	evt->id = ctx->id;
 	evt->handle = handle;
 	evt->instnumber = instnumber;
 	evt->list = list;
 
-	healthd_idle_add(segment_data_received_phase2, evt);
+	ipc_post(evt);
 }
 
 
@@ -141,12 +469,14 @@ void device_associated(Context *ctx, DataList *list)
 {
 	DEBUG("Device associated");
 
-	char *data = xml_encode_data_list(list);
+	ipc_evt *evt = ipc_evt_new(IPC_ASSOCIATED, ctx->id);
 
-	if (data) {
-		ipc.call_agent_associated(ctx->id, data);
-		free(data);
+	// list belongs to the core
+	if (ipc_wants("DESCRIPTION", ctx->id, list)) {
+		evt->list = data_list_copy(list);
 	}
+
+	ipc_post(evt);
 }
 
 /**
@@ -158,7 +488,9 @@ void device_associated(Context *ctx, DataList *list)
 int device_connected(Context *ctx, const char *low_addr)
 {
 	DEBUG("Device connected");
-	ipc.call_agent_connected(ctx->id, low_addr);
+	ipc_evt *evt = ipc_evt_new(IPC_CONNECTED, ctx->id);
+	evt->addr = low_addr ? strdup(low_addr) : NULL;
+	ipc_post(evt);
 	return 1;
 }
 
@@ -171,7 +503,9 @@ int device_connected(Context *ctx, const char *low_addr)
 int device_disconnected(Context *ctx, const char *low_addr)
 {
 	DEBUG("Device disconnected");
-	ipc.call_agent_disconnected(ctx->id, low_addr);
+	ipc_evt *evt = ipc_evt_new(IPC_DISCONNECTED, ctx->id);
+	evt->addr = low_addr ? strdup(low_addr) : NULL;
+	ipc_post(evt);
 	return 1;
 }
 
@@ -181,7 +515,7 @@ int device_disconnected(Context *ctx, const char *low_addr)
 void device_disassociated(Context *ctx)
 {
 	DEBUG("Device unassociated");
-	ipc.call_agent_disassociated(ctx->id);
+	ipc_post(ipc_evt_new(IPC_DISASSOCIATED, ctx->id));
 }
 
 /**
@@ -197,13 +531,15 @@ static void device_reqmdsattr_callback(Context *ctx, Request *r, DATA_apdu *resp
 
 	DataList *list = manager_get_mds_attributes(ctx->id);
 
-	if (list) {
-		char *data = xml_encode_data_list(list);
-		if (data) {
-			ipc.call_agent_deviceattributes(ctx->id, data);
-			free(data);
-		}
+	if (list && !ipc_wants("ATTRIBUTES", ctx->id, list)) {
 		data_list_del(list);
+		return;
+	}
+
+	if (list) {
+		ipc_evt *evt = ipc_evt_new(IPC_ATTRIBUTES, ctx->id);
+		evt->list = list;
+		ipc_post(evt);
 	}
 }
 
@@ -239,6 +575,47 @@ void device_getconfig(ContextId ctx, char** xml_out)
 	}
 }
 
+/**
+ * get runtime statistics of a device connection
+ *
+ * \param ctx
+ * \param xml_out pointer to string to be filled with result XML
+ */
+void device_getstats(ContextId ctx, char** xml_out)
+{
+	DataList *list;
+
+	DEBUG("device_getstats");
+	list = manager_get_stats(ctx);
+
+	if (list) {
+		*xml_out = xml_encode_data_list(list);
+		data_list_del(list);
+	} else {
+		*xml_out = strdup("");
+	}
+}
+
+/**
+ * get runtime statistics of all connections
+ *
+ * \param xml_out pointer to string to be filled with result XML
+ */
+void healthd_getstats(char** xml_out)
+{
+	DataList *list;
+
+	DEBUG("healthd_getstats");
+	list = manager_get_global_stats();
+
+	if (list) {
+		*xml_out = xml_encode_data_list(list);
+		data_list_del(list);
+	} else {
+		*xml_out = strdup("");
+	}
+}
+
 /**
  * request measuremens
  *
@@ -333,25 +710,27 @@ static void device_get_pmstore_cb(Context *ctx, Request *r, DATA_apdu *response_
 {
 	PMStoreGetRet *ret = (PMStoreGetRet*) r->return_data;
 	DataList *list;
-	char *data;
+	ipc_evt *evt;
 
 	DEBUG("device_get_pmstore_cb");
 
 	if (!ret)
 		return;
 
+	evt = ipc_evt_new(IPC_PMSTOREDATA, ctx->id);
+	evt->handle = ret->handle;
+
 	if (ret->error) {
 		// some error
-		ipc.call_agent_pmstoredata(ctx->id, ret->handle, "");
+		ipc_post(evt);
 		return;
 	}
 
 	if ((list = manager_get_pmstore_data(ctx->id, ret->handle))) {
-		if ((data = xml_encode_data_list(list))) {
-			ipc.call_agent_pmstoredata(ctx->id, ret->handle, data);
-			free(data);
-			data_list_del(list);
-		}
+		evt->list = list;
+		ipc_post(evt);
+	} else {
+		free(evt);
 	}
 }
 
@@ -384,17 +763,16 @@ static void device_get_segminfo_cb(Context *ctx, Request *r, DATA_apdu *response
 {
 	PMStoreGetSegmInfoRet *ret = (PMStoreGetSegmInfoRet*) r->return_data;
 	DataList *list;
-	char *data;
+	ipc_evt *evt;
 
 	if (!ret)
 		return;
 
 	if ((list = manager_get_segment_info_data(ctx->id, ret->handle))) {
-		if ((data = xml_encode_data_list(list))) {
-			ipc.call_agent_segmentinfo(ctx->id, ret->handle, data);
-			free(data);
-			data_list_del(list);
-		}
+		evt = ipc_evt_new(IPC_SEGMENTINFO, ctx->id);
+		evt->handle = ret->handle;
+		evt->list = list;
+		ipc_post(evt);
 	}
 }
 
@@ -412,7 +790,11 @@ static void device_get_segmdata_cb(Context *ctx, Request *r, DATA_apdu *response
 	if (!ret)
 		return;
 
-	ipc.call_agent_segmentdataresponse(ctx->id, ret->handle, ret->inst, ret->error);
+	ipc_evt *evt = ipc_evt_new(IPC_SEGMENTDATARESPONSE, ctx->id);
+	evt->handle = ret->handle;
+	evt->instnumber = ret->inst;
+	evt->status = ret->error;
+	ipc_post(evt);
 }
 
 /**
@@ -429,7 +811,11 @@ static void device_clear_segm_cb(Context *ctx, Request *r, DATA_apdu *response_a
 	if (!ret)
 		return;
 
-	ipc.call_agent_segmentcleared(ctx->id, ret->handle, ret->inst, ret->error);
+	ipc_evt *evt = ipc_evt_new(IPC_SEGMENTCLEARED, ctx->id);
+	evt->handle = ret->handle;
+	evt->instnumber = ret->inst;
+	evt->status = ret->error;
+	ipc_post(evt);
 }
 
 /**
@@ -12,6 +12,8 @@ int device_disconnected(Context *ctx, const char *low_addr);
 void device_disassociated(Context *ctx);
 void device_reqmdsattr(ContextId ctx);
 void device_getconfig(ContextId ctx, char** xml_out);
+void device_getstats(ContextId ctx, char** xml_out);
+void healthd_getstats(char** xml_out);
 void device_reqmeasurement(ContextId ctx);
 void device_set_time(ContextId ctx, unsigned long long time);
 void device_reqactivationscanner(ContextId ctx, int handle);
@@ -25,5 +27,8 @@ void device_get_segmdata(ContextId ctx, int handle, int instnumber,
 void device_clearsegmdata(ContextId ctx, int handle, int instnumber,
 				int *ret);
 void device_clearallsegmdata(ContextId ctx, int handle, int *ret);
+int healthd_journal_open(const char *dir, unsigned int sync_ms,
+			 unsigned long long max_bytes);
+void healthd_journal_close();
 
 #endif
@@ -13,6 +13,10 @@ typedef struct {
 	void (*call_agent_segmentcleared)(ContextId, unsigned int, unsigned int, unsigned int);
 	void (*call_agent_pmstoredata)(ContextId, unsigned int, char *);
 	void (*call_agent_deviceattributes)(ContextId, char *xml);
+	/* Optional. Tells whether anybody wants a message of the given type
+	 * (e.g. "MEASUREMENT") for a device, before the data list is encoded.
+	 * NULL means every message is wanted. */
+	int (*wants)(const char *, ContextId, DataList *);
 	void (*start)();
 	void (*stop)();
 } healthd_ipc;
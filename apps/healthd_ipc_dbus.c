@@ -160,8 +160,18 @@ static LinkedList *_devices = NULL;
 static DBusGConnection *bus = NULL;
 static DBusGProxy *agent_proxy = NULL;
 
+/* Measurement batching, disabled while max_events is 0 */
+static struct {
+	guint max_events;
+	guint window_ms;
+	GPtrArray *paths;
+	GPtrArray *xmls;
+	guint timer;
+} batch;
+
 static const char *get_device_object(const char *, ContextId);
 static void get_agent_proxy();
+static void batch_flush();
 
 static LinkedList *devices()
 {
@@ -257,6 +267,22 @@ gboolean srv_configurepassive(Serv *obj, gchar *agent,
 	return TRUE;
 }
 
+/**
+ * Callback related to manager.GetStats D-Bus method.
+ * Returns runtime statistics of all device connections.
+ *
+ * @param obj Serv object (GObject)
+ * @param xml_out pointer to string to be filled with result XML
+ * @param err
+ * @return success status
+ */
+gboolean srv_getstats(Serv *obj, char** xml_out, GError **err)
+{
+	DEBUG("srv_getstats");
+	healthd_getstats(xml_out);
+	return TRUE;
+}
+
 static int cmp_device_by_handle(void *arg, void *nodeElement) 
 {
 	ContextId handle = *((ContextId *) arg);
@@ -498,6 +524,8 @@ static void call_agent_connected(ContextId ctx, const char *low_addr)
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "Connected",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -536,6 +564,8 @@ static void call_agent_associated(ContextId conn_handle, char *xml)
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "Associated",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -550,6 +580,111 @@ static void call_agent_associated(ContextId conn_handle, char *xml)
 	// return TRUE;
 }
 
+/**
+ * Batching window timeout.
+ *
+ * @param data unused
+ * @return always FALSE
+ */
+static gboolean batch_timeout(gpointer data)
+{
+	batch.timer = 0;
+	batch_flush();
+	return FALSE;
+}
+
+/**
+ * Sends the pending measurements in a single agent.MeasurementDataBatch
+ * call. Called when the batch is full, when its window expires, and
+ * before any other agent call so that events keep their order.
+ */
+static void batch_flush()
+{
+	DBusGProxyCall *call;
+	gchar **paths;
+	gchar **xmls;
+
+	if (batch.timer) {
+		g_source_remove(batch.timer);
+		batch.timer = 0;
+	}
+
+	if (!batch.paths || batch.paths->len == 0) {
+		return;
+	}
+
+	DEBUG("flushing %u measurements", batch.paths->len);
+
+	g_ptr_array_add(batch.paths, NULL);
+	g_ptr_array_add(batch.xmls, NULL);
+	paths = (gchar **) g_ptr_array_free(batch.paths, FALSE);
+	xmls = (gchar **) g_ptr_array_free(batch.xmls, FALSE);
+	batch.paths = NULL;
+	batch.xmls = NULL;
+
+	if (agent_proxy) {
+		call = dbus_g_proxy_begin_call(agent_proxy,
+					       "MeasurementDataBatch",
+					       call_agent_epilogue, NULL, NULL,
+					       G_TYPE_STRV, paths,
+					       G_TYPE_STRV, xmls,
+					       G_TYPE_INVALID, G_TYPE_INVALID);
+
+		if (!call) {
+			DEBUG("error calling agent");
+		}
+	}
+
+	g_strfreev(paths);
+	g_strfreev(xmls);
+}
+
+/**
+ * Adds a measurement to the pending batch.
+ *
+ * @param device_path device object path
+ * @param xml Data in xml format
+ */
+static void batch_add(const char *device_path, const char *xml)
+{
+	if (!batch.paths) {
+		batch.paths = g_ptr_array_new();
+		batch.xmls = g_ptr_array_new();
+	}
+
+	g_ptr_array_add(batch.paths, g_strdup(device_path));
+	g_ptr_array_add(batch.xmls, g_strdup(xml));
+
+	if (batch.paths->len >= batch.max_events) {
+		batch_flush();
+	} else if (!batch.timer) {
+		batch.timer = g_timeout_add(batch.window_ms, batch_timeout, NULL);
+	}
+}
+
+/**
+ * Enables coalescing of measurements. Instead of one
+ * agent.MeasurementData call per event, up to max_events measurements
+ * received within window_ms milliseconds are delivered by a single
+ * agent.MeasurementDataBatch(as devices, as xmls) call, so the
+ * per-message D-Bus overhead is paid once per batch. The client must
+ * implement that method.
+ *
+ * @param max_events measurements per batch, 0 or 1 disables batching
+ * @param window_ms longest time a measurement waits in a batch
+ */
+void healthd_ipc_dbus_set_batching(unsigned int max_events,
+				   unsigned int window_ms)
+{
+	batch_flush();
+
+	batch.max_events = max_events > 1 ? max_events : 0;
+	batch.window_ms = window_ms;
+
+	DEBUG("D-Bus measurement batching: %u events, %u ms",
+	      batch.max_events, batch.window_ms);
+}
+
 /**
  * Function that calls D-Bus agent.MeasurementData method.
  *
@@ -576,6 +711,11 @@ static void call_agent_measurementdata(ContextId conn_handle, char *xml)
 		return; // FALSE;
 	}
 
+	if (batch.max_events) {
+		batch_add(device_path, xml);
+		return;
+	}
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "MeasurementData",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -615,6 +755,8 @@ static void call_agent_segmentinfo(ContextId conn_handle, unsigned int handle, c
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "SegmentInfo",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -658,6 +800,8 @@ static void call_agent_segmentdataresponse(ContextId conn_handle,
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "SegmentDataResponse",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -702,6 +846,8 @@ static void call_agent_segmentdata(ContextId conn_handle, unsigned int handle,
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "SegmentData",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -744,6 +890,8 @@ static void call_agent_pmstoredata(ContextId conn_handle, unsigned int handle, c
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "PMStoreData",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -787,6 +935,8 @@ static void call_agent_segmentcleared(ContextId conn_handle, unsigned int handle
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "SegmentCleared",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -829,6 +979,8 @@ static void call_agent_deviceattributes(ContextId conn_handle, char *xml)
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "DeviceAttributes",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -866,6 +1018,8 @@ static void call_agent_disassociated(ContextId conn_handle)
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "Disassociated",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -903,6 +1057,8 @@ static void call_agent_disconnected(ContextId ctx, const char *low_addr)
 		return; // FALSE;
 	}
 
+	batch_flush();
+
 	call = dbus_g_proxy_begin_call(agent_proxy, "Disconnected",
 				       call_agent_epilogue, NULL, NULL,
 				       G_TYPE_STRING, device_path,
@@ -968,6 +1124,21 @@ gboolean dbus_device_getconfig(Device *obj, char** xml_out, GError **err)
 	return TRUE;
 }
 
+/**
+ * DBUS facade to get runtime statistics of device connection
+ *
+ * \param obj
+ * \param xml_out pointer to string to be filled with result XML
+ * \param err
+ * \return TRUE if success
+ */
+gboolean dbus_device_getstats(Device *obj, char** xml_out, GError **err)
+{
+	DEBUG("dbus_device_getstats");
+	device_getstats(obj->handle, xml_out);
+	return TRUE;
+}
+
 /**
  * DBUS facade to request measuremens
  *
@@ -1161,6 +1332,11 @@ static Serv *srvObj = NULL;
 
 static void stop()
 {
+	batch_flush();
+
+	/* the main loop is gone: send the last batch before letting go */
+	dbus_connection_flush(dbus_g_connection_get_connection(bus));
+
 	g_object_unref(busProxy);
 	g_object_unref(srvObj);
 	dbus_g_connection_unref(bus);
@@ -4,5 +4,7 @@
 #include "healthd_ipc.h"
 
 void healthd_ipc_dbus_init(healthd_ipc *ipc);
+void healthd_ipc_dbus_set_batching(unsigned int max_events,
+				   unsigned int window_ms);
 
 #endif
@@ -37,11 +37,16 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <glib.h>
 #include <gio/gio.h>
 #include "src/communication/context_manager.h"
+#include "src/dim/mds.h"
+#include "src/api/text_encoder.h"
 #include "src/util/log.h"
 #include "src/util/linkedlist.h"
 #include "healthd_common.h"
@@ -50,15 +55,98 @@
 
 /* TCP clients */
 
+/**
+ * Formatted message, shared by the queues of all clients it is sent to
+ */
+typedef struct {
+	int ref;
+	size_t len;
+	char *data;
+} tcp_message;
+
+/**
+ * What to do with a client whose queue is full
+ */
+typedef enum {
+	TCP_LAGGARD_DISCONNECT = 0,
+	TCP_LAGGARD_DROP
+} tcp_laggard_policy;
+
+/* Messages and bytes a client may have queued before it is a laggard */
+#define TCP_QUEUE_MAX 256
+#define TCP_QUEUE_MAX_BYTES (4 * 1024 * 1024)
+
+/* Queued messages written by a single writev() */
+#define TCP_WRITEV_MAX 16
+
+/* Subscriptions a client may hold */
+#define TCP_SUBSCRIPTIONS_MAX 64
+
+/**
+ * Subscription of a client; unset fields match any message
+ */
+typedef struct {
+	/* message type, e.g. MEASUREMENT */
+	char *topic;
+	int has_context;
+	ContextId context;
+	/* system id in hex, as in the XML documents */
+	char *system_id;
+	/* only matches messages carrying an observation of this metric */
+	int has_metric;
+	int metric;
+} tcp_subscription;
+
+/**
+ * System id of a device, remembered until it disconnects
+ */
+typedef struct {
+	ContextId id;
+	char *system_id;
+} tcp_device;
+
 typedef struct {
 	int fd;
-	char *buf;
+	GIOChannel *channel;
+	guint read_watch;
+	guint write_watch;
+	/* ring of pending messages */
+	tcp_message *queue[TCP_QUEUE_MAX];
+	int queue_head;
+	int queue_count;
+	size_t queue_bytes;
+	/* bytes of the head message already written */
+	size_t head_offset;
+	/* messages dropped since the queue was last full */
+	unsigned int dropped;
+	/* set when the client must be closed by the caller */
+	int lagging;
+	/* no subscriptions means every message */
+	tcp_subscription *subscriptions;
+	int subscriptions_count;
+	char *inbuf;
 } tcp_client;
 
 static const unsigned int PORT = 9005;
+
+/* Longest command line accepted from clients */
+static const unsigned int MAX_COMMAND = 256;
+static tcp_laggard_policy laggard_policy = TCP_LAGGARD_DISCONNECT;
 static LinkedList *_tcp_clients = NULL;
+static LinkedList *_tcp_devices = NULL;
 static int server_fd = -1;
 
+/* Metric codes of the data list last offered through tcp_wants(),
+ * used by the announcement of that same message */
+static struct {
+	int valid;
+	char topic[32];
+	ContextId id;
+	int *metrics;
+	int count;
+	int capacity;
+} offered;
+
 static LinkedList *tcp_clients()
 {
 	if ( ! _tcp_clients) {
@@ -67,77 +155,405 @@ static LinkedList *tcp_clients()
 	return _tcp_clients;
 }
 
+static LinkedList *tcp_devices()
+{
+	if ( ! _tcp_devices) {
+		_tcp_devices = llist_new();
+	}
+	return _tcp_devices;
+}
+
+static int tcp_device_search(void *arg, void *element)
+{
+	ContextId *id = arg;
+	tcp_device *device = element;
+
+	return device->id.plugin == id->plugin &&
+		device->id.connid == id->connid;
+}
+
+/**
+ * Forgets the system id of a device
+ *
+ * @param id device context
+ */
+static void tcp_device_forget(ContextId id)
+{
+	tcp_device *device;
+
+	device = llist_search_first(tcp_devices(), &id, tcp_device_search);
+
+	if (device) {
+		llist_remove(tcp_devices(), device);
+		free(device->system_id);
+		free(device);
+	}
+}
+
+/**
+ * Gets the system id of a device, looking it up in the MDS the first
+ * time it is needed.
+ *
+ * @param id device context
+ * @return system id in hex, or NULL if not known yet
+ */
+static const char *tcp_system_id(ContextId id)
+{
+	tcp_device *device;
+	Context *ctx;
+	char *system_id = NULL;
+
+	device = llist_search_first(tcp_devices(), &id, tcp_device_search);
+
+	if (device) {
+		return device->system_id;
+	}
+
+	ctx = context_get_and_lock(id);
+
+	if (ctx && ctx->mds && ctx->mds->system_id.length > 0) {
+		system_id = octet_string2hex(&ctx->mds->system_id);
+	}
+
+	context_unlock(ctx);
+
+	if (!system_id) {
+		return NULL;
+	}
+
+	device = calloc(1, sizeof(tcp_device));
+	device->id = id;
+	device->system_id = system_id;
+	llist_add(tcp_devices(), device);
+
+	return system_id;
+}
+
+/**
+ * Wraps a formatted message so it can be queued to several clients
+ * without copying. Takes ownership of data.
+ *
+ * @param data message text, allocated with malloc()
+ * @return message with one reference
+ */
+static tcp_message *tcp_message_new(char *data)
+{
+	tcp_message *message = g_new0(tcp_message, 1);
+	message->ref = 1;
+	message->len = strlen(data);
+	message->data = data;
+	return message;
+}
+
+static tcp_message *tcp_message_ref(tcp_message *message)
+{
+	++message->ref;
+	return message;
+}
+
+static void tcp_message_unref(tcp_message *message)
+{
+	if (--message->ref > 0) {
+		return;
+	}
+
+	free(message->data);
+	g_free(message);
+}
+
+/**
+ * Removes the head message from the client queue
+ *
+ * @param client the client
+ */
+static void tcp_dequeue(tcp_client *client)
+{
+	tcp_message *message = client->queue[client->queue_head];
+
+	client->queue[client->queue_head] = NULL;
+	client->queue_head = (client->queue_head + 1) % TCP_QUEUE_MAX;
+	client->queue_count--;
+	client->queue_bytes -= message->len;
+	client->head_offset = 0;
+	tcp_message_unref(message);
+}
+
+/**
+ * Removes all subscriptions of a client, which then receives every
+ * message again
+ *
+ * @param client the client
+ */
+static void tcp_unsubscribe(tcp_client *client)
+{
+	int i;
+
+	for (i = 0; i < client->subscriptions_count; ++i) {
+		free(client->subscriptions[i].topic);
+		free(client->subscriptions[i].system_id);
+	}
+
+	free(client->subscriptions);
+	client->subscriptions = NULL;
+	client->subscriptions_count = 0;
+}
+
+/**
+ * Adds a subscription from a SUBSCRIBE command line. Fields are
+ * separated by tabs; a missing, empty or "*" field matches anything.
+ *
+ * SUBSCRIBE\ttopic\tdevice\tmetric
+ *
+ * where device is either plugin:connid or a system id in hex, and
+ * metric is a decimal MDC code.
+ *
+ * @param client the client
+ * @param args command line after SUBSCRIBE and its tab
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int tcp_subscribe(tcp_client *client, char *args)
+{
+	tcp_subscription sub;
+	tcp_subscription *subs;
+	char *fields[3] = {NULL, NULL, NULL};
+	char *end;
+	int i;
+
+	for (i = 0; i < 3 && args; ++i) {
+		fields[i] = args;
+		if ((args = strchr(args, '\t'))) {
+			*args++ = '\0';
+		}
+	}
+
+	for (i = 0; i < 3; ++i) {
+		if (fields[i] && (!*fields[i] || strcmp(fields[i], "*") == 0)) {
+			fields[i] = NULL;
+		}
+	}
+
+	memset(&sub, 0, sizeof(sub));
+
+	if (fields[1] && strchr(fields[1], ':')) {
+		if (sscanf(fields[1], "%u:%llu", &sub.context.plugin,
+					&sub.context.connid) != 2) {
+			return 0;
+		}
+		sub.has_context = 1;
+	}
+
+	if (fields[2]) {
+		sub.metric = strtol(fields[2], &end, 10);
+		if (*end) {
+			return 0;
+		}
+		sub.has_metric = 1;
+	}
+
+	if (client->subscriptions_count >= TCP_SUBSCRIPTIONS_MAX) {
+		return 0;
+	}
+
+	subs = realloc(client->subscriptions, sizeof(tcp_subscription) *
+				(client->subscriptions_count + 1));
+
+	if (!subs) {
+		return 0;
+	}
+
+	if (fields[0]) {
+		sub.topic = strdup(fields[0]);
+	}
+
+	if (fields[1] && !sub.has_context) {
+		sub.system_id = strdup(fields[1]);
+	}
+
+	client->subscriptions = subs;
+	client->subscriptions[client->subscriptions_count++] = sub;
+
+	return 1;
+}
+
+/**
+ * Checks a message against one subscription
+ *
+ * @param sub the subscription
+ * @param command message type
+ * @param id device context
+ * @param metrics metric codes carried by the message
+ * @param count number of metric codes
+ * @return 1 if message matches, 0 otherwise
+ */
+static int tcp_subscription_match(tcp_subscription *sub, const char *command,
+				ContextId id, int *metrics, int count)
+{
+	const char *system_id;
+	int i;
+
+	if (sub->topic && strcmp(sub->topic, command) != 0) {
+		return 0;
+	}
+
+	if (sub->has_context && (sub->context.plugin != id.plugin ||
+				sub->context.connid != id.connid)) {
+		return 0;
+	}
+
+	if (sub->system_id) {
+		system_id = tcp_system_id(id);
+		if (!system_id || strcasecmp(system_id, sub->system_id) != 0) {
+			return 0;
+		}
+	}
+
+	if (sub->has_metric) {
+		for (i = 0; i < count; ++i) {
+			if (metrics[i] == sub->metric) {
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Tells whether a client wants a message
+ *
+ * @return 1 if client wants it, 0 otherwise
+ */
+static int tcp_client_wants(tcp_client *client, const char *command,
+				ContextId id, int *metrics, int count)
+{
+	int i;
+
+	if (!client->subscriptions_count) {
+		return 1;
+	}
+
+	for (i = 0; i < client->subscriptions_count; ++i) {
+		if (tcp_subscription_match(&client->subscriptions[i], command,
+						id, metrics, count)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 static void tcp_close(tcp_client *client)
 {
 	DEBUG("TCP: freeing client %p", client);
 
+	if (client->write_watch) {
+		g_source_remove(client->write_watch);
+		client->write_watch = 0;
+	}
+
+	if (client->read_watch) {
+		g_source_remove(client->read_watch);
+		client->read_watch = 0;
+	}
+
+	while (client->queue_count > 0) {
+		tcp_dequeue(client);
+	}
+
+	tcp_unsubscribe(client);
+	g_io_channel_unref(client->channel);
+	client->channel = NULL;
 	shutdown(client->fd, SHUT_RDWR);
 	close(client->fd);
 	client->fd = -1;
-	free(client->buf);
-	client->buf = 0;
+	free(client->inbuf);
+	client->inbuf = 0;
 	llist_remove(tcp_clients(), client);
-	free(client);
+	g_free(client);
 }
 
 static gboolean tcp_write(GIOChannel *src, GIOCondition cond, gpointer data)
 {
 	tcp_client *client = (tcp_client*) data;
-	gsize len = strlen(client->buf);
-	gsize written;
-	char *newbuf;
-	gboolean more;
+	struct iovec iov[TCP_WRITEV_MAX];
+	ssize_t written;
+	int count;
+	int i;
 
 	if (cond != G_IO_OUT) {
 		DEBUG("TCP: write: false alarm");
 		return TRUE;
 	}
 
-	if (len <= 0) {
-		g_io_channel_unref(src);
-		return FALSE;
+	DEBUG("TCP: writing client %p", data);
+
+	for (count = 0; count < client->queue_count && count < TCP_WRITEV_MAX;
+								++count) {
+		tcp_message *message;
+		size_t offset = count ? 0 : client->head_offset;
+
+		message = client->queue[(client->queue_head + count) % TCP_QUEUE_MAX];
+		iov[count].iov_base = message->data + offset;
+		iov[count].iov_len = message->len - offset;
 	}
 
-	DEBUG("TCP: writing client %p", data);
+	if (count <= 0) {
+		client->write_watch = 0;
+		return FALSE;
+	}
 
-	int fd = g_io_channel_unix_get_fd(src);
-	written = send(fd, client->buf, len, 0);
+	written = writev(client->fd, iov, count);
 
 	DEBUG("TCP: client %p written %d bytes", data, (int) written);
 
+	if (written < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return TRUE;
+	}
+
 	if (written <= 0) {
-		free(client->buf);
-		client->buf = strdup("");
-		g_io_channel_unref(src);
+		/* Connection is gone; tcp_read() will see the hangup */
+		while (client->queue_count > 0) {
+			tcp_dequeue(client);
+		}
+		client->write_watch = 0;
 		return FALSE;
 	}
 
-	if (written >= len) {
-		newbuf = strdup("");
-		g_io_channel_unref(src);
-		more = FALSE;
-	} else {
-		newbuf = strdup(client->buf + written);
-		more = TRUE;
+	for (i = 0; i < count; ++i) {
+		if ((size_t) written < iov[i].iov_len) {
+			client->head_offset += written;
+			break;
+		}
+		written -= iov[i].iov_len;
+		tcp_dequeue(client);
 	}
-	free(client->buf);
-	client->buf = newbuf;
 
-	return more;
+	if (client->queue_count <= 0) {
+		client->write_watch = 0;
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
+static void tcp_command(tcp_client *client, char *line);
+
 static gboolean tcp_read(GIOChannel *src, GIOCondition cond, gpointer data)
 {
 	char buf[256];
 	gsize count;
+	char *newbuf;
+	char *line;
+	char *eol;
 
 	DEBUG("TCP: reading client %p", data);
 
 	tcp_client *client = (tcp_client*) data;
 
 	if (cond != G_IO_IN) {
+		client->read_watch = 0;
 		tcp_close(client);
-		g_io_channel_unref(src);
 		return FALSE;
 	}
 
@@ -145,29 +561,118 @@ static gboolean tcp_read(GIOChannel *src, GIOCondition cond, gpointer data)
 	count = recv(fd, buf, 256, 0);
 
 	if (count == 0) {
+		client->read_watch = 0;
+		tcp_close(client);
+		return FALSE;
+	}
+
+	if ((gssize) count < 0) {
+		return TRUE;
+	}
+
+	if (asprintf(&newbuf, "%s%.*s", client->inbuf, (int) count, buf) < 0) {
+		return TRUE;
+	}
+
+	free(client->inbuf);
+	client->inbuf = newbuf;
+
+	line = client->inbuf;
+
+	while ((eol = strchr(line, '\n'))) {
+		*eol = '\0';
+		if (eol > line && *(eol - 1) == '\r')
+			*(eol - 1) = '\0';
+		tcp_command(client, line);
+		line = eol + 1;
+	}
+
+	if (strlen(line) > MAX_COMMAND) {
+		DEBUG("TCP: client %p command too long, discarded", client);
+		line += strlen(line);
+	}
+
+	newbuf = strdup(line);
+	free(client->inbuf);
+	client->inbuf = newbuf;
+
+	if (client->lagging) {
+		client->read_watch = 0;
 		tcp_close(client);
-		g_io_channel_unref(src);
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
-static void tcp_send(tcp_client *client, const char *msg)
+/**
+ * Queues a message to a client. When the queue of the client is full,
+ * the laggard policy either drops the message for this client or marks
+ * the client to be closed by the caller (client->lagging).
+ *
+ * @param client the client
+ * @param message the message; the queue takes its own reference
+ * @return 1 if message was queued, 0 otherwise
+ */
+static int tcp_send(tcp_client *client, tcp_message *message)
 {
-	char *newbuf;
+	int tail;
+
+	if (client->lagging) {
+		return 0;
+	}
+
+	/* the byte cap bounds a backlog; a single large message, e.g. a
+	 * whole PM-segment, is always taken by an empty queue */
+	if (client->queue_count >= TCP_QUEUE_MAX ||
+	    (client->queue_count > 0 &&
+	     client->queue_bytes + message->len > TCP_QUEUE_MAX_BYTES)) {
+		if (laggard_policy == TCP_LAGGARD_DISCONNECT) {
+			WARNING("TCP: client %p is not reading, disconnecting",
+				client);
+			client->lagging = 1;
+		} else {
+			if (!client->dropped) {
+				WARNING("TCP: client %p is not reading, "
+					"dropping messages", client);
+			}
+			client->dropped++;
+		}
+		return 0;
+	}
+
+	if (client->dropped) {
+		DEBUG("TCP: client %p dropped %u messages", client,
+		      client->dropped);
+		client->dropped = 0;
+	}
 
 	DEBUG("TCP: scheduling write %p", client);
 
-	if (asprintf(&newbuf, "%s%s", client->buf, msg) < 0) {
-		return;
+	tail = (client->queue_head + client->queue_count) % TCP_QUEUE_MAX;
+	client->queue[tail] = tcp_message_ref(message);
+	client->queue_count++;
+	client->queue_bytes += message->len;
+
+	if (!client->write_watch) {
+		client->write_watch = g_io_add_watch(client->channel, G_IO_OUT,
+						     tcp_write, client);
 	}
 
-	free(client->buf);
-	client->buf = newbuf;
+	return 1;
+}
 
-	GIOChannel *channel = g_io_channel_unix_new(client->fd);
-	g_io_add_watch(channel, G_IO_OUT, tcp_write, client);
+/**
+ * Selects what happens to a client that does not read its messages
+ * fast enough: by default it is disconnected; otherwise the messages
+ * that do not fit in its queue are dropped, and it keeps the ones
+ * queued after it catches up.
+ *
+ * @param drop 1 to drop messages, 0 to disconnect the client
+ */
+void healthd_ipc_tcp_set_drop_laggards(int drop)
+{
+	laggard_policy = drop ? TCP_LAGGARD_DROP : TCP_LAGGARD_DISCONNECT;
 }
 
 static gboolean tcp_accept(GIOChannel *src, GIOCondition cond, gpointer data)
@@ -187,14 +692,19 @@ static gboolean tcp_accept(GIOChannel *src, GIOCondition cond, gpointer data)
 		return TRUE;
 	}
 
+	/* Writes must never block the main loop behind a slow client */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
 	new_client = g_new0(tcp_client, 1);
 	new_client->fd = fd;
-	new_client->buf = strdup("");
+	new_client->inbuf = strdup("");
 
 	DEBUG("TCP: adding client %p to list", new_client);
 
-	GIOChannel *channel = g_io_channel_unix_new(fd);
-	g_io_add_watch(channel, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL, tcp_read, new_client);
+	new_client->channel = g_io_channel_unix_new(fd);
+	new_client->read_watch = g_io_add_watch(new_client->channel,
+				G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL,
+				tcp_read, new_client);
 
 	llist_add(tcp_clients(), new_client);
 
@@ -222,7 +732,7 @@ static void tcp_listen()
 	DEBUG("TCP: listening");
 }
 
-static void tcp_announce(const char *command, ContextId ctx, const char *arg)
+static char *tcp_format(const char *command, const char *id, const char *arg)
 {
 	char *msg;
 	char *j;
@@ -232,22 +742,195 @@ static void tcp_announce(const char *command, ContextId ctx, const char *arg)
 		if ((*j == '\t') || (*j == '\n'))
 			*j = ' ';
 
-	if (asprintf(&msg, "%s\t%d:%llu\t%s\n", command, ctx.plugin, ctx.connid, arg2) < 0) {
-		free(arg2);
-		return;
+	if (asprintf(&msg, "%s\t%s\t%s\n", command, id, arg2) < 0) {
+		msg = NULL;
+	}
+
+	free(arg2);
+	return msg;
+}
+
+/**
+ * Adds the metric codes found in a data entry and its children to
+ * the offered message
+ *
+ * @param entry the data entry
+ */
+static void tcp_offer_metrics(DataEntry *entry)
+{
+	int i;
+
+	for (i = 0; i < entry->meta_data.size; ++i) {
+		MetaAtt *att = &entry->meta_data.values[i];
+
+		if (strcmp(att->name, "metric-id") != 0) {
+			continue;
+		}
+
+		if (offered.count >= offered.capacity) {
+			int capacity = offered.capacity ? offered.capacity * 2 : 16;
+			int *metrics = realloc(offered.metrics,
+						capacity * sizeof(int));
+			if (!metrics) {
+				return;
+			}
+			offered.metrics = metrics;
+			offered.capacity = capacity;
+		}
+
+		offered.metrics[offered.count++] = atoi(att->value);
+	}
+
+	if (entry->choice == COMPOUND_DATA_ENTRY) {
+		for (i = 0; i < entry->u.compound.entries_count; ++i) {
+			tcp_offer_metrics(&entry->u.compound.entries[i]);
+		}
+	}
+}
+
+/**
+ * Tells healthd whether any client wants a message, before its data
+ * list is encoded. Metric codes of the list are kept for the
+ * announcement that follows, so it is matched against metric
+ * subscriptions without decoding the XML.
+ *
+ * @param command message type
+ * @param ctx device context
+ * @param list data list of the message
+ * @return 1 if some client wants the message, 0 otherwise
+ */
+static int tcp_wants(const char *command, ContextId ctx, DataList *list)
+{
+	LinkedNode *i;
+	int j;
+
+	offered.valid = 1;
+	offered.id = ctx;
+	offered.count = 0;
+	snprintf(offered.topic, sizeof(offered.topic), "%s", command);
+
+	for (j = 0; list && j < list->size; ++j) {
+		tcp_offer_metrics(&list->values[j]);
+	}
+
+	for (i = tcp_clients()->first; i; i = i->next) {
+		if (tcp_client_wants(i->element, command, ctx,
+				offered.metrics, offered.count)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Sends a message to every client that subscribed to it. The message
+ * is formatted once and shared by the queues of all those clients.
+ *
+ * @param command message type
+ * @param ctx device context
+ * @param arg message argument
+ */
+static void tcp_announce(const char *command, ContextId ctx, const char *arg)
+{
+	tcp_message *message = NULL;
+	int *metrics = NULL;
+	int count = 0;
+	char *msg;
+	char id[48];
+
+	if (offered.valid && strcmp(offered.topic, command) == 0 &&
+			offered.id.plugin == ctx.plugin &&
+			offered.id.connid == ctx.connid) {
+		metrics = offered.metrics;
+		count = offered.count;
+		offered.valid = 0;
 	}
 
-	printf("%s\n", msg);
-	
 	LinkedNode *i = tcp_clients()->first;
 
 	while (i) {
-		tcp_send(i->element, msg);
+		tcp_client *client = i->element;
 		i = i->next;
+
+		if (!tcp_client_wants(client, command, ctx, metrics, count)) {
+			continue;
+		}
+
+		if (!message) {
+			snprintf(id, sizeof(id), "%d:%llu", ctx.plugin, ctx.connid);
+			msg = tcp_format(command, id, arg);
+
+			if (!msg) {
+				return;
+			}
+
+			printf("%s\n", msg);
+			message = tcp_message_new(msg);
+		}
+
+		if (!tcp_send(client, message) && client->lagging) {
+			tcp_close(client);
+		}
 	}
 
-	free(arg2);
-	free(msg);
+	if (message) {
+		tcp_message_unref(message);
+	}
+}
+
+/**
+ * Answers a command line sent by a client. Answers go to that client
+ * only, in the same format as announcements.
+ *
+ * Commands:
+ * STATS - global runtime statistics
+ * STATS\tplugin:connid - runtime statistics of a device connection
+ * SUBSCRIBE\ttopic\tdevice\tmetric - receive only matching messages,
+ *	see tcp_subscribe()
+ * UNSUBSCRIBE - drop all subscriptions, receive every message again
+ *
+ * @param client the client
+ * @param line command line, without line terminator
+ */
+static void tcp_command(tcp_client *client, char *line)
+{
+	ContextId ctx;
+	char *xml;
+	char *msg;
+
+	DEBUG("TCP: client %p command %s", client, line);
+
+	if (strcmp(line, "STATS") == 0) {
+		healthd_getstats(&xml);
+		msg = tcp_format("STATS", "global", xml);
+	} else if (strncmp(line, "STATS\t", 6) == 0) {
+		if (sscanf(line + 6, "%u:%llu", &ctx.plugin, &ctx.connid) != 2) {
+			DEBUG("TCP: invalid context %s", line + 6);
+			return;
+		}
+		device_getstats(ctx, &xml);
+		msg = tcp_format("STATS", line + 6, xml);
+	} else if (strncmp(line, "SUBSCRIBE\t", 10) == 0) {
+		if (!tcp_subscribe(client, line + 10)) {
+			DEBUG("TCP: client %p invalid subscription", client);
+		}
+		return;
+	} else if (strcmp(line, "UNSUBSCRIBE") == 0) {
+		tcp_unsubscribe(client);
+		return;
+	} else {
+		DEBUG("TCP: unknown command");
+		return;
+	}
+
+	if (msg) {
+		tcp_message *message = tcp_message_new(msg);
+		tcp_send(client, message);
+		tcp_message_unref(message);
+	}
+
+	free(xml);
 }
 
 static void self_configure()
@@ -266,6 +949,7 @@ static void self_configure()
 static void call_agent_connected(ContextId ctx, const char *low_addr)
 {
 	DEBUG("call_agent_connected");
+	tcp_device_forget(ctx);
 	tcp_announce("CONNECTED", ctx, low_addr);
 }
 
@@ -435,6 +1119,7 @@ static void call_agent_disconnected(ContextId ctx, const char *low_addr)
 {
 	DEBUG("call_agent_disconnected");
 	tcp_announce("DISCONNECT", ctx, "");
+	tcp_device_forget(ctx);
 }
 
 static void start()
@@ -460,6 +1145,7 @@ void healthd_ipc_tcp_init(healthd_ipc *ipc)
 	ipc->call_agent_segmentcleared = &call_agent_segmentcleared;
 	ipc->call_agent_pmstoredata = &call_agent_pmstoredata;
 	ipc->call_agent_deviceattributes = &call_agent_deviceattributes;
+	ipc->wants = &tcp_wants;
 	ipc->start = &start;
 	ipc->stop = &stop;
 }
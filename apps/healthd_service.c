@@ -39,6 +39,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <glib.h>
@@ -52,6 +54,7 @@
 #include "src/trans/trans.h"
 #include "src/util/log.h"
 #include "src/util/linkedlist.h"
+#include "src/util/shmring.h"
 #include "src/communication/service.h"
 #include "src/dim/pmstore_req.h"
 #include "healthd_service.h"
@@ -131,6 +134,274 @@ void healthd_idle_add(void *f, void *param)
 	g_idle_add(&healthd_idle_cb, data);
 }
 
+/**
+ * Does PM-Store bulk work while the main loop is otherwise idle
+ */
+static gboolean healthd_bulk_cb(gpointer data)
+{
+	return manager_run_bulk_work() ? TRUE : FALSE;
+}
+
+/**
+ * Called by the manager when bulk work is pending. Low priority idle
+ * handlers run only when no I/O of any agent is waiting.
+ */
+static void healthd_bulk_wakeup()
+{
+	g_idle_add_full(G_PRIORITY_LOW, healthd_bulk_cb, NULL, NULL);
+}
+
+/**
+ * Job of the worker pool
+ */
+typedef struct healthd_job {
+	void (*work)(void*);
+	void (*done)(void*);
+	void *param;
+	int finished;
+	struct healthd_job *next;
+} healthd_job;
+
+/* Worker pool; jobs are kept in submission order until done */
+static struct {
+	pthread_t *threads;
+	int count;
+	int quit;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	healthd_job *first;
+	healthd_job *last;
+	healthd_job *next_work;
+	int pipe[2];
+	GIOChannel *channel;
+	guint watch;
+} workers = {NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+		NULL, NULL, NULL, {-1, -1}, NULL, 0};
+
+/**
+ * Skips jobs that have nothing left to run. Must hold workers.mutex.
+ */
+static void healthd_workers_skip()
+{
+	while (workers.next_work && (workers.next_work->finished ||
+					!workers.next_work->work)) {
+		workers.next_work->finished = 1;
+		workers.next_work = workers.next_work->next;
+	}
+}
+
+/**
+ * Worker thread
+ *
+ * @param arg unused
+ * @return always NULL
+ */
+static void *healthd_worker(void *arg)
+{
+	healthd_job *job;
+	char c = 0;
+
+	pthread_mutex_lock(&workers.mutex);
+
+	while (!workers.quit) {
+		healthd_workers_skip();
+
+		if (!workers.next_work) {
+			pthread_cond_wait(&workers.cond, &workers.mutex);
+			continue;
+		}
+
+		job = workers.next_work;
+		workers.next_work = job->next;
+		pthread_mutex_unlock(&workers.mutex);
+
+		job->work(job->param);
+
+		pthread_mutex_lock(&workers.mutex);
+		job->finished = 1;
+
+		if (job == workers.first) {
+			if (write(workers.pipe[1], &c, 1) < 0) {
+				DEBUG("workers: wake-up failed");
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&workers.mutex);
+
+	return NULL;
+}
+
+/**
+ * Calls done() of finished jobs, in submission order, on the main loop
+ */
+static void healthd_workers_done()
+{
+	healthd_job *job;
+
+	for (;;) {
+		pthread_mutex_lock(&workers.mutex);
+		healthd_workers_skip();
+		job = workers.first;
+
+		if (!job || !job->finished) {
+			pthread_mutex_unlock(&workers.mutex);
+			break;
+		}
+
+		workers.first = job->next;
+
+		if (!workers.first) {
+			workers.last = NULL;
+		}
+
+		pthread_mutex_unlock(&workers.mutex);
+
+		job->done(job->param);
+		free(job);
+	}
+}
+
+static gboolean healthd_workers_wakeup(GIOChannel *src, GIOCondition cond,
+					gpointer data)
+{
+	char buf[64];
+
+	while (read(workers.pipe[0], buf, sizeof(buf)) > 0)
+		;
+
+	healthd_workers_done();
+
+	return TRUE;
+}
+
+/**
+ * Schedules a job. work() runs in a worker thread, or right away when
+ * there are no workers; then done() is called in the main loop. done()
+ * calls of all jobs happen in the order the jobs were added, so events
+ * reach IPC clients in order even when their work finishes out of
+ * order. Jobs without work just wait for the jobs before them.
+ *
+ * @param work function that may run in any thread, or NULL
+ * @param done function called in the main loop
+ * @param param argument of both functions
+ */
+void healthd_work_add(void *work, void *done, void *param)
+{
+	healthd_job *job;
+
+	pthread_mutex_lock(&workers.mutex);
+
+	if (!workers.first && (!work || !workers.count)) {
+		/* nothing to wait for */
+		pthread_mutex_unlock(&workers.mutex);
+
+		if (work) {
+			((void (*)(void*)) work)(param);
+		}
+
+		((void (*)(void*)) done)(param);
+		return;
+	}
+
+	job = calloc(1, sizeof(healthd_job));
+	job->work = work;
+	job->done = done;
+	job->param = param;
+	job->finished = !work;
+
+	if (workers.last) {
+		workers.last->next = job;
+	} else {
+		workers.first = job;
+	}
+
+	workers.last = job;
+
+	if (!workers.next_work) {
+		workers.next_work = job;
+	}
+
+	pthread_cond_signal(&workers.cond);
+	pthread_mutex_unlock(&workers.mutex);
+}
+
+/**
+ * Starts the worker pool that takes XML encoding off the main loop
+ *
+ * @param count number of worker threads; 0 runs jobs in the main loop
+ */
+static void healthd_workers_start(int count)
+{
+	int i;
+
+	if (count <= 0) {
+		return;
+	}
+
+	if (pipe(workers.pipe) < 0) {
+		ERROR("workers: cannot create pipe");
+		return;
+	}
+
+	fcntl(workers.pipe[0], F_SETFL, O_NONBLOCK);
+
+	workers.channel = g_io_channel_unix_new(workers.pipe[0]);
+	workers.watch = g_io_add_watch(workers.channel, G_IO_IN,
+					healthd_workers_wakeup, NULL);
+
+	workers.threads = calloc(count, sizeof(pthread_t));
+
+	for (i = 0; i < count; ++i) {
+		if (pthread_create(&workers.threads[workers.count], NULL,
+					healthd_worker, NULL) == 0) {
+			++workers.count;
+		}
+	}
+
+	DEBUG("workers: %d threads", workers.count);
+}
+
+/**
+ * Stops the worker pool, finishing pending jobs in the calling thread
+ */
+static void healthd_workers_stop()
+{
+	healthd_job *job;
+	int i;
+
+	pthread_mutex_lock(&workers.mutex);
+	workers.quit = 1;
+	pthread_cond_broadcast(&workers.cond);
+	pthread_mutex_unlock(&workers.mutex);
+
+	for (i = 0; i < workers.count; ++i) {
+		pthread_join(workers.threads[i], NULL);
+	}
+
+	free(workers.threads);
+	workers.threads = NULL;
+	workers.count = 0;
+
+	for (job = workers.first; job; job = job->next) {
+		if (!job->finished) {
+			job->work(job->param);
+			job->finished = 1;
+		}
+	}
+
+	workers.next_work = NULL;
+	healthd_workers_done();
+
+	if (workers.channel) {
+		g_source_remove(workers.watch);
+		g_io_channel_unref(workers.channel);
+		workers.channel = NULL;
+		close(workers.pipe[0]);
+		close(workers.pipe[1]);
+	}
+}
+
 /**
  * Configures HDP data types
  */
@@ -148,6 +419,8 @@ static void app_clean_up()
 {
 	g_main_loop_unref(mainloop);
 
+	healthd_workers_stop();
+	healthd_journal_close();
 	ipc.stop();
 }
 
@@ -193,6 +466,22 @@ int main(int argc, char *argv[])
 	int usb_support = 0;
 	int tcpp_support = 0;
 
+	unsigned int batch_events = 0;
+	unsigned int batch_ms = 100;
+
+	int worker_count = 2;
+
+	const char *journal_dir = NULL;
+	unsigned int journal_sync_ms = 1000;
+	unsigned long long journal_max_bytes = 0;
+
+	const char *shm_name = NULL;
+	unsigned int shm_records = 4096;
+
+	unsigned int bulk_slice_us = 2000;
+
+	int tcp_drop_laggards = 0;
+
 	int i;
 
 	int opmode = DBUS_SERVER;
@@ -215,13 +504,45 @@ int main(int argc, char *argv[])
 			usb_support = 1;
 		} else if (strcmp(argv[i], "--tcpp") == 0) {
 			tcpp_support = 1;
+		} else if (strncmp(argv[i], "--dbus-batch=", 13) == 0) {
+			batch_events = atoi(argv[i] + 13);
+		} else if (strncmp(argv[i], "--dbus-batch-ms=", 16) == 0) {
+			batch_ms = atoi(argv[i] + 16);
+		} else if (strncmp(argv[i], "--workers=", 10) == 0) {
+			worker_count = atoi(argv[i] + 10);
+		} else if (strncmp(argv[i], "--journal=", 10) == 0) {
+			journal_dir = argv[i] + 10;
+		} else if (strncmp(argv[i], "--journal-sync-ms=", 18) == 0) {
+			journal_sync_ms = atoi(argv[i] + 18);
+		} else if (strncmp(argv[i], "--journal-max-bytes=", 20) == 0) {
+			journal_max_bytes = strtoull(argv[i] + 20, NULL, 10);
+		} else if (strncmp(argv[i], "--shm=", 6) == 0) {
+			shm_name = argv[i] + 6;
+		} else if (strncmp(argv[i], "--shm-records=", 14) == 0) {
+			char *end;
+			unsigned long records = strtoul(argv[i] + 14, &end, 10);
+
+			if (*end || records == 0 ||
+			    records > SHMRING_MAX_CAPACITY) {
+				ERROR("--shm-records must be from 1 to %u",
+				      SHMRING_MAX_CAPACITY);
+				return 1;
+			}
+
+			shm_records = records;
+		} else if (strcmp(argv[i], "--tcp-drop-laggards") == 0) {
+			tcp_drop_laggards = 1;
+		} else if (strncmp(argv[i], "--bulk-slice-us=", 16) == 0) {
+			bulk_slice_us = atoi(argv[i] + 16);
 		}
 	}
 
 	if (opmode == DBUS_SERVER) {
 		healthd_ipc_dbus_init(&ipc);
+		healthd_ipc_dbus_set_batching(batch_events, batch_ms);
 	} else if (opmode == TCP_SERVER) {
 		healthd_ipc_tcp_init(&ipc);
+		healthd_ipc_tcp_set_drop_laggards(tcp_drop_laggards);
 	} else if (opmode == AUTOTESTING) {
 		healthd_ipc_auto_init(&ipc);
 	}
@@ -268,6 +589,22 @@ int main(int argc, char *argv[])
 	listener.device_disconnected = &device_disconnected;
 
 	manager_add_listener(listener);
+
+	// 0 decodes PM-Store data as it arrives
+	if (bulk_slice_us) {
+		manager_set_bulk_scheduler(healthd_bulk_wakeup, bulk_slice_us);
+	}
+
+	if (journal_dir && !healthd_journal_open(journal_dir, journal_sync_ms,
+						 journal_max_bytes)) {
+		ERROR("Cannot open journal at %s", journal_dir);
+	}
+
+	if (shm_name && !manager_publish_shm(shm_name, shm_records)) {
+		ERROR("Cannot publish to shared memory %s", shm_name);
+	}
+
+	healthd_workers_start(worker_count);
 	manager_start();
 
 	if (trans_support) {
@@ -281,6 +618,7 @@ int main(int argc, char *argv[])
 	g_main_loop_run(mainloop);
 	DEBUG("Main loop stopped");
 	manager_finalize();
+	manager_unpublish_shm();
 	app_clean_up();
 	DEBUG("Stopped.");
 
@@ -5,4 +5,5 @@
 
 void hdp_types_configure(uint16_t hdp_data_types[]);
 void healthd_idle_add(void*, void*);
+void healthd_work_add(void*, void*, void*);
 #endif
@@ -107,6 +107,11 @@ class Agent(dbus.service.Object):
 			print "=== Data: ", xmldata
 		dump(dev, "measurement", xmldata)
 
+	@dbus.service.method("com.signove.health.agent", in_signature="asas", out_signature="")
+	def MeasurementDataBatch(self, devs, xmldatas):
+		for dev, xmldata in zip(devs, xmldatas):
+			self.MeasurementData(dev, xmldata)
+
 	@dbus.service.method("com.signove.health.agent", in_signature="sis", out_signature="")
 	def PMStoreData(self, dev, pmstore_handle, xmldata):
 		print
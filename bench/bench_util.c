@@ -0,0 +1,374 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file bench_util.c
+ * \brief Benchmark support functions.
+ *
+ * Clocks, allocation counting, memory usage and latency histograms
+ * shared by the benchmark programs.
+ *
+ * Allocations are counted by wrapping the libc allocator at link time,
+ * so benchmark programs must be linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 16, 2011
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include "src/util/ioutil.h"
+#include "bench_util.h"
+
+/**
+ * Number of allocator calls since program start
+ */
+static unsigned long long alloc_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+/**
+ * Counting replacement of malloc()
+ */
+void *__wrap_malloc(size_t size)
+{
+	__sync_fetch_and_add(&alloc_count, 1);
+	return __real_malloc(size);
+}
+
+/**
+ * Counting replacement of calloc()
+ */
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	__sync_fetch_and_add(&alloc_count, 1);
+	return __real_calloc(nmemb, size);
+}
+
+/**
+ * Counting replacement of realloc()
+ */
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	__sync_fetch_and_add(&alloc_count, 1);
+	return __real_realloc(ptr, size);
+}
+
+/**
+ * Returns the number of allocator calls made so far.
+ *
+ * Allocations done inside libc itself (e.g. strdup) are not seen.
+ *
+ * @return allocation count
+ */
+unsigned long long bench_allocations()
+{
+	return __sync_fetch_and_add(&alloc_count, 0);
+}
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return current time in nanoseconds
+ */
+unsigned long long bench_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Sleeps until the monotonic clock reaches the given time.
+ *
+ * @param deadline absolute time in nanoseconds, see bench_now_ns()
+ */
+void bench_sleep_until_ns(unsigned long long deadline)
+{
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+		continue;
+	}
+}
+
+/**
+ * Returns the current resident set size.
+ *
+ * @return RSS in kilobytes, or -1 if unknown
+ */
+long bench_rss_kb()
+{
+	long pages = 0;
+	long resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (!f) {
+		return -1;
+	}
+
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+		resident = -1;
+	}
+
+	fclose(f);
+
+	if (resident < 0) {
+		return -1;
+	}
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Returns the peak resident set size of the process.
+ *
+ * @return maximum RSS in kilobytes
+ */
+long bench_max_rss_kb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+/**
+ * Clears all samples of the histogram.
+ *
+ * @param hist the histogram
+ */
+void bench_histogram_reset(BenchHistogram *hist)
+{
+	memset(hist, 0, sizeof(BenchHistogram));
+}
+
+/**
+ * Maps a sample to its bucket index.
+ */
+static int histogram_index(unsigned long long value)
+{
+	int exp;
+
+	if (value < 16) {
+		return (int) value;
+	}
+
+	exp = 63 - __builtin_clzll(value);
+	return (exp - 3) * 16 + (int)((value >> (exp - 4)) & 15);
+}
+
+/**
+ * Maps a bucket index back to the middle of its value range.
+ */
+static unsigned long long histogram_value(int index)
+{
+	int exp;
+	unsigned long long sub;
+
+	if (index < 16) {
+		return index;
+	}
+
+	exp = index / 16 + 3;
+	sub = index % 16;
+	return ((16 + sub) << (exp - 4)) + ((1ULL << (exp - 4)) >> 1);
+}
+
+/**
+ * Adds a sample to the histogram.
+ *
+ * @param hist the histogram
+ * @param value sample, usually in nanoseconds
+ */
+void bench_histogram_record(BenchHistogram *hist, unsigned long long value)
+{
+	hist->buckets[histogram_index(value)]++;
+	hist->count++;
+
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+/**
+ * Estimates a percentile of the recorded samples.
+ *
+ * @param hist the histogram
+ * @param percentile from 0.0 to 100.0
+ * @return estimated sample value, 0 if histogram is empty
+ */
+unsigned long long bench_histogram_percentile(BenchHistogram *hist,
+						double percentile)
+{
+	unsigned long long rank;
+	unsigned long long seen = 0;
+	unsigned long long value;
+	int i;
+
+	if (hist->count == 0) {
+		return 0;
+	}
+
+	rank = (unsigned long long) (hist->count * percentile / 100.0);
+
+	if (rank >= hist->count) {
+		rank = hist->count - 1;
+	}
+
+	for (i = 0; i < BENCH_HISTOGRAM_BUCKETS; i++) {
+		seen += hist->buckets[i];
+
+		if (seen > rank) {
+			value = histogram_value(i);
+			return value > hist->max ? hist->max : value;
+		}
+	}
+
+	return hist->max;
+}
+
+/**
+ * Counts the observed values of a DataList, i.e. the entries
+ * carrying a "metric-id" meta attribute.
+ */
+static int count_entry_observations(DataEntry *entry)
+{
+	int count = 0;
+	int i;
+
+	for (i = 0; i < entry->meta_data.size; i++) {
+		if (strcmp(entry->meta_data.values[i].name, "metric-id") == 0) {
+			count++;
+			break;
+		}
+	}
+
+	if (entry->choice == COMPOUND_DATA_ENTRY) {
+		for (i = 0; i < entry->u.compound.entries_count; i++) {
+			count += count_entry_observations(
+					 &entry->u.compound.entries[i]);
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Counts the decoded observations carried by a DataList.
+ *
+ * @param list data list delivered to a manager listener
+ * @return number of observed values
+ */
+int bench_count_observations(DataList *list)
+{
+	int count = 0;
+	int i;
+
+	if (!list) {
+		return 0;
+	}
+
+	for (i = 0; i < list->size; i++) {
+		count += count_entry_observations(&list->values[i]);
+	}
+
+	return count;
+}
+
+/**
+ * Converts a count over an interval to a per-second rate.
+ *
+ * @param count number of events
+ * @param elapsed_ns interval in nanoseconds
+ * @return events per second
+ */
+double bench_rate(unsigned long long count, unsigned long long elapsed_ns)
+{
+	if (elapsed_ns == 0) {
+		return 0.0;
+	}
+
+	return (double) count * 1000000000.0 / (double) elapsed_ns;
+}
+
+/**
+ * Points HEALTHD_TMP to a new private directory, so that benchmarks
+ * do not touch the extended configurations stored by the user.
+ *
+ * @return the directory, or NULL if it could not be created
+ */
+char *bench_private_tmp_dir()
+{
+	static char dir[] = "/tmp/antidote-bench-XXXXXX";
+
+	if (!mkdtemp(dir)) {
+		return NULL;
+	}
+
+	setenv("HEALTHD_TMP", dir, 1);
+	return dir;
+}
+
+/**
+ * Removes the directory created by bench_private_tmp_dir()
+ * and everything the library stored in it.
+ *
+ * @param dir the private directory, may be NULL
+ */
+void bench_remove_private_tmp_dir(char *dir)
+{
+	char path[512];
+	struct dirent *entry;
+	char *tmp;
+	DIR *d;
+
+	if (!dir) {
+		return;
+	}
+
+	tmp = ioutil_get_tmp();
+	d = opendir(tmp);
+
+	while (d && (entry = readdir(d))) {
+		if (entry->d_name[0] != '.') {
+			snprintf(path, sizeof(path), "%s%s", tmp, entry->d_name);
+			remove(path);
+		}
+	}
+
+	if (d) {
+		closedir(d);
+	}
+
+	rmdir(tmp);
+	free(tmp);
+	rmdir(dir);
+}
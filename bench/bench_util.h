@@ -0,0 +1,76 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file bench_util.h
+ * \brief Benchmark support functions header.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 16, 2011
+ */
+
+#ifndef BENCH_UTIL_H_
+#define BENCH_UTIL_H_
+
+#include <stdio.h>
+#include "src/api/api_definitions.h"
+
+/**
+ * Number of buckets of a latency histogram: 16 linear buckets
+ * followed by 16 sub-buckets for each power of two up to 2^63.
+ */
+#define BENCH_HISTOGRAM_BUCKETS (61 * 16)
+
+/**
+ * Log-linear histogram of nanosecond samples (about 6% precision)
+ */
+typedef struct BenchHistogram {
+	unsigned long long count;
+	unsigned long long max;
+	unsigned long long buckets[BENCH_HISTOGRAM_BUCKETS];
+} BenchHistogram;
+
+unsigned long long bench_now_ns();
+
+void bench_sleep_until_ns(unsigned long long deadline);
+
+unsigned long long bench_allocations();
+
+long bench_rss_kb();
+
+long bench_max_rss_kb();
+
+void bench_histogram_reset(BenchHistogram *hist);
+
+void bench_histogram_record(BenchHistogram *hist, unsigned long long value);
+
+unsigned long long bench_histogram_percentile(BenchHistogram *hist,
+						double percentile);
+
+int bench_count_observations(DataList *list);
+
+double bench_rate(unsigned long long count, unsigned long long elapsed_ns);
+
+char *bench_private_tmp_dir();
+
+void bench_remove_private_tmp_dir(char *dir);
+
+#endif /* BENCH_UTIL_H_ */
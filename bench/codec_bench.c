@@ -0,0 +1,607 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file codec_bench.c
+ * \brief Decoder and encoder microbenchmark.
+ *
+ * Loads a corpus of captured APDUs and runs decode_apdu()/del_apdu(),
+ * encode_apdu() and the conversion of event reports into DataLists in
+ * tight loops, reporting ns/APDU and bytes/s for each message type.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 17, 2011
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/manager.h"
+#include "src/asn1/phd_types.h"
+#include "src/dim/nomenclature.h"
+#include "src/communication/parser/decoder_ASN1.h"
+#include "src/communication/parser/encoder_ASN1.h"
+#include "src/communication/parser/struct_cleaner.h"
+#include "src/communication/plugin/plugin_loopback.h"
+#include "src/communication/context_manager.h"
+#include "src/communication/operating.h"
+#include "src/util/bytelib.h"
+#include "src/util/ioutil.h"
+#include "bench_util.h"
+
+/**
+ * Association (and configuration, for extended configurations) that
+ * brings a manager context to the operating state, so that event
+ * reports can be converted into DataLists.
+ */
+typedef struct CodecSetup {
+	char *association_apdu;
+	char *config_apdu;
+	unsigned long long connid;
+} CodecSetup;
+
+enum {
+	SETUP_NONE = -1,
+	SETUP_PULSE_OXIMETER_0190,
+	SETUP_BLOOD_PRESSURE,
+	SETUP_WEIGHING_SCALE_05DC,
+	SETUP_EXTENDED
+};
+
+static CodecSetup setups[] = {
+	{"H211_ID_0190", NULL, 0},
+	{"blood_pressure/aarq", "blood_pressure/roiv_mdc_noti_config", 0},
+	{"weighing_scale/association_request", "weighing_scale/roiv_mdc_noti_config", 0},
+	{"pulse_oximeter/pulse_oximeter_association_request",
+	 "pulse_oximeter/pulse_oximeter_noti_config_with_scanner", 0},
+};
+
+/**
+ * Corpus entry. A NULL file selects the synthetic segment data APDU,
+ * since there is no captured one.
+ */
+typedef struct CodecEntry {
+	char *name;
+	char *file;
+	int setup;
+} CodecEntry;
+
+static CodecEntry corpus[] = {
+	{"association_request", "pulse_oximeter/pulse_oximeter_association_request", SETUP_NONE},
+	{"association_response", "rx_aare_example_one", SETUP_NONE},
+	{"config_std_0190", "H221_ID_0190", SETUP_NONE},
+	{"config_scanner", "pulse_oximeter/pulse_oximeter_noti_config_with_scanner", SETUP_NONE},
+	{"config_pedometer", "pedometer/pedometer_noti_config", SETUP_NONE},
+	{"config_response", "H222", SETUP_NONE},
+	{"scan_report_fixed", "H241_ID_0190", SETUP_PULSE_OXIMETER_0190},
+	{"scan_report_mp_fixed", "blood_pressure/roiv_mds_note_scan_report_mp_fixed", SETUP_BLOOD_PRESSURE},
+	{"scan_report_mp_fixed_05dc", "weighing_scale/data_report", SETUP_WEIGHING_SCALE_05DC},
+	{"unbuf_scan_report_fixed", "pulse_oximeter/pulse_oximeter_unbuf_scan_report_fixed", SETUP_EXTENDED},
+	{"unbuf_scan_report_var", "pulse_oximeter/pulse_oximeter_unbuf_scan_report_var", SETUP_EXTENDED},
+	{"unbuf_scan_report_grouped", "pulse_oximeter/pulse_oximeter_unbuf_scan_report_grouped", SETUP_EXTENDED},
+	{"unbuf_scan_report_mp_fixed", "pulse_oximeter/pulse_oximeter_unbuf_scan_report_mp_fixed", SETUP_EXTENDED},
+	{"unbuf_scan_report_mp_var", "pulse_oximeter/pulse_oximeter_unbuf_scan_report_mp_var", SETUP_EXTENDED},
+	{"buf_scan_report_fixed", "pulse_oximeter/pulse_oximeter_buf_scan_report_fixed", SETUP_EXTENDED},
+	{"buf_scan_report_var", "pulse_oximeter/pulse_oximeter_buf_scan_report_var", SETUP_EXTENDED},
+	{"buf_scan_report_grouped", "pulse_oximeter/pulse_oximeter_buf_scan_report_grouped", SETUP_EXTENDED},
+	{"segment_data", NULL, SETUP_NONE},
+	{"release_request", "rx_rlrq_normal", SETUP_NONE},
+	{NULL, NULL, SETUP_NONE}
+};
+
+/**
+ * Number of PM-segment entries of the synthetic segment data APDU
+ */
+#define SEGMENT_ENTRIES 64
+
+/**
+ * Size in octets of each synthetic PM-segment entry
+ */
+#define SEGMENT_ENTRY_SIZE 8
+
+/**
+ * Loop iterations of each stage
+ */
+static int iterations = 20000;
+
+/**
+ * Directory holding the captured APDUs
+ */
+static char *resource_dir = "tests/resources/apdu";
+
+/**
+ * DataLists delivered to the listener
+ */
+static unsigned long long deliveries = 0;
+
+/**
+ * Results of one stage
+ */
+typedef struct StageResult {
+	int valid;
+	unsigned long long elapsed_ns;
+	unsigned long long allocations;
+	int extra;
+} StageResult;
+
+static CommunicationPlugin manager_plugin;
+
+/**
+ * Manager listener: counts DataLists produced by the conversion.
+ */
+static void measurement_data_updated(Context *ctx, DataList *list)
+{
+	deliveries++;
+}
+
+/**
+ * Runs the loopback until no APDU is pending.
+ */
+static void drain()
+{
+	while (plugin_network_loopback_pump() > 0) {
+		continue;
+	}
+}
+
+/**
+ * Reads a captured APDU from the resource directory.
+ */
+static intu8 *load_apdu(const char *name, unsigned long *size)
+{
+	char path[512];
+	intu8 *buffer;
+
+	snprintf(path, sizeof(path), "%s/%s", resource_dir, name);
+	buffer = ioutil_buffer_from_file(path, size);
+
+	if (!buffer || *size == 0) {
+		fprintf(stderr, "codec_bench: unable to read %s\n", path);
+		free(buffer);
+		return NULL;
+	}
+
+	return buffer;
+}
+
+/**
+ * Builds a confirmed segment data event report APDU.
+ */
+static intu8 *build_segment_data_apdu(unsigned long *size)
+{
+	int entries = SEGMENT_ENTRIES * SEGMENT_ENTRY_SIZE;
+	ByteStreamWriter *stream = byte_stream_writer_instance(32 + entries + 4);
+	intu8 *buffer;
+	int i;
+
+	write_intu16(stream, PRST_CHOSEN);
+	write_intu16(stream, 32 + entries);
+	write_intu16(stream, 30 + entries);
+	// DATA-apdu
+	write_intu16(stream, 0x0001);
+	write_intu16(stream, ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN);
+	write_intu16(stream, 24 + entries);
+	// EventReportArgumentSimple
+	write_intu16(stream, 16);
+	write_intu32(stream, 0xFFFFFFFF);
+	write_intu16(stream, MDC_NOTI_SEGMENT_DATA);
+	write_intu16(stream, 14 + entries);
+	// SegmentDataEvent
+	write_intu16(stream, 0);
+	write_intu32(stream, 0);
+	write_intu32(stream, SEGMENT_ENTRIES);
+	write_intu16(stream, SEVTSTA_FIRST_ENTRY | SEVTSTA_LAST_ENTRY);
+	write_intu16(stream, entries);
+
+	for (i = 0; i < entries; i++) {
+		write_intu8(stream, (intu8) i);
+	}
+
+	buffer = stream->buffer;
+	*size = stream->size;
+	del_byte_stream_writer(stream, 0);
+
+	return buffer;
+}
+
+/**
+ * Decodes a buffer into an APDU.
+ *
+ * @return 1 on success
+ */
+static int decode_buffer(intu8 *buffer, unsigned long size, APDU *apdu)
+{
+	ByteStreamReader *stream = byte_stream_reader_instance(buffer, size);
+	int error = 0;
+
+	decode_apdu(stream, apdu, &error);
+	free(stream);
+
+	if (error) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Times decode_apdu() followed by del_apdu().
+ */
+static void run_decode(intu8 *buffer, unsigned long size, StageResult *result)
+{
+	unsigned long long start;
+	APDU apdu;
+	int i;
+
+	result->valid = decode_buffer(buffer, size, &apdu);
+
+	if (!result->valid) {
+		return;
+	}
+
+	del_apdu(&apdu);
+
+	result->allocations = bench_allocations();
+	start = bench_now_ns();
+
+	for (i = 0; i < iterations; i++) {
+		decode_buffer(buffer, size, &apdu);
+		del_apdu(&apdu);
+	}
+
+	result->elapsed_ns = bench_now_ns() - start;
+	result->allocations = bench_allocations() - result->allocations;
+}
+
+/**
+ * Times encode_apdu() of a decoded APDU, the way it is done by
+ * communication_send_apdu(). The extra field tells whether the
+ * encoded octets match the captured ones.
+ */
+static void run_encode(intu8 *buffer, unsigned long size, StageResult *result)
+{
+	ByteStreamWriter *stream;
+	unsigned long long start;
+	APDU apdu;
+	int i;
+
+	result->valid = decode_buffer(buffer, size, &apdu);
+
+	if (!result->valid) {
+		return;
+	}
+
+	stream = byte_stream_writer_instance(apdu.length + 4);
+	encode_apdu(stream, &apdu);
+	result->extra = stream->size == size &&
+			memcmp(stream->buffer, buffer, size) == 0;
+	del_byte_stream_writer(stream, 1);
+
+	result->allocations = bench_allocations();
+	start = bench_now_ns();
+
+	for (i = 0; i < iterations; i++) {
+		stream = byte_stream_writer_instance(apdu.length + 4);
+		encode_apdu(stream, &apdu);
+		del_byte_stream_writer(stream, 1);
+	}
+
+	result->elapsed_ns = bench_now_ns() - start;
+	result->allocations = bench_allocations() - result->allocations;
+
+	del_apdu(&apdu);
+}
+
+/**
+ * Brings a manager context to the operating state.
+ *
+ * @return 1 on success
+ */
+static int establish(CodecSetup *setup, unsigned long long connid)
+{
+	unsigned long size = 0;
+	intu8 *buffer;
+	ContextId id = {1, connid};
+	Context *ctx;
+	int ok;
+
+	plugin_network_loopback_connect(connid);
+
+	buffer = load_apdu(setup->association_apdu, &size);
+
+	if (!buffer) {
+		return 0;
+	}
+
+	plugin_network_loopback_inject(connid, buffer, size);
+	free(buffer);
+
+	if (setup->config_apdu) {
+		buffer = load_apdu(setup->config_apdu, &size);
+
+		if (!buffer) {
+			return 0;
+		}
+
+		plugin_network_loopback_inject(connid, buffer, size);
+		free(buffer);
+	}
+
+	drain();
+
+	ctx = context_get_and_lock(id);
+
+	if (!ctx) {
+		return 0;
+	}
+
+	ok = ctx->mds != NULL && ctx->fsm->state == fsm_state_operating;
+	context_unlock(ctx);
+
+	if (!ok) {
+		fprintf(stderr, "codec_bench: %s did not reach operating state\n",
+			setup->association_apdu);
+	}
+
+	return ok;
+}
+
+/**
+ * Times the conversion of a decoded event report into DataLists,
+ * through the same path used by the operating state. The extra field
+ * holds the number of DataLists produced per APDU.
+ */
+static void run_datalist(intu8 *buffer, unsigned long size, int setup_index,
+			 StageResult *result)
+{
+	CodecSetup *setup = &setups[setup_index];
+	EventReportArgumentSimple *evt;
+	unsigned long long start;
+	DATA_apdu *data_apdu;
+	ContextId id = {1, 0};
+	Context *ctx;
+	APDU apdu;
+	int i;
+
+	if (setup->connid == 0) {
+		setup->connid = setup_index + 1;
+
+		if (!establish(setup, setup->connid)) {
+			setup->connid = (unsigned long long) -1;
+		}
+	}
+
+	if (setup->connid == (unsigned long long) -1) {
+		return;
+	}
+
+	if (!decode_buffer(buffer, size, &apdu)) {
+		return;
+	}
+
+	data_apdu = encode_get_data_apdu(&apdu.u.prst);
+
+	if (data_apdu->message.choice == ROIV_CMIP_EVENT_REPORT_CHOSEN) {
+		evt = &data_apdu->message.u.roiv_cmipEventReport;
+	} else {
+		evt = &data_apdu->message.u.roiv_cmipConfirmedEventReport;
+	}
+
+	id.connid = setup->connid;
+	ctx = context_get_and_lock(id);
+
+	if (ctx) {
+		deliveries = 0;
+		operating_decode_event(ctx, evt->obj_handle, evt->event_type,
+				       &evt->event_info);
+		result->extra = (int) deliveries;
+		result->valid = deliveries > 0;
+
+		result->allocations = bench_allocations();
+		start = bench_now_ns();
+
+		for (i = 0; result->valid && i < iterations; i++) {
+			operating_decode_event(ctx, evt->obj_handle,
+					       evt->event_type, &evt->event_info);
+		}
+
+		result->elapsed_ns = bench_now_ns() - start;
+		result->allocations = bench_allocations() - result->allocations;
+		context_unlock(ctx);
+	}
+
+	del_apdu(&apdu);
+}
+
+/**
+ * Writes the results of a stage as a JSON object.
+ */
+static void print_stage(FILE *out, const char *stage, StageResult *result,
+			unsigned long size, const char *extra_name, int last)
+{
+	double ns = 0;
+
+	if (!result->valid) {
+		fprintf(out, "\"%s\": null%s", stage, last ? "" : ", ");
+		return;
+	}
+
+	ns = (double) result->elapsed_ns / iterations;
+
+	fprintf(out, "\"%s\": {\"ns_per_apdu\": %.1f, \"bytes_per_s\": %.0f, "
+		"\"allocations_per_apdu\": %.2f",
+		stage, ns,
+		bench_rate((unsigned long long) size * iterations, result->elapsed_ns),
+		(double) result->allocations / iterations);
+
+	if (extra_name) {
+		fprintf(out, ", \"%s\": %d", extra_name, result->extra);
+	}
+
+	fprintf(out, "}%s", last ? "" : ", ");
+}
+
+/**
+ * Prints command-line usage.
+ */
+static void print_help(char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [OPTION]...\n"
+		"Time APDU decoding, encoding and DataList conversion.\n\n"
+		"  --iterations=N    loop iterations per stage (default %d)\n"
+		"  --apdu=NAME       run only the given corpus entry\n"
+		"  --resources=DIR   captured APDU directory (default %s)\n"
+		"  --output=FILE     write JSON results to FILE (default stdout)\n"
+		"  --list            list corpus entries\n",
+		program, iterations, resource_dir);
+}
+
+int main(int argc, char **argv)
+{
+	CommunicationPlugin *plugins[] = {&manager_plugin, 0};
+	ManagerListener listener = MANAGER_LISTENER_EMPTY;
+	char *only = NULL;
+	char *output = NULL;
+	FILE *out = stdout;
+	char *tmp_dir;
+	int first = 1;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--iterations=", 13) == 0) {
+			iterations = atoi(argv[i] + 13);
+		} else if (strncmp(argv[i], "--apdu=", 7) == 0) {
+			only = argv[i] + 7;
+		} else if (strncmp(argv[i], "--resources=", 12) == 0) {
+			resource_dir = argv[i] + 12;
+		} else if (strncmp(argv[i], "--output=", 9) == 0) {
+			output = argv[i] + 9;
+		} else if (strcmp(argv[i], "--list") == 0) {
+			CodecEntry *e;
+
+			for (e = corpus; e->name; e++) {
+				printf("%s\n", e->name);
+			}
+
+			return 0;
+		} else {
+			print_help(argv[0]);
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	if (iterations <= 0) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	if (output) {
+		out = fopen(output, "w");
+
+		if (!out) {
+			fprintf(stderr, "codec_bench: unable to open %s\n", output);
+			return 1;
+		}
+	}
+
+	tmp_dir = bench_private_tmp_dir();
+
+	// A manager-only loopback keeps the contexts used by the
+	// DataList conversion; nothing is sent back to agents.
+	manager_plugin = communication_plugin();
+	plugin_network_loopback_setup(&manager_plugin, NULL);
+	manager_init(plugins);
+	listener.measurement_data_updated = measurement_data_updated;
+	manager_add_listener(listener);
+	manager_start();
+
+	fprintf(out, "{\"benchmark\": \"codec\", \"iterations\": %d, \"results\": [",
+		iterations);
+
+	for (i = 0; corpus[i].name; i++) {
+		CodecEntry *entry = &corpus[i];
+		StageResult decode, encode, datalist;
+		unsigned long size = 0;
+		intu8 *buffer;
+
+		if (only && strcmp(only, entry->name) != 0) {
+			continue;
+		}
+
+		if (entry->file) {
+			buffer = load_apdu(entry->file, &size);
+		} else {
+			buffer = build_segment_data_apdu(&size);
+		}
+
+		if (!buffer) {
+			continue;
+		}
+
+		memset(&decode, 0, sizeof(StageResult));
+		memset(&encode, 0, sizeof(StageResult));
+		memset(&datalist, 0, sizeof(StageResult));
+
+		run_decode(buffer, size, &decode);
+		run_encode(buffer, size, &encode);
+
+		if (entry->setup != SETUP_NONE) {
+			run_datalist(buffer, size, entry->setup, &datalist);
+		}
+
+		fprintf(out, "%s\n    {\"apdu\": \"%s\", \"bytes\": %lu, ",
+			first ? "" : ",", entry->name, size);
+		print_stage(out, "decode", &decode, size, NULL, 0);
+		print_stage(out, "encode", &encode, size, "roundtrip", 0);
+		print_stage(out, "datalist", &datalist, size, "lists_per_apdu", 1);
+		fprintf(out, "}");
+		fflush(out);
+
+		first = 0;
+		free(buffer);
+	}
+
+	fprintf(out, "\n]}\n");
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	for (i = 0; i < (int) (sizeof(setups) / sizeof(setups[0])); i++) {
+		if (setups[i].connid != 0 &&
+		    setups[i].connid != (unsigned long long) -1) {
+			plugin_network_loopback_disconnect(setups[i].connid);
+		}
+	}
+
+	drain();
+	manager_finalize();
+	bench_remove_private_tmp_dir(tmp_dir);
+
+	if (first) {
+		fprintf(stderr, "codec_bench: unknown APDU %s\n", only);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,580 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file manager_bench.c
+ * \brief End-to-end manager throughput benchmark.
+ *
+ * Runs N agents sending M reports each through the manager, over the
+ * in-process loopback plugin, for every standard specialization and for
+ * captured extended configurations. Results are written as JSON so that
+ * they can be compared between releases.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 16, 2011
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/manager.h"
+#include "src/agent.h"
+#include "src/communication/plugin/plugin_loopback.h"
+#include "src/communication/extconfigurations.h"
+#include "src/util/ioutil.h"
+#include "apps/sample_agent_common.h"
+#include "bench_util.h"
+
+/**
+ * Benchmark scenario. Standard scenarios drive a real agent with the
+ * given configuration; captured scenarios inject recorded APDUs into a
+ * manager-only loopback.
+ */
+typedef struct BenchScenario {
+	char *name;
+	int config;
+	void *(*event_report_cb)();
+	char *config_apdu;
+	char *report_apdu;
+} BenchScenario;
+
+static BenchScenario scenarios[] = {
+	{"pulse_oximeter_0190", 0x0190, oximeter_event_report_cb, NULL, NULL},
+	{"blood_pressure_02bc", 0x02BC, blood_pressure_event_report_cb, NULL, NULL},
+	{"weighing_scale_05dc", 0x05DC, weightscale_event_report_cb, NULL, NULL},
+	{"glucometer_06a4", 0x06A4, glucometer_event_report_cb, NULL, NULL},
+	{"extended_unbuf_fixed", 0, NULL,
+	 "pulse_oximeter/pulse_oximeter_noti_config_with_scanner",
+	 "pulse_oximeter/pulse_oximeter_unbuf_scan_report_fixed"},
+	{"extended_unbuf_var", 0, NULL,
+	 "pulse_oximeter/pulse_oximeter_noti_config_with_scanner",
+	 "pulse_oximeter/pulse_oximeter_unbuf_scan_report_var"},
+	{"extended_unbuf_grouped", 0, NULL,
+	 "pulse_oximeter/pulse_oximeter_noti_config_with_scanner",
+	 "pulse_oximeter/pulse_oximeter_unbuf_scan_report_grouped"},
+	{"extended_buf_fixed", 0, NULL,
+	 "pulse_oximeter/pulse_oximeter_noti_config_with_scanner",
+	 "pulse_oximeter/pulse_oximeter_buf_scan_report_fixed"},
+	{NULL, 0, NULL, NULL, NULL}
+};
+
+/**
+ * Association request of the captured extended configuration
+ */
+#define BENCH_ASSOCIATION_APDU "pulse_oximeter/pulse_oximeter_association_request"
+
+/**
+ * Release request sent by the captured agents
+ */
+#define BENCH_RELEASE_APDU "rx_rlrq_normal"
+
+/**
+ * Number of simulated agents
+ */
+static int agent_count = 10;
+
+/**
+ * Reports sent by each agent
+ */
+static int report_count = 1000;
+
+/**
+ * Reports per second per agent, 0 means as fast as possible
+ */
+static double report_rate = 0;
+
+/**
+ * Directory holding the captured APDUs
+ */
+static char *resource_dir = "tests/resources/apdu";
+
+/**
+ * Results of one scenario
+ */
+typedef struct BenchResult {
+	unsigned long long elapsed_ns;
+	unsigned long long apdus;
+	unsigned long long observations;
+	unsigned long long deliveries;
+	unsigned long long allocations;
+	BenchHistogram latency;
+	long rss_kb;
+	long max_rss_kb;
+} BenchResult;
+
+static BenchResult result;
+
+/**
+ * Whether the measured phase is running
+ */
+static int measuring = 0;
+
+/**
+ * Number of agents that reached the operating state
+ */
+static int available = 0;
+
+/**
+ * Time the last APDU of each connection was handed to the manager
+ */
+static unsigned long long *receive_time = NULL;
+
+static CommunicationPlugin manager_plugin;
+static CommunicationPlugin agent_plugin;
+
+/**
+ * Loopback stream function wrapped to timestamp received APDUs
+ */
+static network_get_apdu_stream_ptr loopback_get_apdu_stream = NULL;
+
+/**
+ * Timestamps an APDU on the way into the manager.
+ */
+static ByteStreamReader *timed_get_apdu_stream(Context *ctx)
+{
+	ByteStreamReader *stream = loopback_get_apdu_stream(ctx);
+
+	if (stream && measuring) {
+		receive_time[ctx->id.connid - 1] = bench_now_ns();
+		result.apdus++;
+	}
+
+	return stream;
+}
+
+/**
+ * Manager listener: records receive-to-listener latency.
+ */
+static void measurement_data_updated(Context *ctx, DataList *list)
+{
+	if (!measuring) {
+		return;
+	}
+
+	bench_histogram_record(&result.latency,
+			       bench_now_ns() - receive_time[ctx->id.connid - 1]);
+	result.observations += bench_count_observations(list);
+	result.deliveries++;
+}
+
+/**
+ * Manager listener: counts agents in operating state.
+ */
+static void device_available(Context *ctx, DataList *list)
+{
+	available++;
+}
+
+/**
+ * Agent listener: associates as soon as the transport is up.
+ */
+static void agent_connected(Context *ctx, const char *addr)
+{
+	agent_associate(ctx->id);
+}
+
+/**
+ * Runs the loopback until no APDU is pending.
+ */
+static void drain()
+{
+	while (plugin_network_loopback_pump() > 0) {
+		continue;
+	}
+}
+
+/**
+ * Reads a captured APDU from the resource directory.
+ */
+static intu8 *load_apdu(const char *name, unsigned long *size)
+{
+	char path[512];
+	intu8 *buffer;
+
+	snprintf(path, sizeof(path), "%s/%s", resource_dir, name);
+	buffer = ioutil_buffer_from_file(path, size);
+
+	if (!buffer || *size == 0) {
+		fprintf(stderr, "manager_bench: unable to read %s\n", path);
+		free(buffer);
+		return NULL;
+	}
+
+	return buffer;
+}
+
+/**
+ * Prepares loopback plugins and clears per-scenario state.
+ */
+static void setup_plugins(int with_agent)
+{
+	memset(&result, 0, sizeof(result));
+	measuring = 0;
+	available = 0;
+
+	manager_plugin = communication_plugin();
+	agent_plugin = communication_plugin();
+	plugin_network_loopback_setup(&manager_plugin,
+				      with_agent ? &agent_plugin : NULL);
+
+	loopback_get_apdu_stream = manager_plugin.network_get_apdu_stream;
+	manager_plugin.network_get_apdu_stream = timed_get_apdu_stream;
+}
+
+/**
+ * Starts the measured phase.
+ */
+static void measure_begin(unsigned long long *start)
+{
+	result.allocations = bench_allocations();
+	measuring = 1;
+	*start = bench_now_ns();
+}
+
+/**
+ * Waits for the next report tick when running paced.
+ */
+static void measure_pace(unsigned long long start, int tick)
+{
+	if (report_rate > 0) {
+		bench_sleep_until_ns(start + (unsigned long long)
+				     (tick * 1000000000.0 / report_rate));
+	}
+}
+
+/**
+ * Ends the measured phase.
+ */
+static void measure_end(unsigned long long start)
+{
+	result.elapsed_ns = bench_now_ns() - start;
+	measuring = 0;
+	result.allocations = bench_allocations() - result.allocations;
+	result.rss_kb = bench_rss_kb();
+	result.max_rss_kb = bench_max_rss_kb();
+}
+
+/**
+ * Runs a scenario with real agents of a standard specialization.
+ */
+static int run_standard(BenchScenario *scenario)
+{
+	CommunicationPlugin *manager_plugins[] = {&manager_plugin, 0};
+	CommunicationPlugin *agent_plugins[] = {&agent_plugin, 0};
+	ManagerListener manager_listener = MANAGER_LISTENER_EMPTY;
+	AgentListener agent_listener = AGENT_LISTENER_EMPTY;
+	ContextId id = {0, 0};
+	unsigned long long start;
+	int i, r;
+
+	setup_plugins(1);
+
+	manager_init(manager_plugins);
+	agent_init(agent_plugins, scenario->config,
+		   scenario->event_report_cb, mds_data_cb);
+
+	manager_listener.measurement_data_updated = measurement_data_updated;
+	manager_listener.device_available = device_available;
+	manager_add_listener(manager_listener);
+
+	agent_listener.device_connected = agent_connected;
+	agent_add_listener(agent_listener);
+
+	manager_start();
+
+	for (i = 0; i < agent_count; i++) {
+		plugin_network_loopback_connect(i + 1);
+	}
+
+	drain();
+
+	if (available != agent_count) {
+		fprintf(stderr, "manager_bench: %s: %d of %d agents associated\n",
+			scenario->name, available, agent_count);
+	}
+
+	// agents live in the second registered plugin
+	id.plugin = 2;
+	measure_begin(&start);
+
+	for (r = 0; r < report_count; r++) {
+		measure_pace(start, r);
+
+		for (i = 0; i < agent_count; i++) {
+			id.connid = i + 1;
+			agent_send_data(id);
+		}
+
+		drain();
+	}
+
+	measure_end(start);
+
+	for (i = 0; i < agent_count; i++) {
+		id.connid = i + 1;
+		agent_request_association_release(id);
+	}
+
+	drain();
+
+	for (i = 0; i < agent_count; i++) {
+		plugin_network_loopback_disconnect(i + 1);
+	}
+
+	drain();
+
+	agent_finalize();
+	manager_finalize();
+
+	return available == agent_count;
+}
+
+/**
+ * Runs a scenario replaying captured APDUs of an extended configuration.
+ */
+static int run_captured(BenchScenario *scenario)
+{
+	CommunicationPlugin *manager_plugins[] = {&manager_plugin, 0};
+	ManagerListener manager_listener = MANAGER_LISTENER_EMPTY;
+	unsigned long association_size = 0;
+	unsigned long config_size = 0;
+	unsigned long report_size = 0;
+	unsigned long release_size = 0;
+	intu8 *association = load_apdu(BENCH_ASSOCIATION_APDU, &association_size);
+	intu8 *config = load_apdu(scenario->config_apdu, &config_size);
+	intu8 *report = load_apdu(scenario->report_apdu, &report_size);
+	intu8 *release = load_apdu(BENCH_RELEASE_APDU, &release_size);
+	unsigned long long start;
+	int i, r;
+
+	if (!association || !config || !report || !release) {
+		free(association);
+		free(config);
+		free(report);
+		free(release);
+		return 0;
+	}
+
+	setup_plugins(0);
+
+	manager_init(manager_plugins);
+
+	// force the configuration exchange for every run
+	ext_configurations_remove_all_configs();
+
+	manager_listener.measurement_data_updated = measurement_data_updated;
+	manager_listener.device_available = device_available;
+	manager_add_listener(manager_listener);
+
+	manager_start();
+
+	for (i = 0; i < agent_count; i++) {
+		plugin_network_loopback_connect(i + 1);
+		plugin_network_loopback_inject(i + 1, association, association_size);
+		plugin_network_loopback_inject(i + 1, config, config_size);
+	}
+
+	drain();
+
+	if (available != agent_count) {
+		fprintf(stderr, "manager_bench: %s: %d of %d agents associated\n",
+			scenario->name, available, agent_count);
+	}
+
+	measure_begin(&start);
+
+	for (r = 0; r < report_count; r++) {
+		measure_pace(start, r);
+
+		for (i = 0; i < agent_count; i++) {
+			plugin_network_loopback_inject(i + 1, report, report_size);
+		}
+
+		drain();
+	}
+
+	measure_end(start);
+
+	for (i = 0; i < agent_count; i++) {
+		plugin_network_loopback_inject(i + 1, release, release_size);
+	}
+
+	drain();
+
+	for (i = 0; i < agent_count; i++) {
+		plugin_network_loopback_disconnect(i + 1);
+	}
+
+	drain();
+
+	manager_finalize();
+
+	free(association);
+	free(config);
+	free(report);
+	free(release);
+
+	return available == agent_count;
+}
+
+/**
+ * Writes the results of one scenario as a JSON object.
+ */
+static void print_result(FILE *out, BenchScenario *scenario, int ok, int first)
+{
+	double seconds = result.elapsed_ns / 1000000000.0;
+
+	fprintf(out, "%s\n    {\"scenario\": \"%s\", \"ok\": %s, ",
+		first ? "" : ",", scenario->name, ok ? "true" : "false");
+	fprintf(out, "\"elapsed_s\": %.6f, \"apdus\": %llu, \"apdus_per_s\": %.1f, ",
+		seconds, result.apdus, bench_rate(result.apdus, result.elapsed_ns));
+	fprintf(out, "\"observations\": %llu, \"observations_per_s\": %.1f, ",
+		result.observations,
+		bench_rate(result.observations, result.elapsed_ns));
+	fprintf(out, "\"deliveries\": %llu, ", result.deliveries);
+	fprintf(out, "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, "
+		"\"p999\": %llu, \"max\": %llu}, ",
+		bench_histogram_percentile(&result.latency, 50.0),
+		bench_histogram_percentile(&result.latency, 99.0),
+		bench_histogram_percentile(&result.latency, 99.9),
+		result.latency.max);
+	fprintf(out, "\"rss_kb\": %ld, \"max_rss_kb\": %ld, ",
+		result.rss_kb, result.max_rss_kb);
+	fprintf(out, "\"allocations_per_apdu\": %.2f}",
+		result.apdus ? (double) result.allocations / result.apdus : 0.0);
+}
+
+/**
+ * Prints command-line usage.
+ */
+static void print_help(char *program)
+{
+	fprintf(stderr,
+		"Usage: %s [OPTION]...\n"
+		"Run N agents x M reports through the manager and report throughput.\n\n"
+		"  --agents=N        simulated agents (default %d)\n"
+		"  --reports=M       reports per agent (default %d)\n"
+		"  --rate=R          reports per second per agent, 0 = unpaced (default 0)\n"
+		"  --scenario=NAME   run only the given scenario\n"
+		"  --resources=DIR   captured APDU directory (default %s)\n"
+		"  --output=FILE     write JSON results to FILE (default stdout)\n"
+		"  --list            list scenarios\n\n"
+		"Library log messages go to stderr; redirect it to measure\n"
+		"without terminal output.\n",
+		program, agent_count, report_count, resource_dir);
+}
+
+int main(int argc, char **argv)
+{
+	char *only = NULL;
+	char *output = NULL;
+	char *tmp_dir;
+	FILE *out = stdout;
+	int first = 1;
+	int failed = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--agents=", 9) == 0) {
+			agent_count = atoi(argv[i] + 9);
+		} else if (strncmp(argv[i], "--reports=", 10) == 0) {
+			report_count = atoi(argv[i] + 10);
+		} else if (strncmp(argv[i], "--rate=", 7) == 0) {
+			report_rate = atof(argv[i] + 7);
+		} else if (strncmp(argv[i], "--scenario=", 11) == 0) {
+			only = argv[i] + 11;
+		} else if (strncmp(argv[i], "--resources=", 12) == 0) {
+			resource_dir = argv[i] + 12;
+		} else if (strncmp(argv[i], "--output=", 9) == 0) {
+			output = argv[i] + 9;
+		} else if (strcmp(argv[i], "--list") == 0) {
+			BenchScenario *s;
+
+			for (s = scenarios; s->name; s++) {
+				printf("%s\n", s->name);
+			}
+
+			return 0;
+		} else {
+			print_help(argv[0]);
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	if (agent_count <= 0 || report_count <= 0 || report_rate < 0) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	if (output) {
+		out = fopen(output, "w");
+
+		if (!out) {
+			fprintf(stderr, "manager_bench: unable to open %s\n", output);
+			return 1;
+		}
+	}
+
+	receive_time = calloc(agent_count, sizeof(unsigned long long));
+	tmp_dir = bench_private_tmp_dir();
+
+	fprintf(out, "{\"benchmark\": \"manager\", \"agents\": %d, "
+		"\"reports\": %d, \"rate\": %.1f, \"results\": [",
+		agent_count, report_count, report_rate);
+
+	for (i = 0; scenarios[i].name; i++) {
+		BenchScenario *scenario = &scenarios[i];
+		int ok;
+
+		if (only && strcmp(only, scenario->name) != 0) {
+			continue;
+		}
+
+		if (scenario->config) {
+			ok = run_standard(scenario);
+		} else {
+			ok = run_captured(scenario);
+		}
+
+		failed |= !ok;
+		print_result(out, scenario, ok, first);
+		fflush(out);
+		first = 0;
+	}
+
+	fprintf(out, "\n]}\n");
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	bench_remove_private_tmp_dir(tmp_dir);
+	free(receive_time);
+
+	if (first) {
+		fprintf(stderr, "manager_bench: unknown scenario %s\n", only);
+		return 1;
+	}
+
+	return failed;
+}
@@ -0,0 +1,232 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file capture_replay.c
+ * \brief Replays APDU captures against a TCP/IP manager.
+ *
+ * Sessions come from capture files (one per captured context) or
+ * from APDU files, e.g. tests/resources/apdu, which are concatenated
+ * into one session. Sessions are spread over the requested number of
+ * connections and replayed by the replay engine, see replay_engine.c.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 23, 2011
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "replay_engine.h"
+#include "src/communication/capture.h"
+
+/**
+ * Prints usage information
+ */
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [options] <capture or APDU file>...\n"
+		"\t-x factor\tspeed factor, 1 is the original pace (default)\n"
+		"\t-f\t\tsend as fast as possible, same as -x 0\n"
+		"\t-n count\tconcurrent connections (default: one per session)\n"
+		"\t-l count\treplay each session this many times (default 1)\n"
+		"\t-i ms\t\ttime between APDUs of APDU files (default 100)\n"
+		"\t-a\t\tcaptures were taken by agents (replay sent APDUs)\n"
+		"\t-c plugin\treplay only captured contexts of this plugin id\n"
+		"\t-h host\t\tmanager address (default 127.0.0.1)\n"
+		"\t-p port\t\tport of the first connection (default 6024)\n"
+		"\t-s\t\tall connections to the same port; by default\n"
+		"\t\t\tconnection i goes to port + i\n", name);
+}
+
+/**
+ * Tells whether a file is a capture file.
+ */
+static int is_capture(const char *path)
+{
+	char magic[CAPTURE_MAGIC_SIZE];
+	FILE *f = fopen(path, "rb");
+	int ret = 0;
+
+	if (f != NULL) {
+		ret = fread(magic, 1, CAPTURE_MAGIC_SIZE, f) == CAPTURE_MAGIC_SIZE
+		      && memcmp(magic, CAPTURE_FILE_MAGIC, CAPTURE_MAGIC_SIZE) == 0;
+		fclose(f);
+	}
+
+	return ret;
+}
+
+/**
+ * Main function
+ */
+int main(int argc, char **argv)
+{
+	ReplayOptions options;
+	ReplayResult result;
+	ReplaySession **sessions = NULL;
+	ReplaySession **loaded;
+	ReplaySession *corpus = NULL;
+	int count = 0;
+	int loaded_count;
+	int direction = CAPTURE_IN;
+	unsigned int plugin = 0;
+	unsigned long long interval = 100000000ULL;
+	double elapsed;
+	int opt;
+	int i;
+
+	memset(&options, 0, sizeof(options));
+	options.manager.sin_family = AF_INET;
+	options.manager.sin_addr.s_addr = inet_addr("127.0.0.1");
+	options.first_port = 6024;
+	options.loops = 1;
+	options.scale = 1;
+
+	while ((opt = getopt(argc, argv, "x:fn:l:i:ac:h:p:s")) != -1) {
+		switch (opt) {
+		case 'x':
+			options.scale = atof(optarg);
+			break;
+		case 'f':
+			options.scale = 0;
+			break;
+		case 'n':
+			options.connections = atoi(optarg);
+			break;
+		case 'l':
+			options.loops = atoi(optarg);
+			break;
+		case 'i':
+			interval = atoll(optarg) * 1000000ULL;
+			break;
+		case 'a':
+			direction = CAPTURE_OUT;
+			break;
+		case 'c':
+			plugin = atoi(optarg);
+			break;
+		case 'h':
+			options.manager.sin_addr.s_addr = inet_addr(optarg);
+			break;
+		case 'p':
+			options.first_port = atoi(optarg);
+			break;
+		case 's':
+			options.same_port = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc || options.loops < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = optind; i < argc; ++i) {
+		if (is_capture(argv[i])) {
+			if (!replay_load_capture(argv[i], direction, plugin,
+						 &loaded, &loaded_count)) {
+				fprintf(stderr, "cannot read capture %s\n", argv[i]);
+				return 1;
+			}
+		} else {
+			if (corpus == NULL) {
+				corpus = replay_session_new(argv[i]);
+				loaded = &corpus;
+				loaded_count = 1;
+			} else {
+				loaded_count = 0;
+			}
+
+			if (replay_session_load_apdus(corpus, argv[i], interval) < 0) {
+				return 1;
+			}
+
+			if (loaded_count == 0) {
+				continue;
+			}
+		}
+
+		sessions = realloc(sessions,
+				   (count + loaded_count) * sizeof(ReplaySession *));
+
+		if (sessions == NULL) {
+			return 1;
+		}
+
+		memcpy(sessions + count, loaded,
+		       loaded_count * sizeof(ReplaySession *));
+		count += loaded_count;
+
+		if (loaded != &corpus) {
+			free(loaded);
+		}
+	}
+
+	if (count == 0) {
+		fprintf(stderr, "nothing to replay\n");
+		return 1;
+	}
+
+	if (options.connections <= 0) {
+		options.connections = count;
+	}
+
+	replay_run(sessions, count, &options, &result);
+
+	elapsed = result.elapsed / 1e9;
+
+	printf("%d connections, %llu APDUs (%llu bytes) sent, "
+	       "%llu APDUs (%llu bytes) received in %.3f s\n",
+	       options.connections, result.apdus_sent, result.bytes_sent,
+	       result.apdus_received, result.bytes_received, elapsed);
+
+	if (elapsed > 0) {
+		printf("%.0f APDUs/s sent\n", result.apdus_sent / elapsed);
+	}
+
+	if (result.confirmed > 0) {
+		printf("%llu confirmed reports, round trip mean %.3f ms, "
+		       "max %.3f ms\n", result.confirmed,
+		       result.latency_sum / 1e6 / result.confirmed,
+		       result.latency_max / 1e6);
+	}
+
+	if (result.aborts > 0 || result.failed > 0) {
+		printf("%llu aborts received, %d connections failed\n",
+		       result.aborts, result.failed);
+	}
+
+	for (i = 0; i < count; ++i) {
+		replay_session_del(sessions[i]);
+	}
+
+	free(sessions);
+
+	return result.failed > 0 || result.aborts > 0;
+}
@@ -1,8 +1,11 @@
 #!/usr/bin/env python
 
-# This script takes a dump generated by uncommenting APDU_DUMP in
-# src/communication/communication.c, and replays it against a TCP/IP manager,
-# playing the Agent role.
+# This script takes a dump in the old APDU_DUMP format, or a hex dump,
+# and replays it against a TCP/IP manager, playing the Agent role.
+#
+# The stack no longer writes APDU_DUMP files; captures taken with
+# ANTIDOTE_CAPTURE=file (see src/communication/capture.h) are replayed
+# by the capture_replay tool.
 #
 # It accepts two dump formats, they can even be intermixed in the same
 # file.
@@ -0,0 +1,880 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file replay_engine.c
+ * \brief APDU replay engine.
+ *
+ * Plays the agent role of recorded sessions against a TCP/IP manager,
+ * over many concurrent connections served by a single poll() loop.
+ *
+ * Recorded APDUs cannot be sent verbatim once sessions are repeated,
+ * sped up or multiplied, so each APDU is patched when it is sent:
+ * requests (ROIV) get fresh invoke-ids from a per-connection counter,
+ * responses (RORS/ROER/RORJ) take the invoke-id of the manager request
+ * they answer, and event reports get an event-time counted from the
+ * start of the connection. A response is held back until the manager
+ * request it answers arrives (or RESPONSE_WAIT elapses).
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 24, 2011
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "replay_engine.h"
+#include "src/communication/capture.h"
+#include "src/communication/stats.h"
+
+/**
+ * Longest time a response waits for the manager request it answers,
+ * in nanoseconds
+ */
+#define RESPONSE_WAIT 2000000000ULL
+
+/**
+ * Time given to the manager to answer the last APDUs, in nanoseconds
+ */
+#define DRAIN_WAIT 500000000ULL
+
+/**
+ * Manager requests that may be waiting for an answer
+ */
+#define MAX_PENDING 8
+
+/**
+ * Confirmed event reports whose answer may be outstanding
+ */
+#define MAX_INFLIGHT 16
+
+/**
+ * Offset of the invoke-id in a PRST APDU
+ */
+#define PRST_INVOKE_ID 6
+
+/**
+ * Offset of the DATA-apdu choice in a PRST APDU
+ */
+#define PRST_CHOICE 8
+
+/**
+ * Offset of the event-time of an event report in a PRST APDU
+ */
+#define PRST_EVENT_TIME 14
+
+/**
+ * State of a replayed connection
+ */
+typedef struct ReplayConnection {
+	/**
+	 * Socket, -1 once closed
+	 */
+	int sk;
+	/**
+	 * Session being replayed
+	 */
+	ReplaySession *session;
+	/**
+	 * Next APDU of the session
+	 */
+	int cursor;
+	/**
+	 * Completed replays of the session
+	 */
+	int loop;
+	/**
+	 * Clock at connection
+	 */
+	unsigned long long connected;
+	/**
+	 * Clock at the start of the current replay of the session
+	 */
+	unsigned long long start;
+	/**
+	 * Clock since when the next APDU waits for a manager request
+	 */
+	unsigned long long waiting;
+	/**
+	 * Next invoke-id of agent requests
+	 */
+	intu16 invoke_id;
+	/**
+	 * Invoke-ids of manager requests not answered yet
+	 */
+	intu16 pending[MAX_PENDING];
+	/**
+	 * Number of entries in pending
+	 */
+	int pending_count;
+	/**
+	 * Send time of confirmed event reports, by invoke-id
+	 */
+	unsigned long long inflight[MAX_INFLIGHT];
+	/**
+	 * Data received and not parsed yet
+	 */
+	intu8 *input;
+	/**
+	 * Bytes in input
+	 */
+	intu32 input_length;
+	/**
+	 * Size of input
+	 */
+	intu32 input_size;
+} ReplayConnection;
+
+/**
+ * \cond Undocumented
+ */
+static intu16 get_intu16(const intu8 *buf)
+{
+	return (buf[0] << 8) | buf[1];
+}
+
+static void put_intu16(intu8 *buf, intu16 value)
+{
+	buf[0] = value >> 8;
+	buf[1] = value;
+}
+
+static void put_intu32(intu8 *buf, intu32 value)
+{
+	put_intu16(buf, value >> 16);
+	put_intu16(buf + 2, value & 0xffff);
+}
+/**
+ * \endcond
+ */
+
+/**
+ * Creates an empty session.
+ *
+ * @param name where the session came from
+ * @return the session, NULL if out of memory
+ */
+ReplaySession *replay_session_new(const char *name)
+{
+	ReplaySession *session = calloc(1, sizeof(ReplaySession));
+
+	if (session != NULL) {
+		session->name = strdup(name);
+	}
+
+	return session;
+}
+
+/**
+ * Appends a copy of an APDU to a session.
+ *
+ * @param session the session
+ * @param offset time since the start of the session, in nanoseconds
+ * @param data encoded APDU
+ * @param length APDU length
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int replay_session_add(ReplaySession *session, unsigned long long offset,
+		       intu8 *data, intu32 length)
+{
+	ReplayApdu *apdu;
+
+	if (session->count == session->size) {
+		int size = session->size ? session->size * 2 : 16;
+		ReplayApdu *p = realloc(session->apdus, size * sizeof(ReplayApdu));
+
+		if (p == NULL) {
+			return 0;
+		}
+
+		session->apdus = p;
+		session->size = size;
+	}
+
+	apdu = &session->apdus[session->count];
+	apdu->data = malloc(length);
+
+	if (apdu->data == NULL) {
+		return 0;
+	}
+
+	memcpy(apdu->data, data, length);
+	apdu->length = length;
+	apdu->offset = offset;
+	session->count++;
+
+	return 1;
+}
+
+/**
+ * Converts a hex digit
+ *
+ * @return digit value, -1 if not a hex digit
+ */
+static int hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Decodes a line of a hex APDU file in place.
+ *
+ * @return number of bytes, -1 if the line has an odd number of digits
+ * or something else than hex digits, spaces and "0x" prefixes
+ */
+static int decode_hex_line(char *line)
+{
+	intu8 *out = (intu8 *) line;
+	int digits = 0;
+	int length = 0;
+	int high = 0;
+	char *s;
+
+	for (s = line; *s; ++s) {
+		if (*s == ' ' || *s == '\t' || *s == '\r') {
+			continue;
+		}
+
+		if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X') && digits % 2 == 0) {
+			++s;
+			continue;
+		}
+
+		if (hex_value(*s) < 0) {
+			return -1;
+		}
+
+		if (digits++ % 2 == 0) {
+			high = hex_value(*s);
+		} else {
+			out[length++] = (high << 4) | hex_value(*s);
+		}
+	}
+
+	return digits % 2 ? -1 : length;
+}
+
+/**
+ * Appends the APDUs of a file to a session, spaced by a fixed interval.
+ *
+ * The file may hold binary APDUs one after another (as the files of
+ * tests/resources/apdu), or text with one hex APDU per line. Text lines
+ * may start with "recvh" (agent APDU, as in replay_agent.py dumps);
+ * lines starting with "sendh" (manager APDUs) or '#' are skipped.
+ *
+ * @param session the session
+ * @param path APDU file
+ * @param interval time between APDUs, in nanoseconds
+ * @return number of APDUs added, -1 on error
+ */
+int replay_session_load_apdus(ReplaySession *session, const char *path,
+			      unsigned long long interval)
+{
+	unsigned long long offset = 0;
+	intu8 *buffer = NULL;
+	long size;
+	long i;
+	int count = 0;
+	FILE *f;
+
+	f = fopen(path, "rb");
+
+	if (f == NULL) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buffer = malloc(size + 1);
+
+	if (buffer == NULL || fread(buffer, 1, size, f) != (size_t) size) {
+		fclose(f);
+		free(buffer);
+		return -1;
+	}
+
+	fclose(f);
+	buffer[size] = 0;
+
+	if (session->count > 0) {
+		offset = session->apdus[session->count - 1].offset + interval;
+	}
+
+	if (size > 0 && (buffer[0] & 0xF0) == 0xE0) {
+		// binary APDUs
+		for (i = 0; i + 4 <= size; ) {
+			intu32 length = 4 + get_intu16(buffer + i + 2);
+
+			if (i + (long) length > size) {
+				fprintf(stderr, "%s: truncated APDU at %ld\n", path, i);
+				break;
+			}
+
+			if (!replay_session_add(session, offset, buffer + i, length)) {
+				break;
+			}
+
+			offset += interval;
+			i += length;
+			count++;
+		}
+	} else {
+		char *line = strtok((char *) buffer, "\n");
+
+		for (; line != NULL; line = strtok(NULL, "\n")) {
+			int length;
+
+			while (*line == ' ' || *line == '\t') {
+				++line;
+			}
+
+			if (*line == '#' || strncmp(line, "sendh", 5) == 0) {
+				continue;
+			}
+
+			if (strncmp(line, "recvh", 5) == 0) {
+				line += 5;
+			}
+
+			length = decode_hex_line(line);
+
+			if (length < 0) {
+				fprintf(stderr, "%s: bad hex line\n", path);
+				count = -1;
+				break;
+			}
+
+			if (length < 4 || (intu32) length < 4u + get_intu16((intu8 *) line + 2)) {
+				continue;
+			}
+
+			if (!replay_session_add(session, offset, (intu8 *) line, length)) {
+				break;
+			}
+
+			offset += interval;
+			count++;
+		}
+	}
+
+	free(buffer);
+
+	return count;
+}
+
+/**
+ * Creates one session for each context of a capture file, with the
+ * APDUs captured in the given direction.
+ *
+ * @param path capture file
+ * @param direction CAPTURE_IN to replay APDUs a manager received,
+ * CAPTURE_OUT to replay APDUs an agent sent
+ * @param plugin if not 0, only contexts of this plugin are taken
+ * @param sessions receives a new array of sessions
+ * @param count receives the number of sessions
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int replay_load_capture(const char *path, int direction, unsigned int plugin,
+			ReplaySession ***sessions, int *count)
+{
+	CaptureReader *reader;
+	CaptureRecord record;
+	ContextId *ids = NULL;
+	unsigned long long *starts = NULL;
+	ReplaySession **list = NULL;
+	char name[256];
+	int n = 0;
+	int i;
+
+	reader = capture_reader_open(path);
+
+	if (reader == NULL) {
+		return 0;
+	}
+
+	while (capture_reader_next(reader, &record)) {
+		if (record.direction != direction
+		    || (plugin && record.id.plugin != plugin)) {
+			continue;
+		}
+
+		for (i = 0; i < n; ++i) {
+			if (ids[i].plugin == record.id.plugin
+			    && ids[i].connid == record.id.connid) {
+				break;
+			}
+		}
+
+		if (i == n) {
+			ids = realloc(ids, (n + 1) * sizeof(ContextId));
+			starts = realloc(starts, (n + 1) * sizeof(unsigned long long));
+			list = realloc(list, (n + 1) * sizeof(ReplaySession *));
+
+			if (ids == NULL || starts == NULL || list == NULL) {
+				break;
+			}
+
+			snprintf(name, sizeof(name), "%s#%u:%llu", path,
+				 record.id.plugin, record.id.connid);
+			ids[n] = record.id;
+			starts[n] = record.timestamp;
+			list[n] = replay_session_new(name);
+			n++;
+		}
+
+		replay_session_add(list[i], record.timestamp - starts[i],
+				   record.data, record.length);
+	}
+
+	capture_reader_close(reader);
+	free(ids);
+	free(starts);
+
+	*sessions = list;
+	*count = n;
+
+	return list != NULL;
+}
+
+/**
+ * Destroys a session.
+ *
+ * @param session the session
+ */
+void replay_session_del(ReplaySession *session)
+{
+	int i;
+
+	if (session == NULL) {
+		return;
+	}
+
+	for (i = 0; i < session->count; ++i) {
+		free(session->apdus[i].data);
+	}
+
+	free(session->apdus);
+	free(session->name);
+	free(session);
+}
+
+/**
+ * Closes a connection.
+ */
+static void connection_close(ReplayConnection *conn)
+{
+	if (conn->sk >= 0) {
+		close(conn->sk);
+		conn->sk = -1;
+	}
+}
+
+/**
+ * Tells whether the peer answers a remote operation invoke
+ */
+static int roiv_confirmed(intu16 choice)
+{
+	return choice == ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN
+	       || choice == ROIV_CMIP_GET_CHOSEN
+	       || choice == ROIV_CMIP_CONFIRMED_SET_CHOSEN
+	       || choice == ROIV_CMIP_CONFIRMED_ACTION_CHOSEN;
+}
+
+/**
+ * Handles an APDU received from the manager.
+ */
+static void handle_input_apdu(ReplayConnection *conn, intu8 *apdu,
+			      intu32 length, ReplayResult *result)
+{
+	intu16 choice;
+	intu16 invoke_id;
+	unsigned long long *sent;
+	unsigned long long latency;
+
+	result->apdus_received++;
+
+	if (get_intu16(apdu) == ABRT_CHOSEN) {
+		result->aborts++;
+		return;
+	}
+
+	if (get_intu16(apdu) != PRST_CHOSEN || length < PRST_CHOICE + 2) {
+		return;
+	}
+
+	invoke_id = get_intu16(apdu + PRST_INVOKE_ID);
+	choice = get_intu16(apdu + PRST_CHOICE);
+
+	if ((choice & 0xff00) == ROIV_CMIP_EVENT_REPORT_CHOSEN) {
+		// unconfirmed requests get no response to wait for
+		if (roiv_confirmed(choice) && conn->pending_count < MAX_PENDING) {
+			conn->pending[conn->pending_count++] = invoke_id;
+		}
+	} else if (choice == RORS_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN) {
+		sent = &conn->inflight[invoke_id % MAX_INFLIGHT];
+
+		if (*sent) {
+			latency = stats_now_ns() - *sent;
+			result->confirmed++;
+			result->latency_sum += latency;
+
+			if (latency > result->latency_max) {
+				result->latency_max = latency;
+			}
+
+			*sent = 0;
+		}
+	}
+}
+
+/**
+ * Reads what the manager sent and handles the complete APDUs.
+ *
+ * @return 1 if the connection is still open, 0 otherwise
+ */
+static int connection_read(ReplayConnection *conn, ReplayResult *result)
+{
+	intu32 offset = 0;
+	intu32 length;
+	ssize_t n;
+
+	if (conn->input_size - conn->input_length < 4096) {
+		intu32 size = conn->input_size ? conn->input_size * 2 : 8192;
+		intu8 *p = realloc(conn->input, size);
+
+		if (p == NULL) {
+			return 0;
+		}
+
+		conn->input = p;
+		conn->input_size = size;
+	}
+
+	n = recv(conn->sk, conn->input + conn->input_length,
+		 conn->input_size - conn->input_length, MSG_DONTWAIT);
+
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+		connection_close(conn);
+		return 0;
+	}
+
+	if (n < 0) {
+		return 1;
+	}
+
+	conn->input_length += n;
+	result->bytes_received += n;
+
+	while (conn->input_length - offset >= 4) {
+		length = 4 + get_intu16(conn->input + offset + 2);
+
+		if (conn->input_length - offset < length) {
+			break;
+		}
+
+		handle_input_apdu(conn, conn->input + offset, length, result);
+		offset += length;
+	}
+
+	memmove(conn->input, conn->input + offset, conn->input_length - offset);
+	conn->input_length -= offset;
+
+	return 1;
+}
+
+/**
+ * Patches invoke-id and event-time of an APDU about to be sent.
+ *
+ * @return 0 if the APDU answers a manager request that did not
+ * arrive yet, so it must wait; 1 otherwise
+ */
+static int rewrite_apdu(ReplayConnection *conn, intu8 *apdu, intu32 length,
+			unsigned long long now)
+{
+	intu16 choice;
+
+	if (get_intu16(apdu) != PRST_CHOSEN || length < PRST_CHOICE + 2) {
+		return 1;
+	}
+
+	choice = get_intu16(apdu + PRST_CHOICE);
+
+	if ((choice & 0xff00) == ROIV_CMIP_EVENT_REPORT_CHOSEN) {
+		put_intu16(apdu + PRST_INVOKE_ID, conn->invoke_id);
+
+		if ((choice == ROIV_CMIP_EVENT_REPORT_CHOSEN
+		     || choice == ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN)
+		    && length >= PRST_EVENT_TIME + 4) {
+			// RelativeTime ticks are 1/8 ms
+			put_intu32(apdu + PRST_EVENT_TIME,
+				   (now - conn->connected) / 125000);
+		}
+
+		if (choice == ROIV_CMIP_CONFIRMED_EVENT_REPORT_CHOSEN) {
+			conn->inflight[conn->invoke_id % MAX_INFLIGHT] = now;
+		}
+
+		conn->invoke_id++;
+		return 1;
+	}
+
+	// a response: answer the oldest manager request
+	if (conn->pending_count == 0) {
+		if (!conn->waiting) {
+			conn->waiting = now;
+		}
+
+		if (now - conn->waiting < RESPONSE_WAIT) {
+			return 0;
+		}
+	} else {
+		put_intu16(apdu + PRST_INVOKE_ID, conn->pending[0]);
+		conn->pending_count--;
+		memmove(conn->pending, conn->pending + 1,
+			conn->pending_count * sizeof(intu16));
+	}
+
+	conn->waiting = 0;
+
+	return 1;
+}
+
+/**
+ * Sends the APDUs of a connection that are due.
+ *
+ * @param conn the connection
+ * @param now current clock
+ * @param options replay settings
+ * @param result updated with sent APDUs
+ * @return clock when the next APDU is due, 0 if the session is over
+ */
+static unsigned long long connection_send(ReplayConnection *conn,
+		unsigned long long now, ReplayOptions *options,
+		ReplayResult *result)
+{
+	ReplaySession *session = conn->session;
+	ReplayApdu *apdu;
+	unsigned long long due;
+	intu8 *buffer;
+	intu32 sent;
+	ssize_t n;
+
+	while (conn->sk >= 0 && conn->loop < options->loops) {
+		if (conn->cursor == session->count) {
+			conn->cursor = 0;
+			conn->start = now;
+
+			if (++conn->loop == options->loops || session->count == 0) {
+				break;
+			}
+		}
+
+		apdu = &session->apdus[conn->cursor];
+		due = conn->start;
+
+		if (options->scale > 0) {
+			due += apdu->offset / options->scale;
+		}
+
+		if (due > now) {
+			return due;
+		}
+
+		buffer = malloc(apdu->length);
+
+		if (buffer == NULL) {
+			break;
+		}
+
+		memcpy(buffer, apdu->data, apdu->length);
+
+		if (!rewrite_apdu(conn, buffer, apdu->length, now)) {
+			// poll again soon, the request may be on its way
+			free(buffer);
+			return now + 1000000;
+		}
+
+		for (sent = 0; sent < apdu->length; sent += n) {
+			n = send(conn->sk, buffer + sent, apdu->length - sent,
+				 MSG_NOSIGNAL);
+
+			if (n <= 0 && errno != EINTR) {
+				fprintf(stderr, "%s: send failed: %s\n",
+					session->name, strerror(errno));
+				connection_close(conn);
+				result->failed++;
+				break;
+			}
+
+			if (n < 0) {
+				n = 0;
+			}
+		}
+
+		free(buffer);
+
+		if (conn->sk < 0) {
+			break;
+		}
+
+		result->apdus_sent++;
+		result->bytes_sent += apdu->length;
+		conn->cursor++;
+	}
+
+	return 0;
+}
+
+/**
+ * Replays sessions against a manager.
+ *
+ * @param sessions sessions to be replayed
+ * @param count number of sessions
+ * @param options replay settings
+ * @param result filled with the results
+ * @return 1 if all connections were made, 0 otherwise
+ */
+int replay_run(ReplaySession **sessions, int count, ReplayOptions *options,
+	       ReplayResult *result)
+{
+	ReplayConnection *conns;
+	struct pollfd *fds;
+	struct sockaddr_in addr;
+	unsigned long long start;
+	unsigned long long now;
+	unsigned long long next;
+	unsigned long long due;
+	unsigned long long drain_until = 0;
+	int active;
+	int timeout;
+	int i;
+
+	memset(result, 0, sizeof(ReplayResult));
+
+	if (count <= 0 || options->connections <= 0) {
+		return 0;
+	}
+
+	conns = calloc(options->connections, sizeof(ReplayConnection));
+	fds = calloc(options->connections, sizeof(struct pollfd));
+
+	if (conns == NULL || fds == NULL) {
+		free(conns);
+		free(fds);
+		return 0;
+	}
+
+	start = stats_now_ns();
+
+	for (i = 0; i < options->connections; ++i) {
+		ReplayConnection *conn = &conns[i];
+
+		addr = options->manager;
+		addr.sin_port = htons(options->first_port
+				      + (options->same_port ? 0 : i));
+
+		conn->session = sessions[i % count];
+		conn->sk = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (conn->sk < 0 || connect(conn->sk, (struct sockaddr *) &addr,
+					    sizeof(addr)) < 0) {
+			fprintf(stderr, "%s: cannot connect to port %d: %s\n",
+				conn->session->name, ntohs(addr.sin_port),
+				strerror(errno));
+			connection_close(conn);
+			result->failed++;
+			continue;
+		}
+
+		conn->connected = conn->start = stats_now_ns();
+	}
+
+	while (1) {
+		now = stats_now_ns();
+		next = 0;
+		active = 0;
+
+		for (i = 0; i < options->connections; ++i) {
+			due = connection_send(&conns[i], now, options, result);
+
+			if (due && (!next || due < next)) {
+				next = due;
+			}
+
+			fds[i].fd = conns[i].sk;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+
+			if (due) {
+				active++;
+			}
+		}
+
+		if (!active) {
+			// all sessions sent; wait a bit for the last answers
+			if (!drain_until) {
+				drain_until = now + DRAIN_WAIT;
+			}
+
+			if (now >= drain_until) {
+				break;
+			}
+
+			next = drain_until;
+		}
+
+		timeout = next > now ? (next - now + 999999) / 1000000 : 0;
+
+		if (poll(fds, options->connections, timeout) > 0) {
+			for (i = 0; i < options->connections; ++i) {
+				if (fds[i].revents) {
+					connection_read(&conns[i], result);
+				}
+			}
+		}
+	}
+
+	result->elapsed = stats_now_ns() - start;
+
+	for (i = 0; i < options->connections; ++i) {
+		connection_close(&conns[i]);
+		free(conns[i].input);
+	}
+
+	free(conns);
+	free(fds);
+
+	return result->failed == 0;
+}
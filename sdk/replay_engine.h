@@ -0,0 +1,171 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file replay_engine.h
+ * \brief APDU replay engine header.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 24, 2011
+ */
+
+#ifndef REPLAY_ENGINE_H_
+#define REPLAY_ENGINE_H_
+
+#include <netinet/in.h>
+#include "src/asn1/phd_types.h"
+
+/**
+ * An APDU to be sent by the agent side
+ */
+typedef struct ReplayApdu {
+	/**
+	 * Time since the start of the session, in nanoseconds
+	 */
+	unsigned long long offset;
+	/**
+	 * APDU length
+	 */
+	intu32 length;
+	/**
+	 * Encoded APDU
+	 */
+	intu8 *data;
+} ReplayApdu;
+
+/**
+ * APDUs sent by one agent, in order
+ */
+typedef struct ReplaySession {
+	/**
+	 * Where the session came from, for messages
+	 */
+	char *name;
+	/**
+	 * APDUs of the session
+	 */
+	ReplayApdu *apdus;
+	/**
+	 * Number of APDUs
+	 */
+	int count;
+	/**
+	 * Allocated APDUs
+	 */
+	int size;
+} ReplaySession;
+
+/**
+ * Replay settings
+ */
+typedef struct ReplayOptions {
+	/**
+	 * Manager address; the port is set per connection
+	 */
+	struct sockaddr_in manager;
+	/**
+	 * Port of the first connection
+	 */
+	int first_port;
+	/**
+	 * If 0, connection i goes to first_port + i (the TCP plugin takes
+	 * one agent per port); if 1, all connections go to first_port
+	 */
+	int same_port;
+	/**
+	 * Number of concurrent connections; connection i replays
+	 * session i modulo the number of sessions
+	 */
+	int connections;
+	/**
+	 * Times each connection replays its session
+	 */
+	int loops;
+	/**
+	 * Speed factor: 1 keeps the original pace, 10 is ten times
+	 * faster, 0 sends as fast as possible
+	 */
+	double scale;
+} ReplayOptions;
+
+/**
+ * Replay results
+ */
+typedef struct ReplayResult {
+	/**
+	 * APDUs sent to the manager
+	 */
+	unsigned long long apdus_sent;
+	/**
+	 * Bytes sent to the manager
+	 */
+	unsigned long long bytes_sent;
+	/**
+	 * APDUs received from the manager
+	 */
+	unsigned long long apdus_received;
+	/**
+	 * Bytes received from the manager
+	 */
+	unsigned long long bytes_received;
+	/**
+	 * Aborts received from the manager
+	 */
+	unsigned long long aborts;
+	/**
+	 * Confirmed event reports answered by the manager
+	 */
+	unsigned long long confirmed;
+	/**
+	 * Sum of confirmed event report round trips, in nanoseconds
+	 */
+	unsigned long long latency_sum;
+	/**
+	 * Longest confirmed event report round trip, in nanoseconds
+	 */
+	unsigned long long latency_max;
+	/**
+	 * Connections that failed
+	 */
+	int failed;
+	/**
+	 * Wall time of the replay, in nanoseconds
+	 */
+	unsigned long long elapsed;
+} ReplayResult;
+
+ReplaySession *replay_session_new(const char *name);
+
+int replay_session_add(ReplaySession *session, unsigned long long offset,
+		       intu8 *data, intu32 length);
+
+int replay_session_load_apdus(ReplaySession *session, const char *path,
+			      unsigned long long interval);
+
+int replay_load_capture(const char *path, int direction, unsigned int plugin,
+			ReplaySession ***sessions, int *count);
+
+void replay_session_del(ReplaySession *session);
+
+int replay_run(ReplaySession **sessions, int count, ReplayOptions *options,
+	       ReplayResult *result);
+
+#endif /* REPLAY_ENGINE_H_ */
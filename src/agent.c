@@ -144,7 +144,8 @@ void agent_init(CommunicationPlugin **plugins, int config,
 
 	// Listen to all communication state transitions
 	communication_add_state_transition_listener(fsm_state_size, &agent_handle_transition_evt);
-	communication_set_connection_listeners(&agent_notify_evt_device_connected,
+	communication_set_connection_listeners(AGENT_CONTEXT,
+						&agent_notify_evt_device_connected,
 						&agent_notify_evt_device_disconnected);
 
 	// Register standard configurations for each specialization.
@@ -442,6 +443,11 @@ void agent_handle_transition_evt(Context *ctx, fsm_states previous, fsm_states n
 {
 	DEBUG("agent: handling transition event");
 
+	if (!(ctx->type & AGENT_CONTEXT)) {
+		// manager context living in the same process
+		return;
+	}
+
 	if (previous == fsm_state_operating && next != previous) {
 		DEBUG(" agent: Notify device unavailable.\n");
 		// Exiting operating state
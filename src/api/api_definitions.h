@@ -50,6 +50,7 @@
  */
 typedef char *APIDEF_type;
 #define APIDEF_TYPE_STRING "string"
+#define APIDEF_TYPE_INTU64 "intu64"
 #define APIDEF_TYPE_INT32 "int32"
 #define APIDEF_TYPE_INTU32 "intu32"
 #define APIDEF_TYPE_INT16 "int16"
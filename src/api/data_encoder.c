@@ -1135,6 +1135,36 @@ void data_set_intu32(DataEntry *data, char *att_name, intu32 *value)
 	set_simple(data, data_strcp(att_name), APIDEF_TYPE_INTU32, intu32_2str(*value));
 }
 
+/**
+ * Sets data entry with passed type.
+ *
+ * @param data entry
+ * @param att_name the name of the entry
+ * @param value the entry value
+ */
+void data_set_intu64(DataEntry *data, char *att_name, unsigned long long *value)
+{
+	if (data == NULL)
+		return;
+
+	set_simple(data, data_strcp(att_name), APIDEF_TYPE_INTU64, intu64_2str(*value));
+}
+
+/**
+ * Sets data entry as an empty compound, to be filled by the caller.
+ *
+ * @param data entry
+ * @param att_name the name of the entry
+ * @param size number of child entries
+ */
+void data_set_compound(DataEntry *data, char *att_name, int size)
+{
+	if (data == NULL)
+		return;
+
+	set_cmp(data, data_strcp(att_name), size);
+}
+
 /**
  * Sets data entry with passed type.
  *
@@ -1239,6 +1269,87 @@ DataList *data_list_new(int size)
 	return list;
 }
 
+/**
+ * Duplicates a string, accepting NULL.
+ *
+ * @param str the string
+ * @return the copy, or NULL
+ */
+static char *strcp_null(const char *str)
+{
+	return str ? data_strcp(str) : NULL;
+}
+
+/**
+ * Deep-copies a data entry.
+ *
+ * @param dst the entry to be filled, contents are overwritten
+ * @param src the entry to be copied
+ */
+void data_entry_copy(DataEntry *dst, DataEntry *src)
+{
+	int i;
+
+	*dst = *src;
+
+	if (src->meta_data.size > 0) {
+		dst->meta_data.values = calloc(src->meta_data.size,
+					       sizeof(MetaAtt));
+
+		for (i = 0; i < src->meta_data.size; i++) {
+			MetaAtt *meta = &src->meta_data.values[i];
+			dst->meta_data.values[i].name = strcp_null(meta->name);
+			dst->meta_data.values[i].value = strcp_null(meta->value);
+		}
+	} else {
+		dst->meta_data.values = NULL;
+	}
+
+	if (src->choice == SIMPLE_DATA_ENTRY) {
+		dst->u.simple.name = strcp_null(src->u.simple.name);
+		dst->u.simple.value = strcp_null(src->u.simple.value);
+	} else if (src->choice == COMPOUND_DATA_ENTRY) {
+		CompoundDataEntry *cmp = &src->u.compound;
+
+		dst->u.compound.name = strcp_null(cmp->name);
+		dst->u.compound.entries = NULL;
+
+		if (cmp->entries_count > 0) {
+			dst->u.compound.entries = calloc(cmp->entries_count,
+							 sizeof(DataEntry));
+		}
+
+		for (i = 0; i < cmp->entries_count; i++) {
+			data_entry_copy(&dst->u.compound.entries[i],
+					&cmp->entries[i]);
+		}
+	}
+}
+
+/**
+ * Deep-copies a list of elements, e.g. to keep a list that is owned
+ * by the caller of an event listener.
+ *
+ * @param pointer the list of elements to be copied.
+ * @return a new list, to be deleted by data_list_del()
+ */
+DataList *data_list_copy(DataList *pointer)
+{
+	DataList *list;
+	int i;
+
+	if (pointer == NULL)
+		return NULL;
+
+	list = data_list_new(pointer->size);
+
+	for (i = 0; i < pointer->size; i++) {
+		data_entry_copy(&list->values[i], &pointer->values[i]);
+	}
+
+	return list;
+}
+
 /**
  * Deletes all elements of the list. It also deletes the list.
  *
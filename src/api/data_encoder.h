@@ -117,6 +117,8 @@ void data_set_handle_attr_val_map(DataEntry *data, char *att_name, HandleAttrVal
 void data_set_pm_segment_entry_map(DataEntry *data, char *att_name, PmSegmentEntryMap *map);
 void data_set_intu16(DataEntry *data, char *att_name, intu16 *value);
 void data_set_intu32(DataEntry *data, char *att_name, intu32 *value);
+void data_set_intu64(DataEntry *data, char *att_name, unsigned long long *value);
+void data_set_compound(DataEntry *data, char *att_name, int size);
 void data_set_high_res_relative_time(DataEntry *data, char *att_name, HighResRelativeTime *time);
 void data_set_absolute_time_adj(DataEntry *data, char *att_name, AbsoluteTimeAdjust *adj);
 
@@ -35,5 +35,7 @@
 void data_entry_del(DataEntry *pointer);
 DataList *data_list_new(int size);
 void data_list_del(DataList *pointer);
+void data_entry_copy(DataEntry *dst, DataEntry *src);
+DataList *data_list_copy(DataList *pointer);
 
 #endif /* DATA_LIST_H_ */
@@ -137,6 +137,19 @@ char *intu32_2str(intu32 value)
 	return str;
 }
 
+/**
+ * Converts an unsigned 64-bit integer to string representation.
+ *
+ * @param value the integer to be converted into string.
+ * @return the string representation.
+ */
+char *intu64_2str(unsigned long long value)
+{
+	char *str = calloc(MAX_INT_STR + 1, sizeof(char));
+	sprintf(str, "%llu", value);
+	return str;
+}
+
 /**
  * Converts an intu16 list to string representation.
  *
@@ -41,6 +41,7 @@ char *int16_2str(int16 value);
 char *intu16_2str(intu16 value);
 char *int32_2str(int32 value);
 char *intu32_2str(intu32 value);
+char *intu64_2str(unsigned long long value);
 char *intu16list_2str(intu16 *list, int size);
 char *float2str(float value);
 char *octet_string2str(octet_string *str);
@@ -0,0 +1,998 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file timeseries.c
+ * \brief Compressed time-series storage.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jun 19, 2012
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "timeseries.h"
+#include "src/util/log.h"
+
+/**
+ * \defgroup TimeSeries Time Series
+ * \ingroup API
+ *
+ * \brief Compressed storage of numeric observations.
+ *
+ * Observations are kept per device and metric id, in blocks of
+ * compressed points (the Gorilla scheme): a timestamp is stored as
+ * the difference between its delta and the previous delta, which is
+ * a single bit for periodic measurements, and a value is stored as
+ * the XOR with the previous value, which is a single bit when it did
+ * not change and just the differing bits otherwise.
+ *
+ * Blocks are kept in time order and record the time range they
+ * cover, so a range query only decodes the blocks it overlaps.
+ *
+ * An application feeds the store from its
+ * ManagerListener::measurement_data_updated callback, through
+ * timeseries_append_data_list(). Points must arrive in time order
+ * for each series.
+ *
+ * @{
+ */
+
+/**
+ * File format magic and version
+ */
+static const char file_magic[8] = {'A', 'T', 'S', 'D', 'B', 0, 0, 1};
+
+/**
+ * Classes of timestamp delta-of-delta, after the single '0' bit for
+ * zero: prefix bits, and bits of the two's complement value
+ */
+static const struct {
+	unsigned int prefix;
+	int prefix_bits;
+	int bits;
+} dod_classes[4] = {
+	{0x2, 2, 7},
+	{0x6, 3, 9},
+	{0xe, 4, 12},
+	{0xf, 4, 64}
+};
+
+/**
+ * Reads bits from a block
+ */
+typedef struct BitReader {
+	const intu8 *data;
+	intu32 nbits;
+	intu32 pos;
+} BitReader;
+
+/**
+ * Appends the n lower bits of a value to a block, most significant
+ * bit first.
+ */
+static void write_bits(TimeSeriesBlock *block, unsigned long long value, int n)
+{
+	while (n > 0) {
+		intu32 byte = block->nbits >> 3;
+		int room = 8 - (block->nbits & 7);
+		int take = n < room ? n : room;
+		intu8 bits = (value >> (n - take)) & ((1u << take) - 1);
+
+		if (byte >= block->capacity) {
+			intu32 capacity = block->capacity ? block->capacity * 2 : 64;
+
+			block->data = realloc(block->data, capacity);
+			memset(block->data + block->capacity, 0,
+			       capacity - block->capacity);
+			block->capacity = capacity;
+		}
+
+		block->data[byte] |= bits << (room - take);
+		block->nbits += take;
+		n -= take;
+	}
+}
+
+/**
+ * Reads n bits, most significant bit first.
+ *
+ * @return 1 if operation succeeds, 0 if block is too short
+ */
+static int read_bits(BitReader *reader, int n, unsigned long long *value)
+{
+	unsigned long long v = 0;
+
+	if ((intu32) n > reader->nbits - reader->pos) {
+		return 0;
+	}
+
+	while (n > 0) {
+		int room = 8 - (reader->pos & 7);
+		int take = n < room ? n : room;
+		intu8 byte = reader->data[reader->pos >> 3];
+
+		v = (v << take) | ((byte >> (room - take)) & ((1u << take) - 1));
+		reader->pos += take;
+		n -= take;
+	}
+
+	*value = v;
+
+	return 1;
+}
+
+static long long sign_extend(unsigned long long value, int bits)
+{
+	unsigned long long sign = 1ULL << (bits - 1);
+
+	return (long long) ((value ^ sign) - sign);
+}
+
+static void codec_reset(TimeSeriesCodec *codec)
+{
+	memset(codec, 0, sizeof(TimeSeriesCodec));
+	codec->leading = -1;
+}
+
+static void encode_dod(TimeSeriesBlock *block, long long dod)
+{
+	int i;
+
+	if (dod == 0) {
+		write_bits(block, 0, 1);
+		return;
+	}
+
+	for (i = 0; i < 3; ++i) {
+		long long limit = 1LL << (dod_classes[i].bits - 1);
+
+		if (dod >= -limit && dod < limit) {
+			break;
+		}
+	}
+
+	write_bits(block, dod_classes[i].prefix, dod_classes[i].prefix_bits);
+	write_bits(block, (unsigned long long) dod, dod_classes[i].bits);
+}
+
+static int decode_dod(BitReader *reader, long long *dod)
+{
+	unsigned long long bit;
+	unsigned long long value;
+	int i;
+
+	if (!read_bits(reader, 1, &bit)) {
+		return 0;
+	}
+
+	if (!bit) {
+		*dod = 0;
+		return 1;
+	}
+
+	for (i = 0; i < 3; ++i) {
+		if (!read_bits(reader, 1, &bit)) {
+			return 0;
+		}
+
+		if (!bit) {
+			break;
+		}
+	}
+
+	if (!read_bits(reader, dod_classes[i].bits, &value)) {
+		return 0;
+	}
+
+	*dod = sign_extend(value, dod_classes[i].bits);
+
+	return 1;
+}
+
+static void encode_value(TimeSeriesBlock *block, TimeSeriesCodec *codec,
+			 unsigned long long value)
+{
+	unsigned long long x = value ^ codec->value;
+	int leading;
+	int trailing;
+	int significant;
+
+	if (!x) {
+		write_bits(block, 0, 1);
+		return;
+	}
+
+	leading = __builtin_clzll(x);
+	trailing = __builtin_ctzll(x);
+
+	if (leading > 31) {
+		leading = 31;
+	}
+
+	// Changed bits fit in the previous window
+	if (codec->leading >= 0 && leading >= codec->leading &&
+	    trailing >= codec->trailing) {
+		write_bits(block, 0x2, 2);
+		write_bits(block, x >> codec->trailing,
+			   64 - codec->leading - codec->trailing);
+		return;
+	}
+
+	significant = 64 - leading - trailing;
+
+	write_bits(block, 0x3, 2);
+	write_bits(block, leading, 5);
+	write_bits(block, significant & 0x3f, 6);
+	write_bits(block, x >> trailing, significant);
+
+	codec->leading = leading;
+	codec->trailing = trailing;
+}
+
+static int decode_value(BitReader *reader, TimeSeriesCodec *codec)
+{
+	unsigned long long bit;
+	unsigned long long bits;
+	unsigned long long leading;
+	unsigned long long significant;
+
+	if (!read_bits(reader, 1, &bit)) {
+		return 0;
+	}
+
+	if (!bit) {
+		return 1;
+	}
+
+	if (!read_bits(reader, 1, &bit)) {
+		return 0;
+	}
+
+	if (bit) {
+		if (!read_bits(reader, 5, &leading) ||
+		    !read_bits(reader, 6, &significant)) {
+			return 0;
+		}
+
+		if (!significant) {
+			significant = 64;
+		}
+
+		if (leading + significant > 64) {
+			return 0;
+		}
+
+		codec->leading = leading;
+		codec->trailing = 64 - leading - significant;
+	} else if (codec->leading < 0) {
+		return 0;
+	}
+
+	if (!read_bits(reader, 64 - codec->leading - codec->trailing, &bits)) {
+		return 0;
+	}
+
+	codec->value ^= bits << codec->trailing;
+
+	return 1;
+}
+
+static void encode_point(TimeSeriesBlock *block, TimeSeriesCodec *codec,
+			 unsigned long long timestamp, FLOAT_Type value)
+{
+	unsigned long long bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	if (!codec->count) {
+		write_bits(block, timestamp, 64);
+		write_bits(block, bits, 64);
+		block->first = timestamp;
+	} else {
+		long long delta = timestamp - codec->timestamp;
+
+		encode_dod(block, delta - codec->delta);
+		encode_value(block, codec, bits);
+		codec->delta = delta;
+	}
+
+	codec->timestamp = timestamp;
+	codec->value = bits;
+	codec->count++;
+
+	block->last = timestamp;
+	block->count++;
+}
+
+/**
+ * Decodes the next point of a block.
+ *
+ * @return 1 if operation succeeds, 0 if block is corrupt
+ */
+static int decode_point(BitReader *reader, TimeSeriesCodec *codec,
+			TimeSeriesPoint *point)
+{
+	if (!codec->count) {
+		if (!read_bits(reader, 64, &codec->timestamp) ||
+		    !read_bits(reader, 64, &codec->value)) {
+			return 0;
+		}
+	} else {
+		long long dod;
+
+		if (!decode_dod(reader, &dod)) {
+			return 0;
+		}
+
+		codec->delta += dod;
+		codec->timestamp += codec->delta;
+
+		if (!decode_value(reader, codec)) {
+			return 0;
+		}
+	}
+
+	codec->count++;
+
+	point->timestamp = codec->timestamp;
+	memcpy(&point->value, &codec->value, sizeof(point->value));
+
+	return 1;
+}
+
+/**
+ * Decodes a whole block, leaving the codec in the state the writer had
+ * after its last point.
+ *
+ * @return 1 if operation succeeds, 0 if block is corrupt
+ */
+static int replay_block(TimeSeriesBlock *block, TimeSeriesCodec *codec)
+{
+	BitReader reader = {block->data, block->nbits, 0};
+	TimeSeriesPoint point;
+	intu32 i;
+
+	codec_reset(codec);
+
+	for (i = 0; i < block->count; ++i) {
+		if (!decode_point(&reader, codec, &point)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Releases the unused tail of a block that takes no more points.
+ */
+static void block_shrink(TimeSeriesBlock *block)
+{
+	intu32 size = (block->nbits + 7) / 8;
+
+	if (size && size < block->capacity) {
+		block->data = realloc(block->data, size);
+		block->capacity = size;
+	}
+}
+
+static int compare_series(TimeSeries *series, unsigned long long device,
+			  OID_Type metric)
+{
+	if (series->device != device) {
+		return series->device < device ? -1 : 1;
+	}
+
+	return series->metric < metric ? -1 : series->metric > metric;
+}
+
+/**
+ * Looks a series up. Must hold db->mutex.
+ *
+ * @param db the store
+ * @param device device key
+ * @param metric metric id
+ * @param index filled with the position of the series, or where it
+ *        would be inserted
+ * @return the series, or NULL if there is none
+ */
+static TimeSeries *find_series(TimeSeriesDB *db, unsigned long long device,
+			       OID_Type metric, int *index)
+{
+	int lo = 0;
+	int hi = db->count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = compare_series(db->series[mid], device, metric);
+
+		if (cmp == 0) {
+			*index = mid;
+			return db->series[mid];
+		}
+
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	*index = lo;
+
+	return NULL;
+}
+
+/**
+ * Creates a series. Must hold db->mutex.
+ */
+static TimeSeries *add_series(TimeSeriesDB *db, int index,
+			      unsigned long long device, OID_Type metric)
+{
+	TimeSeries *series = calloc(1, sizeof(TimeSeries));
+
+	series->device = device;
+	series->metric = metric;
+	codec_reset(&series->codec);
+
+	if (db->count >= db->capacity) {
+		db->capacity = db->capacity ? db->capacity * 2 : 16;
+		db->series = realloc(db->series,
+				     db->capacity * sizeof(TimeSeries *));
+	}
+
+	memmove(&db->series[index + 1], &db->series[index],
+		(db->count - index) * sizeof(TimeSeries *));
+	db->series[index] = series;
+	db->count++;
+
+	return series;
+}
+
+/**
+ * Starts a new block in a series.
+ */
+static TimeSeriesBlock *add_block(TimeSeries *series)
+{
+	if (series->block_count > 0) {
+		block_shrink(&series->blocks[series->block_count - 1]);
+	}
+
+	if (series->block_count >= series->block_capacity) {
+		series->block_capacity = series->block_capacity ?
+					 series->block_capacity * 2 : 4;
+		series->blocks = realloc(series->blocks,
+					 series->block_capacity *
+					 sizeof(TimeSeriesBlock));
+	}
+
+	memset(&series->blocks[series->block_count], 0, sizeof(TimeSeriesBlock));
+	codec_reset(&series->codec);
+
+	return &series->blocks[series->block_count++];
+}
+
+static void series_del(TimeSeries *series)
+{
+	int i;
+
+	for (i = 0; i < series->block_count; ++i) {
+		free(series->blocks[i].data);
+	}
+
+	free(series->blocks);
+	free(series);
+}
+
+/**
+ * Creates an empty store.
+ *
+ * @param block_points points per block, 0 for the default. Larger
+ *        blocks compress better; smaller blocks make range queries
+ *        decode less.
+ * @return the store
+ */
+TimeSeriesDB *timeseries_new(intu32 block_points)
+{
+	TimeSeriesDB *db = calloc(1, sizeof(TimeSeriesDB));
+
+	db->block_points = block_points ? block_points
+			   : TIMESERIES_BLOCK_POINTS;
+	pthread_mutex_init(&db->mutex, NULL);
+
+	return db;
+}
+
+/**
+ * Destroys a store and all of its points.
+ *
+ * @param db the store
+ */
+void timeseries_del(TimeSeriesDB *db)
+{
+	int i;
+
+	if (!db) {
+		return;
+	}
+
+	for (i = 0; i < db->count; ++i) {
+		series_del(db->series[i]);
+	}
+
+	free(db->series);
+	pthread_mutex_destroy(&db->mutex);
+	free(db);
+}
+
+/**
+ * Stores one observation.
+ *
+ * @param db the store
+ * @param device device key, e.g. the system id of the device
+ * @param metric metric id
+ * @param timestamp time of the observation, in any unit; periodic
+ *        observations compress best
+ * @param value observed value
+ * @return 1 if operation succeeds, 0 if the point is older than the
+ *         last point of its series
+ */
+int timeseries_append(TimeSeriesDB *db, unsigned long long device,
+		      OID_Type metric, unsigned long long timestamp,
+		      FLOAT_Type value)
+{
+	TimeSeries *series;
+	TimeSeriesBlock *block = NULL;
+	int index;
+
+	pthread_mutex_lock(&db->mutex);
+
+	series = find_series(db, device, metric, &index);
+
+	if (!series) {
+		series = add_series(db, index, device, metric);
+	}
+
+	if (series->block_count > 0) {
+		block = &series->blocks[series->block_count - 1];
+
+		if (timestamp < block->last) {
+			pthread_mutex_unlock(&db->mutex);
+			DEBUG("timeseries: point out of order for metric %d",
+			      metric);
+			return 0;
+		}
+
+		if (block->count >= db->block_points) {
+			block = NULL;
+		}
+	}
+
+	if (!block) {
+		block = add_block(series);
+	}
+
+	encode_point(block, &series->codec, timestamp, value);
+
+	pthread_mutex_unlock(&db->mutex);
+
+	return 1;
+}
+
+static const char *entry_metric_id(DataEntry *entry)
+{
+	int i;
+
+	for (i = 0; i < entry->meta_data.size; ++i) {
+		if (strcmp(entry->meta_data.values[i].name, "metric-id") == 0) {
+			return entry->meta_data.values[i].value;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Stores the observed values of a data entry and its children.
+ *
+ * @param parent_metric metric id of the parent entry, if any
+ * @return number of points stored
+ */
+static int append_entry(TimeSeriesDB *db, unsigned long long device,
+			unsigned long long timestamp, DataEntry *entry,
+			const char *parent_metric)
+{
+	const char *metric = entry_metric_id(entry);
+	int count = 0;
+	int i;
+
+	if (entry->choice == COMPOUND_DATA_ENTRY) {
+		for (i = 0; i < entry->u.compound.entries_count; ++i) {
+			count += append_entry(db, device, timestamp,
+					      &entry->u.compound.entries[i],
+					      metric);
+		}
+
+		return count;
+	}
+
+	if (!entry->u.simple.value) {
+		return 0;
+	}
+
+	if (metric) {
+		if (!entry->u.simple.type ||
+		    strcmp(entry->u.simple.type, APIDEF_TYPE_FLOAT) != 0) {
+			return 0;
+		}
+	} else if (parent_metric && entry->u.simple.name &&
+		   strcmp(entry->u.simple.name, "value") == 0) {
+		// Value field of a Nu-Observed-Value, tagged on its parent
+		metric = parent_metric;
+	} else {
+		return 0;
+	}
+
+	return timeseries_append(db, device, atoi(metric), timestamp,
+				 strtod(entry->u.simple.value, NULL));
+}
+
+/**
+ * Stores the observed numeric values found in a measurement data list,
+ * as delivered to ManagerListener::measurement_data_updated.
+ *
+ * @param db the store
+ * @param device device key, e.g. the system id of the device
+ * @param timestamp time of the measurement
+ * @param list the data list
+ * @return number of points stored
+ */
+int timeseries_append_data_list(TimeSeriesDB *db, unsigned long long device,
+				unsigned long long timestamp, DataList *list)
+{
+	int count = 0;
+	int i;
+
+	for (i = 0; list && i < list->size; ++i) {
+		count += append_entry(db, device, timestamp, &list->values[i],
+				      NULL);
+	}
+
+	return count;
+}
+
+/**
+ * Gets the points of a series within a time range.
+ *
+ * @param db the store
+ * @param device device key
+ * @param metric metric id
+ * @param from start of range, inclusive
+ * @param to end of range, inclusive
+ * @param count filled with the number of points
+ * @return points in time order, to be freed by caller; NULL if none
+ */
+TimeSeriesPoint *timeseries_query(TimeSeriesDB *db, unsigned long long device,
+				  OID_Type metric, unsigned long long from,
+				  unsigned long long to, int *count)
+{
+	TimeSeriesPoint *points = NULL;
+	TimeSeries *series;
+	int capacity = 0;
+	int n = 0;
+	int index;
+	int lo;
+	int hi;
+	int i;
+
+	pthread_mutex_lock(&db->mutex);
+
+	series = find_series(db, device, metric, &index);
+
+	if (!series) {
+		goto out;
+	}
+
+	// first block that ends at or after from
+	lo = 0;
+	hi = series->block_count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (series->blocks[mid].last < from) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (i = lo; i < series->block_count && series->blocks[i].first <= to;
+	     ++i) {
+		TimeSeriesBlock *block = &series->blocks[i];
+		BitReader reader = {block->data, block->nbits, 0};
+		TimeSeriesCodec codec;
+		TimeSeriesPoint point;
+		intu32 j;
+
+		codec_reset(&codec);
+
+		for (j = 0; j < block->count; ++j) {
+			if (!decode_point(&reader, &codec, &point)) {
+				ERROR("timeseries: corrupt block");
+				break;
+			}
+
+			if (point.timestamp < from) {
+				continue;
+			}
+
+			if (point.timestamp > to) {
+				break;
+			}
+
+			if (n >= capacity) {
+				capacity = capacity ? capacity * 2 : 64;
+				points = realloc(points,
+						 capacity * sizeof(TimeSeriesPoint));
+			}
+
+			points[n++] = point;
+		}
+	}
+
+out:
+	pthread_mutex_unlock(&db->mutex);
+
+	*count = n;
+
+	return points;
+}
+
+/**
+ * Gets the size of the compressed points of a store.
+ *
+ * @param db the store
+ * @return size in bytes
+ */
+unsigned long long timeseries_size(TimeSeriesDB *db)
+{
+	unsigned long long size = 0;
+	int i;
+	int j;
+
+	pthread_mutex_lock(&db->mutex);
+
+	for (i = 0; i < db->count; ++i) {
+		for (j = 0; j < db->series[i]->block_count; ++j) {
+			size += (db->series[i]->blocks[j].nbits + 7) / 8;
+		}
+	}
+
+	pthread_mutex_unlock(&db->mutex);
+
+	return size;
+}
+
+static int write_int(FILE *f, unsigned long long value, int size)
+{
+	intu8 buf[8];
+	int i;
+
+	for (i = size - 1; i >= 0; --i) {
+		buf[i] = value;
+		value >>= 8;
+	}
+
+	return fwrite(buf, size, 1, f) == 1;
+}
+
+static int read_int(FILE *f, unsigned long long *value, int size)
+{
+	intu8 buf[8];
+	int i;
+
+	if (fread(buf, size, 1, f) != 1) {
+		return 0;
+	}
+
+	*value = 0;
+
+	for (i = 0; i < size; ++i) {
+		*value = (*value << 8) | buf[i];
+	}
+
+	return 1;
+}
+
+/**
+ * Writes a store to a file. The file is replaced atomically.
+ *
+ * @param db the store
+ * @param path file name
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int timeseries_save(TimeSeriesDB *db, const char *path)
+{
+	char *tmp;
+	FILE *f;
+	int ok;
+	int i;
+	int j;
+
+	if (asprintf(&tmp, "%s.tmp", path) < 0) {
+		return 0;
+	}
+
+	if (!(f = fopen(tmp, "wb"))) {
+		ERROR("timeseries: cannot write %s", tmp);
+		free(tmp);
+		return 0;
+	}
+
+	pthread_mutex_lock(&db->mutex);
+
+	ok = fwrite(file_magic, sizeof(file_magic), 1, f) == 1;
+	ok = ok && write_int(f, db->block_points, 4);
+	ok = ok && write_int(f, db->count, 4);
+
+	for (i = 0; ok && i < db->count; ++i) {
+		TimeSeries *series = db->series[i];
+
+		ok = write_int(f, series->device, 8);
+		ok = ok && write_int(f, series->metric, 2);
+		ok = ok && write_int(f, series->block_count, 4);
+
+		for (j = 0; ok && j < series->block_count; ++j) {
+			TimeSeriesBlock *block = &series->blocks[j];
+
+			ok = write_int(f, block->first, 8);
+			ok = ok && write_int(f, block->last, 8);
+			ok = ok && write_int(f, block->count, 4);
+			ok = ok && write_int(f, block->nbits, 4);
+			ok = ok && fwrite(block->data, (block->nbits + 7) / 8,
+					  1, f) == 1;
+		}
+	}
+
+	pthread_mutex_unlock(&db->mutex);
+
+	ok = fclose(f) == 0 && ok;
+	ok = ok && rename(tmp, path) == 0;
+
+	if (!ok) {
+		ERROR("timeseries: cannot write %s", path);
+		remove(tmp);
+	}
+
+	free(tmp);
+
+	return ok;
+}
+
+/**
+ * Reads the blocks of a series from a file.
+ *
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int load_series(FILE *f, TimeSeries *series)
+{
+	unsigned long long count;
+	unsigned long long v;
+	int i;
+
+	if (!read_int(f, &count, 4) || count > 0x7fffffff) {
+		return 0;
+	}
+
+	for (i = 0; i < (int) count; ++i) {
+		TimeSeriesBlock *block = add_block(series);
+		intu32 size;
+
+		if (!read_int(f, &block->first, 8) ||
+		    !read_int(f, &block->last, 8) ||
+		    !read_int(f, &v, 4)) {
+			return 0;
+		}
+
+		block->count = v;
+
+		if (!read_int(f, &v, 4) || !v) {
+			return 0;
+		}
+
+		block->nbits = v;
+		size = (block->nbits + 7) / 8;
+		block->data = malloc(size);
+		block->capacity = size;
+
+		if (fread(block->data, size, 1, f) != 1) {
+			return 0;
+		}
+	}
+
+	// Writer state of the last block
+	return !series->block_count ||
+	       replay_block(&series->blocks[series->block_count - 1],
+			    &series->codec);
+}
+
+/**
+ * Reads a store from a file written by timeseries_save().
+ *
+ * @param path file name
+ * @return the store, or NULL on error
+ */
+TimeSeriesDB *timeseries_load(const char *path)
+{
+	TimeSeriesDB *db;
+	char magic[sizeof(file_magic)];
+	unsigned long long block_points;
+	unsigned long long count;
+	unsigned long long device;
+	unsigned long long metric;
+	FILE *f;
+	int i;
+
+	if (!(f = fopen(path, "rb"))) {
+		return NULL;
+	}
+
+	if (fread(magic, sizeof(magic), 1, f) != 1 ||
+	    memcmp(magic, file_magic, sizeof(magic)) != 0 ||
+	    !read_int(f, &block_points, 4) || !read_int(f, &count, 4)) {
+		ERROR("timeseries: %s is not a time-series file", path);
+		fclose(f);
+		return NULL;
+	}
+
+	db = timeseries_new(block_points);
+
+	for (i = 0; i < (int) count; ++i) {
+		TimeSeries *series;
+		int index;
+
+		if (!read_int(f, &device, 8) || !read_int(f, &metric, 2) ||
+		    find_series(db, device, metric, &index)) {
+			break;
+		}
+
+		series = add_series(db, index, device, metric);
+
+		if (!load_series(f, series)) {
+			break;
+		}
+	}
+
+	fclose(f);
+
+	if (i < (int) count) {
+		ERROR("timeseries: %s is corrupt", path);
+		timeseries_del(db);
+		return NULL;
+	}
+
+	return db;
+}
+
+/** @} */
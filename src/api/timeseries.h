@@ -0,0 +1,141 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file timeseries.h
+ * \brief Compressed time-series storage header.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jun 19, 2012
+ */
+
+/**
+ * @addtogroup TimeSeries
+ * @{
+ */
+
+#ifndef TIMESERIES_H_
+#define TIMESERIES_H_
+
+#include <pthread.h>
+#include <asn1/phd_types.h>
+#include <api/api_definitions.h>
+
+/**
+ * Default number of points of a block
+ */
+#define TIMESERIES_BLOCK_POINTS 512
+
+/**
+ * One observation
+ */
+typedef struct TimeSeriesPoint {
+	unsigned long long timestamp;
+	FLOAT_Type value;
+} TimeSeriesPoint;
+
+/**
+ * Compressed block of points, covering the time range [first, last]
+ */
+typedef struct TimeSeriesBlock {
+	unsigned long long first;
+	unsigned long long last;
+	intu32 count;
+	/**
+	 * Length of data, in bits
+	 */
+	intu32 nbits;
+	/**
+	 * Bytes allocated to data
+	 */
+	intu32 capacity;
+	intu8 *data;
+} TimeSeriesBlock;
+
+/**
+ * Compression state, the same for the writer and for readers: each
+ * point is encoded against the one before it
+ */
+typedef struct TimeSeriesCodec {
+	intu32 count;
+	unsigned long long timestamp;
+	long long delta;
+	unsigned long long value;
+	int leading;
+	int trailing;
+} TimeSeriesCodec;
+
+/**
+ * Points of one metric of one device
+ */
+typedef struct TimeSeries {
+	unsigned long long device;
+	OID_Type metric;
+	/**
+	 * Blocks in time order; the last one takes new points
+	 */
+	TimeSeriesBlock *blocks;
+	int block_count;
+	int block_capacity;
+	/**
+	 * State of the last block
+	 */
+	TimeSeriesCodec codec;
+} TimeSeries;
+
+/**
+ * Time-series store
+ */
+typedef struct TimeSeriesDB {
+	/**
+	 * Series sorted by device and metric
+	 */
+	TimeSeries **series;
+	int count;
+	int capacity;
+	intu32 block_points;
+	pthread_mutex_t mutex;
+} TimeSeriesDB;
+
+TimeSeriesDB *timeseries_new(intu32 block_points);
+
+void timeseries_del(TimeSeriesDB *db);
+
+int timeseries_append(TimeSeriesDB *db, unsigned long long device,
+		      OID_Type metric, unsigned long long timestamp,
+		      FLOAT_Type value);
+
+int timeseries_append_data_list(TimeSeriesDB *db, unsigned long long device,
+				unsigned long long timestamp, DataList *list);
+
+TimeSeriesPoint *timeseries_query(TimeSeriesDB *db, unsigned long long device,
+				  OID_Type metric, unsigned long long from,
+				  unsigned long long to, int *count);
+
+unsigned long long timeseries_size(TimeSeriesDB *db);
+
+int timeseries_save(TimeSeriesDB *db, const char *path);
+
+TimeSeriesDB *timeseries_load(const char *path);
+
+/** @} */
+
+#endif /* TIMESERIES_H_ */
@@ -16,6 +16,8 @@ LOCAL_SRC_FILES = \
                    service.c \
                    operating.c \
                    stdconfigurations.c \
+                   stats.c \
+                   capture.c \
                    context_manager.c
 
 LOCAL_MODULE:= libantidotecomm
@@ -0,0 +1,663 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file capture.c
+ * \brief APDU capture source.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 23, 2011
+ */
+
+/**
+ * \defgroup Capture Capture
+ * \ingroup Communication
+ * \brief Capture of sent and received APDUs to a file.
+ *
+ * Capture is switched on and off at runtime by capture_start() and
+ * capture_stop(), or by setting ANTIDOTE_CAPTURE=file before the
+ * network layer is started. The communication layer only copies each
+ * APDU to a queue; a background thread writes the file.
+ *
+ * A capture file starts with CAPTURE_FILE_MAGIC, followed by records
+ * made of a CAPTURE_RECORD_HEADER_SIZE header and the encoded APDU.
+ * Header fields are big-endian: timestamp (64 bits), connection id
+ * (64 bits), plugin id (32 bits), APDU length (32 bits), direction
+ * (8 bits) and three reserved bytes. Records are in timestamp order.
+ *
+ * When capture is stopped, an index is appended: CAPTURE_INDEX_MAGIC,
+ * the entry count (32 bits) and, for each CAPTURE_INDEX_INTERVAL
+ * records, the timestamp and offset of the record (64 bits each).
+ * The file ends with the index offset (64 bits) and CAPTURE_END_MAGIC.
+ * Files without index (e.g. the program crashed) remain readable.
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "src/communication/capture.h"
+#include "src/communication/stats.h"
+#include "src/util/log.h"
+
+/**
+ * \def CAPTURE_QUEUE_LIMIT
+ * Maximum number of APDU bytes waiting for the writer thread;
+ * APDUs beyond that are dropped and counted.
+ */
+#ifndef CAPTURE_QUEUE_LIMIT
+#define CAPTURE_QUEUE_LIMIT (4 * 1024 * 1024)
+#endif
+
+/**
+ * APDU waiting to be written
+ */
+typedef struct CaptureEntry {
+	/**
+	 * Next entry of the queue
+	 */
+	struct CaptureEntry *next;
+	/**
+	 * The record; data points to the bytes following this struct
+	 */
+	CaptureRecord record;
+} CaptureEntry;
+
+/**
+ * 1 while capturing. Read without lock as a fast path, so
+ * capture_apdu() costs a single test when capture is off.
+ */
+static volatile int active = 0;
+
+/**
+ * Asks the writer thread to finish
+ */
+static int stopping = 0;
+
+/**
+ * Protects the queue and the flags
+ */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signals the writer thread that the queue has data
+ */
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Writer thread
+ */
+static pthread_t writer;
+
+/**
+ * First APDU of the queue
+ */
+static CaptureEntry *queue_head = NULL;
+
+/**
+ * Last APDU of the queue
+ */
+static CaptureEntry *queue_tail = NULL;
+
+/**
+ * APDU bytes in the queue
+ */
+static unsigned long queue_bytes = 0;
+
+/**
+ * APDUs dropped because the queue was full
+ */
+static unsigned long long dropped = 0;
+
+/**
+ * Capture file, used by the writer thread only
+ */
+static FILE *file = NULL;
+
+/**
+ * Offset of the next record in the file
+ */
+static unsigned long long file_offset = 0;
+
+/**
+ * Records written to the file
+ */
+static unsigned long long record_count = 0;
+
+/**
+ * Index entries, pairs of timestamp and record offset
+ */
+static unsigned long long *file_index = NULL;
+
+/**
+ * Number of index entries
+ */
+static intu32 index_count = 0;
+
+/**
+ * Allocated index entries
+ */
+static intu32 index_size = 0;
+
+/**
+ * \cond Undocumented
+ */
+static void put_intu32(intu8 *buf, intu32 value)
+{
+	buf[0] = value >> 24;
+	buf[1] = value >> 16;
+	buf[2] = value >> 8;
+	buf[3] = value;
+}
+
+static void put_intu64(intu8 *buf, unsigned long long value)
+{
+	put_intu32(buf, value >> 32);
+	put_intu32(buf + 4, value & 0xffffffff);
+}
+
+static intu32 get_intu32(const intu8 *buf)
+{
+	return ((intu32) buf[0] << 24) | ((intu32) buf[1] << 16)
+	       | ((intu32) buf[2] << 8) | buf[3];
+}
+
+static unsigned long long get_intu64(const intu8 *buf)
+{
+	return ((unsigned long long) get_intu32(buf) << 32)
+	       | get_intu32(buf + 4);
+}
+/**
+ * \endcond
+ */
+
+/**
+ * Adds an index entry for the record about to be written.
+ */
+static void index_add(unsigned long long timestamp)
+{
+	if (index_count == index_size) {
+		intu32 size = index_size ? index_size * 2 : 256;
+		unsigned long long *p = realloc(file_index,
+					2 * size * sizeof(unsigned long long));
+
+		if (p == NULL) {
+			return;
+		}
+
+		file_index = p;
+		index_size = size;
+	}
+
+	file_index[2 * index_count] = timestamp;
+	file_index[2 * index_count + 1] = file_offset;
+	index_count++;
+}
+
+/**
+ * Writes a record to the capture file.
+ */
+static void write_record(CaptureRecord *record)
+{
+	intu8 header[CAPTURE_RECORD_HEADER_SIZE];
+
+	if (record_count % CAPTURE_INDEX_INTERVAL == 0) {
+		index_add(record->timestamp);
+	}
+
+	memset(header, 0, sizeof(header));
+	put_intu64(header, record->timestamp);
+	put_intu64(header + 8, record->id.connid);
+	put_intu32(header + 16, record->id.plugin);
+	put_intu32(header + 20, record->length);
+	header[24] = record->direction;
+
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(record->data, 1, record->length, file);
+
+	file_offset += sizeof(header) + record->length;
+	record_count++;
+}
+
+/**
+ * Writes the index and the end mark of the capture file.
+ */
+static void write_index()
+{
+	intu8 buf[16];
+	intu32 i;
+
+	fwrite(CAPTURE_INDEX_MAGIC, 1, CAPTURE_MAGIC_SIZE, file);
+	put_intu32(buf, index_count);
+	fwrite(buf, 1, 4, file);
+
+	for (i = 0; i < index_count; ++i) {
+		put_intu64(buf, file_index[2 * i]);
+		put_intu64(buf + 8, file_index[2 * i + 1]);
+		fwrite(buf, 1, 16, file);
+	}
+
+	put_intu64(buf, file_offset);
+	fwrite(buf, 1, 8, file);
+	fwrite(CAPTURE_END_MAGIC, 1, CAPTURE_MAGIC_SIZE, file);
+}
+
+/**
+ * Writer thread: takes whole batches from the queue, so the
+ * communication layer waits for the lock only while a pointer
+ * swap is done.
+ */
+static void *writer_loop(void *arg)
+{
+	CaptureEntry *batch;
+	CaptureEntry *next;
+	int finish;
+
+	do {
+		pthread_mutex_lock(&mutex);
+
+		while (queue_head == NULL && !stopping) {
+			pthread_cond_wait(&cond, &mutex);
+		}
+
+		batch = queue_head;
+		queue_head = queue_tail = NULL;
+		queue_bytes = 0;
+		finish = stopping;
+
+		pthread_mutex_unlock(&mutex);
+
+		for (; batch != NULL; batch = next) {
+			next = batch->next;
+			write_record(&batch->record);
+			free(batch);
+		}
+
+		fflush(file);
+	} while (!finish);
+
+	return NULL;
+}
+
+/**
+ * Starts capturing all APDUs sent and received by the stack.
+ *
+ * @param path file to be written, truncated if it exists
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int capture_start(const char *path)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (active) {
+		pthread_mutex_unlock(&mutex);
+		ERROR("capture: already capturing");
+		return 0;
+	}
+
+	file = fopen(path, "wb");
+
+	if (file == NULL) {
+		pthread_mutex_unlock(&mutex);
+		ERROR("capture: cannot write %s", path);
+		return 0;
+	}
+
+	fwrite(CAPTURE_FILE_MAGIC, 1, CAPTURE_MAGIC_SIZE, file);
+	file_offset = CAPTURE_MAGIC_SIZE;
+	record_count = 0;
+	index_count = 0;
+	dropped = 0;
+	stopping = 0;
+
+	if (pthread_create(&writer, NULL, writer_loop, NULL) != 0) {
+		fclose(file);
+		file = NULL;
+		pthread_mutex_unlock(&mutex);
+		ERROR("capture: cannot create writer thread");
+		return 0;
+	}
+
+	active = 1;
+	pthread_mutex_unlock(&mutex);
+
+	DEBUG("capture: writing APDUs to %s", path);
+
+	return 1;
+}
+
+/**
+ * Tells whether APDUs are being captured.
+ *
+ * @return 1 if capturing, 0 otherwise
+ */
+int capture_is_active()
+{
+	return active;
+}
+
+/**
+ * Queues an APDU to be written to the capture file. Does nothing
+ * if capture is off.
+ *
+ * @param id context of the APDU
+ * @param direction whether the APDU was sent or received
+ * @param data encoded APDU
+ * @param length APDU length
+ */
+void capture_apdu(ContextId id, CaptureDirection direction,
+		  intu8 *data, intu32 length)
+{
+	CaptureEntry *entry;
+
+	if (!active) {
+		return;
+	}
+
+	entry = malloc(sizeof(CaptureEntry) + length);
+
+	if (entry == NULL) {
+		__sync_fetch_and_add(&dropped, 1);
+		return;
+	}
+
+	entry->next = NULL;
+	entry->record.id = id;
+	entry->record.direction = direction;
+	entry->record.length = length;
+	entry->record.data = (intu8 *) (entry + 1);
+	memcpy(entry->record.data, data, length);
+
+	pthread_mutex_lock(&mutex);
+
+	if (!active || queue_bytes + length > CAPTURE_QUEUE_LIMIT) {
+		if (active) {
+			__sync_fetch_and_add(&dropped, 1);
+		}
+
+		pthread_mutex_unlock(&mutex);
+		free(entry);
+		return;
+	}
+
+	// taken with the lock held, so the file is in timestamp order
+	entry->record.timestamp = stats_now_ns();
+
+	if (queue_tail != NULL) {
+		queue_tail->next = entry;
+	} else {
+		queue_head = entry;
+	}
+
+	queue_tail = entry;
+	queue_bytes += length;
+
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Returns the number of APDUs left out of the current (or last)
+ * capture because the writer thread could not keep up.
+ *
+ * @return number of dropped APDUs
+ */
+unsigned long long capture_dropped()
+{
+	return __sync_fetch_and_add(&dropped, 0);
+}
+
+/**
+ * Stops capturing. Waits until queued APDUs are written, then
+ * appends the index and closes the file.
+ */
+void capture_stop()
+{
+	pthread_mutex_lock(&mutex);
+
+	if (!active) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	active = 0;
+	stopping = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(writer, NULL);
+
+	write_index();
+	fclose(file);
+	file = NULL;
+
+	free(file_index);
+	file_index = NULL;
+	index_size = 0;
+
+	if (dropped > 0) {
+		ERROR("capture: %llu APDUs dropped", dropped);
+	}
+
+	DEBUG("capture: %llu APDUs written", record_count);
+}
+
+/**
+ * Opens a capture file for reading.
+ *
+ * @param path capture file
+ * @return the reader, NULL if the file cannot be read or is not
+ * a capture file. Must be closed by capture_reader_close().
+ */
+CaptureReader *capture_reader_open(const char *path)
+{
+	CaptureReader *reader;
+	char magic[CAPTURE_MAGIC_SIZE];
+	intu8 buf[16];
+	unsigned long long offset;
+	intu32 i;
+
+	reader = calloc(1, sizeof(CaptureReader));
+
+	if (reader == NULL) {
+		return NULL;
+	}
+
+	reader->file = fopen(path, "rb");
+
+	if (reader->file == NULL) {
+		ERROR("capture: cannot read %s", path);
+		free(reader);
+		return NULL;
+	}
+
+	if (fread(magic, 1, CAPTURE_MAGIC_SIZE, reader->file) != CAPTURE_MAGIC_SIZE
+	    || memcmp(magic, CAPTURE_FILE_MAGIC, CAPTURE_MAGIC_SIZE) != 0) {
+		ERROR("capture: %s is not a capture file", path);
+		capture_reader_close(reader);
+		return NULL;
+	}
+
+	// the index is optional, ignore it if anything looks wrong
+	if (fseek(reader->file, -16, SEEK_END) == 0
+	    && fread(buf, 1, 16, reader->file) == 16
+	    && memcmp(buf + 8, CAPTURE_END_MAGIC, CAPTURE_MAGIC_SIZE) == 0) {
+		offset = get_intu64(buf);
+
+		if (fseek(reader->file, offset, SEEK_SET) == 0
+		    && fread(magic, 1, CAPTURE_MAGIC_SIZE, reader->file) == CAPTURE_MAGIC_SIZE
+		    && memcmp(magic, CAPTURE_INDEX_MAGIC, CAPTURE_MAGIC_SIZE) == 0
+		    && fread(buf, 1, 4, reader->file) == 4) {
+			reader->end = offset;
+			reader->index_count = get_intu32(buf);
+			reader->index = calloc(2 * reader->index_count + 1,
+					       sizeof(unsigned long long));
+
+			for (i = 0; reader->index && i < reader->index_count; ++i) {
+				if (fread(buf, 1, 16, reader->file) != 16) {
+					reader->index_count = i;
+					break;
+				}
+
+				reader->index[2 * i] = get_intu64(buf);
+				reader->index[2 * i + 1] = get_intu64(buf + 8);
+			}
+
+			if (reader->index == NULL) {
+				reader->index_count = 0;
+			}
+		}
+	}
+
+	fseek(reader->file, CAPTURE_MAGIC_SIZE, SEEK_SET);
+
+	return reader;
+}
+
+/**
+ * Reads the header of the next record.
+ *
+ * @return 1 if a header was read, 0 at the end of the records
+ */
+static int read_header(CaptureReader *reader, CaptureRecord *record)
+{
+	intu8 header[CAPTURE_RECORD_HEADER_SIZE];
+
+	if (reader->end > 0 && ftell(reader->file) >= reader->end) {
+		return 0;
+	}
+
+	if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+		return 0;
+	}
+
+	record->timestamp = get_intu64(header);
+	record->id.connid = get_intu64(header + 8);
+	record->id.plugin = get_intu32(header + 16);
+	record->length = get_intu32(header + 20);
+	record->direction = header[24];
+	record->data = NULL;
+
+	return 1;
+}
+
+/**
+ * Reads the next record.
+ *
+ * @param reader the reader
+ * @param record filled with the record; its data stays valid
+ * until the next call
+ * @return 1 if a record was read, 0 at the end of the file
+ */
+int capture_reader_next(CaptureReader *reader, CaptureRecord *record)
+{
+	if (!read_header(reader, record)) {
+		return 0;
+	}
+
+	if (record->length > reader->buffer_size) {
+		intu8 *p = realloc(reader->buffer, record->length);
+
+		if (p == NULL) {
+			return 0;
+		}
+
+		reader->buffer = p;
+		reader->buffer_size = record->length;
+	}
+
+	if (fread(reader->buffer, 1, record->length, reader->file)
+	    != record->length) {
+		// truncated capture
+		return 0;
+	}
+
+	record->data = reader->buffer;
+
+	return 1;
+}
+
+/**
+ * Moves the reader to the first record captured at or after the
+ * given time, using the index if the file has one.
+ *
+ * @param reader the reader
+ * @param timestamp capture time, see CaptureRecord
+ * @return 1 if such a record exists, 0 otherwise
+ */
+int capture_reader_seek(CaptureReader *reader, unsigned long long timestamp)
+{
+	CaptureRecord record;
+	long offset = CAPTURE_MAGIC_SIZE;
+	intu32 low = 0;
+	intu32 high = reader->index_count;
+
+	// last index entry before timestamp: records captured at the
+	// same time may come before the entry that has it
+	while (low < high) {
+		intu32 mid = (low + high) / 2;
+
+		if (reader->index[2 * mid] < timestamp) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	if (low > 0) {
+		offset = reader->index[2 * (low - 1) + 1];
+	}
+
+	fseek(reader->file, offset, SEEK_SET);
+
+	while (read_header(reader, &record)) {
+		if (record.timestamp >= timestamp) {
+			fseek(reader->file, -CAPTURE_RECORD_HEADER_SIZE, SEEK_CUR);
+			return 1;
+		}
+
+		if (fseek(reader->file, record.length, SEEK_CUR) != 0) {
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Closes a capture file.
+ *
+ * @param reader the reader
+ */
+void capture_reader_close(CaptureReader *reader)
+{
+	if (reader == NULL) {
+		return;
+	}
+
+	fclose(reader->file);
+	free(reader->index);
+	free(reader->buffer);
+	free(reader);
+}
+
+/** @} */
@@ -0,0 +1,157 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file capture.h
+ * \brief APDU capture header.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 23, 2011
+ */
+
+/**
+ * @addtogroup Capture
+ * @{
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdio.h>
+#include <communication/context.h>
+
+/**
+ * Direction of a captured APDU, seen from the local stack
+ */
+typedef enum {
+	CAPTURE_IN = 0, // !< APDU received from the peer
+	CAPTURE_OUT = 1 // !< APDU sent to the peer
+} CaptureDirection;
+
+/**
+ * Magic number at the start of capture files
+ */
+#define CAPTURE_FILE_MAGIC "ANTCAP01"
+
+/**
+ * Magic number at the start of the index block
+ */
+#define CAPTURE_INDEX_MAGIC "ANTCAPIX"
+
+/**
+ * Magic number at the end of a complete capture file
+ */
+#define CAPTURE_END_MAGIC "ANTCAPEN"
+
+/**
+ * Size of the magic numbers
+ */
+#define CAPTURE_MAGIC_SIZE 8
+
+/**
+ * Size of the fixed part of a record in the file
+ */
+#define CAPTURE_RECORD_HEADER_SIZE 28
+
+/**
+ * One index entry is written for each CAPTURE_INDEX_INTERVAL records
+ */
+#define CAPTURE_INDEX_INTERVAL 64
+
+/**
+ * A captured APDU
+ */
+typedef struct CaptureRecord {
+	/**
+	 * Monotonic clock at capture time, in nanoseconds
+	 */
+	unsigned long long timestamp;
+	/**
+	 * Context of the APDU
+	 */
+	ContextId id;
+	/**
+	 * Direction, see CaptureDirection
+	 */
+	int direction;
+	/**
+	 * APDU length
+	 */
+	intu32 length;
+	/**
+	 * Encoded APDU
+	 */
+	intu8 *data;
+} CaptureRecord;
+
+/**
+ * Reader of capture files
+ */
+typedef struct CaptureReader {
+	/**
+	 * Capture file
+	 */
+	FILE *file;
+	/**
+	 * Offset where records end, i.e. where the index starts.
+	 * Zero when the file has no index (the capture was not stopped).
+	 */
+	long end;
+	/**
+	 * Number of index entries
+	 */
+	intu32 index_count;
+	/**
+	 * Index entries, pairs of timestamp and record offset
+	 */
+	unsigned long long *index;
+	/**
+	 * Buffer of the last record read
+	 */
+	intu8 *buffer;
+	/**
+	 * Size of buffer
+	 */
+	intu32 buffer_size;
+} CaptureReader;
+
+int capture_start(const char *path);
+
+int capture_is_active();
+
+void capture_apdu(ContextId id, CaptureDirection direction,
+		  intu8 *data, intu32 length);
+
+unsigned long long capture_dropped();
+
+void capture_stop();
+
+CaptureReader *capture_reader_open(const char *path);
+
+int capture_reader_next(CaptureReader *reader, CaptureRecord *record);
+
+int capture_reader_seek(CaptureReader *reader, unsigned long long timestamp);
+
+void capture_reader_close(CaptureReader *reader);
+
+/** @} */
+
+#endif /* CAPTURE_H_ */
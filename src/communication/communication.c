@@ -48,17 +48,15 @@
 #include "src/communication/disassociating.h"
 #include "src/communication/plugin/plugin.h"
 #include "src/communication/service.h"
+#include "src/communication/stats.h"
 #include "src/util/bytelib.h"
 #include "src/communication/parser/encoder_ASN1.h"
 #include "src/communication/parser/decoder_ASN1.h"
 #include "src/communication/parser/struct_cleaner.h"
 #include "src/util/log.h"
-
-// #define APDU_DUMP
-
-#ifdef APDU_DUMP
-#include <util/ioutil.h>
-#endif
+#include "src/util/trace.h"
+#include "src/communication/capture.h"
+#include "src/dim/mds_template.h"
 
 /**
  * Represents the network layer status
@@ -139,14 +137,34 @@ static StateTransitionListener *state_transition_listener_list = NULL;
 static int state_transition_listener_size = 0;
 
 /**
- * Connection listener
+ * Connection listener definition
+ */
+typedef struct ConnectionListener {
+	/**
+	 * Context types (MANAGER_CONTEXT, AGENT_CONTEXT) to listen
+	 */
+	int type;
+
+	/**
+	 * Function called after transport connection
+	 */
+	comm_conn_cb connected;
+
+	/**
+	 * Function called after transport disconnection
+	 */
+	comm_disconn_cb disconnected;
+} ConnectionListener;
+
+/**
+ * List of connection listeners
  */
-static comm_conn_cb connection_listener = NULL;
+static ConnectionListener *connection_listener_list = NULL;
 
 /**
- * Disconnection listener
+ * Number of connection listeners
  */
-static comm_disconn_cb disconnection_listener = NULL;
+static int connection_listener_size = 0;
 
 static int communication_fire_transport_disconnect_evt(Context *ctx);
 
@@ -290,6 +308,10 @@ void communication_finalize()
 	plugin_count = 0;
 
 	trans_finalize();
+
+	capture_stop();
+
+	mds_template_clear();
 }
 
 
@@ -348,15 +370,51 @@ void communication_remove_all_state_transition_listeners()
 }
 
 
-void communication_set_connection_listeners(comm_conn_cb cf, comm_disconn_cb df)
+/**
+ * Sets connection listeners for a kind of context. Manager and agent
+ * may live in the same process (e.g. over loopback plugin), so each
+ * one registers for its own context type.
+ *
+ * @param type context type mask (MANAGER_CONTEXT, AGENT_CONTEXT)
+ * @param cf connection listener
+ * @param df disconnection listener
+ */
+void communication_set_connection_listeners(int type, comm_conn_cb cf,
+						comm_disconn_cb df)
 {
-	connection_listener = cf;
-	disconnection_listener = df;
+	int i;
+
+	for (i = 0; i < connection_listener_size; i++) {
+		if (connection_listener_list[i].type == type) {
+			connection_listener_list[i].connected = cf;
+			connection_listener_list[i].disconnected = df;
+			return;
+		}
+	}
+
+	ConnectionListener *list = realloc(connection_listener_list,
+					   sizeof(ConnectionListener)
+					   * (connection_listener_size + 1));
+
+	if (list == NULL) {
+		return;
+	}
+
+	connection_listener_list = list;
+	connection_listener_list[connection_listener_size].type = type;
+	connection_listener_list[connection_listener_size].connected = cf;
+	connection_listener_list[connection_listener_size].disconnected = df;
+	connection_listener_size++;
 }
 
+/**
+ * Removes all connection listeners
+ */
 void communication_remove_connection_listeners()
 {
-	connection_listener = disconnection_listener = NULL;
+	free(connection_listener_list);
+	connection_listener_list = NULL;
+	connection_listener_size = 0;
 }
 
 /**
@@ -369,6 +427,11 @@ void communication_network_start()
 {
 	if (network_status == NETWORK_STATUS_NOT_INITIALIZED) {
 		unsigned int i;
+		char *capture_path = getenv("ANTIDOTE_CAPTURE");
+
+		if (capture_path && *capture_path && !capture_is_active()) {
+			capture_start(capture_path);
+		}
 
 		for (i = 1; i <= plugin_count; ++i) {
 			CommunicationPlugin *comm_plugin = comm_plugins[i];
@@ -467,8 +530,14 @@ Context *communication_transport_connect_indication(ContextId id, const char *ad
 				       NULL);
 	}
 
-	if (connection_listener)
-		connection_listener(ctx, addr);
+	int i;
+
+	for (i = 0; ctx && i < connection_listener_size; i++) {
+		ConnectionListener *l = &connection_listener_list[i];
+
+		if ((l->type & ctx->type) && l->connected)
+			l->connected(ctx, addr);
+	}
 
 	communication_unlock(ctx);
 	// thread-safe block - end
@@ -493,8 +562,14 @@ void communication_transport_disconnect_indication(ContextId id, const char *add
 
 	communication_fire_transport_disconnect_evt(ctx);
 
-	if (disconnection_listener)
-		disconnection_listener(ctx, addr);
+	int i;
+
+	for (i = 0; i < connection_listener_size; i++) {
+		ConnectionListener *l = &connection_listener_list[i];
+
+		if ((l->type & ctx->type) && l->disconnected)
+			l->disconnected(ctx, addr);
+	}
 
 	context_unlock(ctx);
 
@@ -607,21 +682,33 @@ void communication_process_input_data(Context *ctx, ByteStreamReader *stream)
 			return;
 		}
 
-#ifdef APDU_DUMP
-		ioutil_buffer_to_file("apdu_dump", 5, (unsigned char *) "recv ", 1);
-		ioutil_buffer_to_file("apdu_dump", stream->unread_bytes, stream->buffer, 1);
-		ioutil_buffer_to_file("apdu_dump", 1, (unsigned char *) "\n", 1);
-#endif
+		capture_apdu(ctx->id, CAPTURE_IN, stream->buffer_cur,
+			     stream->unread_bytes);
+
+		stats_count(ctx, STATS_APDUS_IN, 1);
+		stats_count(ctx, STATS_BYTES_IN, stream->unread_bytes);
+		TRACE(TRACE_APDU_RECEIVED, ctx->id.plugin, ctx->id.connid,
+		      stream->buffer_cur, stream->unread_bytes);
 
 		// Decode the APDU
 		APDU apdu;
+		unsigned long long start = stats_now_ns();
 		decode_apdu(stream, &apdu, &error);
+		stats_record_time(ctx, STATS_DECODE_TIME, stats_now_ns() - start);
+
 		if (error) {
 			DEBUG("Invalid APDU, firing abort");
+			stats_count(ctx, STATS_DECODE_ERRORS, 1);
+			TRACE(TRACE_DECODE_ERROR, ctx->id.plugin, ctx->id.connid,
+			      NULL, 0);
 			communication_fire_evt(ctx, fsm_evt_req_assoc_abort, NULL);
 			return;
 		}
 
+		if (apdu.choice == ABRT_CHOSEN) {
+			stats_count(ctx, STATS_ABORTS_RECEIVED, 1);
+		}
+
 		// Process APDU
 		communication_process_apdu(ctx, &apdu);
 
@@ -665,6 +752,7 @@ void communication_fire_evt(Context *ctx, fsm_events evt, FSMEventData *data)
 	fsm_states previous = fsm->state;
 
 	if (fsm_process_evt(ctx, evt, data) == FSM_PROCESS_EVT_RESULT_STATE_CHANGED) {
+		stats_transition(ctx, fsm->state);
 		communication_notify_state_transition_evt(ctx, previous, fsm->state);
 	}
 
@@ -750,8 +838,6 @@ void communication_process_apdu(Context *ctx, APDU *apdu)
 	// thread-safe block - start
 	communication_lock(ctx);
 
-	DEBUG(" communication: current sm(%s) ", fsm_get_current_state_name(ctx->fsm));
-
 	if (ctx->type & AGENT_CONTEXT) {
 		communication_process_apdu_agent(ctx, apdu);
 	} else {
@@ -781,25 +867,24 @@ int communication_send_apdu(Context *ctx, APDU *apdu)
 	// thread-safe block - start
 	communication_lock(ctx);
 
-	DEBUG(" communication: sending APDU ");
-
 	ByteStreamWriter *encoded_apdu = NULL;
 	encoded_apdu = byte_stream_writer_instance(apdu->length + 4/*apdu header*/);
 
 	encode_apdu(encoded_apdu, apdu);
 
-#ifdef APDU_DUMP
-	ioutil_buffer_to_file("apdu_dump", 5, (unsigned char *) "send ", 1);
-	ioutil_buffer_to_file("apdu_dump", encoded_apdu->size, encoded_apdu->buffer, 1);
-	ioutil_buffer_to_file("apdu_dump", 1, (unsigned char *) "\n", 1);
-#endif
+	capture_apdu(ctx->id, CAPTURE_OUT, encoded_apdu->buffer,
+		     encoded_apdu->size);
+
+	stats_count(ctx, STATS_APDUS_OUT, 1);
+	stats_count(ctx, STATS_BYTES_OUT, encoded_apdu->size);
+	TRACE(TRACE_APDU_SENT, ctx->id.plugin, ctx->id.connid,
+	      encoded_apdu->buffer, encoded_apdu->size);
 
 	// send encoded_apdu bytes
 	int return_val = comm_plugin->network_send_apdu_stream(ctx, encoded_apdu);
 
 	del_byte_stream_writer(encoded_apdu, 1);
 
-	DEBUG(" communication: APDU sent ");
 	communication_unlock(ctx);
 	// thread-safe block - end
 
@@ -831,6 +916,7 @@ void communication_abort(Context *ctx, Abort_reason reason)
 	apdu.length = sizeof(ABRT_apdu);
 	apdu.u.abrt.reason = reason;
 
+	stats_count(ctx, STATS_ABORTS_SENT, 1);
 	communication_send_apdu(ctx, &apdu);
 
 	communication_unlock(ctx);
@@ -1059,6 +1145,8 @@ void communication_timeout(Context *ctx)
 	communication_lock(ctx);
 
 	if (ctx != NULL) {
+		stats_count(ctx, STATS_TIMEOUTS, 1);
+		TRACE(TRACE_TIMEOUT, ctx->id.plugin, ctx->id.connid, NULL, 0);
 		communication_fire_evt(ctx, fsm_evt_ind_timeout, NULL);
 		if (ctx->type & MANAGER_CONTEXT)
 			manager_notify_evt_timeout(ctx);
@@ -68,7 +68,8 @@ int communication_add_state_transition_listener(
 	fsm_states state,
 	communication_state_transition_handler_function listener_function);
 
-void communication_set_connection_listeners(comm_conn_cb cf, comm_disconn_cb df);
+void communication_set_connection_listeners(int type, comm_conn_cb cf,
+						comm_disconn_cb df);
 
 void communication_remove_connection_listeners();
 
@@ -429,6 +429,9 @@ ConfigResult configuring_perform_configuration_in(Context *ctx,
 
 		ConfigObjectList *object_list;
 
+		// the object table template is looked up by this id
+		ctx->mds->dev_configuration_id = config_report.config_report_id;
+
 		if (std_configurations_is_supported_standard(
 				    config_report.config_report_id)) {
 			DEBUG(" configuring: using standard configuration ");
@@ -32,6 +32,8 @@
 #ifndef CONTEXT_H_
 #define CONTEXT_H_
 
+#include <communication/stats.h>
+
 /**
  * \ingroup Communication
  * @{
@@ -133,6 +135,11 @@ typedef struct Context {
 	 */
 	int ref;
 
+	/**
+	 * Runtime statistics of this connection
+	 */
+	Stats stats;
+
 } Context;
 
 #define MANAGER_CONTEXT 1
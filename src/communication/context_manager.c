@@ -278,4 +278,31 @@ void context_iterate(context_handle function)
 	llist_iterate(context_list, (llist_handle_element) function);
 }
 
+/**
+ * @brief Iterate over all contexts, with the global lock held, and call
+ * function for each one. Contexts are not locked, and function must
+ * not lock them.
+ *
+ * @param function Handle function called at each iterated element.
+ * @param data argument passed to function.
+ */
+void context_iterate_data(context_handle_data function, void *data)
+{
+	LinkedNode *node;
+
+	gil_lock();
+
+	node = context_list ? context_list->first : NULL;
+
+	while (node != NULL) {
+		if (!function(node->element, data)) {
+			break;
+		}
+
+		node = node->next;
+	}
+
+	gil_unlock();
+}
+
 /** @} */
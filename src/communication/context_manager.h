@@ -39,11 +39,19 @@
  */
 typedef int (*context_handle)(Context *ctx);
 
+/**
+ * Function to handle context during an iteration, with an argument
+ * @return If function return 0, the iteration stops,
+ * if not it continues to next element.
+ */
+typedef int (*context_handle_data)(Context *ctx, void *data);
+
 Context *context_create(ContextId id, int type);
 void context_remove(ContextId id);
 void context_remove_all();
 Context *context_get_and_lock(ContextId id);
 void context_unlock(Context *ctx);
 void context_iterate(context_handle function);
+void context_iterate_data(context_handle_data function, void *data);
 
 #endif /* CONTEXT_MANAGER_H_ */
@@ -37,78 +37,155 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "src/util/bytelib.h"
 #include "src/communication/parser/encoder_ASN1.h"
 #include "src/communication/parser/decoder_ASN1.h"
-#include "src/util/bytelib.h"
 #include "src/communication/parser/struct_cleaner.h"
 #include "src/communication/communication.h"
+#include "src/dim/mds_template.h"
 #include "src/util/ioutil.h"
 #include "src/util/log.h"
 
 /**
- * Index file that lists saved configurations.
- * Internal structure is an encoded array of ExtConfig
+ * Store file that keeps all saved configurations.
+ *
+ * The file is mapped in memory. It starts with a struct ExtConfigHeader,
+ * which holds a hash table of record chains, followed by records
+ * (struct ExtConfigRecord) that are only ever appended. Registering a
+ * configuration again appends a new record, which shadows the old
+ * one because chains are searched from the newest record.
+ */
+#define EXT_CONFIG_FILE "ext_configs.db"
+
+/**
+ * Index file of the previous storage format, where each configuration
+ * was kept in a separate file. Imported into the store, then removed.
+ */
+#define EXT_CONFIG_LEGACY_FILE "config_list.bin"
+
+/**
+ * Magic number of the store file
+ */
+#define EXT_CONFIG_MAGIC "ANTXCF01"
+
+/**
+ * Written in native byte order, tells whether the store was
+ * created on a machine of the same endianness
+ */
+#define EXT_CONFIG_BYTE_ORDER 0x01020304
+
+/**
+ * Number of hash chains, must be a power of two
+ */
+#define EXT_CONFIG_BUCKETS 4096
+
+/**
+ * Initial size of the store file
  */
-#define EXT_CONFIG_FILE "config_list.bin"
+#define EXT_CONFIG_INITIAL_SIZE (64 * 1024)
 
 /**
- * Extended configuration structure.
- * The index file is an encoded array of this struct.
+ * Store file header
  */
-struct ExtConfig {
+struct ExtConfigHeader {
 	/**
-	 * System ID of device
+	 * EXT_CONFIG_MAGIC
 	 */
-	octet_string system_id;
+	char magic[8];
+	/**
+	 * EXT_CONFIG_BYTE_ORDER
+	 */
+	intu32 byte_order;
+	/**
+	 * EXT_CONFIG_BUCKETS
+	 */
+	intu32 buckets;
+	/**
+	 * Offset where the next record will be appended
+	 */
+	unsigned long long end;
+	/**
+	 * Number of records
+	 */
+	unsigned long long count;
+	/**
+	 * Offset of the newest record of each hash chain, 0 if empty
+	 */
+	unsigned long long heads[EXT_CONFIG_BUCKETS];
+};
+
+/**
+ * Record of a configuration. Followed by the system id bytes and
+ * the encoded ConfigObjectList, padded to a multiple of 8 bytes.
+ */
+struct ExtConfigRecord {
+	/**
+	 * Offset of the next (older) record of the hash chain, 0 if none
+	 */
+	unsigned long long next;
+	/**
+	 * Hash of system id and config id
+	 */
+	intu32 hash;
 	/**
 	 * Configuration ID (namespace = system id)
 	 */
 	ConfigId config_id;
 	/**
-	 * Configuration object size.
-	 * Every configuration is written in a separate file.
-	 * The index only knows (and checks) the size.
+	 * System ID length
+	 */
+	intu16 system_id_length;
+	/**
+	 * Encoded configuration object list size
+	 */
+	intu32 obj_size;
+	/**
+	 * \cond Undocumented
+	 */
+	intu32 reserved;
+	/**
+	 * \endcond
 	 */
-	intu16 obj_size;
 };
 
 /**
- * List of extended configurations in memory
- * Loaded from index file at startup
+ * Store file descriptor, -1 when not loaded
  */
-static struct ExtConfig *ext_configuration_list = NULL;
-
-// TODO use a LinkedList
+static int store_fd = -1;
 
 /**
- * Size of extended configuration list in memory
+ * Mapped store file, NULL when not loaded
  */
-static int ext_configuration_size = 0;
+static intu8 *store = NULL;
 
-static char *ext_configurations_get_file_name(octet_string *system_id,
-		ConfigId config_id);
-
-static void ext_configurations_write_file(octet_string *system_id,
-		ConfigId config_id, ByteStreamWriter *stream, int new);
+/**
+ * Size of the mapping (and of the file)
+ */
+static size_t store_size = 0;
 
-static struct ExtConfig *ext_configurations_get_config(
-	octet_string *system_id, ConfigId config_id);
+/**
+ * Mapped header
+ */
+#define STORE_HEADER ((struct ExtConfigHeader *) store)
 
 static void ext_configurations_create_environment();
 
 /**
- * Returns fully qualified index file name
+ * Returns fully qualified name of a file in configuration directory
+ *
+ * @param name file name
  * @return Heap-allocated of file name string
  */
-static char *ext_concat_path_file()
+static char *ext_concat_path_file(const char *name)
 {
 	char *tmp = ioutil_get_tmp();
-	char *path = calloc(strlen(tmp) + strlen(EXT_CONFIG_FILE) + 1,
-			    sizeof(char));
-	sprintf(path, "%s"EXT_CONFIG_FILE, tmp);
+	char *path = calloc(strlen(tmp) + strlen(name) + 1, sizeof(char));
+	sprintf(path, "%s%s", tmp, name);
 	free(tmp);
 	return path;
 }
@@ -130,31 +207,17 @@ static void ext_configurations_create_environment()
 		if (status != 0) {
 			ERROR("Unable to create configuration directory: %d", \
 			      errno);
-			return;
 		} else {
 			DEBUG("Configuration directory created");
 		}
 	}
 
 	free(config_path);
-
-	char *concat = ext_concat_path_file();
-
-	if (stat(concat, &st) != 0) {
-		FILE *fd = fopen(concat, "a+");
-		if (fd) {
-			fclose(fd);
-			DEBUG("Configuration file created");
-		} else {
-			DEBUG("Unable to create configuration file: %d", errno);
-		}
-	}
-
-	free(concat);
 }
 
 /**
- * Get the file name related to a system id/config id tuple
+ * Get the file name related to a system id/config id tuple,
+ * in the previous storage format
  * 
  * @param system_id system id of device
  * @param config_id id of extented configuration
@@ -162,226 +225,413 @@ static void ext_configurations_create_environment()
 static char *ext_configurations_get_file_name(octet_string *system_id,
 		ConfigId config_id)
 {
-	int length = 0;
 	char *config_path = ioutil_get_tmp();
-	length = length + strlen(config_path);
+	int length = strlen(config_path);
 	length = length + 2 * system_id->length; // each system_id element is "??"
 	length = length + 9; // "-????.bin"
 	length = length + 1; // "\0"
 
 	char *file_path = calloc(length, sizeof(char));
-	sprintf(file_path, "%s", config_path);
+	int pos = sprintf(file_path, "%s", config_path);
 	int i;
 
 	for (i = 0; i < system_id->length; i++) {
-		sprintf(file_path, "%s%.2x", file_path, system_id->value[i]);
+		pos += sprintf(file_path + pos, "%.2x", system_id->value[i]);
 	}
 
-	sprintf(file_path, "%s-%.4x.bin", file_path, config_id);
+	sprintf(file_path + pos, "-%.4x.bin", config_id);
 	free(config_path);
 	return file_path;
 }
 
 /**
- * This method destroys the list of available settings but maintains
- * persistent data for later use.
+ * Hashes a system id/config id tuple (FNV-1a)
  */
-void ext_configurations_destroy()
+static intu32 ext_configurations_hash(octet_string *system_id,
+				      ConfigId config_id)
 {
-	gil_lock();
-	if (ext_configuration_list != NULL) {
-		int index;
+	intu32 hash = 2166136261u;
+	int i;
 
-		for (index = 0; index < ext_configuration_size; index++) {
-			del_octet_string(&ext_configuration_list[index].system_id);
-		}
+	for (i = 0; i < system_id->length; i++) {
+		hash = (hash ^ system_id->value[i]) * 16777619u;
+	}
 
-		free(ext_configuration_list);
-		ext_configuration_list = NULL;
+	hash = (hash ^ (config_id >> 8)) * 16777619u;
+	hash = (hash ^ (config_id & 0xff)) * 16777619u;
+
+	return hash;
+}
 
-		ext_configuration_size = 0;
+/**
+ * Maps the first size bytes of the store file
+ *
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int store_map(size_t size)
+{
+	intu8 *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  store_fd, 0);
+
+	if (map == MAP_FAILED) {
+		ERROR("ext config: cannot map store: %d", errno);
+		return 0;
 	}
-	gil_unlock();
+
+	store = map;
+	store_size = size;
+
+	return 1;
 }
 
 /**
- * Removes all saved configurations from disk
+ * Unmaps and closes the store file.
+ * Must be called with gil locked.
  */
-void ext_configurations_remove_all_configs()
+static void store_close()
 {
-	int index;
+	if (store != NULL) {
+		munmap(store, store_size);
+		store = NULL;
+		store_size = 0;
+	}
 
-	gil_lock();
-	for (index = 0; index < ext_configuration_size; index++) {
-		octet_string system_id =
-			ext_configuration_list[index].system_id;
-		ConfigId config_id = ext_configuration_list[index].config_id;
-		char *file_path = ext_configurations_get_file_name(&system_id,
-				  config_id);
+	if (store_fd >= 0) {
+		close(store_fd);
+		store_fd = -1;
+	}
+}
 
-		if (remove(file_path) != 0) {
-			ERROR("\n[Error] Unable to remove file %s", file_path);
-		}
+/**
+ * Truncates the store file and writes an empty header.
+ * Must be called with gil locked and the file open.
+ *
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int store_init()
+{
+	if (store != NULL) {
+		munmap(store, store_size);
+		store = NULL;
+	}
 
-		free(file_path);
-		file_path = NULL;
+	if (ftruncate(store_fd, 0) != 0
+	    || ftruncate(store_fd, EXT_CONFIG_INITIAL_SIZE) != 0) {
+		ERROR("ext config: cannot size store: %d", errno);
+		return 0;
+	}
+
+	if (!store_map(EXT_CONFIG_INITIAL_SIZE)) {
+		return 0;
 	}
-	gil_unlock();
 
-	char *concat = ext_concat_path_file();
+	memcpy(STORE_HEADER->magic, EXT_CONFIG_MAGIC, sizeof(STORE_HEADER->magic));
+	STORE_HEADER->byte_order = EXT_CONFIG_BYTE_ORDER;
+	STORE_HEADER->buckets = EXT_CONFIG_BUCKETS;
+	STORE_HEADER->end = sizeof(struct ExtConfigHeader);
+	STORE_HEADER->count = 0;
 
-	if (remove(concat) != 0) {
-		ERROR("\n[Error] Unable to remove file %s", concat);
+	return 1;
+}
+
+/**
+ * Makes room for appending bytes to the store, growing the file
+ * geometrically. Must be called with gil locked.
+ *
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int store_reserve(size_t bytes)
+{
+	size_t needed = STORE_HEADER->end + bytes;
+	size_t size = store_size;
+
+	if (needed <= store_size) {
+		return 1;
 	}
 
-	free(concat);
+	while (size < needed) {
+		size *= 2;
+	}
+
+	if (ftruncate(store_fd, size) != 0) {
+		ERROR("ext config: cannot grow store: %d", errno);
+		return 0;
+	}
 
-	ext_configurations_destroy();
+	munmap(store, store_size);
+	store = NULL;
+
+	return store_map(size);
 }
 
 /**
- * This method wipes the ext config index file
+ * Returns the system id bytes of a record
  */
-static void ext_configurations_wipe()
+static intu8 *record_system_id(struct ExtConfigRecord *record)
 {
-	ext_configurations_create_environment();
-	ByteStreamWriter *stream = byte_stream_writer_instance(0);
-	char *concat = ext_concat_path_file();
-	ioutil_buffer_to_file(concat, stream->size, stream->buffer, 0);
-	free(concat);
-	del_byte_stream_writer(stream, 1);
-	
-	DEBUG("wiped ext config file");
+	return (intu8 *) (record + 1);
 }
 
+/**
+ * Returns the encoded configuration of a record
+ */
+static intu8 *record_object(struct ExtConfigRecord *record)
+{
+	return record_system_id(record) + record->system_id_length;
+}
 
 /**
- * This method loads the list of available configurations.
+ * Finds the newest record of a configuration.
+ * Must be called with gil locked.
+ *
+ * @param system_id System ID (device identification)
+ * @param config_id Extended configuration ID
+ * @return the record or NULL if not found (or store not loaded)
  */
-void ext_configurations_load_configurations()
+static struct ExtConfigRecord *store_find(octet_string *system_id,
+		ConfigId config_id)
 {
-	ext_configurations_create_environment();
+	struct ExtConfigRecord *record;
+	unsigned long long offset;
+	unsigned long long end;
+	intu32 hash;
 
-	unsigned long buffer_size = 0;
-	ByteStreamReader *stream = 0;
-	char *concat = ext_concat_path_file();
-	unsigned char *buffer = ioutil_buffer_from_file(concat, &buffer_size);
-	free(concat);
+	if (store == NULL) {
+		return NULL;
+	}
 
-	if (!buffer) {
-		DEBUG("No ext config buffer to read");
-		goto exit;
+	end = STORE_HEADER->end;
+	hash = ext_configurations_hash(system_id, config_id);
+	offset = STORE_HEADER->heads[hash & (EXT_CONFIG_BUCKETS - 1)];
+
+	// offsets beyond end belong to an interrupted append
+	while (offset >= sizeof(struct ExtConfigHeader)
+	       && offset + sizeof(struct ExtConfigRecord) <= end) {
+		record = (struct ExtConfigRecord *) (store + offset);
+
+		// do not trust sizes read from the file
+		if (offset + sizeof(struct ExtConfigRecord)
+		    + record->system_id_length + record->obj_size > end) {
+			WARNING("ext config: corrupted record at %llu", offset);
+			return NULL;
+		}
+
+		if (record->hash == hash && record->config_id == config_id
+		    && record->system_id_length == system_id->length
+		    && memcmp(record_system_id(record), system_id->value,
+			      system_id->length) == 0) {
+			return record;
+		}
+
+		// records are appended, so chains always go backwards
+		if (record->next >= offset) {
+			WARNING("ext config: corrupted chain at %llu", offset);
+			return NULL;
+		}
+
+		offset = record->next;
 	}
 
-	stream = byte_stream_reader_instance(buffer, buffer_size);
-	if (!stream) {
-		DEBUG("Zero-sized ext config buffer");
-		goto exit;
+	return NULL;
+}
+
+/**
+ * Appends a configuration to the store.
+ * Must be called with gil locked.
+ *
+ * @param system_id System ID (device identification)
+ * @param config_id Extended configuration ID
+ * @param data encoded configuration object list
+ * @param size size of data
+ */
+static void store_append(octet_string *system_id, ConfigId config_id,
+			 intu8 *data, intu32 size)
+{
+	struct ExtConfigRecord *record;
+	unsigned long long offset;
+	intu32 bucket;
+	size_t length;
+
+	if (store == NULL) {
+		return;
 	}
 
-	gil_lock();
-	if (ext_configuration_list != NULL) {
-		free(ext_configuration_list);
-		ext_configuration_list = NULL;
-		ext_configuration_size = 0;
+	length = sizeof(struct ExtConfigRecord) + system_id->length + size;
+	length = (length + 7) & ~((size_t) 7);
+
+	if (!store_reserve(length)) {
+		return;
 	}
 
-	ext_configuration_list = calloc(0, sizeof(struct ExtConfig));
-	ext_configuration_size = 0;
-	gil_unlock();
+	offset = STORE_HEADER->end;
+	record = (struct ExtConfigRecord *) (store + offset);
+	memset(record, 0, length);
 
-	while (stream->unread_bytes > 0) {
-		int i = ext_configuration_size;
-		int error = 0;
+	record->hash = ext_configurations_hash(system_id, config_id);
+	record->config_id = config_id;
+	record->system_id_length = system_id->length;
+	record->obj_size = size;
+	memcpy(record_system_id(record), system_id->value, system_id->length);
+	memcpy(record_object(record), data, size);
 
-		int config_id = read_intu16(stream, &error);
-		if (error) {
-			DEBUG("ext config: err reading config_id %d", i);
-			ext_configurations_wipe();
-			break;
-		}
+	bucket = record->hash & (EXT_CONFIG_BUCKETS - 1);
+	record->next = STORE_HEADER->heads[bucket];
+
+	// the record is complete before it becomes reachable
+	STORE_HEADER->end = offset + length;
+	STORE_HEADER->heads[bucket] = offset;
+	STORE_HEADER->count++;
+}
+
+/**
+ * Imports configurations saved in the previous storage format,
+ * one file per configuration plus an index, and removes the files.
+ * Must be called with gil locked.
+ */
+static void ext_configurations_import_legacy()
+{
+	unsigned long buffer_size = 0;
+	ByteStreamReader *stream;
+	unsigned char *buffer;
+	struct stat st;
+	char *concat = ext_concat_path_file(EXT_CONFIG_LEGACY_FILE);
+
+	if (stat(concat, &st) != 0) {
+		free(concat);
+		return;
+	}
 
-		DEBUG("Decoding ext config id %x", config_id);
+	buffer = ioutil_buffer_from_file(concat, &buffer_size);
+
+	stream = byte_stream_reader_instance(buffer, buffer_size);
 
+	while (stream && stream->unread_bytes > 0) {
+		int error = 0;
 		octet_string system_id = {0, 0};
-		decode_octet_string(stream, &system_id, &error);
-		if (error) {
-			DEBUG("ext config: err reading system_id %d %d", i, error);
-				ext_configurations_wipe();
-				break;
-			}
 
-		int obj_size = read_intu16(stream, &error);
+		ConfigId config_id = read_intu16(stream, &error);
+
+		if (!error) {
+			decode_octet_string(stream, &system_id, &error);
+		}
+
+		intu16 obj_size = error ? 0 : read_intu16(stream, &error);
+
 		if (error) {
-			DEBUG("ext config: err reading obj_size %d", i);
+			DEBUG("ext config: bad legacy index");
 			del_octet_string(&system_id);
-			ext_configurations_wipe();
 			break;
 		}
 
-		gil_lock();
-		ext_configuration_list = realloc(ext_configuration_list,
-			++ext_configuration_size * sizeof(struct ExtConfig));
+		char *file_path = ext_configurations_get_file_name(&system_id,
+				  config_id);
+		unsigned long size = 0;
+		intu8 *obj = ioutil_buffer_from_file(file_path, &size);
 
-		ext_configuration_list[i].config_id = config_id;
-		ext_configuration_list[i].system_id = system_id;
-		ext_configuration_list[i].obj_size = obj_size;
-		gil_unlock();
+		if (obj != NULL && size == obj_size) {
+			DEBUG("ext config: importing %x", config_id);
+			store_append(&system_id, config_id, obj, size);
+		}
+
+		remove(file_path);
+		free(file_path);
+		free(obj);
+		del_octet_string(&system_id);
 	}
 
-exit:
-	free(buffer);
 	free(stream);
+	free(buffer);
+	remove(concat);
+	free(concat);
 }
 
 /**
- * Write extended configuration to disk
- *
- * @param system_id System ID (device identification)
- * @param config_id Extended configuration ID
- * @param stream Stream of bytes with encoded configuration
- * @param new If not 0, indicates that config id was unknown
- *        Otherwise, overwrites old saved config with same ID
+ * This method destroys the list of available settings but maintains
+ * persistent data for later use.
  */
-static void ext_configurations_write_file(octet_string *system_id,
-		ConfigId config_id, ByteStreamWriter *stream,
-		int new)
+void ext_configurations_destroy()
 {
-	if (new) {
-		// appends data to index file
-		int size = 2 + sizeof(ConfigId) +
-			sizeof(system_id->length) + system_id->length +
-			2;
-
-		ByteStreamWriter *header_stream = byte_stream_writer_instance(size);
-
-		encode_configid(header_stream, &config_id); // 2
-		encode_octet_string(header_stream, system_id); // 2 + len
-		write_intu16(header_stream, stream->size); // 2 (size of config)
-	
-		char *concat = ext_concat_path_file();
-		int err = ioutil_buffer_to_file(concat, header_stream->size,
-					     header_stream->buffer, 1);
-		free(concat);
-		del_byte_stream_writer(header_stream, 1);
+	gil_lock();
+	store_close();
+	gil_unlock();
+
+	mds_template_clear();
+}
+
+/**
+ * Removes all saved configurations from disk
+ */
+void ext_configurations_remove_all_configs()
+{
+	char *concat = ext_concat_path_file(EXT_CONFIG_FILE);
+
+	gil_lock();
+	store_close();
 
-		if (err) {
-			ERROR("error writing ext config index");
-			return;
+	if (remove(concat) != 0 && errno != ENOENT) {
+		ERROR("\n[Error] Unable to remove file %s", concat);
+	}
+
+	gil_unlock();
+
+	mds_template_clear();
+
+	free(concat);
+}
+
+/**
+ * This method loads the store of saved configurations. The store is
+ * only mapped, so the cost does not depend on how many configurations
+ * it holds.
+ */
+void ext_configurations_load_configurations()
+{
+	struct stat st;
+	char *concat;
+	int fresh;
+
+	ext_configurations_create_environment();
+	concat = ext_concat_path_file(EXT_CONFIG_FILE);
+
+	gil_lock();
+	store_close();
+
+	store_fd = open(concat, O_RDWR | O_CREAT, 0600);
+
+	if (store_fd < 0 || fstat(store_fd, &st) != 0) {
+		ERROR("ext config: cannot open %s: %d", concat, errno);
+		store_close();
+		goto exit;
+	}
+
+	fresh = st.st_size < (off_t) sizeof(struct ExtConfigHeader);
+
+	if (!fresh && store_map(st.st_size)) {
+		if (memcmp(STORE_HEADER->magic, EXT_CONFIG_MAGIC,
+			   sizeof(STORE_HEADER->magic)) != 0
+		    || STORE_HEADER->byte_order != EXT_CONFIG_BYTE_ORDER
+		    || STORE_HEADER->buckets != EXT_CONFIG_BUCKETS
+		    || STORE_HEADER->end < sizeof(struct ExtConfigHeader)
+		    || STORE_HEADER->end > store_size) {
+			ERROR("ext config: invalid store, wiping it");
+			fresh = 1;
 		}
 	}
 
-	// writes particular config+device file
-	char *file_path =
-		ext_configurations_get_file_name(system_id, config_id);
-	int err = ioutil_buffer_to_file(file_path, stream->size,
-					     stream->buffer, 0);
-	free(file_path);
-	file_path = NULL;
+	if (fresh || store == NULL) {
+		if (!store_init()) {
+			store_close();
+			goto exit;
+		}
 
-	if (err) {
-		ERROR("error writing ext config file");
+		ext_configurations_import_legacy();
 	}
+
+	DEBUG("ext config: %llu configurations in store", STORE_HEADER->count);
+
+exit:
+	gil_unlock();
+	free(concat);
 }
 
 /**
@@ -396,11 +646,10 @@ static void ext_configurations_write_file(octet_string *system_id,
 void ext_configurations_register_conf(octet_string *system_id,
 				      ConfigId config_id, ConfigObjectList *object_list)
 {
-	int new;
 	int empty;
 
 	gil_lock();
-	empty = (ext_configuration_list == NULL);
+	empty = (store == NULL);
 	gil_unlock();
 
 	if (empty) {
@@ -409,91 +658,30 @@ void ext_configurations_register_conf(octet_string *system_id,
 
 	int size = object_list->length + 2 * sizeof(object_list->count);
 	ByteStreamWriter *stream = byte_stream_writer_instance(size);
-	DEBUG("Encoding %x to index", config_id);
+	DEBUG("Encoding %x to store", config_id);
 	encode_configobjectlist(stream, object_list);
 
-	struct ExtConfig *cfg = ext_configurations_get_config(system_id, config_id);
-	if (!cfg) {
-		int error = 0;
-		DEBUG("Adding new ext config %x to index", config_id);
-		new = 1;
-		gil_lock();
-		ext_configuration_size++;
-		ext_configuration_list = realloc(ext_configuration_list,
-					 ext_configuration_size * sizeof(struct ExtConfig));
-		cfg = &(ext_configuration_list[ext_configuration_size - 1]);
-
-		cfg->config_id = config_id;
-
-		size = system_id->length * sizeof(intu8) + sizeof(intu16);
-		ByteStreamWriter *w_stream = byte_stream_writer_instance(size);
-		encode_octet_string(w_stream, system_id);
-
-		ByteStreamReader *r_stream = byte_stream_reader_instance(w_stream->buffer, size);
-		// used just to alloc system_id into cfg; won't fail.
-		decode_octet_string(r_stream, &cfg->system_id, &error);
-
-		del_byte_stream_writer(w_stream, 1);
-		free(r_stream);
-		gil_unlock();
-	} else {
-		DEBUG("Updating ext config");
-		new = 0;
+	gil_lock();
+	struct ExtConfigRecord *record = store_find(system_id, config_id);
+	int changed = 0;
+
+	if (record == NULL || record->obj_size != stream->size
+	    || memcmp(record_object(record), stream->buffer, stream->size) != 0) {
+		DEBUG("Adding ext config %x to store", config_id);
+		store_append(system_id, config_id, stream->buffer, stream->size);
+		changed = 1;
 	}
 
-	ext_configurations_write_file(system_id, config_id, stream, new);
-
-	cfg->obj_size = stream->size;
+	gil_unlock();
 
-	if (ext_configuration_list == NULL) {
-		ERROR("ext configuration list is null");
+	if (changed) {
+		// objects built from the old configuration are stale
+		mds_template_invalidate(system_id, config_id);
 	}
 
 	del_byte_stream_writer(stream, 1);
 }
 
-/**
- * Get extended configuration for a given system and config id
- *
- * @param system_id System ID (device identification)
- * @param config_id Extended configuration ID
- * @return Extended configuration structure or NULL if not found
- */
-static struct ExtConfig *ext_configurations_get_config(octet_string *system_id,
-		ConfigId config_id) {
-	int index;
-	
-	gil_lock();
-
-	for (index = 0; index < ext_configuration_size; index++) {
-		ConfigId selected_conf_id =
-			ext_configuration_list[index].config_id;
-		octet_string selected_sys_id =
-			ext_configuration_list[index].system_id;
-
-		if (selected_conf_id == config_id && selected_sys_id.length
-		    == system_id->length) {
-			int i = 0;
-			int is_different = 0;
-
-			while (i < selected_sys_id.length && is_different == 0) {
-				is_different |= selected_sys_id.value[i]
-						!= system_id->value[i];
-				i++;
-			}
-
-			if (is_different == 0) {
-				gil_unlock();
-				return &ext_configuration_list[index];
-			}
-		}
-	}
-
-	gil_unlock();
-
-	return NULL;
-}
-
 /**
  * Return true if the configuration described in the config_report
  * parameter is known.
@@ -507,11 +695,18 @@ static struct ExtConfig *ext_configurations_get_config(octet_string *system_id,
 int ext_configurations_is_supported_standard(octet_string *system_id,
 		ConfigId config_id)
 {
-	return ext_configurations_get_config(system_id, config_id) != NULL;
+	int found;
+
+	gil_lock();
+	found = store_find(system_id, config_id) != NULL;
+	gil_unlock();
+
+	return found;
 }
 
 /**
  * This method return the Extended Configuration that was recorded.
+ * It is decoded straight from the mapped store.
  *
  * @param system_id Identify the agent;
  * @param config_id Identify the configuration described in the
@@ -522,46 +717,35 @@ int ext_configurations_is_supported_standard(octet_string *system_id,
 ConfigObjectList *ext_configurations_get_configuration_attributes(
 	octet_string *system_id, ConfigId config_id)
 {
+	ConfigObjectList *result = NULL;
+	struct ExtConfigRecord *record;
 
-	struct ExtConfig *config = ext_configurations_get_config(system_id,
-				   config_id);
-
-	if (config != NULL) {
-		ConfigId selected_cfg_id = config->config_id;
-		octet_string selected_sys_id = config->system_id;
-		unsigned long size = config->obj_size;
+	gil_lock();
+	record = store_find(system_id, config_id);
 
-		char *file_path = ext_configurations_get_file_name(
-					  &selected_sys_id, selected_cfg_id);
-		intu8 *buffer = ioutil_buffer_from_file(file_path, &size);
+	if (record != NULL) {
+		ByteStreamReader *stream = byte_stream_reader_instance(
+						   record_object(record), record->obj_size);
+		int error = stream == NULL;
 
-		free(file_path);
-		file_path = NULL;
+		result = malloc(sizeof(ConfigObjectList));
 
-		if (buffer == NULL) {
-			ERROR("ext_config_get could not read from file");
-			return NULL;
-		} else if (size != config->obj_size) {
-			ERROR("ext_config_get: bad obj size");
-			free(buffer);
-			return NULL;
-		} else {
-			ConfigObjectList *result = malloc(sizeof(ConfigObjectList));
-			ByteStreamReader *stream = byte_stream_reader_instance(buffer, size);
-			int error = 0;
+		if (!error) {
 			decode_configobjectlist(stream, result, &error);
-			if (error) {
-				ERROR("ext_config_get: bad configuration data");
-				free(result);
-				result = NULL;
-			}
-			free(stream);
-			free(buffer);
-			return result;
 		}
+
+		if (error) {
+			ERROR("ext_config_get: bad configuration data");
+			free(result);
+			result = NULL;
+		}
+
+		free(stream);
 	}
 
-	return NULL;
+	gil_unlock();
+
+	return result;
 }
 
 /** @} */
@@ -48,6 +48,7 @@
 #include "src/communication/operating.h"
 #include "src/communication/agent_ops.h"
 #include "src/util/log.h"
+#include "src/util/trace.h"
 
 static char *fsm_state_strings[] = {
 	"disconnected",
@@ -424,7 +425,8 @@ FSM_PROCESS_EVT_STATUS fsm_process_evt(FSMContext *ctx, fsm_events evt, FSMEvent
 {
 	FSM *fsm = ctx->fsm;
 
-	DEBUG(" state machine(<%s>): process event <%s> ", fsm_state_to_string(fsm->state), fsm_event_to_string(evt));
+	intu8 trace_data[3] = {fsm->state, evt, 0};
+	TRACE(TRACE_FSM_EVENT, ctx->id.plugin, ctx->id.connid, trace_data, 2);
 
 	int i;
 	FsmTransitionRule *rule = NULL;
@@ -439,8 +441,10 @@ FSM_PROCESS_EVT_STATUS fsm_process_evt(FSMContext *ctx, fsm_events evt, FSMEvent
 
 
 			// Make transition
-			DEBUG(" state machine(<%s>): transition to <%s> ",
-				fsm_state_to_string(fsm->state), fsm_state_to_string(rule->nextState));
+			trace_data[1] = rule->nextState;
+			trace_data[2] = evt;
+			TRACE(TRACE_FSM_TRANSITION, ctx->id.plugin, ctx->id.connid,
+			      trace_data, 3);
 
 
 			fsm->state = rule->nextState;
@@ -492,24 +492,12 @@ void operating_event_report(Context *ctx, fsm_events evt, FSMEventData *data)
 		time = data_apdu->message.u.roiv_cmipConfirmedEventReport.event_time;
 	}
 
-	if (handle == 0) {
-		if (!operating_decode_mds_event(ctx, type, &event)) {
-			data->choice = FSM_EVT_DATA_ERROR_RESULT;
-			data->u.error_result.error_value = NO_SUCH_ACTION;
-			data->u.error_result.parameter.length = 0;
-			data->u.error_result.parameter.value = 0;
-			communication_roer_tx(ctx, evt, data);
-		}
-	} else {
-		struct MDS_object *obj = mds_get_object_by_handle(ctx->mds, handle);
-
-		if (obj != NULL && obj->choice == MDS_OBJ_SCANNER) {
-			if (obj->u.scanner.choice == EPI_CFG_SCANNER) {
-				operating_decode_epi_scan_event(ctx, &obj->u.scanner.u.epi_cfg_scanner, type, &event);
-			} else if (obj->u.scanner.choice == PERI_CFG_SCANNER) {
-				operating_decode_peri_scan_event(ctx, &obj->u.scanner.u.peri_cfg_scanner, type, &event);
-			}
-		}
+	if (!operating_decode_event(ctx, handle, type, &event)) {
+		data->choice = FSM_EVT_DATA_ERROR_RESULT;
+		data->u.error_result.error_value = NO_SUCH_ACTION;
+		data->u.error_result.parameter.length = 0;
+		data->u.error_result.parameter.value = 0;
+		communication_roer_tx(ctx, evt, data);
 	}
 
 	// If confirmed event report, send the confirmation
@@ -533,6 +521,40 @@ void operating_event_report(Context *ctx, fsm_events evt, FSMEventData *data)
 	}
 }
 
+/**
+ * Decodes the information of an incoming event report and updates
+ * the MDS, notifying measurement data to the manager listeners.
+ *
+ * Events of MDS (handle 0) and scanner objects are handled; events of
+ * other objects are silently ignored.
+ *
+ * @param ctx
+ * @param handle Object handle of the event source.
+ * @param type Event type.
+ * @param event Event information.
+ * @return 0 if an MDS event type is not supported, 1 otherwise.
+ */
+int operating_decode_event(Context *ctx, ASN1_HANDLE handle, OID_Type type, Any *event)
+{
+	struct MDS_object *obj;
+
+	if (handle == 0) {
+		return operating_decode_mds_event(ctx, type, event);
+	}
+
+	obj = mds_get_object_by_handle(ctx->mds, handle);
+
+	if (obj != NULL && obj->choice == MDS_OBJ_SCANNER) {
+		if (obj->u.scanner.choice == EPI_CFG_SCANNER) {
+			operating_decode_epi_scan_event(ctx, &obj->u.scanner.u.epi_cfg_scanner, type, event);
+		} else if (obj->u.scanner.choice == PERI_CFG_SCANNER) {
+			operating_decode_peri_scan_event(ctx, &obj->u.scanner.u.peri_cfg_scanner, type, event);
+		}
+	}
+
+	return 1;
+}
+
 /**
  * Assembles and send event report response.
  *
@@ -1429,12 +1451,18 @@ int operating_decode_segment_data_event(Context *ctx, InvokeIDType invoke_id, AS
 		RelativeTime currentTime, OID_Type event_type, Any *event)
 {
 	int error = 0;
+	int ok = 0;
 	SegmentDataEvent segm_data_event;
 	SegmentDataResult result;
+	struct PMStore *pmstore = NULL;
 
 	struct MDS_object *mds_obj;
 	mds_obj = mds_get_object_by_handle(ctx->mds, obj_handle);
 
+	if (mds_obj && mds_obj->choice == MDS_OBJ_PMSTORE) {
+		pmstore = &(mds_obj->u.pmstore);
+	}
+
 	ByteStreamReader *event_data_stream = byte_stream_reader_instance(event->value, event->length);
 	decode_segmentdataevent(event_data_stream, &segm_data_event, &error);
 	free(event_data_stream);
@@ -1448,9 +1476,9 @@ int operating_decode_segment_data_event(Context *ctx, InvokeIDType invoke_id, AS
 	result.segm_data_event_descr.segm_evt_status = SEVTSTA_MANAGER_ABORT;
 
 	if (!(segm_data_event.segm_data_event_descr.segm_evt_status & SEVTSTA_AGENT_ABORT) &&
-			mds_obj && mds_obj->choice == MDS_OBJ_PMSTORE) {
+			pmstore) {
 
-		int ok = pmstore_segment_data_event(ctx, &(mds_obj->u.pmstore), segm_data_event);
+		ok = pmstore_segment_data_event(ctx, pmstore, segm_data_event);
 		if (ok) {
 			result.segm_data_event_descr.segm_evt_status = SEVTSTA_MANAGER_CONFIRM;
 		}
@@ -1458,9 +1486,15 @@ int operating_decode_segment_data_event(Context *ctx, InvokeIDType invoke_id, AS
 
 	del_segmentdataevent(&segm_data_event);
 
+	// Confirm before decoding, so the agent sends the next entries meanwhile
 	operating_segment_data_event_response_tx(ctx, invoke_id, obj_handle,
 			currentTime, event_type, result);
 
+	if (pmstore) {
+		pmstore_segment_data_decode(ctx, pmstore,
+				segm_data_event.segm_data_event_descr, ok);
+	}
+
 	return 1;
 }
 /** @} */
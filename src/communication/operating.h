@@ -87,6 +87,8 @@ void operating_assoc_release_req_tx(Context *ctx, fsm_events evt, FSMEventData *
 
 int operating_decode_mds_event(Context *ctx, OID_Type event_type, Any *event);
 
+int operating_decode_event(Context *ctx, ASN1_HANDLE handle, OID_Type type, Any *event);
+
 void operating_decode_segment_info(struct MDS *mds, Any *event, ASN1_HANDLE obj_handle, Request *r,
 					int errtype, int err);
 
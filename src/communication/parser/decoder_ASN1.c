@@ -91,8 +91,21 @@
 
 #define CHILDREN(typeU, type) CHILDREN_GENERIC(typeU, DECODE_FUNCTION(type))
 #define CHILDREN16(typeU) CHILDREN_GENERIC(typeU, PRIM_FUNCTION(read_intu16))
-#define CHILDREN_FLOAT(typeU) CHILDREN_GENERIC(typeU, PRIM_FUNCTION(read_float))
-#define CHILDREN_SFLOAT(typeU) CHILDREN_GENERIC(typeU, PRIM_FUNCTION(read_sfloat))
+
+#define CHILDREN_MANY(typeU, readfunction)						\
+	if (pointer->count > 0) {							\
+		pointer->value = (typeU *) calloc(pointer->count, sizeof(typeU));	\
+											\
+		if (pointer->value == NULL) {						\
+			ERROR("memory full");						\
+			goto fail;							\
+		}									\
+											\
+		CHK(readfunction(stream, pointer->value, pointer->count, error));	\
+	}
+
+#define CHILDREN_FLOAT(typeU) CHILDREN_MANY(typeU, read_float_many)
+#define CHILDREN_SFLOAT(typeU) CHILDREN_MANY(typeU, read_sfloat_many)
 
 #define EPILOGUE(name) 			\
 	return; 			\
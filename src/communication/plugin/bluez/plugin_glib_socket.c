@@ -275,7 +275,6 @@ static gboolean network_read_apdu(GIOChannel *source, GIOCondition condition,
 		}
 
 		DEBUG(" glib socket: APDU received ");
-		ioutil_print_buffer(stream->buffer_cur, apdu_size);
 
 		ContextId id = {plugin_id, conn_id};
 		Context *ctx = context_get_and_lock(id);
@@ -477,7 +476,6 @@ static int network_send_apdu_stream(Context *ctx, ByteStreamWriter *stream)
 		}
 
 		DEBUG(" network:tcp APDU sent ");
-		ioutil_print_buffer(stream->buffer, stream->size);
 		return TCP_ERROR_NONE;
 
 	}
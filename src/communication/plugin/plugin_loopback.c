@@ -0,0 +1,651 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file plugin_loopback.c
+ * \brief In-process loopback plugin source.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 14, 2011
+ */
+
+/**
+ * @addtogroup LoopbackPlugin
+ *
+ * \brief Links manager and agent contexts living in the same process.
+ *
+ * Each connection is a pair of in-memory APDU queues, one per direction.
+ * Sending an APDU only copies it to the peer queue; nothing is processed
+ * until the application calls plugin_network_loopback_pump(), so runs are
+ * deterministic and free of system calls. The plugin is single-threaded:
+ * use it with the stub thread functions and drive it from one thread.
+ *
+ * The agent side is optional. Without it, APDUs can be fed to the manager
+ * with plugin_network_loopback_inject() and manager output is discarded.
+ *
+ * @{
+ */
+
+#include "src/communication/communication.h"
+#include "src/communication/plugin/plugin_loopback.h"
+#include "src/util/log.h"
+#include "src/util/linkedlist.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \cond Undocumented
+ */
+static const int LOOPBACK_ERROR = NETWORK_ERROR;
+static const int LOOPBACK_ERROR_NONE = NETWORK_ERROR_NONE;
+/**
+ * \endcond
+ */
+
+/**
+ * Plugin ID attributed by stack to the manager side
+ */
+static unsigned int manager_plugin_id = 0;
+
+/**
+ * Plugin ID attributed by stack to the agent side
+ */
+static unsigned int agent_plugin_id = 0;
+
+/**
+ * Whether an agent-side plugin has been set up
+ */
+static int has_agent = 0;
+
+/**
+ * Queued APDU
+ */
+typedef struct LoopbackApdu {
+	/**
+	 * Encoded APDU, owned by the queue
+	 */
+	intu8 *buffer;
+
+	/**
+	 * APDU length
+	 */
+	intu32 size;
+
+	/**
+	 * Next queued APDU
+	 */
+	struct LoopbackApdu *next;
+} LoopbackApdu;
+
+/**
+ * FIFO of APDUs travelling in one direction
+ */
+typedef struct LoopbackQueue {
+	/**
+	 * Oldest APDU
+	 */
+	LoopbackApdu *head;
+
+	/**
+	 * Newest APDU
+	 */
+	LoopbackApdu *tail;
+} LoopbackQueue;
+
+/**
+ * Loopback connection
+ */
+typedef struct LoopbackChannel {
+	/**
+	 * Connection ID, shared by both sides
+	 */
+	unsigned long long connid;
+
+	/**
+	 * Connected status
+	 */
+	int connected;
+
+	/**
+	 * APDUs sent by agent, waiting for manager
+	 */
+	LoopbackQueue to_manager;
+
+	/**
+	 * APDUs sent by manager, waiting for agent
+	 */
+	LoopbackQueue to_agent;
+} LoopbackChannel;
+
+/**
+ * List of the connections
+ */
+static LinkedList *channels = NULL;
+
+/**
+ * \cond Undocumented
+ */
+static int search_channel_by_connid(void *arg, void *element)
+{
+	unsigned long long connid = *((unsigned long long *) arg);
+	LoopbackChannel *ch = (LoopbackChannel *) element;
+
+	if (ch == NULL) {
+		return 0;
+	}
+
+	return connid == ch->connid;
+}
+/**
+ * \endcond
+ */
+
+/**
+ * Gets a channel
+ *
+ * @param connid connection ID
+ * @return the channel or NULL
+ */
+static LoopbackChannel *get_channel(unsigned long long connid)
+{
+	return (LoopbackChannel *) llist_search_first(channels, &connid,
+			&search_channel_by_connid);
+}
+
+/**
+ * Appends a copy of buffer to queue
+ *
+ * @param queue the queue
+ * @param buffer APDU bytes
+ * @param size APDU length
+ * @return LOOPBACK_ERROR_NONE if ok
+ */
+static int queue_push(LoopbackQueue *queue, intu8 *buffer, intu32 size)
+{
+	LoopbackApdu *item = malloc(sizeof(LoopbackApdu));
+
+	if (item == NULL) {
+		return LOOPBACK_ERROR;
+	}
+
+	item->buffer = malloc(size);
+
+	if (item->buffer == NULL) {
+		free(item);
+		return LOOPBACK_ERROR;
+	}
+
+	memcpy(item->buffer, buffer, size);
+	item->size = size;
+	item->next = NULL;
+
+	if (queue->tail) {
+		queue->tail->next = item;
+	} else {
+		queue->head = item;
+	}
+
+	queue->tail = item;
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/**
+ * Removes oldest APDU from queue
+ *
+ * @param queue the queue
+ * @return the APDU (caller gets ownership) or NULL if queue is empty
+ */
+static LoopbackApdu *queue_pop(LoopbackQueue *queue)
+{
+	LoopbackApdu *item = queue->head;
+
+	if (item) {
+		queue->head = item->next;
+
+		if (queue->head == NULL) {
+			queue->tail = NULL;
+		}
+	}
+
+	return item;
+}
+
+/**
+ * Discards all APDUs in queue
+ *
+ * @param queue the queue
+ */
+static void queue_clear(LoopbackQueue *queue)
+{
+	LoopbackApdu *item;
+
+	while ((item = queue_pop(queue))) {
+		free(item->buffer);
+		free(item);
+	}
+}
+
+/**
+ * Destroys a channel (list element handler)
+ *
+ * @param element LoopbackChannel pointer
+ * @return 1
+ */
+static int destroy_channel(void *element)
+{
+	LoopbackChannel *ch = (LoopbackChannel *) element;
+
+	if (ch) {
+		queue_clear(&ch->to_manager);
+		queue_clear(&ch->to_agent);
+		free(ch);
+	}
+
+	return 1;
+}
+
+/**
+ * Gets the queue a context reads from
+ *
+ * @param ch channel
+ * @param ctx context
+ * @return incoming queue
+ */
+static LoopbackQueue *incoming_queue(LoopbackChannel *ch, Context *ctx)
+{
+	if (ctx->id.plugin == manager_plugin_id) {
+		return &ch->to_manager;
+	}
+
+	return &ch->to_agent;
+}
+
+/**
+ * Initialize network layer (manager side)
+ *
+ * @param plugin_label the Plugin ID or label attributed by stack
+ * @return LOOPBACK_ERROR_NONE
+ */
+static int network_manager_init(unsigned int plugin_label)
+{
+	manager_plugin_id = plugin_label;
+
+	if (channels == NULL) {
+		channels = llist_new();
+	}
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/**
+ * Initialize network layer (agent side)
+ *
+ * @param plugin_label the Plugin ID or label attributed by stack
+ * @return LOOPBACK_ERROR_NONE
+ */
+static int network_agent_init(unsigned int plugin_label)
+{
+	agent_plugin_id = plugin_label;
+
+	if (channels == NULL) {
+		channels = llist_new();
+	}
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/**
+ * Tells whether there is an APDU waiting for the context
+ *
+ * @param ctx current connection context.
+ * @return LOOPBACK_ERROR_NONE if data is available, LOOPBACK_ERROR otherwise
+ */
+static int network_loopback_wait_for_data(Context *ctx)
+{
+	LoopbackChannel *ch = get_channel(ctx->id.connid);
+
+	if (ch == NULL || !ch->connected) {
+		return LOOPBACK_ERROR;
+	}
+
+	if (incoming_queue(ch, ctx)->head == NULL) {
+		return LOOPBACK_ERROR;
+	}
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/**
+ * Dequeues the next APDU addressed to context
+ *
+ * @param ctx current connection context.
+ * @return a byteStream with the APDU or NULL if there is none.
+ */
+static ByteStreamReader *network_get_apdu_stream(Context *ctx)
+{
+	LoopbackChannel *ch = get_channel(ctx->id.connid);
+
+	if (ch == NULL) {
+		ERROR("network loopback: unknown connection %llu",
+		      ctx->id.connid);
+		return NULL;
+	}
+
+	LoopbackApdu *item = queue_pop(incoming_queue(ch, ctx));
+
+	if (item == NULL) {
+		return NULL;
+	}
+
+	// stream takes ownership of buffer
+	ByteStreamReader *stream = byte_stream_reader_instance(item->buffer,
+				   item->size);
+
+	if (stream == NULL) {
+		free(item->buffer);
+	}
+
+	free(item);
+
+	return stream;
+}
+
+/**
+ * Copies an encoded APDU to the peer queue
+ *
+ * @param ctx Context
+ * @param stream the apdu to be sent
+ * @return LOOPBACK_ERROR_NONE if queued successfully
+ */
+static int network_send_apdu_stream(Context *ctx, ByteStreamWriter *stream)
+{
+	LoopbackChannel *ch = get_channel(ctx->id.connid);
+
+	if (ch == NULL || !ch->connected) {
+		return LOOPBACK_ERROR;
+	}
+
+	if (ctx->id.plugin == manager_plugin_id) {
+		if (!has_agent) {
+			// nobody on the other side; behave like a sink
+			return LOOPBACK_ERROR_NONE;
+		}
+
+		return queue_push(&ch->to_agent, stream->buffer, stream->size);
+	}
+
+	return queue_push(&ch->to_manager, stream->buffer, stream->size);
+}
+
+/**
+ * Marks connection as closed. Both sides are notified by the next
+ * plugin_network_loopback_pump() call, since this may run while the
+ * channel list is being walked.
+ *
+ * @param ctx
+ * @return LOOPBACK_ERROR_NONE
+ */
+static int network_disconnect(Context *ctx)
+{
+	LoopbackChannel *ch = get_channel(ctx->id.connid);
+
+	if (ch == NULL)
+		return LOOPBACK_ERROR;
+
+	ch->connected = 0;
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/**
+ * Finalizes network layer and deallocated data
+ *
+ * @return LOOPBACK_ERROR_NONE
+ */
+static int network_finalize()
+{
+	llist_destroy(channels, &destroy_channel);
+	channels = NULL;
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/**
+ * Notifies both sides that connection is gone and destroys channel
+ *
+ * @param ch channel
+ */
+static void close_channel(LoopbackChannel *ch)
+{
+	ContextId mgr_cid = {manager_plugin_id, ch->connid};
+	ContextId agt_cid = {agent_plugin_id, ch->connid};
+
+	llist_remove(channels, ch);
+
+	communication_transport_disconnect_indication(mgr_cid, "loopback");
+
+	if (has_agent) {
+		communication_transport_disconnect_indication(agt_cid,
+				"loopback");
+	}
+
+	destroy_channel(ch);
+}
+
+/**
+ * Creates a connection and notifies stack (manager side first, then
+ * agent side), so a context is created at each end.
+ *
+ * @param connid connection ID, must be unique among loopback connections
+ * @return LOOPBACK_ERROR_NONE if ok
+ */
+int plugin_network_loopback_connect(unsigned long long connid)
+{
+	if (!manager_plugin_id || channels == NULL) {
+		ERROR("network loopback: network not started");
+		return LOOPBACK_ERROR;
+	}
+
+	if (get_channel(connid)) {
+		ERROR("network loopback: connection %llu already exists",
+		      connid);
+		return LOOPBACK_ERROR;
+	}
+
+	LoopbackChannel *ch = calloc(1, sizeof(LoopbackChannel));
+
+	if (ch == NULL || !llist_add(channels, ch)) {
+		free(ch);
+		return LOOPBACK_ERROR;
+	}
+
+	ch->connid = connid;
+	ch->connected = 1;
+
+	ContextId mgr_cid = {manager_plugin_id, connid};
+	communication_transport_connect_indication(mgr_cid, "loopback");
+
+	if (has_agent) {
+		ContextId agt_cid = {agent_plugin_id, connid};
+		communication_transport_connect_indication(agt_cid,
+				"loopback");
+	}
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/**
+ * Closes a connection, notifying both sides. Must not be called from
+ * inside a stack callback; use the regular disconnect requests there.
+ *
+ * @param connid connection ID
+ */
+void plugin_network_loopback_disconnect(unsigned long long connid)
+{
+	LoopbackChannel *ch = get_channel(connid);
+
+	if (ch) {
+		close_channel(ch);
+	}
+}
+
+/**
+ * Queues raw APDU bytes to be received by manager side, as if they
+ * were sent by an agent. Useful to replay captured traffic.
+ *
+ * @param connid connection ID
+ * @param buffer APDU bytes (copied)
+ * @param size APDU length
+ * @return LOOPBACK_ERROR_NONE if queued
+ */
+int plugin_network_loopback_inject(unsigned long long connid,
+				   intu8 *buffer, intu32 size)
+{
+	LoopbackChannel *ch = get_channel(connid);
+
+	if (ch == NULL || !ch->connected) {
+		return LOOPBACK_ERROR;
+	}
+
+	return queue_push(&ch->to_manager, buffer, size);
+}
+
+/**
+ * Hands the oldest APDU of queue to the stack
+ *
+ * @param queue incoming queue of context
+ * @param cid context ID
+ * @return 1
+ */
+static int deliver(LoopbackQueue *queue, ContextId cid)
+{
+	LoopbackApdu *head = queue->head;
+
+	communication_read_input_stream(cid);
+
+	if (queue->head == head) {
+		// context is gone, nobody will ever read this APDU
+		LoopbackApdu *item = queue_pop(queue);
+		free(item->buffer);
+		free(item);
+	}
+
+	return 1;
+}
+
+/**
+ * Delivers queued APDUs until every queue is empty. Connections are
+ * served round-robin, one APDU per direction per pass, so a chatty
+ * connection does not starve others.
+ *
+ * @return number of APDUs processed
+ */
+int plugin_network_loopback_pump()
+{
+	int total = 0;
+	int processed;
+
+	do {
+		processed = 0;
+
+		LinkedNode *node = channels ? channels->first : NULL;
+
+		while (node) {
+			LoopbackChannel *ch = (LoopbackChannel *) node->element;
+			node = node->next;
+
+			if (ch->connected && ch->to_manager.head) {
+				ContextId cid = {manager_plugin_id, ch->connid};
+				processed += deliver(&ch->to_manager, cid);
+			}
+
+			if (ch->connected && ch->to_agent.head) {
+				ContextId cid = {agent_plugin_id, ch->connid};
+				processed += deliver(&ch->to_agent, cid);
+			}
+		}
+
+		// reap connections closed during this pass
+		node = channels ? channels->first : NULL;
+
+		while (node) {
+			LoopbackChannel *ch = (LoopbackChannel *) node->element;
+			node = node->next;
+
+			if (!ch->connected) {
+				close_channel(ch);
+			}
+		}
+
+		total += processed;
+	} while (processed > 0);
+
+	return total;
+}
+
+/**
+ * Initiate CommunicationPlugin structs for in-process loopback.
+ *
+ * @param manager_plugin CommunicationPlugin to be given to manager_init()
+ * @param agent_plugin CommunicationPlugin to be given to agent_init(),
+ *                     or NULL if APDUs will be injected directly
+ *
+ * @return LOOPBACK_ERROR if error
+ */
+int plugin_network_loopback_setup(CommunicationPlugin *manager_plugin,
+				  CommunicationPlugin *agent_plugin)
+{
+	DEBUG("network:loopback Initializing");
+
+	if (manager_plugin == NULL) {
+		return LOOPBACK_ERROR;
+	}
+
+	if (channels) {
+		// plugin was already initialized once
+		network_finalize();
+	}
+
+	manager_plugin_id = 0;
+	agent_plugin_id = 0;
+	has_agent = agent_plugin != NULL;
+
+	manager_plugin->network_init = network_manager_init;
+	manager_plugin->network_wait_for_data = network_loopback_wait_for_data;
+	manager_plugin->network_get_apdu_stream = network_get_apdu_stream;
+	manager_plugin->network_send_apdu_stream = network_send_apdu_stream;
+	manager_plugin->network_disconnect = network_disconnect;
+	manager_plugin->network_finalize = network_finalize;
+
+	if (agent_plugin) {
+		agent_plugin->network_init = network_agent_init;
+		agent_plugin->network_wait_for_data = network_loopback_wait_for_data;
+		agent_plugin->network_get_apdu_stream = network_get_apdu_stream;
+		agent_plugin->network_send_apdu_stream = network_send_apdu_stream;
+		agent_plugin->network_disconnect = network_disconnect;
+		agent_plugin->network_finalize = network_finalize;
+	}
+
+	return LOOPBACK_ERROR_NONE;
+}
+
+/** @} */
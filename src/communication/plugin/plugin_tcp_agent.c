@@ -264,7 +264,6 @@ static ByteStreamReader *network_get_apdu_stream(Context *ctx)
 	}
 
 	DEBUG(" network:tcp APDU received ");
-	ioutil_print_buffer(stream->buffer_cur, apdu_size);
 
 	return stream;
 }
@@ -298,7 +297,6 @@ static int network_send_apdu_stream(Context *ctx, ByteStreamWriter *stream)
 	}
 
 	DEBUG(" network:tcp APDU sent ");
-	ioutil_print_buffer(stream->buffer, stream->size);
 
 	return TCP_ERROR_NONE;
 }
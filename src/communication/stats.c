@@ -0,0 +1,335 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file stats.c
+ * \brief Runtime statistics source.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 21, 2011
+ */
+
+/**
+ * \defgroup Stats Statistics
+ * \ingroup Communication
+ * \brief Runtime counters of the communication layer.
+ *
+ * Every context keeps its own copy of the counters, and each update is
+ * also applied to a process-wide copy, so statistics of contexts that
+ * are already gone remain visible in the global numbers.
+ *
+ * Updates are single atomic additions, so they can be done from any
+ * thread, with or without the context lock held.
+ *
+ * @{
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "src/communication/stats.h"
+#include "src/communication/context_manager.h"
+#include "src/communication/service.h"
+#include "src/api/data_encoder.h"
+#include "src/api/data_list.h"
+
+/**
+ * Statistics of all contexts, since program start
+ */
+static Stats global_stats;
+
+/**
+ * Entry names of the counters, indexed by StatsCounter
+ */
+static const char *counter_names[STATS_COUNTERS] = {
+	"apdus-in",
+	"apdus-out",
+	"bytes-in",
+	"bytes-out",
+	"decode-errors",
+	"aborts-sent",
+	"aborts-received",
+	"timeouts",
+	"transitions"
+};
+
+/**
+ * Entry names of the timings, indexed by StatsTiming
+ */
+static const char *timing_names[STATS_TIMINGS] = {
+	"decode-time",
+	"listener-time"
+};
+
+/**
+ * Reads the monotonic clock.
+ *
+ * @return current time in nanoseconds
+ */
+unsigned long long stats_now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Atomically adds to a counter
+ */
+static void add(unsigned long long *counter, unsigned long long delta)
+{
+	__sync_fetch_and_add(counter, delta);
+}
+
+/**
+ * Atomically reads a counter
+ */
+static unsigned long long get(unsigned long long *counter)
+{
+	return __sync_fetch_and_add(counter, 0);
+}
+
+/**
+ * Increments a counter of the context and the global one.
+ *
+ * @param ctx context, may be NULL to update global statistics only
+ * @param counter the counter
+ * @param delta value to be added
+ */
+void stats_count(Context *ctx, StatsCounter counter, unsigned long long delta)
+{
+	if (ctx != NULL) {
+		add(&ctx->stats.counters[counter], delta);
+	}
+
+	add(&global_stats.counters[counter], delta);
+}
+
+/**
+ * Adds a sample to a histogram
+ */
+static void histogram_record(StatsHistogram *hist, unsigned long long value)
+{
+	int bucket = 0;
+
+	if (value > 0) {
+		bucket = 64 - __builtin_clzll(value);
+	}
+
+	if (bucket >= STATS_HISTOGRAM_BUCKETS) {
+		bucket = STATS_HISTOGRAM_BUCKETS - 1;
+	}
+
+	add(&hist->buckets[bucket], 1);
+	add(&hist->count, 1);
+	add(&hist->sum, value);
+}
+
+/**
+ * Records a time measurement of the context and the global one.
+ *
+ * @param ctx context, may be NULL to update global statistics only
+ * @param timing which timing was measured
+ * @param elapsed_ns measured time, see stats_now_ns()
+ */
+void stats_record_time(Context *ctx, StatsTiming timing,
+		       unsigned long long elapsed_ns)
+{
+	if (ctx != NULL) {
+		histogram_record(&ctx->stats.timings[timing], elapsed_ns);
+	}
+
+	histogram_record(&global_stats.timings[timing], elapsed_ns);
+}
+
+/**
+ * Counts a state machine transition.
+ *
+ * @param ctx context
+ * @param state the state just entered
+ */
+void stats_transition(Context *ctx, fsm_states state)
+{
+	stats_count(ctx, STATS_TRANSITIONS, 1);
+
+	if (state >= fsm_state_size) {
+		return;
+	}
+
+	if (ctx != NULL) {
+		add(&ctx->stats.state_entries[state], 1);
+	}
+
+	add(&global_stats.state_entries[state], 1);
+}
+
+/**
+ * Clears global statistics. Statistics of existing contexts are kept.
+ */
+void stats_reset_global()
+{
+	memset(&global_stats, 0, sizeof(Stats));
+}
+
+/**
+ * Estimates a percentile of the histogram samples.
+ *
+ * @return upper bound of the bucket holding the percentile, 0 if empty
+ */
+static unsigned long long histogram_percentile(StatsHistogram *hist,
+		unsigned long long count, int per_mille)
+{
+	unsigned long long rank;
+	unsigned long long seen = 0;
+	int i;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	rank = count * per_mille / 1000;
+
+	if (rank >= count) {
+		rank = count - 1;
+	}
+
+	for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+		seen += get(&hist->buckets[i]);
+
+		if (seen > rank) {
+			break;
+		}
+	}
+
+	if (i >= STATS_HISTOGRAM_BUCKETS - 1) {
+		i = STATS_HISTOGRAM_BUCKETS - 1;
+	}
+
+	return 1ULL << i;
+}
+
+/**
+ * Fills a compound entry with a summary of the histogram.
+ */
+static void set_histogram(DataEntry *entry, const char *name,
+			  StatsHistogram *hist)
+{
+	unsigned long long value;
+	unsigned long long count = get(&hist->count);
+
+	data_set_compound(entry, (char *) name, 5);
+
+	data_set_intu64(&entry->u.compound.entries[0], "count", &count);
+	value = get(&hist->sum);
+	data_set_intu64(&entry->u.compound.entries[1], "sum-ns", &value);
+	value = histogram_percentile(hist, count, 500);
+	data_set_intu64(&entry->u.compound.entries[2], "p50-ns", &value);
+	value = histogram_percentile(hist, count, 990);
+	data_set_intu64(&entry->u.compound.entries[3], "p99-ns", &value);
+	value = histogram_percentile(hist, count, 999);
+	data_set_intu64(&entry->u.compound.entries[4], "p999-ns", &value);
+}
+
+/**
+ * Adds the pending requests of a context to a total.
+ */
+static int count_outstanding_requests(Context *ctx, void *data)
+{
+	unsigned long long *total = data;
+
+	if (ctx->service != NULL) {
+		*total += ctx->service->requests_count;
+	}
+
+	return 1;
+}
+
+/**
+ * Creates a data list with the statistics of a context, or the
+ * global statistics.
+ *
+ * The list holds a single compound entry named "Stats", whose
+ * "context" meta attribute tells the origin ("plugin:connid" or
+ * "global"). The context should be locked by the caller.
+ *
+ * @param ctx context, or NULL for global statistics
+ * @return data list, caller must delete with data_list_del()
+ */
+DataList *stats_get_data_list(Context *ctx)
+{
+	Stats *stats = ctx != NULL ? &ctx->stats : &global_stats;
+	DataList *list;
+	DataEntry *root;
+	DataEntry *states;
+	unsigned long long value;
+	unsigned long long outstanding = 0;
+	char id[48];
+	int n;
+	int i;
+
+	list = data_list_new(1);
+
+	if (list == NULL) {
+		return NULL;
+	}
+
+	if (ctx != NULL) {
+		snprintf(id, sizeof(id), "%u:%llu", ctx->id.plugin,
+			 ctx->id.connid);
+		if (ctx->service != NULL) {
+			outstanding = ctx->service->requests_count;
+		}
+	} else {
+		strcpy(id, "global");
+		context_iterate_data(count_outstanding_requests, &outstanding);
+	}
+
+	root = &list->values[0];
+	data_set_compound(root, "Stats", STATS_COUNTERS + 1 + 1 + STATS_TIMINGS);
+	data_set_meta_att(root, data_strcp("context"), data_strcp(id));
+
+	for (n = 0; n < STATS_COUNTERS; n++) {
+		value = get(&stats->counters[n]);
+		data_set_intu64(&root->u.compound.entries[n],
+				(char *) counter_names[n], &value);
+	}
+
+	data_set_intu64(&root->u.compound.entries[n++], "outstanding-requests",
+			&outstanding);
+
+	states = &root->u.compound.entries[n++];
+	data_set_compound(states, "state-entries", fsm_state_size);
+
+	for (i = 0; i < fsm_state_size; i++) {
+		value = get(&stats->state_entries[i]);
+		data_set_intu64(&states->u.compound.entries[i],
+				fsm_state_to_string(i), &value);
+	}
+
+	for (i = 0; i < STATS_TIMINGS; i++) {
+		set_histogram(&root->u.compound.entries[n++], timing_names[i],
+			      &stats->timings[i]);
+	}
+
+	return list;
+}
+
+/** @} */
@@ -0,0 +1,129 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file stats.h
+ * \brief Runtime statistics header.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 21, 2011
+ */
+
+/**
+ * @addtogroup Stats
+ * @{
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <communication/fsm.h>
+
+struct Context;
+struct DataList;
+
+/**
+ * Runtime counters kept for each context and globally
+ */
+typedef enum {
+	STATS_APDUS_IN = 0,
+	STATS_APDUS_OUT,
+	STATS_BYTES_IN,
+	STATS_BYTES_OUT,
+	STATS_DECODE_ERRORS,
+	STATS_ABORTS_SENT,
+	STATS_ABORTS_RECEIVED,
+	STATS_TIMEOUTS,
+	STATS_TRANSITIONS,
+
+	STATS_COUNTERS // !< Number of counters, it does not represent a counter
+} StatsCounter;
+
+/**
+ * Timings kept as histograms
+ */
+typedef enum {
+	STATS_DECODE_TIME = 0,
+	STATS_LISTENER_TIME,
+
+	STATS_TIMINGS // !< Number of timings, it does not represent a timing
+} StatsTiming;
+
+/**
+ * Number of histogram buckets. Bucket i holds samples
+ * below 2^i nanoseconds, the last one holds everything else.
+ */
+#define STATS_HISTOGRAM_BUCKETS 40
+
+/**
+ * Power-of-two histogram of nanosecond samples
+ */
+typedef struct StatsHistogram {
+	/**
+	 * Number of samples
+	 */
+	unsigned long long count;
+	/**
+	 * Sum of all samples, in nanoseconds
+	 */
+	unsigned long long sum;
+	/**
+	 * Sample count of each bucket
+	 */
+	unsigned long long buckets[STATS_HISTOGRAM_BUCKETS];
+} StatsHistogram;
+
+/**
+ * Statistics of a context. All fields are updated atomically,
+ * so they may be read at any time without locking.
+ */
+typedef struct Stats {
+	/**
+	 * Counter values, indexed by StatsCounter
+	 */
+	unsigned long long counters[STATS_COUNTERS];
+	/**
+	 * Number of times each state machine state was entered
+	 */
+	unsigned long long state_entries[fsm_state_size];
+	/**
+	 * Timing histograms, indexed by StatsTiming
+	 */
+	StatsHistogram timings[STATS_TIMINGS];
+} Stats;
+
+unsigned long long stats_now_ns();
+
+void stats_count(struct Context *ctx, StatsCounter counter,
+		 unsigned long long delta);
+
+void stats_record_time(struct Context *ctx, StatsTiming timing,
+		       unsigned long long elapsed_ns);
+
+void stats_transition(struct Context *ctx, fsm_states state);
+
+void stats_reset_global();
+
+struct DataList *stats_get_data_list(struct Context *ctx);
+
+/** @} */
+
+#endif /* STATS_H_ */
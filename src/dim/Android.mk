@@ -9,16 +9,22 @@ LOCAL_SRC_FILES = \
 			       dim.c \
 			       dimutil.c \
 			       pmstore.c \
+			       pmstore_download.c \
+			       pmstore_resume.c \
+			       pmstore_sched.c \
 			       pmsegment.c \
 			       cfg_scanner.c \
 			       epi_cfg_scanner.c \
 			       mds.c \
+			       mds_template.c \
 			       metric.c \
 			       numeric.c \
 			       rtsa.c \
 			       enumeration.c \
 			       peri_cfg_scanner.c \
-			       scanner.c 
+			       scanner.c \
+			       snapshot.c \
+			       subscription.c 
 
 LOCAL_MODULE:= libantidotedim
 LOCAL_MODULE_TAGS := debug eng
@@ -33,6 +33,7 @@
 #include "cfg_scanner.h"
 #include "dimutil.h"
 #include "mds.h"
+#include "subscription.h"
 #include "src/api/api_definitions.h"
 #include "src/api/data_encoder.h"
 #include "src/api/text_encoder.h"
@@ -146,6 +147,9 @@ void cfg_scanner_set_operational_state_response(struct CfgScanner *self, Operati
  * describes the objects and attributes that are included and the format of
  * the message.
  *
+ * Each group is delivered in a separate DataList, or all together
+ * if manager_set_coalesce_reports() was enabled.
+ *
  * \param ctx the current context.
  * \param self an instance of the CfgScanner structure.
  * \param report_info the data container
@@ -154,24 +158,46 @@ void cfg_scanner_event_report_scan_report_grouped(Context *ctx, struct CfgScanne
 		ScanReportInfoGrouped *report_info)
 {
 	HandleAttrValMap *attr_map = &self->scanner.scan_handle_attr_val_map;
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int count = 0;
 	int i;
 
 	for (i = 0; i < report_info->obs_scan_grouped.count; i++) {
 		ObservationScanGrouped *data = &report_info->obs_scan_grouped.value[i];
 		ByteStreamReader *stream = byte_stream_reader_instance(data->value, data->length);
-		DataList *data_list = data_list_new(attr_map->count);
+		int j;
+
+		for (j = 0; j < attr_map->count; j++) {
+			DataEntry *entry = NULL;
 
-		if (data_list != NULL) {
-			int j;
+			if (subscription_wants(ctx->mds, attr_map->value[j].obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ?
+						report_info->obs_scan_grouped.count * attr_map->count :
+						attr_map->count);
+					count = 0;
+				}
 
-			for (j = 0; j < attr_map->count; j++) {
-				dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], &data_list->values[j]);
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+				}
 			}
+
+			dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], entry);
+		}
+
+		if (data_list != NULL && !coalesce) {
+			mds_notify_measurement_data(ctx, data_list, count);
+			data_list = NULL;
 		}
 
-		manager_notify_evt_measurement_data_updated(ctx, data_list);
 		free(stream);
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
@@ -188,28 +214,48 @@ void cfg_scanner_event_report_scan_report_mp_grouped(Context *ctx, struct CfgSca
 {
 	HandleAttrValMap *attr_map = &self->scanner.scan_handle_attr_val_map;
 	int info_grouped_list_size = report_info->scan_per_grouped.count;
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int count = 0;
 	int i;
 
 	for (i = 0; i < info_grouped_list_size; ++i) {
-		ObservationScanGrouped *data = &report_info->scan_per_grouped.value[i].obs_scan_grouped;
+		ScanReportPerGrouped *person = &report_info->scan_per_grouped.value[i];
+		ObservationScanGrouped *data = &person->obs_scan_grouped;
 		ByteStreamReader *stream = byte_stream_reader_instance(data->value, data->length);
-		DataList *data_list = data_list_new(attr_map->count);
+		int j;
 
-		if (data_list != NULL) {
-			int j;
+		for (j = 0; j < attr_map->count; j++) {
+			DataEntry *entry = NULL;
 
-			for (j = 0; j < attr_map->count; j++) {
-				data_meta_set_personal_id(&data_list->values[j],
-							  report_info->scan_per_grouped.value[i].person_id);
+			if (subscription_wants(ctx->mds, attr_map->value[j].obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ?
+						info_grouped_list_size * attr_map->count :
+						attr_map->count);
+					count = 0;
+				}
 
-				dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], &data_list->values[j]);
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+					data_meta_set_personal_id(entry, person->person_id);
+				}
 			}
 
-			manager_notify_evt_measurement_data_updated(ctx, data_list);
+			dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], entry);
+		}
+
+		if (data_list != NULL && !coalesce) {
+			mds_notify_measurement_data(ctx, data_list, count);
+			data_list = NULL;
 		}
 
 		free(stream);
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /** @} */
@@ -31,6 +31,7 @@
 
 #include "dimutil.h"
 #include "mds.h"
+#include "snapshot.h"
 #include "src/api/data_encoder.h"
 #include "src/api/text_encoder.h"
 #include "src/api/oid_string.h"
@@ -172,6 +173,7 @@ int dimutil_fill_metric_attr(struct Metric *metric, OID_Type attr_id,
 		data_set_type(data_entry, "Type", &metric->type);
 		break;
 	case MDC_ATTR_SUPPLEMENTAL_TYPES:
+		metric_unshare(metric);
 		del_supplementaltypelist(&metric->supplemental_types);
 		decode_supplementaltypelist(stream,
 					    &(metric->supplemental_types),
@@ -226,6 +228,7 @@ int dimutil_fill_metric_attr(struct Metric *metric, OID_Type attr_id,
 		data_set_oid_type(data_entry, "Metric-Id", &metric->metric_id);
 		break;
 	case MDC_ATTR_ID_PHYSIO_LIST:
+		metric_unshare(metric);
 		del_metricidlist(&metric->metric_id_list);
 		decode_metricidlist(stream, &metric->metric_id_list, &error);
 		if (error) {
@@ -252,6 +255,7 @@ int dimutil_fill_metric_attr(struct Metric *metric, OID_Type attr_id,
 		data_set_oid_type(data_entry, "Unit-Code", &metric->unit_code);
 		break;
 	case MDC_ATTR_ATTRIBUTE_VAL_MAP:
+		metric_unshare(metric);
 		del_attrvalmap(&metric->attribute_value_map);
 		decode_attrvalmap(stream, &(metric->attribute_value_map), &error);
 		if (error) {
@@ -270,6 +274,7 @@ int dimutil_fill_metric_attr(struct Metric *metric, OID_Type attr_id,
 		data_set_handle(data_entry, "Source-Handle-Reference", &metric->source_handle_reference);
 		break;
 	case MDC_ATTR_ID_LABEL_STRING:
+		metric_unshare(metric);
 		del_octet_string(&metric->label_string);
 		decode_octet_string(stream, &(metric->label_string), &error);
 		if (error) {
@@ -279,6 +284,7 @@ int dimutil_fill_metric_attr(struct Metric *metric, OID_Type attr_id,
 		data_set_label_string(data_entry, "Label-String", &metric->label_string);
 		break;
 	case MDC_ATTR_UNIT_LABEL_STRING:
+		metric_unshare(metric);
 		del_octet_string(&metric->unit_label_string);
 		decode_octet_string(stream, &(metric->unit_label_string), &error);
 		if (error) {
@@ -525,6 +531,10 @@ int dimutil_fill_numeric_attr(struct Numeric *numeric, OID_Type attr_id,
 		break;
 	}
 
+	if (result) {
+		snapshot_publish(numeric, attr_id);
+	}
+
 	return result;
 }
 
@@ -919,6 +929,7 @@ static int dimutil_fill_scanner_attr(struct Scanner *scanner,
 		data_set_intu16(data_entry, "Operational-State", &scanner->operational_state);
 		break;
 	case MDC_ATTR_SCAN_HANDLE_LIST:
+		scanner_unshare(scanner);
 		del_handlelist(&scanner->scan_handle_list);
 		decode_handlelist(stream, &scanner->scan_handle_list, &error);
 		if (error) {
@@ -928,6 +939,7 @@ static int dimutil_fill_scanner_attr(struct Scanner *scanner,
 		data_set_handle_list(data_entry, "Scan-Handle-List", &scanner->scan_handle_list);
 		break;
 	case MDC_ATTR_SCAN_HANDLE_ATTR_VAL_MAP:
+		scanner_unshare(scanner);
 		del_handleattrvalmap(&scanner->scan_handle_attr_val_map);
 		decode_handleattrvalmap(stream, &scanner->scan_handle_attr_val_map,
 					&error);
@@ -1067,6 +1079,46 @@ int dimutil_fill_epi_scanner_attr(struct EpiCfgScanner *epi_scanner,
 	return result;
 }
 
+/**
+ * Returns a child of a compound data entry under construction.
+ *
+ * \param data_entry the compound entry, may be NULL
+ * \param j index of child
+ *
+ * \return the child entry, NULL if data_entry is NULL.
+ */
+static DataEntry *dimutil_compound_entry(DataEntry *data_entry, int j)
+{
+	if (data_entry == NULL) {
+		return NULL;
+	}
+
+	return &data_entry->u.compound.entries[j];
+}
+
+/**
+ * Sets up a compound data entry for a metric observation.
+ *
+ * \param data_entry the entry, may be NULL
+ * \param name name of the entry
+ * \param count number of children
+ */
+static void dimutil_compound_init(DataEntry *data_entry, const char *name,
+				  int count)
+{
+	if (data_entry == NULL) {
+		return;
+	}
+
+	data_entry->choice = COMPOUND_DATA_ENTRY;
+	data_entry->u.compound.entries_count = count;
+	data_entry->u.compound.entries = calloc(count, sizeof(DataEntry));
+
+	if (name != NULL) {
+		data_entry->u.compound.name = data_strcp(name);
+	}
+}
+
 /**
  * Initializes a given Metric/Numeric/Enumeration/RT-SA object from a list
  * of attributes.
@@ -1080,18 +1132,13 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
 				       struct Metric_object *metric_obj, AttributeList *attr_list)
 {
 
-	data_entry->choice = COMPOUND_DATA_ENTRY;
-	CompoundDataEntry *cmp_entry =  &data_entry->u.compound;
-	cmp_entry->entries_count =  attr_list->count;
-	cmp_entry->entries = calloc(attr_list->count, sizeof(DataEntry));
-
 	int j;
 	octet_string val;
 	OID_Type attr_id;
 
 	switch (metric_obj->choice) {
 	case METRIC_NUMERIC:
-		cmp_entry->name = data_strcp("Numeric");
+		dimutil_compound_init(data_entry, "Numeric", attr_list->count);
 
 		for (j = 0; j < attr_list->count; ++j) {
 			attr_id = attr_list->value[j].attribute_id;
@@ -1101,7 +1148,8 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
 			ByteStreamReader *stream = byte_stream_reader_instance(val.value,
 						   val.length);
 
-			int result = dimutil_fill_numeric_attr(&(metric_obj->u.numeric), attr_id, stream, &(cmp_entry->entries[j]));
+			int result = dimutil_fill_numeric_attr(&(metric_obj->u.numeric), attr_id, stream,
+							       dimutil_compound_entry(data_entry, j));
 
 			if (result == 0) {
 				ERROR("ERROR filling numeric attribute");
@@ -1112,7 +1160,7 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
 
 		break;
 	case METRIC_ENUM:
-		cmp_entry->name = data_strcp("Enumeration");
+		dimutil_compound_init(data_entry, "Enumeration", attr_list->count);
 
 		for (j = 0; j < attr_list->count; ++j) {
 			attr_id = attr_list->value[j].attribute_id;
@@ -1123,7 +1171,7 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
 						   val.length);
 
 			int result = dimutil_fill_enumeration_attr(&(metric_obj->u.enumeration), attr_id,
-					stream, &(cmp_entry->entries[j]));
+					stream, dimutil_compound_entry(data_entry, j));
 
 			if (result == 0) {
 				ERROR("ERROR filling enumeration attr");
@@ -1134,7 +1182,7 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
 
 		break;
 	case METRIC_RTSA:
-		cmp_entry->name = data_strcp("RT-SA");
+		dimutil_compound_init(data_entry, "RT-SA", attr_list->count);
 
 		for (j = 0; j < attr_list->count; ++j) {
 			attr_id = attr_list->value[j].attribute_id;
@@ -1145,7 +1193,7 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
 						   val.length);
 
 			int result = dimutil_fill_rtsa_attr(&(metric_obj->u.rtsa), attr_id,
-							    stream, &(cmp_entry->entries[j]));
+							    stream, dimutil_compound_entry(data_entry, j));
 
 			if (result == 0) {
 				ERROR("ERROR filling stsa attr");
@@ -1156,6 +1204,7 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
 
 		break;
 	default:
+		dimutil_compound_init(data_entry, NULL, attr_list->count);
 		break;
 	}
 
@@ -1167,7 +1216,8 @@ static void dimutil_fill_metric_object(struct MDS *mds, DataEntry *data_entry,
  *
  * \param mds
  * \param var_obs The measured data that were reported in the var-format.
- * \param data_entry output parameter to describe data value.
+ * \param data_entry output parameter to describe data value, or NULL
+ *        to update the objects only.
  */
 void dimutil_update_mds_from_obs_scan(struct MDS *mds, ObservationScan *var_obs,
 				      DataEntry *data_entry)
@@ -1222,7 +1272,8 @@ void dimutil_update_mds_from_obs_scan(struct MDS *mds, ObservationScan *var_obs,
  *
  * \param mds
  * \param fixed_obs The measured data that were reported in the fixed-format.
- * \param data_entry output parameter to describe data value.
+ * \param data_entry output parameter to describe data value, or NULL
+ *        to update the objects only.
  */
 void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixed *fixed_obs,
 		DataEntry *data_entry)
@@ -1242,10 +1293,7 @@ void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixe
 	int attr_list_size;
 
 	if (metric_obj != NULL) {
-		DataEntry *measurement_entry = data_entry;
-		measurement_entry->choice = COMPOUND_DATA_ENTRY;
-		data_meta_set_handle(measurement_entry, handle);
-		CompoundDataEntry *cmp_entry = &measurement_entry->u.compound;
+		data_meta_set_handle(data_entry, handle);
 
 		octet_string value = fixed_obs->obs_val_data;
 		ByteStreamReader *stream = byte_stream_reader_instance(value.value, value.length);
@@ -1253,16 +1301,14 @@ void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixe
 		switch (metric_obj->choice) {
 		case METRIC_NUMERIC: {
 			AttrValMap val_map = metric_obj->u.numeric.metric.attribute_value_map;
-			cmp_entry->name = data_strcp("Numeric");
 			attr_list_size = metric_obj->u.numeric.metric.attribute_value_map.count;
-			cmp_entry->entries_count = attr_list_size;
-			cmp_entry->entries = calloc(attr_list_size, sizeof(DataEntry));
+			dimutil_compound_init(data_entry, "Numeric", attr_list_size);
 			int j;
 
 			for (j = 0; j < attr_list_size; ++j) {
 				result = dimutil_fill_numeric_attr(&(metric_obj->u.numeric),
 								   val_map.value[j].attribute_id,
-								   stream, &(cmp_entry->entries[j]));
+								   stream, dimutil_compound_entry(data_entry, j));
 
 				if (result == 0) {
 					ERROR("ERROR filling numeric attr");
@@ -1272,18 +1318,15 @@ void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixe
 		break;
 		case METRIC_ENUM: {
 			AttrValMap val_map = metric_obj->u.enumeration.metric.attribute_value_map;
-			cmp_entry->name = data_strcp("Enumeration");
-
 			attr_list_size = metric_obj->u.enumeration.metric.attribute_value_map.count;
-			cmp_entry->entries_count = attr_list_size;
-			cmp_entry->entries = calloc(attr_list_size, sizeof(DataEntry));
+			dimutil_compound_init(data_entry, "Enumeration", attr_list_size);
 			int j;
 
 			for (j = 0; j < attr_list_size; ++j) {
 				result = dimutil_fill_enumeration_attr(&(metric_obj->u.enumeration),
 								       val_map.value[j].attribute_id,
 								       stream,
-								       &(cmp_entry->entries[j]));
+								       dimutil_compound_entry(data_entry, j));
 
 				if (result == 0) {
 					ERROR("ERROR filling enumeration attr");
@@ -1293,17 +1336,14 @@ void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixe
 		break;
 		case METRIC_RTSA: {
 			AttrValMap val_map = metric_obj->u.rtsa.metric.attribute_value_map;
-			cmp_entry->name = data_strcp("RT-SA");
-
 			attr_list_size = metric_obj->u.rtsa.metric.attribute_value_map.count;
-			cmp_entry->entries_count = attr_list_size;
-			cmp_entry->entries = calloc(attr_list_size, sizeof(DataEntry));
+			dimutil_compound_init(data_entry, "RT-SA", attr_list_size);
 			int j;
 
 			for (j = 0; j < attr_list_size; ++j) {
 				result = dimutil_fill_rtsa_attr(&(metric_obj->u.rtsa),
 								val_map.value[j].attribute_id,
-								stream,  &(cmp_entry->entries[j]));
+								stream, dimutil_compound_entry(data_entry, j));
 
 				if (result == 0) {
 					ERROR("ERROR filling rtsa attr");
@@ -1328,7 +1368,8 @@ void dimutil_update_mds_from_obs_scan_fixed(struct MDS *mds, ObservationScanFixe
  * in a Unbuf-Scan-Report-Grouped, Buf-Scan-Report-Grouped, Unbuf-Scan-Report-MP-Grouped,
  * Buf-Scan-Report-MP-Grouped.
  *
- * \param measurement_entry output parameter to describe data value.
+ * \param measurement_entry output parameter to describe data value, or NULL
+ *        to update the objects only.
  */
 void dimutil_update_mds_from_grouped_observations(struct MDS *mds, ByteStreamReader *stream,
 		HandleAttrValMapEntry *val_map_entry,
@@ -1338,23 +1379,22 @@ void dimutil_update_mds_from_grouped_observations(struct MDS *mds, ByteStreamRea
 	struct MDS_object *obj = mds_get_object_by_handle(mds, val_map_entry->obj_handle);
 	AttrValMap *val_map = &val_map_entry->attr_val_map;
 
-	measurement_entry->choice = COMPOUND_DATA_ENTRY;
-	data_meta_set_handle(measurement_entry, val_map_entry->obj_handle);
+	const char *name = NULL;
 
-	CompoundDataEntry *cmp_entry = &measurement_entry->u.compound;
-	cmp_entry->entries_count = val_map->count;
-	cmp_entry->entries = calloc(val_map->count, sizeof(DataEntry));
+	data_meta_set_handle(measurement_entry, val_map_entry->obj_handle);
 
 	if (val_map->count > 0) {
 		if (obj->u.metric.choice == METRIC_NUMERIC) {
-			cmp_entry->name = data_strcp("Numeric");
+			name = "Numeric";
 		} else if (obj->u.metric.choice == METRIC_ENUM) {
-			cmp_entry->name = data_strcp("Enumeration");
+			name = "Enumeration";
 		} else {
-			cmp_entry->name = data_strcp("RT-SA");
+			name = "RT-SA";
 		}
 	}
 
+	dimutil_compound_init(measurement_entry, name, val_map->count);
+
 	int k;
 
 	for (k = 0; k < val_map->count; k++) {
@@ -1362,7 +1402,8 @@ void dimutil_update_mds_from_grouped_observations(struct MDS *mds, ByteStreamRea
 		case METRIC_NUMERIC: {
 			int result = dimutil_fill_numeric_attr(&(obj->u.metric.u.numeric),
 							       val_map->value[k].attribute_id,
-							       stream, &cmp_entry->entries[k]);
+							       stream,
+							       dimutil_compound_entry(measurement_entry, k));
 
 			if (!result) {
 				ERROR("numeric attribute id %d not found",
@@ -1373,7 +1414,8 @@ void dimutil_update_mds_from_grouped_observations(struct MDS *mds, ByteStreamRea
 		case METRIC_ENUM: {
 			int result = dimutil_fill_enumeration_attr(&(obj->u.metric.u.enumeration),
 					val_map->value[k].attribute_id,
-					stream, &cmp_entry->entries[k]);
+					stream,
+					dimutil_compound_entry(measurement_entry, k));
 
 			if (!result) {
 				ERROR("enum attribute id %d not found",
@@ -1385,7 +1427,8 @@ void dimutil_update_mds_from_grouped_observations(struct MDS *mds, ByteStreamRea
 			int result = dimutil_fill_rtsa_attr(
 					     &(obj->u.metric.u.rtsa),
 					     val_map->value[k].attribute_id,
-					     stream, &cmp_entry->entries[k]);
+					     stream,
+					     dimutil_compound_entry(measurement_entry, k));
 
 			if (!result) {
 				ERROR("rtsa attribute id %d not found",
@@ -32,10 +32,13 @@
 #include <stdio.h>
 #include <string.h>
 #include "mds.h"
+#include "mds_template.h"
 #include "dimutil.h"
 #include "nomenclature.h"
 #include "pmstore.h"
 #include "rtsa.h"
+#include "snapshot.h"
+#include "subscription.h"
 #include "src/util/bytelib.h"
 #include "src/communication/parser/decoder_ASN1.h"
 #include "src/communication/parser/struct_cleaner.h"
@@ -96,6 +99,7 @@ MDS *mds_create()
 	mds->dim.id = mds_get_nomenclature_code();
 	mds->objects_list = NULL;
 	mds->objects_list_count = 0;
+	mds->objects_list_size = 0;
 	mds->handle = MDS_HANDLE;
 	return mds;
 }
@@ -474,6 +478,10 @@ Request *mds_get_pmstore(Context *ctx, int handle, service_request_callback requ
  *
  * After configuration steps the Manager is ready to execute operational mode
  *
+ * The object table built for a configuration is kept as a template (see
+ * mds_template.c), and the next MDS configured with the same system id and
+ * configuration id gets a copy of it instead of decoding the list again.
+ *
  * \param ctx context Operating Context
  * \param config_obj_list Configuration object list
  * \param manager Manager flag
@@ -488,6 +496,13 @@ void mds_configure_operating(Context *ctx, ConfigObjectList *config_obj_list,
 
 	MDS *mds  = ctx->mds;
 
+	if (mds_template_clone(&mds->system_id, mds->dev_configuration_id, mds)) {
+		// objects already built for this configuration
+		obj_list_size = 0;
+	} else {
+		mds_reserve_objects(mds, mds->objects_list_count + obj_list_size);
+	}
+
 	for (i = 0; i < obj_list_size; ++i) {
 		struct MDS_object object;
 
@@ -687,9 +702,15 @@ void mds_configure_operating(Context *ctx, ConfigObjectList *config_obj_list,
 		}
 	}
 
+	if (obj_list_size > 0) {
+		mds_template_store(&mds->system_id, mds->dev_configuration_id, mds);
+	}
+
 	service_init(ctx);
 
 	if (manager) {
+		snapshot_attach(ctx, mds);
+
 		DataList *list = data_list_new(1);
 		mds_populate_attributes(mds, &list->values[0]);
 
@@ -875,26 +896,51 @@ void mds_populate_attributes(MDS *mds, DataEntry *entry)
 }
 
 /**
- * Adds a MDS_object to a dynamic list.
+ * Makes room for at least count children objects, so that adding
+ * them does not reallocate the object list.
+ *
+ * \param mds the mds
+ * \param count number of objects
+ * \return 1 if operation succeeds, 0 otherwise
+ */
+int mds_reserve_objects(MDS *mds, int count)
+{
+	struct MDS_object *list;
+
+	if (count <= mds->objects_list_size) {
+		return 1;
+	}
+
+	list = realloc(mds->objects_list, count * sizeof(struct MDS_object));
+
+	if (list == NULL) {
+		ERROR("MDS: cannot allocate %d objects", count);
+		return 0;
+	}
+
+	mds->objects_list = list;
+	mds->objects_list_size = count;
+
+	return 1;
+}
+
+/**
+ * Adds a MDS_object to a dynamic list. The list grows geometrically.
  *
  * \param mds the mds
  * \param object the MDS_object struct to be inserted into a dynamic list.
  */
 void mds_add_object(MDS *mds, struct MDS_object object)
 {
-	// test if there is not elements in the list
-	if (mds->objects_list_count == 0 && mds != NULL) {
-		mds->objects_list = malloc(sizeof(struct MDS_object));
-		memset(mds->objects_list, 0, sizeof(struct MDS_object));
-
-	} else { // change the list size
-		mds->objects_list = realloc(mds->objects_list,
-					    sizeof(struct MDS_object)
-					    * (mds->objects_list_count + 1));
-		memset(mds->objects_list+mds->objects_list_count, 0, sizeof(struct MDS_object));
-
-		if (mds->objects_list == NULL) {
-			ERROR("ERROR");
+	if (mds->objects_list_count >= mds->objects_list_size) {
+		int size = mds->objects_list_size * 2;
+
+		if (size < MDS_OBJECTS_INITIAL_SIZE) {
+			size = MDS_OBJECTS_INITIAL_SIZE;
+		}
+
+		if (!mds_reserve_objects(mds, size)) {
+			return;
 		}
 	}
 
@@ -934,6 +980,27 @@ struct MDS_object *mds_get_object_by_handle(MDS *mds, ASN1_HANDLE obj_handle)
 }
 
 
+/**
+ * Delivers the observations converted into the first entries of a data
+ * list to the application. Observations left out by the subscription
+ * filters leave no entry, so the list is shrunk to the ones that were
+ * filled. The list is released if nothing is left.
+ *
+ * \param ctx
+ * \param data_list the data list, ownership is taken
+ * \param count number of filled entries
+ */
+void mds_notify_measurement_data(Context *ctx, DataList *data_list, int count)
+{
+	if (count <= 0) {
+		data_list_del(data_list);
+		return;
+	}
+
+	data_list->size = count;
+	manager_notify_evt_measurement_data_updated(ctx, data_list);
+}
+
 /**
  * This event provides dynamic data (typically measurements) from the agent for
  * some or all of the objects that the agent supports. Data for reported objects
@@ -951,15 +1018,21 @@ void mds_event_report_dynamic_data_update_var(Context *ctx, ScanReportInfoVar *i
 	DataList *data_list = data_list_new(info_size);
 
 	if (data_list != NULL && info_size > 0) {
+		int count = 0;
 		int i;
 
 		for (i = 0; i < info_size; ++i) {
-			dimutil_update_mds_from_obs_scan(ctx->mds,
-						&info_var->obs_scan_var.value[i],
-						&data_list->values[i]);
+			ObservationScan *obs = &info_var->obs_scan_var.value[i];
+			DataEntry *entry = NULL;
+
+			if (subscription_wants(ctx->mds, obs->obj_handle)) {
+				entry = &data_list->values[count++];
+			}
+
+			dimutil_update_mds_from_obs_scan(ctx->mds, obs, entry);
 		}
 
-		manager_notify_evt_measurement_data_updated(ctx, data_list);
+		mds_notify_measurement_data(ctx, data_list, count);
 	}
 }
 
@@ -986,13 +1059,21 @@ void mds_event_report_dynamic_data_update_fixed(Context *ctx, ScanReportInfoFixe
 	DataList *data_list = data_list_new(info_size);
 
 	if (data_list != NULL && info_size > 0) {
+		int count = 0;
 		int i;
 
 		for (i = 0; i < info_size; ++i) {
-			dimutil_update_mds_from_obs_scan_fixed(ctx->mds, &info_fixed->obs_scan_fixed.value[i], &data_list->values[i]);
+			ObservationScanFixed *obs = &info_fixed->obs_scan_fixed.value[i];
+			DataEntry *entry = NULL;
+
+			if (subscription_wants(ctx->mds, obs->obj_handle)) {
+				entry = &data_list->values[count++];
+			}
+
+			dimutil_update_mds_from_obs_scan_fixed(ctx->mds, obs, entry);
 		}
 
-		manager_notify_evt_measurement_data_updated(ctx, data_list);
+		mds_notify_measurement_data(ctx, data_list, count);
 	}
 }
 
@@ -1000,6 +1081,9 @@ void mds_event_report_dynamic_data_update_fixed(Context *ctx, ScanReportInfoFixe
  * This is the same as MDS-Dynamic-Data-Update-Var, but allows inclusion
  * of data from multiple persons.
  *
+ * Observations of each person are delivered in a separate DataList,
+ * or all together if manager_set_coalesce_reports() was enabled.
+ *
  * \param ctx
  * \param info_mp_var
  */
@@ -1007,25 +1091,48 @@ void mds_event_report_dynamic_data_update_mp_var(Context *ctx,
 		ScanReportInfoMPVar *info_mp_var)
 {
 	int info_mp_list_size = info_mp_var->scan_per_var.count;
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int total = 0;
+	int count = 0;
 	int i;
 
+	for (i = 0; coalesce && i < info_mp_list_size; ++i) {
+		total += info_mp_var->scan_per_var.value[i].obs_scan_var.count;
+	}
+
 	for (i = 0; i < info_mp_list_size; ++i) {
-		int info_size = info_mp_var->scan_per_var.value[i].obs_scan_var.count;
-		DataList *data_list = data_list_new(info_size);
+		ScanReportPerVar *person = &info_mp_var->scan_per_var.value[i];
+		int info_size = person->obs_scan_var.count;
+		int j;
 
-		if (data_list != NULL && info_size > 0) {
-			int j;
+		for (j = 0; j < info_size; ++j) {
+			ObservationScan *obs = &person->obs_scan_var.value[j];
+			DataEntry *entry = NULL;
 
-			for (j = 0; j < info_size; ++j) {
-				data_meta_set_personal_id(&data_list->values[j],
-							  info_mp_var->scan_per_var.value[i].person_id);
+			if (subscription_wants(ctx->mds, obs->obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ? total : info_size);
+					count = 0;
+				}
 
-				dimutil_update_mds_from_obs_scan(ctx->mds, &info_mp_var->scan_per_var.value[i].obs_scan_var.value[j],
-								 &data_list->values[j]);
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+					data_meta_set_personal_id(entry, person->person_id);
+				}
 			}
 
-			manager_notify_evt_measurement_data_updated(ctx, data_list);
+			dimutil_update_mds_from_obs_scan(ctx->mds, obs, entry);
 		}
+
+		if (data_list != NULL && !coalesce) {
+			mds_notify_measurement_data(ctx, data_list, count);
+			data_list = NULL;
+		}
+	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
 	}
 }
 
@@ -1033,6 +1140,9 @@ void mds_event_report_dynamic_data_update_mp_var(Context *ctx,
  * This is the same as MDS-Dynamic-Data-Update-Fixed, but allows inclusion
  * of data from multiple persons.
  *
+ * Observations of each person are delivered in a separate DataList,
+ * or all together if manager_set_coalesce_reports() was enabled.
+ *
  * \param ctx
  * \param info_mp_fixed
  */
@@ -1040,27 +1150,49 @@ void mds_event_report_dynamic_data_update_mp_fixed(Context *ctx,
 		ScanReportInfoMPFixed *info_mp_fixed)
 {
 	int info_fixed_list_size = info_mp_fixed->scan_per_fixed.count;
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int total = 0;
+	int count = 0;
 	int i;
 
+	for (i = 0; coalesce && i < info_fixed_list_size; ++i) {
+		total += info_mp_fixed->scan_per_fixed.value[i].obs_scan_fix.count;
+	}
+
 	for (i = 0; i < info_fixed_list_size; ++i) {
-		int info_size = info_mp_fixed->scan_per_fixed.value[i].obs_scan_fix.count;
-		DataList *data_list = data_list_new(info_size);
+		ScanReportPerFixed *person = &info_mp_fixed->scan_per_fixed.value[i];
+		int info_size = person->obs_scan_fix.count;
+		int j;
 
-		if (data_list != NULL && info_size > 0) {
-			int j;
+		for (j = 0; j < info_size; ++j) {
+			ObservationScanFixed *obs = &person->obs_scan_fix.value[j];
+			DataEntry *entry = NULL;
 
-			for (j = 0; j < info_size; ++j) {
-				data_meta_set_personal_id(&data_list->values[j],
-							  info_mp_fixed->scan_per_fixed.value[i].person_id);
+			if (subscription_wants(ctx->mds, obs->obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ? total : info_size);
+					count = 0;
+				}
 
-				dimutil_update_mds_from_obs_scan_fixed(ctx->mds,
-								       &info_mp_fixed->scan_per_fixed.value[i].obs_scan_fix.value[j],
-								       &data_list->values[j]);
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+					data_meta_set_personal_id(entry, person->person_id);
+				}
 			}
 
-			manager_notify_evt_measurement_data_updated(ctx, data_list);
+			dimutil_update_mds_from_obs_scan_fixed(ctx->mds, obs, entry);
+		}
+
+		if (data_list != NULL && !coalesce) {
+			mds_notify_measurement_data(ctx, data_list, count);
+			data_list = NULL;
 		}
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
@@ -1502,6 +1634,45 @@ Request *mds_set_operational_state_of_the_scanner(Context *ctx, ASN1_HANDLE hand
 }
 
 
+/**
+ * Releases the memory held by an MDS child object. The object
+ * itself is not freed, since it normally lives in the object list.
+ *
+ * \param object the object to be finalized.
+ */
+void mds_object_destroy(struct MDS_object *object)
+{
+	if (object->choice == MDS_OBJ_PMSTORE) {
+		pmstore_destroy(&(object->u.pmstore));
+	} else if (object->choice == MDS_OBJ_METRIC) {
+		switch (object->u.metric.choice) {
+		case METRIC_NUMERIC:
+			snapshot_detach(&(object->u.metric.u.numeric));
+			numeric_destroy(&(object->u.metric.u.numeric));
+			break;
+		case METRIC_ENUM:
+			enumeration_destroy(&(object->u.metric.u.enumeration));
+			break;
+		case METRIC_RTSA:
+			rtsa_destroy(&(object->u.metric.u.rtsa));
+			break;
+		default:
+			break;
+		}
+	} else if (object->choice == MDS_OBJ_SCANNER) {
+		switch (object->u.scanner.choice) {
+		case EPI_CFG_SCANNER:
+			epi_cfg_scanner_destroy(&(object->u.scanner.u.epi_cfg_scanner));
+			break;
+		case PERI_CFG_SCANNER:
+			peri_cfg_scanner_destroy(&(object->u.scanner.u.peri_cfg_scanner));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
 /**
  * Finalizes and deallocate the current MDS instance.
  *
@@ -1514,41 +1685,12 @@ void mds_destroy(MDS *mds)
 
 		if (mds->objects_list != NULL) {
 			for (i = 0; i < mds->objects_list_count; ++i) {
-				if (mds->objects_list[i].choice == MDS_OBJ_PMSTORE) {
-					pmstore_destroy(
-						&(mds->objects_list[i].u.pmstore));
-				} else if (mds->objects_list[i].choice == MDS_OBJ_METRIC) {
-
-					switch (mds->objects_list[i].u.metric.choice) {
-					case METRIC_NUMERIC:
-						numeric_destroy(&(mds->objects_list[i].u.metric.u.numeric));
-						break;
-					case METRIC_ENUM:
-						enumeration_destroy(&(mds->objects_list[i].u.metric.u.enumeration));
-						break;
-					case METRIC_RTSA:
-						rtsa_destroy(&(mds->objects_list[i].u.metric.u.rtsa));
-						break;
-					default:
-						break;
-					}
-
-				} else if (mds->objects_list[i].choice == MDS_OBJ_SCANNER) {
-					switch (mds->objects_list[i].u.scanner.choice) {
-					case EPI_CFG_SCANNER:
-						epi_cfg_scanner_destroy(&(mds->objects_list[i].u.scanner.u.epi_cfg_scanner));
-						break;
-					case PERI_CFG_SCANNER:
-						peri_cfg_scanner_destroy(&(mds->objects_list[i].u.scanner.u.peri_cfg_scanner));
-						break;
-					default:
-						break;
-					}
-				}
+				mds_object_destroy(&(mds->objects_list[i]));
 			}
 
 			free(mds->objects_list);
 			mds->objects_list = NULL;
+			mds->objects_list_size = 0;
 		}
 
 		del_octet_string(&mds->system_id);
@@ -47,6 +47,11 @@
  */
 #define MDS_HANDLE 0
 
+/**
+ * Initial allocated length of the object list
+ */
+#define MDS_OBJECTS_INITIAL_SIZE 8
+
 /**
  * Medical Device System structure
  */
@@ -280,6 +285,11 @@ typedef struct MDS {
  	 */
 	int objects_list_count;
 
+	/**
+	 * Allocated length of objects_list
+ 	 */
+	int objects_list_size;
+
 	/**
 	 * Count of PM-Store objects among children
  	 */
@@ -359,12 +369,16 @@ struct mds_system_data {
 
 void mds_add_object(MDS *mds, struct MDS_object object);
 
+int mds_reserve_objects(MDS *mds, int count);
+
 struct MDS_object *mds_get_object_by_handle(MDS *mds, ASN1_HANDLE obj_handle);
 
 MDS *mds_create();
 
 void mds_destroy(MDS *mds);
 
+void mds_object_destroy(struct MDS_object *object);
+
 int mds_get_nomenclature_code();
 
 void mds_set_attribute(MDS *mds, AVA_Type *attribute);
@@ -404,6 +418,8 @@ void mds_populate_attributes(MDS *mds, DataEntry *mds_entry);
 
 DataList *mds_populate_configuration(MDS *mds);
 
+void mds_notify_measurement_data(Context *ctx, DataList *data_list, int count);
+
 void mds_event_report_dynamic_data_update_var(Context *ctx, ScanReportInfoVar *info_var);
 
 void mds_event_report_dynamic_data_update_fixed(Context *ctx, ScanReportInfoFixed *info_fixed);
@@ -0,0 +1,496 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file mds_template.c
+ * \brief MDS object table cache.
+ *
+ * Building the MDS objects of a configuration means decoding every
+ * attribute of the configuration object list. Devices reconnect over
+ * and over with the same configuration, so the first object table built
+ * for a (system id, configuration id) pair is kept as a template, and
+ * later associations get copies of it. The configuration lists of the
+ * objects are not copied but shared by reference, so identical devices
+ * keep a single copy of them; see metric_share() and scanner_share().
+ *
+ * Standard configurations do not depend on the agent, so their
+ * templates are shared by all agents.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 25, 2011
+ */
+
+/**
+ * @addtogroup MDS
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "mds_template.h"
+#include "src/communication/communication.h"
+#include "src/communication/stdconfigurations.h"
+#include "src/util/log.h"
+
+/**
+ * Cached object table
+ */
+typedef struct MDSTemplate {
+	/**
+	 * System id of the agent, empty for standard configurations
+	 */
+	octet_string system_id;
+	/**
+	 * Configuration id
+	 */
+	ConfigId config_id;
+	/**
+	 * Objects, never handed out directly
+	 */
+	struct MDS_object *objects;
+	/**
+	 * Number of objects
+	 */
+	int count;
+} MDSTemplate;
+
+/**
+ * Cached templates, oldest first
+ */
+static MDSTemplate *templates = NULL;
+
+/**
+ * Number of cached templates
+ */
+static int template_count = 0;
+
+/**
+ * Duplicates a memory block
+ *
+ * \param src block, may be NULL
+ * \param size block size
+ * \return copy, or NULL if the block is empty
+ */
+static void *mds_template_memdup(const void *src, size_t size)
+{
+	void *dst;
+
+	if (src == NULL || size == 0) {
+		return NULL;
+	}
+
+	dst = malloc(size);
+
+	if (dst != NULL) {
+		memcpy(dst, src, size);
+	}
+
+	return dst;
+}
+
+/**
+ * Replaces the value array of a list by a copy of it. The list was
+ * already copied by value, so count and length are right.
+ */
+#define COPY_VALUES(list)								\
+	(list)->value = mds_template_memdup((list)->value,				\
+					    (list)->count * sizeof(*(list)->value));
+
+/**
+ * Replaces the value of an octet string by a copy of it.
+ */
+#define COPY_OCTETS(string)								\
+	(string)->value = mds_template_memdup((string)->value, (string)->length);
+
+/**
+ * Returns the Metric part of a metric object
+ *
+ * \param object the object
+ * \return the Metric, or NULL for other objects
+ */
+static struct Metric *object_metric(struct MDS_object *object)
+{
+	if (object->choice != MDS_OBJ_METRIC) {
+		return NULL;
+	}
+
+	switch (object->u.metric.choice) {
+	case METRIC_NUMERIC:
+		return &object->u.metric.u.numeric.metric;
+	case METRIC_ENUM:
+		return &object->u.metric.u.enumeration.metric;
+	case METRIC_RTSA:
+		return &object->u.metric.u.rtsa.metric;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Returns the Scanner part of a scanner object
+ *
+ * \param object the object
+ * \return the Scanner, or NULL for other objects
+ */
+static struct Scanner *object_scanner(struct MDS_object *object)
+{
+	if (object->choice != MDS_OBJ_SCANNER) {
+		return NULL;
+	}
+
+	switch (object->u.scanner.choice) {
+	case EPI_CFG_SCANNER:
+		return &object->u.scanner.u.epi_cfg_scanner.scanner.scanner;
+	case PERI_CFG_SCANNER:
+		return &object->u.scanner.u.peri_cfg_scanner.scanner.scanner;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Copies an MDS child object. The configuration lists of metrics and
+ * scanners (attribute value maps, labels, handle lists) are shared by
+ * reference between source and copy; the observed values are copied.
+ * PM-segments are not copied, they are fetched from the agent on demand.
+ *
+ * \param dst destination, its contents are overwritten
+ * \param src source
+ */
+void mds_object_copy(struct MDS_object *dst, struct MDS_object *src)
+{
+	struct Metric *metric = object_metric(src);
+	struct Scanner *scanner = object_scanner(src);
+
+	if (metric != NULL) {
+		metric_share(metric);
+	} else if (scanner != NULL) {
+		scanner_share(scanner);
+	}
+
+	*dst = *src;
+
+	metric = object_metric(dst);
+	scanner = object_scanner(dst);
+
+	if (metric != NULL) {
+		metric_addref(metric);
+		// a failed metric_share() leaves the lists private
+		if (metric->shared == NULL) {
+			COPY_VALUES(&metric->supplemental_types);
+			COPY_OCTETS(&metric->label_string);
+			COPY_OCTETS(&metric->unit_label_string);
+			COPY_VALUES(&metric->metric_id_list);
+			COPY_VALUES(&metric->attribute_value_map);
+		}
+	} else if (scanner != NULL) {
+		scanner_addref(scanner);
+		if (scanner->shared == NULL) {
+			int i;
+
+			COPY_VALUES(&scanner->scan_handle_list);
+			COPY_VALUES(&scanner->scan_handle_attr_val_map);
+
+			for (i = 0; scanner->scan_handle_attr_val_map.value != NULL
+			     && i < scanner->scan_handle_attr_val_map.count; ++i) {
+				COPY_VALUES(&scanner->scan_handle_attr_val_map.value[i].attr_val_map);
+			}
+		}
+	}
+
+	switch (dst->choice) {
+	case MDS_OBJ_METRIC:
+		switch (dst->u.metric.choice) {
+		case METRIC_NUMERIC:
+			COPY_VALUES(&dst->u.metric.u.numeric.compound_simple_nu_observed_value);
+			COPY_VALUES(&dst->u.metric.u.numeric.compound_basic_nu_observed_value);
+			COPY_VALUES(&dst->u.metric.u.numeric.compound_nu_observed_value);
+			dst->u.metric.u.numeric.snapshot_slot = 0;
+			break;
+		case METRIC_ENUM:
+			COPY_OCTETS(&dst->u.metric.u.enumeration.enum_observed_value_simple_str);
+			if (dst->u.metric.u.enumeration.enum_observed_value.value.choice
+			    == TEXT_STRING_CHOSEN) {
+				COPY_OCTETS(&dst->u.metric.u.enumeration.enum_observed_value.value.u.enum_text_string);
+			}
+			break;
+		case METRIC_RTSA:
+			COPY_OCTETS(&dst->u.metric.u.rtsa.simple_sa_observed_value);
+			break;
+		default:
+			break;
+		}
+		break;
+	case MDS_OBJ_PMSTORE:
+		COPY_OCTETS(&dst->u.pmstore.pm_store_label);
+		dst->u.pmstore.segment_list_count = 0;
+		dst->u.pmstore.segment_list_size = 0;
+		dst->u.pmstore.segm_list = NULL;
+		dst->u.pmstore.download = NULL;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Gets the system id a template is filed under
+ *
+ * \param system_id agent system id
+ * \param config_id configuration id
+ * \param empty storage for the empty system id
+ * \return system id of the template
+ */
+static octet_string *template_key(octet_string *system_id, ConfigId config_id,
+				  octet_string *empty)
+{
+	if (system_id == NULL
+	    || std_configurations_is_supported_standard(config_id)) {
+		empty->length = 0;
+		empty->value = NULL;
+		return empty;
+	}
+
+	return system_id;
+}
+
+/**
+ * Finds a template. Must be called with the global lock held.
+ *
+ * \param system_id key system id, see template_key()
+ * \param config_id configuration id
+ * \return template position, or -1
+ */
+static int template_find(octet_string *system_id, ConfigId config_id)
+{
+	int i;
+
+	for (i = 0; i < template_count; ++i) {
+		if (templates[i].config_id == config_id
+		    && templates[i].system_id.length == system_id->length
+		    && (system_id->length == 0
+			|| memcmp(templates[i].system_id.value,
+				  system_id->value, system_id->length) == 0)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Frees a template and removes it from the cache. Must be called with
+ * the global lock held.
+ *
+ * \param pos template position
+ */
+static void template_remove(int pos)
+{
+	MDSTemplate *template = &templates[pos];
+	int i;
+
+	for (i = 0; i < template->count; ++i) {
+		mds_object_destroy(&template->objects[i]);
+	}
+
+	free(template->objects);
+	free(template->system_id.value);
+
+	--template_count;
+	memmove(templates + pos, templates + pos + 1,
+		(template_count - pos) * sizeof(MDSTemplate));
+}
+
+/**
+ * Fills the object list of an MDS with a copy of the cached object
+ * table of a configuration.
+ *
+ * \param system_id agent system id
+ * \param config_id configuration id
+ * \param mds MDS with an empty object list
+ * \return 1 if the template was found, 0 otherwise
+ */
+int mds_template_clone(octet_string *system_id, ConfigId config_id, MDS *mds)
+{
+	octet_string empty;
+	MDSTemplate *template;
+	int pos;
+	int i;
+
+	system_id = template_key(system_id, config_id, &empty);
+
+	gil_lock();
+
+	pos = template_find(system_id, config_id);
+
+	if (pos < 0 || mds->objects_list_count != 0) {
+		gil_unlock();
+		return 0;
+	}
+
+	template = &templates[pos];
+	free(mds->objects_list);
+	mds->objects_list_size = 0;
+	mds->objects_list = calloc(template->count, sizeof(struct MDS_object));
+
+	if (mds->objects_list == NULL) {
+		gil_unlock();
+		return 0;
+	}
+
+	for (i = 0; i < template->count; ++i) {
+		mds_object_copy(&mds->objects_list[i], &template->objects[i]);
+	}
+
+	mds->objects_list_count = template->count;
+	mds->objects_list_size = template->count;
+
+	gil_unlock();
+
+	DEBUG("MDS: %d objects of configuration %d taken from template",
+	      mds->objects_list_count, config_id);
+
+	return 1;
+}
+
+/**
+ * Keeps a copy of the object table of an MDS as the template of a
+ * configuration. An existing template for the same configuration is
+ * replaced.
+ *
+ * \param system_id agent system id
+ * \param config_id configuration id
+ * \param mds configured MDS
+ */
+void mds_template_store(octet_string *system_id, ConfigId config_id, MDS *mds)
+{
+	octet_string empty;
+	MDSTemplate template;
+	MDSTemplate *list;
+	int pos;
+	int i;
+
+	system_id = template_key(system_id, config_id, &empty);
+
+	template.config_id = config_id;
+	template.count = mds->objects_list_count;
+	template.system_id.length = system_id->length;
+	template.system_id.value = mds_template_memdup(system_id->value,
+				   system_id->length);
+	template.objects = calloc(template.count + 1, sizeof(struct MDS_object));
+
+	if (template.objects == NULL) {
+		free(template.system_id.value);
+		return;
+	}
+
+	for (i = 0; i < template.count; ++i) {
+		mds_object_copy(&template.objects[i], &mds->objects_list[i]);
+	}
+
+	gil_lock();
+
+	pos = template_find(system_id, config_id);
+
+	if (pos >= 0) {
+		template_remove(pos);
+	} else if (template_count >= MDS_TEMPLATE_LIMIT) {
+		template_remove(0);
+	}
+
+	list = realloc(templates, (template_count + 1) * sizeof(MDSTemplate));
+
+	if (list == NULL) {
+		gil_unlock();
+		ERROR("MDS: cannot keep template");
+		for (i = 0; i < template.count; ++i) {
+			mds_object_destroy(&template.objects[i]);
+		}
+		free(template.objects);
+		free(template.system_id.value);
+		return;
+	}
+
+	templates = list;
+	templates[template_count++] = template;
+
+	gil_unlock();
+}
+
+/**
+ * Drops the template of a configuration, e.g. because the agent
+ * registered a new configuration under the same id.
+ *
+ * \param system_id agent system id
+ * \param config_id configuration id
+ */
+void mds_template_invalidate(octet_string *system_id, ConfigId config_id)
+{
+	octet_string empty;
+	int pos;
+
+	system_id = template_key(system_id, config_id, &empty);
+
+	gil_lock();
+
+	pos = template_find(system_id, config_id);
+
+	if (pos >= 0) {
+		template_remove(pos);
+	}
+
+	gil_unlock();
+}
+
+/**
+ * Gets the number of cached templates
+ *
+ * \return number of templates
+ */
+int mds_template_count()
+{
+	int count;
+
+	gil_lock();
+	count = template_count;
+	gil_unlock();
+
+	return count;
+}
+
+/**
+ * Drops all templates
+ */
+void mds_template_clear()
+{
+	gil_lock();
+
+	while (template_count > 0) {
+		template_remove(template_count - 1);
+	}
+
+	free(templates);
+	templates = NULL;
+
+	gil_unlock();
+}
+
+/** @} */
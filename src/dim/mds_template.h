@@ -0,0 +1,60 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file mds_template.h
+ * \brief MDS object table cache header.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 25, 2011
+ */
+
+/**
+ * @addtogroup MDS
+ * @{
+ */
+
+#ifndef MDS_TEMPLATE_H_
+#define MDS_TEMPLATE_H_
+
+#include <dim/mds.h>
+
+/**
+ * Maximum number of cached object tables; the oldest one is
+ * dropped when a new one does not fit
+ */
+#define MDS_TEMPLATE_LIMIT 64
+
+int mds_template_clone(octet_string *system_id, ConfigId config_id, MDS *mds);
+
+void mds_template_store(octet_string *system_id, ConfigId config_id, MDS *mds);
+
+void mds_template_invalidate(octet_string *system_id, ConfigId config_id);
+
+int mds_template_count();
+
+void mds_template_clear();
+
+void mds_object_copy(struct MDS_object *dst, struct MDS_object *src);
+
+/** @} */
+
+#endif /* MDS_TEMPLATE_H_ */
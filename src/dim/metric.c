@@ -29,6 +29,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "metric.h"
 #include "nomenclature.h"
 #include "src/communication/parser/struct_cleaner.h"
@@ -48,6 +49,67 @@
  * @{
  */
 
+/**
+ * Duplicates a memory block
+ *
+ * \param src block, may be NULL
+ * \param size block size
+ * \return copy, or NULL if the block is empty
+ */
+static void *metric_memdup(const void *src, size_t size)
+{
+	void *dst;
+
+	if (src == NULL || size == 0) {
+		return NULL;
+	}
+
+	dst = malloc(size);
+
+	if (dst != NULL) {
+		memcpy(dst, src, size);
+	}
+
+	return dst;
+}
+
+/**
+ * Frees a shared block and its lists
+ *
+ * \param shared the block.
+ */
+static void metric_free_shared(struct MetricShared *shared)
+{
+	del_supplementaltypelist(&shared->supplemental_types);
+	del_metricidlist(&shared->metric_id_list);
+	del_attrvalmap(&shared->attribute_value_map);
+	del_octet_string(&shared->label_string);
+	del_octet_string(&shared->unit_label_string);
+	free(shared);
+}
+
+/**
+ * Drops the reference of a metric to its shared lists. The lists of
+ * the metric are left empty.
+ *
+ * \param metric the metric.
+ */
+static void metric_release_shared(struct Metric *metric)
+{
+	struct MetricShared *shared = metric->shared;
+
+	memset(&metric->supplemental_types, 0, sizeof(SupplementalTypeList));
+	memset(&metric->metric_id_list, 0, sizeof(MetricIdList));
+	memset(&metric->attribute_value_map, 0, sizeof(AttrValMap));
+	memset(&metric->label_string, 0, sizeof(octet_string));
+	memset(&metric->unit_label_string, 0, sizeof(octet_string));
+	metric->shared = NULL;
+
+	if (__sync_sub_and_fetch(&shared->ref, 1) == 0) {
+		metric_free_shared(shared);
+	}
+}
+
 /**
  * Creates a new instance of Metric object class.
  *
@@ -71,15 +133,102 @@ void metric_destroy(struct Metric *metric)
 {
 	if (metric != NULL) {
 		del_type(&metric->type);
-		del_supplementaltypelist(&metric->supplemental_types);
 		del_metricspecsmall(&metric->metric_spec_small);
 		del_metricstructuresmall(&metric->metric_structure_small);
-		del_metricidlist(&metric->metric_id_list);
-		del_attrvalmap(&metric->attribute_value_map);
-		del_octet_string(&metric->label_string);
-		del_octet_string(&metric->unit_label_string);
 		del_absolutetime(&metric->absolute_time_stamp);
 		del_highresrelativetime(&metric->hi_res_time_stamp);
+
+		if (metric->shared != NULL) {
+			metric_release_shared(metric);
+		} else {
+			del_supplementaltypelist(&metric->supplemental_types);
+			del_metricidlist(&metric->metric_id_list);
+			del_attrvalmap(&metric->attribute_value_map);
+			del_octet_string(&metric->label_string);
+			del_octet_string(&metric->unit_label_string);
+		}
+	}
+}
+
+/**
+ * Moves the configuration lists of a metric to a shared block, so
+ * that copies of the metric made by value can use them too. Each such
+ * copy must take its own reference with metric_addref().
+ *
+ * \param metric the metric.
+ */
+void metric_share(struct Metric *metric)
+{
+	struct MetricShared *shared;
+
+	if (metric->shared != NULL) {
+		return;
+	}
+
+	shared = calloc(1, sizeof(struct MetricShared));
+
+	if (shared == NULL) {
+		return;
+	}
+
+	shared->ref = 1;
+	shared->supplemental_types = metric->supplemental_types;
+	shared->metric_id_list = metric->metric_id_list;
+	shared->attribute_value_map = metric->attribute_value_map;
+	shared->label_string = metric->label_string;
+	shared->unit_label_string = metric->unit_label_string;
+
+	metric->shared = shared;
+}
+
+/**
+ * Takes one more reference to the shared lists of a metric, for a copy
+ * of it made by value. Does nothing if the lists are not shared.
+ *
+ * \param metric the copy.
+ */
+void metric_addref(struct Metric *metric)
+{
+	if (metric->shared != NULL) {
+		__sync_fetch_and_add(&metric->shared->ref, 1);
+	}
+}
+
+/**
+ * Gives the metric private copies of its configuration lists, so that
+ * they can be changed. Does nothing if the lists are not shared.
+ *
+ * \param metric the metric.
+ */
+void metric_unshare(struct Metric *metric)
+{
+	struct MetricShared *shared = metric->shared;
+
+	if (shared == NULL) {
+		return;
+	}
+
+	metric->supplemental_types.value =
+		metric_memdup(shared->supplemental_types.value,
+			      shared->supplemental_types.count * sizeof(TYPE));
+	metric->metric_id_list.value =
+		metric_memdup(shared->metric_id_list.value,
+			      shared->metric_id_list.count * sizeof(OID_Type));
+	metric->attribute_value_map.value =
+		metric_memdup(shared->attribute_value_map.value,
+			      shared->attribute_value_map.count
+			      * sizeof(AttrValMapEntry));
+	metric->label_string.value =
+		metric_memdup(shared->label_string.value,
+			      shared->label_string.length);
+	metric->unit_label_string.value =
+		metric_memdup(shared->unit_label_string.value,
+			      shared->unit_label_string.length);
+
+	metric->shared = NULL;
+
+	if (__sync_sub_and_fetch(&shared->ref, 1) == 0) {
+		metric_free_shared(shared);
 	}
 }
 
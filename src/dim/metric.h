@@ -34,6 +34,44 @@
 #include "asn1/phd_types.h"
 #include "dim.h"
 
+/**
+ * Lists of a Metric that come from the configuration and do not change
+ * while the agent is associated. MDS instances built from the same
+ * configuration share one reference-counted copy of them, see
+ * metric_share().
+ */
+struct MetricShared {
+	/**
+	 * Number of metrics using the lists
+	 */
+	int ref;
+
+	/**
+	 * Shared Supplemental-Types
+	 */
+	SupplementalTypeList supplemental_types;
+
+	/**
+	 * Shared Metric-Id-List
+	 */
+	MetricIdList metric_id_list;
+
+	/**
+	 * Shared Attribute-Value-Map
+	 */
+	AttrValMap attribute_value_map;
+
+	/**
+	 * Shared Label-String
+	 */
+	octet_string label_string;
+
+	/**
+	 * Shared Unit-LabelString
+	 */
+	octet_string unit_label_string;
+};
+
 /**
  * Metric object structure
  */
@@ -205,12 +243,26 @@ struct Metric {
 	 * Indicates that the metric_id_partition attribute is being used
 	 */
 	int use_metric_id_partition_field;
+
+	/**
+	 * When not NULL, supplemental_types, metric_id_list,
+	 * attribute_value_map, label_string and unit_label_string point to
+	 * the lists held by this block and must not be freed or changed
+	 * in place; call metric_unshare() before changing them.
+	 */
+	struct MetricShared *shared;
 };
 
 struct Metric *metric_instance();
 
 void metric_destroy(struct Metric *metric);
 
+void metric_share(struct Metric *metric);
+
+void metric_addref(struct Metric *metric);
+
+void metric_unshare(struct Metric *metric);
+
 int metric_get_nomenclature_code();
 
 #endif /* METRIC_H_ */
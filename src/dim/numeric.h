@@ -104,6 +104,10 @@ struct Numeric {
 	 */
 	FLOAT_Type accuracy;
 
+	/**
+	 * Latest-value slot of this metric, 0 if none (see snapshot.h)
+	 */
+	int snapshot_slot;
 };
 
 struct Numeric *numeric_instance(struct Metric *metric);
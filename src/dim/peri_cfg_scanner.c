@@ -32,6 +32,7 @@
 #include "peri_cfg_scanner.h"
 #include "mds.h"
 #include "dimutil.h"
+#include "subscription.h"
 #include "src/manager_p.h"
 #include "src/api/api_definitions.h"
 #include "src/api/data_encoder.h"
@@ -109,6 +110,9 @@ struct PeriCfgScanner *peri_cfg_scanner_instance(struct CfgScanner *scanner)
  * variable message format (type/length/value) is used when reporting
  * data that changed.
  *
+ * Each observation is delivered in a separate DataList, or all together
+ * if manager_set_coalesce_reports() was enabled.
+ *
  * \param ctx
  * \param self an instance of the PeriCfgScanner structure.
  * \param report_info the data container
@@ -118,24 +122,46 @@ void peri_cfg_scanner_event_report_buf_scan_report_var(Context *ctx,
 		ScanReportInfoVar *report_info)
 {
 	int info_size = report_info->obs_scan_var.count;
-
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int count = 0;
 	int i;
 
 	for (i = 0; i < info_size; ++i) {
-		DataList *data_list = data_list_new(1);
+		ObservationScan *obs = &report_info->obs_scan_var.value[i];
+		DataEntry *entry = NULL;
+
+		if (subscription_wants(ctx->mds, obs->obj_handle)) {
+			if (data_list == NULL) {
+				data_list = data_list_new(coalesce ? info_size : 1);
+				count = 0;
+			}
+
+			if (data_list != NULL) {
+				entry = &data_list->values[count++];
+			}
+		}
+
+		dimutil_update_mds_from_obs_scan(ctx->mds, obs, entry);
 
-		if (data_list != NULL) {
-			dimutil_update_mds_from_obs_scan(ctx->mds, &report_info->obs_scan_var.value[i],
-							 &data_list->values[0]);
-			manager_notify_evt_measurement_data_updated(ctx, data_list);
+		if (data_list != NULL && !coalesce) {
+			mds_notify_measurement_data(ctx, data_list, count);
+			data_list = NULL;
 		}
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
  * This event style is used whenever data values change and the
  * fixed message format of each object is used to report data that changed.
  *
+ * Each observation is delivered in a separate DataList, or all together
+ * if manager_set_coalesce_reports() was enabled.
+ *
  * \param ctx
  * \param self an instance of the PeriCfgScanner structure.
  * \param report_info the data container
@@ -145,17 +171,37 @@ void peri_cfg_scanner_event_report_buf_scan_report_fixed(Context *ctx,
 		ScanReportInfoFixed *report_info)
 {
 	int info_size = report_info->obs_scan_fixed.count;
-
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int count = 0;
 	int i;
 
 	for (i = 0; i < info_size; ++i) {
-		DataList *data_list = data_list_new(1);
+		ObservationScanFixed *obs = &report_info->obs_scan_fixed.value[i];
+		DataEntry *entry = NULL;
+
+		if (subscription_wants(ctx->mds, obs->obj_handle)) {
+			if (data_list == NULL) {
+				data_list = data_list_new(coalesce ? info_size : 1);
+				count = 0;
+			}
 
-		if (data_list != NULL) {
-			dimutil_update_mds_from_obs_scan_fixed(ctx->mds, &report_info->obs_scan_fixed.value[i], &data_list->values[0]);
-			manager_notify_evt_measurement_data_updated(ctx, data_list);
+			if (data_list != NULL) {
+				entry = &data_list->values[count++];
+			}
+		}
+
+		dimutil_update_mds_from_obs_scan_fixed(ctx->mds, obs, entry);
+
+		if (data_list != NULL && !coalesce) {
+			mds_notify_measurement_data(ctx, data_list, count);
+			data_list = NULL;
 		}
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
@@ -164,6 +210,9 @@ void peri_cfg_scanner_event_report_buf_scan_report_fixed(Context *ctx,
  * describes the objects and attributes that are included and the format of
  * the message.
  *
+ * Each observation is delivered in a separate DataList, or all together
+ * if manager_set_coalesce_reports() was enabled.
+ *
  * \param ctx
  * \param self an instance of the PeriCfgScanner structure.
  * \param report_info the data container
@@ -173,7 +222,9 @@ void peri_cfg_scanner_event_report_buf_scan_report_grouped(Context *ctx,
 		ScanReportInfoGrouped *report_info)
 {
 	HandleAttrValMap *attr_map = &self->scanner.scanner.scan_handle_attr_val_map;
-
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int count = 0;
 	int i;
 
 	for (i = 0; i < report_info->obs_scan_grouped.count; i++) {
@@ -183,16 +234,34 @@ void peri_cfg_scanner_event_report_buf_scan_report_grouped(Context *ctx,
 		int j;
 
 		for (j = 0; j < attr_map->count; j++) {
-			DataList *data_list = data_list_new(1);
+			DataEntry *entry = NULL;
+
+			if (subscription_wants(ctx->mds, attr_map->value[j].obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ?
+						report_info->obs_scan_grouped.count * attr_map->count : 1);
+					count = 0;
+				}
+
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+				}
+			}
 
-			if (data_list != NULL) {
-				dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], &data_list->values[0]);
-				manager_notify_evt_measurement_data_updated(ctx, data_list);
+			dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], entry);
+
+			if (data_list != NULL && !coalesce) {
+				mds_notify_measurement_data(ctx, data_list, count);
+				data_list = NULL;
 			}
 		}
 
 		free(stream);
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
@@ -208,27 +277,50 @@ void peri_cfg_scanner_event_report_buf_scan_report_mp_var(Context *ctx,
 		ScanReportInfoMPVar *report_info)
 {
 	int info_mp_list_size = report_info->scan_per_var.count;
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int total = 0;
+	int count = 0;
 	int i;
 
+	for (i = 0; coalesce && i < info_mp_list_size; ++i) {
+		total += report_info->scan_per_var.value[i].obs_scan_var.count;
+	}
+
 	for (i = 0; i < info_mp_list_size; ++i) {
-		int info_size = report_info->scan_per_var.value[i].obs_scan_var.count;
+		ScanReportPerVar *person = &report_info->scan_per_var.value[i];
+		int info_size = person->obs_scan_var.count;
 
 		int j;
 
 		for (j = 0; j < info_size; ++j) {
-			DataList *data_list = data_list_new(1);
+			ObservationScan *obs = &person->obs_scan_var.value[j];
+			DataEntry *entry = NULL;
+
+			if (subscription_wants(ctx->mds, obs->obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ? total : 1);
+					count = 0;
+				}
+
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+					data_meta_set_personal_id(entry, person->person_id);
+				}
+			}
 
-			if (data_list != NULL) {
-				data_meta_set_personal_id(&data_list->values[0],
-							  report_info->scan_per_var.value[i].person_id);
+			dimutil_update_mds_from_obs_scan(ctx->mds, obs, entry);
 
-				dimutil_update_mds_from_obs_scan(ctx->mds,
-								 &report_info->scan_per_var.value[i].obs_scan_var.value[j],
-								 &data_list->values[0]);
-				manager_notify_evt_measurement_data_updated(ctx, data_list);
+			if (data_list != NULL && !coalesce) {
+				mds_notify_measurement_data(ctx, data_list, count);
+				data_list = NULL;
 			}
 		}
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
@@ -243,29 +335,51 @@ void peri_cfg_scanner_event_report_buf_scan_report_mp_fixed(Context *ctx,
 		struct PeriCfgScanner *self,
 		ScanReportInfoMPFixed *report_info)
 {
-
 	int info_fixed_list_size = report_info->scan_per_fixed.count;
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int total = 0;
+	int count = 0;
 	int i;
 
+	for (i = 0; coalesce && i < info_fixed_list_size; ++i) {
+		total += report_info->scan_per_fixed.value[i].obs_scan_fix.count;
+	}
+
 	for (i = 0; i < info_fixed_list_size; ++i) {
-		int info_size = report_info->scan_per_fixed.value[i].obs_scan_fix.count;
+		ScanReportPerFixed *person = &report_info->scan_per_fixed.value[i];
+		int info_size = person->obs_scan_fix.count;
 
 		int j;
 
 		for (j = 0; j < info_size; ++j) {
-			DataList *data_list = data_list_new(1);
+			ObservationScanFixed *obs = &person->obs_scan_fix.value[j];
+			DataEntry *entry = NULL;
+
+			if (subscription_wants(ctx->mds, obs->obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ? total : 1);
+					count = 0;
+				}
+
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+					data_meta_set_personal_id(entry, person->person_id);
+				}
+			}
 
-			if (data_list != NULL) {
-				data_meta_set_personal_id(&data_list->values[0],
-							  report_info->scan_per_fixed.value[i].person_id);
+			dimutil_update_mds_from_obs_scan_fixed(ctx->mds, obs, entry);
 
-				dimutil_update_mds_from_obs_scan_fixed(ctx->mds,
-								       &report_info->scan_per_fixed.value[i].obs_scan_fix.value[j],
-								       &data_list->values[0]);
-				manager_notify_evt_measurement_data_updated(ctx, data_list);
+			if (data_list != NULL && !coalesce) {
+				mds_notify_measurement_data(ctx, data_list, count);
+				data_list = NULL;
 			}
 		}
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
@@ -282,28 +396,48 @@ void peri_cfg_scanner_event_report_buf_scan_report_mp_grouped(Context *ctx,
 {
 	HandleAttrValMap *attr_map = &self->scanner.scanner.scan_handle_attr_val_map;
 	int info_grouped_list_size = report_info->scan_per_grouped.count;
+	int coalesce = manager_coalesce_reports();
+	DataList *data_list = NULL;
+	int count = 0;
 	int i;
 
 	for (i = 0; i < info_grouped_list_size; ++i) {
-		ObservationScanGrouped *data = &report_info->scan_per_grouped.value[i].obs_scan_grouped;
+		ScanReportPerGrouped *person = &report_info->scan_per_grouped.value[i];
+		ObservationScanGrouped *data = &person->obs_scan_grouped;
 		ByteStreamReader *stream = byte_stream_reader_instance(data->value, data->length);
 
 		int j;
 
 		for (j = 0; j < attr_map->count; j++) {
-			DataList *data_list = data_list_new(attr_map->count);
+			DataEntry *entry = NULL;
+
+			if (subscription_wants(ctx->mds, attr_map->value[j].obj_handle)) {
+				if (data_list == NULL) {
+					data_list = data_list_new(coalesce ?
+						info_grouped_list_size * attr_map->count : 1);
+					count = 0;
+				}
+
+				if (data_list != NULL) {
+					entry = &data_list->values[count++];
+					data_meta_set_personal_id(entry, person->person_id);
+				}
+			}
 
-			if (data_list != NULL) {
-				data_meta_set_personal_id(&data_list->values[0],
-							  report_info->scan_per_grouped.value[i].person_id);
+			dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], entry);
 
-				dimutil_update_mds_from_grouped_observations(ctx->mds, stream, &attr_map->value[j], &data_list->values[0]);
-				manager_notify_evt_measurement_data_updated(ctx, data_list);
+			if (data_list != NULL && !coalesce) {
+				mds_notify_measurement_data(ctx, data_list, count);
+				data_list = NULL;
 			}
 		}
 
 		free(stream);
 	}
+
+	if (data_list != NULL) {
+		mds_notify_measurement_data(ctx, data_list, count);
+	}
 }
 
 /**
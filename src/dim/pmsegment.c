@@ -30,6 +30,7 @@
 
 #include <stdlib.h>
 #include "pmsegment.h"
+#include "src/api/data_list.h"
 #include "src/communication/parser/struct_cleaner.h"
 
 /**
@@ -100,6 +101,44 @@ int pmsegment_get_nomenclature_code()
 	return MDC_MOC_PM_SEGMENT;
 }
 
+/**
+ * Returns the length of the entries of a PMSegment, which is fixed by
+ * its PM-Segment-Entry-Map.
+ *
+ * \param pm_segment the PMSegment.
+ * \return length in bytes, or 0 if it cannot be determined.
+ */
+int pmsegment_entry_size(struct PMSegment *pm_segment)
+{
+	PmSegmentEntryMap *map = &pm_segment->pm_segment_entry_map;
+	SegmEntryHeader header = map->segm_entry_header;
+	int size = 0;
+	int i;
+	int j;
+
+	if (header & ~(SEG_ELEM_HDR_ABSOLUTE_TIME | SEG_ELEM_HDR_RELATIVE_TIME |
+		       SEG_ELEM_HDR_HIRES_RELATIVE_TIME)) {
+		return 0;
+	}
+
+	if (header & SEG_ELEM_HDR_ABSOLUTE_TIME)
+		size += 8;
+	if (header & SEG_ELEM_HDR_RELATIVE_TIME)
+		size += 4;
+	if (header & SEG_ELEM_HDR_HIRES_RELATIVE_TIME)
+		size += 8;
+
+	for (i = 0; i < map->segm_entry_elem_list.count; ++i) {
+		AttrValMap *val_map = &map->segm_entry_elem_list.value[i].attr_val_map;
+
+		for (j = 0; j < val_map->count; ++j) {
+			size += val_map->value[j].attribute_len;
+		}
+	}
+
+	return size;
+}
+
 /**
  * Finalizes and deallocate the given PMSegment.
  *
@@ -113,6 +152,8 @@ void pmsegment_destroy(struct PMSegment *pm_segment)
 		del_absolutetimeadjust(&pm_segment->date_and_time_adjustment);
 		del_segmentstatistics(&pm_segment->segment_statistics);
 		del_octet_string(&pm_segment->fixed_segment_data);
+		data_list_del(pm_segment->decoded);
+		pm_segment->decoded = NULL;
 	}
 }
 
@@ -33,6 +33,7 @@
 
 #include <stdlib.h>
 #include "asn1/phd_types.h"
+#include "api/api_definitions.h"
 #include "nomenclature.h"
 #include "dim.h"
 
@@ -191,6 +192,53 @@ struct PMSegment {
 	 */
 	RelativeTime transfer_timeout;
 
+	/**
+	 * Index of the first entry kept in fixed_segment_data; entries
+	 * before it were already decoded or delivered
+	 */
+	intu32 buffered_index;
+
+	/**
+	 * Hash of the entries received in the current transfer
+	 */
+	unsigned long long hash;
+
+	/**
+	 * Entries delivered by an interrupted transfer, which are not
+	 * delivered again if they arrive unchanged
+	 */
+	intu32 resume_entries;
+
+	/**
+	 * Hash of those entries
+	 */
+	unsigned long long resume_hash;
+
+	/**
+	 * Whether entries are streamed to the download of the PM-Store,
+	 * instead of being delivered whole
+	 */
+	int streamed;
+
+	/**
+	 * Whether delivered entries are recorded for resuming
+	 */
+	int resumable;
+
+	/**
+	 * Whether the last entry arrived and is not delivered yet
+	 */
+	int complete;
+
+	/**
+	 * Entries decoded so far, when the segment is delivered whole
+	 */
+	DataList *decoded;
+
+	/**
+	 * Whether decoding waits in the bulk work scheduler
+	 */
+	int scheduled;
 };
 
 struct PMSegment *pmsegment_instance(InstNumber instance_number);
@@ -199,6 +247,8 @@ void pmsegment_remove_all_entries(struct PMSegment *pm_segment);
 
 int pmsegment_get_nomenclature_code();
 
+int pmsegment_entry_size(struct PMSegment *pm_segment);
+
 void pmsegment_destroy(struct PMSegment *pm_segment);
 
 #endif /* PMSEGMENT_H_ */
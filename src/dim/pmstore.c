@@ -34,6 +34,8 @@
 #include <assert.h>
 #include "pmstore.h"
 #include "pmstore_req.h"
+#include "pmstore_resume.h"
+#include "pmstore_sched.h"
 #include "src/api/api_definitions.h"
 #include "src/api/data_encoder.h"
 #include "src/api/data_list.h"
@@ -44,6 +46,7 @@
 #include "src/communication/parser/decoder_ASN1.h"
 #include "src/communication/parser/encoder_ASN1.h"
 #include "src/communication/service.h"
+#include "src/communication/stats.h"
 #include "src/manager_p.h"
 #include "src/util/log.h"
 #include "src/dim/mds.h"
@@ -79,17 +82,28 @@ static const intu32 PM_STORE_TO_GET = 3;
  */
 static const intu32 PM_STORE_TO_CONFIRM_SET = 3;
 
+/**
+ * Entries decoded at a time by pmstore_segment_process()
+ */
+#define PMSTORE_DECODE_BATCH 32
+
+/**
+ * Undecoded entries (bytes) a segment may buffer; past that, bulk
+ * work is done as data arrives
+ */
+#define PMSTORE_PENDING_MAX 32768
+
 static int pmstore_fill_segment_attr(struct PMSegment *pm_segment,
 					OID_Type attr_id,
 					ByteStreamReader *stream);
 
 static void pmstore_populate_all_attributes(MDS *mds, struct PMStore *pmstore,
 						struct PMSegment *pmsegment,
+						intu8 *data, int length,
+						int entry_count,
 						DataEntry *segm_data_entry);
 
-static void decode_fixed_segment_data(Context *ctx, struct PMStore *pmstore,
-					struct PMSegment *pmsegment,
-					int last);
+static void pmstore_segment_discard(struct PMSegment *segment);
 
 /**
  * Returns one instance of the PMStore structure.
@@ -104,6 +118,7 @@ struct PMStore *pmstore_instance()
 	store->dim.id = pmstore_get_nomenclature_code();
 	store->segm_list = NULL;
 	store->segment_list_count = 0;
+	store->segment_list_size = 0;
 	store->number_of_segments = 0;
 	return store;
 }
@@ -150,6 +165,7 @@ void pmstore_service_action_clear_segments(struct PMStore *pm_store, SegmSelecti
 
 				free(pm_store->segm_list);
 				pm_store->segment_list_count = 0;
+				pm_store->segment_list_size = 0;
 				pm_store->segm_list = NULL;
 			}
 		}
@@ -383,6 +399,7 @@ void pmstore_remove_selected_segm(struct PMStore *pm_store, intu16 *selection,
 		}
 
 		pm_store->segment_list_count = temp_size;
+		pm_store->segment_list_size = temp_size;
 
 		free(temp_segm);
 	} else {
@@ -499,6 +516,9 @@ void pmstore_get_segmentinfo_result(struct PMStore *pm_store,
 
 	int info_list_size = info_list.count;
 
+	pmstore_reserve_segments(pm_store,
+				 pm_store->segment_list_count + info_list_size);
+
 	for (i = 0; i < info_list_size; ++i) {
 		int ok = 1;
 		InstNumber inst_number = info_list.value[i].seg_inst_no;
@@ -644,10 +664,26 @@ int pmstore_segment_data_event(Context *ctx, struct PMStore *pm_store,
 			first, last);
 
 	if (first) {
+		// finish a previous transfer still waiting in the scheduler
+		if (pmsegment->fixed_segment_data.length > 0 ||
+		    pmsegment->complete) {
+			pmstore_segment_process(ctx, pm_store, pmsegment, ~0ULL);
+		}
+
+		pmstore_segment_discard(pmsegment);
+
 		pmsegment->empiric_usage_count = 0;
-		free(pmsegment->fixed_segment_data.value);
-		pmsegment->fixed_segment_data.value = NULL;
-		pmsegment->fixed_segment_data.length = 0;
+		pmsegment->buffered_index = 0;
+		pmsegment->hash = PMSTORE_RESUME_HASH_INIT;
+		pmsegment->resume_entries = 0;
+		pmsegment->streamed = pmstore_download_streaming(pm_store,
+								 inst_number);
+		pmsegment->resumable = pmstore_download_active(pm_store,
+							       inst_number);
+
+		if (pmsegment->resumable) {
+			pmstore_resume_load(ctx, pm_store, pmsegment);
+		}
 	}
 
 	// It is correct to expect segments to come in order
@@ -657,25 +693,302 @@ int pmstore_segment_data_event(Context *ctx, struct PMStore *pm_store,
 		return 0;
 	}
 
-	pmsegment->empiric_usage_count = event.segm_data_event_descr.segm_evt_entry_index +
-					event.segm_data_event_descr.segm_evt_entry_count;
+	intu32 index = event.segm_data_event_descr.segm_evt_entry_index;
+	intu32 count = event.segm_data_event_descr.segm_evt_entry_count;
+	intu8 *entries = event.segm_data_event_entries.value;
+	int length = event.segm_data_event_entries.length;
+
+	if (pmsegment->resume_entries > index) {
+		// delivered by an interrupted transfer: check and drop
+		intu32 dup = pmsegment->resume_entries - index;
+		int changed = 0;
+
+		if (dup > count) {
+			dup = count;
+		}
+
+		int dup_length = dup * pmsegment_entry_size(pmsegment);
+
+		if (dup_length > length) {
+			changed = 1;
+		} else {
+			pmsegment->hash = pmstore_resume_hash(pmsegment->hash,
+							      entries, dup_length);
+
+			if (index + dup == pmsegment->resume_entries) {
+				changed = pmsegment->hash != pmsegment->resume_hash;
+				pmsegment->resume_entries = 0;
+			} else if (last) {
+				changed = 1;
+			}
+		}
+
+		if (changed) {
+			DEBUG("PM-Segment %d changed, transferring again",
+			      inst_number);
+			pmstore_resume_forget(ctx, pm_store, inst_number);
+			pmstore_segment_discard(pmsegment);
+			pmsegment->resume_entries = 0;
+			// nothing to keep for the aborted transfer
+			pmsegment->resumable = 0;
+			pmstore_download_segment_retry(pm_store, inst_number);
+			return 0;
+		}
+
+		index += dup;
+		count -= dup;
+		entries += dup_length;
+		length -= dup_length;
+	}
+
+	if (pmsegment->fixed_segment_data.length + length > PMSTORE_PENDING_MAX) {
+		// bulk work fell behind: catch up before buffering more
+		pmstore_segment_process(ctx, pm_store, pmsegment, ~0ULL);
+	}
+
+	pmsegment->hash = pmstore_resume_hash(pmsegment->hash, entries, length);
+	pmsegment->empiric_usage_count = index + count;
+
+	if (pmsegment->fixed_segment_data.length == 0) {
+		pmsegment->buffered_index = index;
+	}
 
 	int offset = pmsegment->fixed_segment_data.length;
-	pmsegment->fixed_segment_data.length += event.segm_data_event_entries.length;
+	pmsegment->fixed_segment_data.length += length;
 
 	pmsegment->fixed_segment_data.value = realloc(pmsegment->fixed_segment_data.value,
 		  				      pmsegment->fixed_segment_data.length);
 
-	memcpy(&(pmsegment->fixed_segment_data.value[offset]),
-	       	event.segm_data_event_entries.value,
-		event.segm_data_event_entries.length);
+	memcpy(&(pmsegment->fixed_segment_data.value[offset]), entries, length);
+
+	return 1;
+}
+
+/**
+ * Drops entries of a segment not delivered yet
+ *
+ * \param segment the PM-Segment
+ */
+static void pmstore_segment_discard(struct PMSegment *segment)
+{
+	free(segment->fixed_segment_data.value);
+	segment->fixed_segment_data.value = NULL;
+	segment->fixed_segment_data.length = 0;
+	segment->buffered_index = segment->empiric_usage_count;
+	data_list_del(segment->decoded);
+	segment->decoded = NULL;
+	segment->complete = 0;
+}
+
+/**
+ * Gives up the transfer of a segment: entries already received are
+ * decoded and, for a segment delivered whole, kept to resume the
+ * download later. See pmstore_resume_keep().
+ *
+ * Must be called in a thread safe communication context.
+ *
+ * \param ctx the device context
+ * \param pm_store the PMStore
+ * \param segment the PM-Segment
+ */
+void pmstore_segment_abandon(Context *ctx, struct PMStore *pm_store,
+				struct PMSegment *segment)
+{
+	if (segment->fixed_segment_data.length > 0) {
+		pmstore_segment_process(ctx, pm_store, segment, ~0ULL);
+	}
+
+	if (segment->resumable && !segment->streamed) {
+		pmstore_resume_keep(ctx, pm_store, segment);
+	}
+
+	pmstore_segment_discard(segment);
+}
+
+/**
+ * Moves decoded entries to the list of a segment delivered whole
+ *
+ * \param segment the PM-Segment
+ * \param entry "PM-Segment" compound entry, whose contents are taken
+ */
+static void pmstore_segment_keep(struct PMSegment *segment, DataEntry *entry)
+{
+	DataEntry *kept;
+	int count;
+
+	if (!segment->decoded) {
+		segment->decoded = data_list_new(1);
+		segment->decoded->values[0] = *entry;
+		return;
+	}
+
+	kept = &segment->decoded->values[0];
+	count = kept->u.compound.entries_count + entry->u.compound.entries_count;
+
+	kept->u.compound.entries = realloc(kept->u.compound.entries,
+					   count * sizeof(DataEntry));
+	memcpy(&kept->u.compound.entries[kept->u.compound.entries_count],
+	       entry->u.compound.entries,
+	       entry->u.compound.entries_count * sizeof(DataEntry));
+	kept->u.compound.entries_count = count;
+
+	free(entry->u.compound.entries);
+	free(entry->u.compound.name);
+}
+
+/**
+ * Decodes and delivers the entries of a Segment-Data-Event, after it
+ * was stored by pmstore_segment_data_event() and confirmed to the
+ * agent. Streamed downloads get the entries of every event; otherwise
+ * the whole segment is delivered when its last entry arrives.
+ *
+ * Decoding is deferred to the bulk work scheduler when it is enabled,
+ * see pmstore_sched_set().
+ *
+ * \param ctx
+ * \param pm_store the PMStore.
+ * \param descr the event description.
+ * \param ok 1 if the event was stored, 0 if the transfer was aborted
+ */
+void pmstore_segment_data_decode(Context *ctx, struct PMStore *pm_store,
+				SegmDataEventDescr descr, int ok)
+{
+	struct PMSegment *pmsegment;
+	InstNumber inst_number = descr.segm_instance;
+	int last = descr.segm_evt_status & SEVTSTA_LAST_ENTRY;
+
+	pmsegment = pmstore_get_segment_by_inst_number(pm_store, inst_number);
+
+	if (!ok || !pmsegment) {
+		if (pmsegment) {
+			pmstore_segment_abandon(ctx, pm_store, pmsegment);
+		}
+
+		pmstore_download_segment_failed(ctx, pm_store, inst_number);
+		return;
+	}
 
 	if (last) {
-		DEBUG("Decoding PM-Segment data...");
-		decode_fixed_segment_data(ctx, pm_store, pmsegment, last);
+		pmsegment->complete = 1;
+		pmstore_download_segment_received(ctx, pm_store, inst_number);
 	}
 
-	return 1;
+	if (pmstore_sched_add(ctx, pm_store, pmsegment)) {
+		return;
+	}
+
+	pmstore_segment_process(ctx, pm_store, pmsegment, ~0ULL);
+}
+
+/**
+ * Decodes buffered entries of a segment, delivering them to the
+ * download that streams them or keeping them until the segment is
+ * complete. Entries are decoded PMSTORE_DECODE_BATCH at a time, until
+ * none is left or the time budget is spent; at least one batch is
+ * decoded per call.
+ *
+ * Must be called in a thread safe communication context.
+ *
+ * \param ctx the device context
+ * \param pm_store the PMStore
+ * \param segment the PM-Segment
+ * \param budget_ns time budget, in nanoseconds
+ * \return 1 if work is left, 0 otherwise
+ */
+int pmstore_segment_process(Context *ctx, struct PMStore *pm_store,
+				struct PMSegment *segment,
+				unsigned long long budget_ns)
+{
+	unsigned long long start = stats_now_ns();
+	int size = pmsegment_entry_size(segment);
+	InstNumber inst_number = segment->instance_number;
+
+	while (segment->fixed_segment_data.length > 0) {
+		octet_string *data = &segment->fixed_segment_data;
+		int count = segment->empiric_usage_count - segment->buffered_index;
+		int length = data->length;
+		DataEntry entry;
+
+		if (size > 0 && count > PMSTORE_DECODE_BATCH &&
+		    count * size == data->length) {
+			count = PMSTORE_DECODE_BATCH;
+			length = count * size;
+		}
+
+		memset(&entry, 0, sizeof(DataEntry));
+		pmstore_populate_all_attributes(ctx->mds, pm_store, segment,
+						data->value, length, count,
+						&entry);
+
+		if (!segment->streamed) {
+			pmstore_segment_keep(segment, &entry);
+		} else if (pm_store->download) {
+			PMStoreDownloadOptions *options = &pm_store->download->options;
+			DataList *list = data_list_new(1);
+
+			list->values[0] = entry;
+			options->entries(ctx, pm_store->handle, inst_number,
+					 segment->buffered_index, list,
+					 options->user_data);
+		} else {
+			// download cancelled meanwhile
+			data_entry_del(&entry);
+		}
+
+		data->length -= length;
+		memmove(data->value, data->value + length, data->length);
+		segment->buffered_index += count;
+
+		if (data->length == 0) {
+			free(data->value);
+			data->value = NULL;
+		}
+
+		if (stats_now_ns() - start >= budget_ns) {
+			break;
+		}
+	}
+
+	if (segment->fixed_segment_data.length > 0) {
+		return 1;
+	}
+
+	// entries still being checked against an earlier transfer
+	// are not delivered yet
+	if (segment->resumable && !segment->resume_entries &&
+	    (segment->streamed || segment->complete)) {
+		pmstore_resume_save(ctx, pm_store, segment, segment->complete);
+	}
+
+	if (!segment->complete) {
+		return 0;
+	}
+
+	segment->complete = 0;
+
+	if (!segment->streamed) {
+		DataList *list = segment->decoded;
+
+		segment->decoded = NULL;
+
+		if (!list && !segment->buffered_index) {
+			// empty segment
+			list = data_list_new(1);
+			pmstore_populate_all_attributes(ctx->mds, pm_store,
+							segment, NULL, 0, 0,
+							&list->values[0]);
+		}
+
+		if (list) {
+			DEBUG("Delivering PM-Segment data...");
+			manager_notify_evt_segment_data(ctx, pm_store->handle,
+							inst_number, list);
+		}
+	}
+
+	pmstore_download_segment_delivered(ctx, pm_store, inst_number);
+
+	return 0;
 }
 
 /**
@@ -878,6 +1191,39 @@ struct PMSegment *pmstore_get_segment_by_inst_number(struct PMStore *pm_store,
 	return NULL;
 }
 
+/**
+ * Makes room for at least count PM-segments, so that adding them does
+ * not reallocate the segment list.
+ *
+ * \param pm_store the PMStore.
+ * \param count number of PM-segments, at most PMSTORE_SEGMENTS_MAX.
+ * \return 1 if operation succeeds, 0 otherwise
+ */
+int pmstore_reserve_segments(struct PMStore *pm_store, int count)
+{
+	struct PMSegment **list;
+
+	if (count > PMSTORE_SEGMENTS_MAX) {
+		return 0;
+	}
+
+	if (count <= pm_store->segment_list_size) {
+		return 1;
+	}
+
+	list = realloc(pm_store->segm_list, count * sizeof(struct PMSegment *));
+
+	if (list == NULL) {
+		ERROR("PM-Store segm list");
+		return 0;
+	}
+
+	pm_store->segm_list = list;
+	pm_store->segment_list_size = count;
+
+	return 1;
+}
+
 /**
  * Adds a new segment into PMStore.
  *
@@ -900,18 +1246,20 @@ void pmstore_add_segment(struct PMStore *pm_store, struct PMSegment *segment)
 		return;
 	}
 
-	// test if there is not elements in the list
-	if (pm_store->segment_list_count == 0) {
-		pm_store->segm_list = calloc(1, sizeof(struct PMSegment *));
+	if (pm_store->segment_list_count >= pm_store->segment_list_size) {
+		int size = pm_store->segment_list_size * 2;
 
-	} else { // change the list size
-		pm_store->segm_list = realloc(pm_store->segm_list,
-					      sizeof(struct PMSegment *)
-					      * (pm_store->segment_list_count
-						 + 1));
+		if (size < PMSTORE_SEGMENTS_INITIAL_SIZE) {
+			size = PMSTORE_SEGMENTS_INITIAL_SIZE;
+		} else if (size > PMSTORE_SEGMENTS_MAX) {
+			size = PMSTORE_SEGMENTS_MAX;
+		}
 
-		if (pm_store->segm_list == NULL) {
-			ERROR("PM-Store segm list");
+		if (pm_store->segment_list_count >= size
+		    || !pmstore_reserve_segments(pm_store, size)) {
+			pmsegment_destroy(segment);
+			free(segment);
+			return;
 		}
 	}
 
@@ -1063,14 +1411,19 @@ int pmstore_set_attribute(struct PMStore *pmstore, OID_Type attr_id, ByteStreamR
 }
 
 /**
- * Scan a segment of index segment_index, decode segment data and generate xml
+ * Scan entries of a segment, decode segment data and generate xml
  *
  * \param pmstore the PMStore.
  * \param segment the PMSegment
+ * \param data encoded entries
+ * \param length length of data
+ * \param entry_count number of entries in data
  * \param segm_data_entry output parameter to describe data value.
  */
 static void pmstore_populate_all_attributes(struct MDS *mds, struct PMStore *pmstore,
 						struct PMSegment *segment, 
+						intu8 *data, int length,
+						int entry_count,
 						DataEntry *segm_data_entry)
 {
 	int error = 0;
@@ -1079,15 +1432,12 @@ static void pmstore_populate_all_attributes(struct MDS *mds, struct PMStore *pms
 	RelativeTime rel_time; // length 4
 	HighResRelativeTime hires_rel_time;	// 8
 
-	int entry_count = segment->empiric_usage_count;
-
 	segm_data_entry->choice = COMPOUND_DATA_ENTRY;
 	segm_data_entry->u.compound.name = data_strcp("PM-Segment");
 	segm_data_entry->u.compound.entries_count = entry_count;
 	segm_data_entry->u.compound.entries = calloc(entry_count, sizeof(DataEntry));
 
-	ByteStreamReader *stream = byte_stream_reader_instance(segment->fixed_segment_data.value,
-							       segment->fixed_segment_data.length);
+	ByteStreamReader *stream = byte_stream_reader_instance(data, length);
 	//  stream length double-checked at the end of every iteration
 	int offset = 0;
 
@@ -1286,7 +1636,7 @@ static void pmstore_populate_all_attributes(struct MDS *mds, struct PMStore *pms
 			break;
 		}
 
-		if (offset > segment->fixed_segment_data.length) {
+		if (offset > length) {
 			DEBUG("PM-Segment buffer overrun");
 			segm_data_entry->u.compound.entries_count = i;
 			break;
@@ -1296,29 +1646,6 @@ static void pmstore_populate_all_attributes(struct MDS *mds, struct PMStore *pms
 	free(stream);
 }
 
-/**
- * Choose a segment to decode fixed segment data
- *
- * \param ctx
- * \param pmstore the PMStore.
- *
- */
-static void decode_fixed_segment_data(Context *ctx, struct PMStore *pmstore,
-					struct PMSegment *segment, int last)
-{
-	if (last) {
-		DataList *list = data_list_new(1);
-
-		pmstore_populate_all_attributes(ctx->mds, pmstore, segment,
-						&list->values[0]);
-
-		manager_notify_evt_segment_data(ctx, pmstore->handle,
-						segment->instance_number,
-						list);
-	}
-}
-
-
 /**
  * Finalizes and deallocate the given PMStore.
  *
@@ -1339,9 +1666,11 @@ void pmstore_destroy(struct PMStore *pm_store)
 
 			free(pm_store->segm_list);
 			pm_store->segm_list = NULL;
+			pm_store->segment_list_size = 0;
 		}
 
 		del_octet_string(&pm_store->pm_store_label);
+		pmstore_download_destroy(pm_store);
 	}
 }
 
@@ -34,11 +34,21 @@
 #include "nomenclature.h"
 #include "dim.h"
 #include "pmsegment.h"
+#include "pmstore_download.h"
 #include "util/bytelib.h"
 #include "communication/service.h"
 #include "asn1/phd_types.h"
 #include "api/api_definitions.h"
 
+/**
+ * Initial allocated length of the PM-segment list
+ */
+#define PMSTORE_SEGMENTS_INITIAL_SIZE 4
+
+/**
+ * Maximum length of the PM-segment list
+ */
+#define PMSTORE_SEGMENTS_MAX 0xFFFF
 
 /**
  * \brief The PMStore is an struct defining attributes that are common
@@ -155,10 +165,20 @@ struct PMStore {
 	 */
 	intu16 segment_list_count;
 
+	/**
+	 * Allocated length of segm_list
+	 */
+	intu16 segment_list_size;
+
 	/**
 	 * List of PM-Segments belonging to this PM-Store
 	 */
 	struct PMSegment **segm_list;
+
+	/**
+	 * Download started by manager_download_pmstore(), if any
+	 */
+	PMStoreDownload *download;
 };
 
 struct PMStore *pmstore_instance();
@@ -195,6 +215,8 @@ void pmstore_clear_segment_result(struct PMStore *pmstore, struct RequestRet *re
 
 void pmstore_add_segment(struct PMStore *pm_store, struct PMSegment *segment);
 
+int pmstore_reserve_segments(struct PMStore *pm_store, int count);
+
 void pmstore_remove_selected_segm(struct PMStore *pm_store, intu16 *selection,
 				  intu16 length);
 
@@ -203,6 +225,16 @@ int pmstore_get_nomenclature_code();
 int pmstore_segment_data_event(Context *ctx, struct PMStore *pm_store,
 				SegmentDataEvent event);
 
+void pmstore_segment_data_decode(Context *ctx, struct PMStore *pm_store,
+				SegmDataEventDescr descr, int ok);
+
+void pmstore_segment_abandon(Context *ctx, struct PMStore *pm_store,
+				struct PMSegment *segment);
+
+int pmstore_segment_process(Context *ctx, struct PMStore *pm_store,
+				struct PMSegment *segment,
+				unsigned long long budget_ns);
+
 Request  *pmstore_service_action_clear_segments_send_command(Context *ctx, struct PMStore *pm_store,
 		SegmSelection *selection, service_request_callback request_callback);
 
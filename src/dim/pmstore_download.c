@@ -0,0 +1,517 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pmstore_download.c
+ * \brief PM-Store bulk download.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jul 03, 2012
+ */
+
+/**
+ * \addtogroup PMStore
+ * @{
+ *
+ * Downloads every PM-segment of a PM-Store without the application
+ * having to drive each Get-Segment-Info, Trig-Segment-Data-Xfer and
+ * Clear-Segments request itself.
+ *
+ * An agent transfers one segment of a PM-Store at a time, so segments
+ * are triggered one after the other; the next one is triggered as soon
+ * as the last entries of the current one arrive, before they are
+ * decoded and delivered, so the agent never waits for the application.
+ * Each PM-Store and each agent has its own download, so downloads of
+ * several stores and several agents run side by side.
+ */
+
+#include <stdlib.h>
+#include "pmstore_download.h"
+#include "pmstore.h"
+#include "pmstore_req.h"
+#include "pmstore_resume.h"
+#include "src/dim/mds.h"
+#include "src/util/log.h"
+
+static void download_transfer_next(Context *ctx, struct PMStore *pmstore);
+
+/**
+ * Finds the PM-Store of a handle
+ *
+ * \param ctx the device context
+ * \param handle the PM-Store handle
+ * \return the PM-Store, or NULL
+ */
+static struct PMStore *download_pmstore(Context *ctx, int handle)
+{
+	struct MDS_object *mds_obj;
+
+	if (!ctx->mds) {
+		return NULL;
+	}
+
+	mds_obj = mds_get_object_by_handle(ctx->mds, handle);
+
+	if (!mds_obj || mds_obj->choice != MDS_OBJ_PMSTORE) {
+		return NULL;
+	}
+
+	return &mds_obj->u.pmstore;
+}
+
+/**
+ * Ends the download of a PM-Store if nothing is left to do
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ */
+static void download_finish(Context *ctx, struct PMStore *pmstore)
+{
+	PMStoreDownload *download = pmstore->download;
+
+	if (download->current >= 0 || download->next < download->count ||
+	    download->clearing > 0 || download->delivering > 0) {
+		return;
+	}
+
+	DEBUG("PM-Store %d download: %d segments, %d failures",
+	      pmstore->handle, download->completed, download->failed);
+
+	pmstore->download = NULL;
+
+	if (download->options.done) {
+		download->options.done(ctx, pmstore->handle,
+				       download->completed, download->failed,
+				       download->options.user_data);
+	}
+
+	free(download->segments);
+	free(download);
+}
+
+/**
+ * Callback of Clear-Segments
+ */
+static void download_clear_cb(Context *ctx, Request *r, DATA_apdu *response_apdu)
+{
+	PMStoreClearSegmRet *ret = (PMStoreClearSegmRet *) r->return_data;
+	struct PMStore *pmstore;
+
+	if (!ret) {
+		return;
+	}
+
+	pmstore = download_pmstore(ctx, ret->handle);
+
+	if (!pmstore || !pmstore->download) {
+		return;
+	}
+
+	pmstore->download->clearing--;
+
+	if (ret->error) {
+		WARNING("PM-Store %d download: clear failed, %d %d",
+			ret->handle, ret->error, ret->error_detail);
+		pmstore->download->failed++;
+	} else {
+		pmstore_resume_forget(ctx, pmstore, ret->inst);
+	}
+
+	download_finish(ctx, pmstore);
+}
+
+/**
+ * Clears a delivered segment, if the download was asked to
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ */
+static void download_clear(Context *ctx, struct PMStore *pmstore, InstNumber inst)
+{
+	PMStoreDownload *download = pmstore->download;
+
+	if (!download->options.clear_segments) {
+		return;
+	}
+
+	if (mds_service_clear_segment(ctx, pmstore->handle, inst,
+				      download_clear_cb)) {
+		download->clearing++;
+	} else {
+		download->failed++;
+	}
+}
+
+/**
+ * Callback of Trig-Segment-Data-Xfer. Data comes afterwards, in
+ * Segment-Data-Events.
+ */
+static void download_trig_cb(Context *ctx, Request *r, DATA_apdu *response_apdu)
+{
+	PMStoreGetSegmDataRet *ret = (PMStoreGetSegmDataRet *) r->return_data;
+	PMStoreDownload *download;
+	struct PMStore *pmstore;
+
+	if (!ret) {
+		return;
+	}
+
+	pmstore = download_pmstore(ctx, ret->handle);
+
+	if (!pmstore || !pmstore->download || !ret->error) {
+		return;
+	}
+
+	download = pmstore->download;
+
+	if (ret->error == 3 && ret->error_detail == TSXR_FAIL_SEGM_EMPTY) {
+		DEBUG("PM-Store %d download: segment %d is empty",
+		      pmstore->handle, download->current);
+	} else {
+		WARNING("PM-Store %d download: segment %d refused, %d %d",
+			pmstore->handle, download->current,
+			ret->error, ret->error_detail);
+		download->failed++;
+	}
+
+	download->current = -1;
+	download_transfer_next(ctx, pmstore);
+	download_finish(ctx, pmstore);
+}
+
+/**
+ * Callback of Get-Segment-Info, which fills the segment list of the
+ * PM-Store
+ */
+static void download_info_cb(Context *ctx, Request *r, DATA_apdu *response_apdu)
+{
+	PMStoreGetSegmInfoRet *ret = (PMStoreGetSegmInfoRet *) r->return_data;
+	PMStoreDownload *download;
+	struct PMStore *pmstore;
+	int i;
+
+	if (!ret) {
+		return;
+	}
+
+	pmstore = download_pmstore(ctx, ret->handle);
+
+	if (!pmstore || !pmstore->download) {
+		return;
+	}
+
+	download = pmstore->download;
+
+	if (ret->error) {
+		WARNING("PM-Store %d download: no segment info, %d %d",
+			ret->handle, ret->error, ret->error_detail);
+		download->failed++;
+		download_finish(ctx, pmstore);
+		return;
+	}
+
+	download->segments = calloc(pmstore->segment_list_count + 1,
+				    sizeof(InstNumber));
+
+	for (i = 0; i < pmstore->segment_list_count; ++i) {
+		download->segments[i] = pmstore->segm_list[i]->instance_number;
+	}
+
+	download->count = pmstore->segment_list_count;
+
+	DEBUG("PM-Store %d download: %d segments", pmstore->handle,
+	      download->count);
+
+	download_transfer_next(ctx, pmstore);
+	download_finish(ctx, pmstore);
+}
+
+/**
+ * Triggers the transfer of the next segment, unless one is running
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ */
+static void download_transfer_next(Context *ctx, struct PMStore *pmstore)
+{
+	PMStoreDownload *download = pmstore->download;
+	TrigSegmDataXferReq trig;
+
+	while (download->current < 0 && download->next < download->count) {
+		struct PMSegment *segment;
+
+		trig.seg_inst_no = download->segments[download->next++];
+		segment = pmstore_get_segment_by_inst_number(pmstore, trig.seg_inst_no);
+
+		if (!segment) {
+			// cleared by someone else meanwhile
+			continue;
+		}
+
+		if (pmstore_resume_delivered(ctx, pmstore, segment)) {
+			DEBUG("PM-Store %d download: segment %d already delivered",
+			      pmstore->handle, trig.seg_inst_no);
+			download->completed++;
+			download_clear(ctx, pmstore, trig.seg_inst_no);
+			continue;
+		}
+
+		if (pmstore_service_action_trig_segment_data_xfer(ctx, pmstore,
+				&trig, download_trig_cb)) {
+			download->current = trig.seg_inst_no;
+		} else {
+			download->failed++;
+		}
+	}
+}
+
+/**
+ * Starts downloading all segments of a PM-Store.
+ *
+ * Must be called in a thread safe communication context.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param options download options, copied
+ * \return 1 if operation succeeds, 0 otherwise
+ */
+int pmstore_download_start(Context *ctx, struct PMStore *pmstore,
+				const PMStoreDownloadOptions *options)
+{
+	PMStoreDownload *download;
+
+	if (pmstore->download) {
+		ERROR("PM-Store %d download already running", pmstore->handle);
+		return 0;
+	}
+
+	download = calloc(1, sizeof(PMStoreDownload));
+	download->options = *options;
+	download->current = -1;
+	download->retry = -1;
+	pmstore->download = download;
+
+	if (!mds_service_get_segment_info(ctx, pmstore->handle, download_info_cb)) {
+		pmstore->download = NULL;
+		free(download);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Tells whether a segment is being transferred by a download
+ *
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ * \return 1 if so, 0 otherwise
+ */
+int pmstore_download_active(struct PMStore *pmstore, InstNumber inst)
+{
+	return pmstore->download && pmstore->download->current == inst;
+}
+
+/**
+ * Tells whether the entries of a segment are streamed to a download
+ * callback, instead of being accumulated until the last one.
+ *
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ * \return 1 if entries are streamed, 0 otherwise
+ */
+int pmstore_download_streaming(struct PMStore *pmstore, InstNumber inst)
+{
+	return pmstore_download_active(pmstore, inst) &&
+	       pmstore->download->options.entries;
+}
+
+/**
+ * Asks for a segment to be transferred again once its current
+ * transfer is aborted, e.g. because it differs from what an earlier
+ * transfer delivered.
+ *
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ */
+void pmstore_download_segment_retry(struct PMStore *pmstore, InstNumber inst)
+{
+	if (pmstore_download_active(pmstore, inst)) {
+		pmstore->download->retry = inst;
+	}
+}
+
+/**
+ * Notifies that the last entries of a segment arrived. The next
+ * segment is triggered right away, while this one is decoded.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ */
+void pmstore_download_segment_received(Context *ctx, struct PMStore *pmstore,
+					InstNumber inst)
+{
+	PMStoreDownload *download = pmstore->download;
+
+	if (!download || download->current != inst) {
+		return;
+	}
+
+	download->completed++;
+	download->delivering++;
+	download->current = -1;
+	download_transfer_next(ctx, pmstore);
+}
+
+/**
+ * Notifies that a segment was delivered to the application, so that
+ * it can be cleared.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ */
+void pmstore_download_segment_delivered(Context *ctx, struct PMStore *pmstore,
+					InstNumber inst)
+{
+	PMStoreDownload *download = pmstore->download;
+	int i;
+
+	if (!download) {
+		return;
+	}
+
+	for (i = 0; i < download->next; ++i) {
+		if (download->segments[i] == inst) {
+			break;
+		}
+	}
+
+	if (i >= download->next || download->current == inst ||
+	    download->delivering <= 0) {
+		return;
+	}
+
+	download->delivering--;
+	download_clear(ctx, pmstore, inst);
+	download_finish(ctx, pmstore);
+}
+
+/**
+ * Notifies that the transfer of a segment was aborted
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ */
+void pmstore_download_segment_failed(Context *ctx, struct PMStore *pmstore,
+					InstNumber inst)
+{
+	PMStoreDownload *download = pmstore->download;
+
+	if (!download || download->current != inst) {
+		return;
+	}
+
+	download->current = -1;
+
+	if (download->retry == inst) {
+		// transfer_next() takes it again
+		download->retry = -1;
+		download->next--;
+	} else {
+		WARNING("PM-Store %d download: segment %d aborted",
+			pmstore->handle, inst);
+		download->failed++;
+	}
+
+	download_transfer_next(ctx, pmstore);
+	download_finish(ctx, pmstore);
+}
+
+/**
+ * Ends all downloads of a device, e.g. when it leaves the operating
+ * state. Segments not transferred yet count as failures; entries of
+ * the segment being transferred are kept to resume it.
+ *
+ * \param ctx the device context
+ */
+void pmstore_download_cancel_all(Context *ctx)
+{
+	int i;
+
+	if (!ctx->mds) {
+		return;
+	}
+
+	for (i = 0; i < ctx->mds->objects_list_count; ++i) {
+		struct MDS_object *mds_obj = &ctx->mds->objects_list[i];
+		PMStoreDownload *download;
+
+		if (mds_obj->choice != MDS_OBJ_PMSTORE ||
+		    !mds_obj->u.pmstore.download) {
+			continue;
+		}
+
+		download = mds_obj->u.pmstore.download;
+		download->failed += download->count - download->next;
+
+		if (download->current >= 0 || !download->segments) {
+			download->failed++;
+		}
+
+		if (download->current >= 0) {
+			struct PMSegment *segment;
+
+			segment = pmstore_get_segment_by_inst_number(
+					&mds_obj->u.pmstore, download->current);
+
+			if (segment) {
+				pmstore_segment_abandon(ctx, &mds_obj->u.pmstore,
+							segment);
+			}
+		}
+
+		download->current = -1;
+		download->next = download->count;
+		download->clearing = 0;
+		download->delivering = 0;
+		download_finish(ctx, &mds_obj->u.pmstore);
+	}
+}
+
+/**
+ * Frees the download of a PM-Store, if any, without notifying
+ *
+ * \param pmstore the PM-Store
+ */
+void pmstore_download_destroy(struct PMStore *pmstore)
+{
+	if (pmstore->download) {
+		free(pmstore->download->segments);
+		free(pmstore->download);
+		pmstore->download = NULL;
+	}
+}
+
+/** @} */
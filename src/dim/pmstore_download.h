@@ -0,0 +1,139 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pmstore_download.h
+ * \brief PM-Store bulk download header.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jul 03, 2012
+ */
+
+/**
+ * @addtogroup PMStore
+ * @{
+ */
+
+#ifndef PMSTORE_DOWNLOAD_H_
+#define PMSTORE_DOWNLOAD_H_
+
+#include <asn1/phd_types.h>
+#include <api/api_definitions.h>
+#include <communication/context.h>
+
+/**
+ * Called with the entries of each Segment-Data-Event, as soon as they
+ * are decoded. DataList ownership is passed to the callee.
+ */
+typedef void (*pmstore_download_entries_callback)(Context *ctx, int handle,
+					int instnumber, intu32 first_entry,
+					DataList *list, void *user_data);
+
+/**
+ * Called once when a download finishes, successfully or not
+ */
+typedef void (*pmstore_download_done_callback)(Context *ctx, int handle,
+					int segments, int failed,
+					void *user_data);
+
+/**
+ * Options of manager_download_pmstore()
+ */
+typedef struct PMStoreDownloadOptions {
+	/**
+	 * Clear each PM-segment in the agent once its data was delivered
+	 */
+	int clear_segments;
+	/**
+	 * If set, entries are streamed to this function as they arrive
+	 * and are not kept in memory; otherwise every segment is handed
+	 * whole to the segment_data_received listeners
+	 */
+	pmstore_download_entries_callback entries;
+	/**
+	 * Optional, called when all segments were tried
+	 */
+	pmstore_download_done_callback done;
+	void *user_data;
+} PMStoreDownloadOptions;
+
+/**
+ * Progress of a download, kept by the PM-Store
+ */
+typedef struct PMStoreDownload {
+	PMStoreDownloadOptions options;
+	/**
+	 * Instance numbers of the segments to download, in order
+	 */
+	InstNumber *segments;
+	int count;
+	/**
+	 * Index in segments of the next segment to transfer
+	 */
+	int next;
+	/**
+	 * Instance number of the segment being transferred, -1 if none
+	 */
+	int current;
+	/**
+	 * Clear commands sent and not answered yet
+	 */
+	int clearing;
+	/**
+	 * Segments received and not delivered yet
+	 */
+	int delivering;
+	/**
+	 * Instance number of a segment to transfer again after it
+	 * aborts, -1 if none
+	 */
+	int retry;
+	int completed;
+	int failed;
+} PMStoreDownload;
+
+struct PMStore;
+
+int pmstore_download_start(Context *ctx, struct PMStore *pmstore,
+				const PMStoreDownloadOptions *options);
+
+int pmstore_download_active(struct PMStore *pmstore, InstNumber inst);
+
+int pmstore_download_streaming(struct PMStore *pmstore, InstNumber inst);
+
+void pmstore_download_segment_retry(struct PMStore *pmstore, InstNumber inst);
+
+void pmstore_download_segment_received(Context *ctx, struct PMStore *pmstore,
+					InstNumber inst);
+
+void pmstore_download_segment_delivered(Context *ctx, struct PMStore *pmstore,
+					InstNumber inst);
+
+void pmstore_download_segment_failed(Context *ctx, struct PMStore *pmstore,
+					InstNumber inst);
+
+void pmstore_download_cancel_all(Context *ctx);
+
+void pmstore_download_destroy(struct PMStore *pmstore);
+
+/** @} */
+
+#endif /* PMSTORE_DOWNLOAD_H_ */
@@ -0,0 +1,369 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pmstore_resume.c
+ * \brief PM-Segment transfer progress.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jul 10, 2012
+ */
+
+/**
+ * \addtogroup PMStore
+ * @{
+ *
+ * Remembers, for each agent, PM-Store and PM-Segment, how many entries
+ * of a download reached the application, so that a download cut by a
+ * disconnection does not deliver them again on the next association.
+ *
+ * An agent always sends a segment from its first entry, so entries are
+ * still transferred; the ones already delivered are checked against
+ * the hash of the first transfer and dropped without being decoded.
+ * Segments delivered whole are not transferred again, unless their
+ * Segment-Usage-Count shows new entries. A segment to be delivered
+ * whole that was cut keeps the entries decoded so far, so that they
+ * are neither decoded nor lost on the next transfer.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pmstore_resume.h"
+#include "pmstore.h"
+#include "pmsegment.h"
+#include "src/dim/mds.h"
+#include "src/api/data_list.h"
+#include "src/util/log.h"
+
+/**
+ * Progress of PM-Segments, in no particular order
+ */
+static PMSegmentProgress progress[PMSTORE_RESUME_MAX];
+
+/**
+ * Number of used entries of progress
+ */
+static int progress_count = 0;
+
+/**
+ * Source of PMSegmentProgress.stamp
+ */
+static unsigned long long progress_stamp = 0;
+
+/**
+ * Protects progress
+ */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Hashes entries (64-bit FNV-1a), continuing a previous hash
+ *
+ * \param hash previous hash, or PMSTORE_RESUME_HASH_INIT
+ * \param data entries
+ * \param length length of data
+ * \return the hash
+ */
+unsigned long long pmstore_resume_hash(unsigned long long hash,
+					const intu8 *data, int length)
+{
+	int i;
+
+	for (i = 0; i < length; ++i) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Finds the progress of a segment. Must be called with mutex locked.
+ *
+ * \return the progress, or NULL
+ */
+static PMSegmentProgress *progress_find(octet_string *system_id,
+					ASN1_HANDLE handle, InstNumber inst)
+{
+	int i;
+
+	for (i = 0; i < progress_count; ++i) {
+		PMSegmentProgress *p = &progress[i];
+
+		if (p->handle == handle && p->inst == inst &&
+		    p->system_id.length == system_id->length &&
+		    memcmp(p->system_id.value, system_id->value,
+			   system_id->length) == 0) {
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Removes a progress entry. Must be called with mutex locked.
+ */
+static void progress_remove(PMSegmentProgress *p)
+{
+	free(p->system_id.value);
+	data_list_del(p->kept);
+	*p = progress[--progress_count];
+}
+
+/**
+ * Tells whether two absolute times are equal
+ */
+static int same_time(AbsoluteTime *a, AbsoluteTime *b)
+{
+	return a->century == b->century && a->year == b->year &&
+	       a->month == b->month && a->day == b->day &&
+	       a->hour == b->hour && a->minute == b->minute &&
+	       a->second == b->second && a->sec_fractions == b->sec_fractions;
+}
+
+/**
+ * Prepares a segment whose transfer is starting to skip the entries
+ * a previous transfer delivered.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param segment the PM-Segment
+ */
+void pmstore_resume_load(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment)
+{
+	PMSegmentProgress *p;
+
+	segment->resume_entries = 0;
+	segment->resume_hash = 0;
+
+	if (!ctx->mds || !pmsegment_entry_size(segment)) {
+		return;
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	p = progress_find(&ctx->mds->system_id, pmstore->handle,
+			  segment->instance_number);
+
+	if (p && same_time(&p->start_time, &segment->segment_start_abs_time) &&
+	    !(segment->streamed && p->kept)) {
+		segment->resume_entries = p->entries;
+		segment->resume_hash = p->hash;
+
+		if (!segment->streamed && !p->complete) {
+			// delivered along with the rest of the segment
+			segment->decoded = p->kept;
+			p->kept = NULL;
+		}
+
+		DEBUG("PM-Segment %d: resuming after %d entries",
+		      segment->instance_number, p->entries);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Records the progress of a segment
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param segment the PM-Segment
+ * \param entries number of entries received
+ * \param hash hash of the entries received
+ * \param complete whether the last entry was delivered
+ * \param kept entries decoded but not delivered, or NULL; taken
+ */
+static void progress_store(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment, intu32 entries,
+				unsigned long long hash, int complete,
+				DataList *kept)
+{
+	octet_string *system_id = &ctx->mds->system_id;
+	PMSegmentProgress *p;
+
+	pthread_mutex_lock(&mutex);
+
+	p = progress_find(system_id, pmstore->handle, segment->instance_number);
+
+	if (!p) {
+		if (progress_count >= PMSTORE_RESUME_MAX) {
+			PMSegmentProgress *oldest = &progress[0];
+			int i;
+
+			for (i = 1; i < progress_count; ++i) {
+				if (progress[i].stamp < oldest->stamp) {
+					oldest = &progress[i];
+				}
+			}
+
+			progress_remove(oldest);
+		}
+
+		p = &progress[progress_count++];
+		memset(p, 0, sizeof(PMSegmentProgress));
+		p->system_id.value = malloc(system_id->length + 1);
+		memcpy(p->system_id.value, system_id->value, system_id->length);
+		p->system_id.length = system_id->length;
+		p->handle = pmstore->handle;
+		p->inst = segment->instance_number;
+	}
+
+	data_list_del(p->kept);
+
+	p->start_time = segment->segment_start_abs_time;
+	p->entries = entries;
+	p->hash = hash;
+	p->complete = complete;
+	p->kept = kept;
+	p->stamp = ++progress_stamp;
+
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Records that all entries received so far were delivered.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param segment the PM-Segment
+ * \param complete whether the last entry was delivered
+ */
+void pmstore_resume_save(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment, int complete)
+{
+	if (!ctx->mds) {
+		return;
+	}
+
+	progress_store(ctx, pmstore, segment, segment->empiric_usage_count,
+			segment->hash, complete, NULL);
+}
+
+/**
+ * Keeps the entries decoded so far of a segment to be delivered whole
+ * whose transfer was cut, taking segment->decoded. Buffered entries
+ * must have been decoded.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param segment the PM-Segment
+ */
+void pmstore_resume_keep(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment)
+{
+	if (!ctx->mds || !segment->decoded) {
+		return;
+	}
+
+	if (segment->resume_entries) {
+		// still checking the entries kept by an earlier transfer
+		progress_store(ctx, pmstore, segment, segment->resume_entries,
+				segment->resume_hash, 0, segment->decoded);
+	} else {
+		progress_store(ctx, pmstore, segment, segment->buffered_index,
+				segment->hash, 0, segment->decoded);
+	}
+
+	DEBUG("PM-Segment %d: keeping decoded entries",
+	      segment->instance_number);
+
+	segment->decoded = NULL;
+}
+
+/**
+ * Tells whether a segment was delivered whole and has no new entries
+ * since, according to the Segment-Usage-Count of the last segment info.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param segment the PM-Segment
+ * \return 1 if there is nothing to transfer, 0 otherwise
+ */
+int pmstore_resume_delivered(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment)
+{
+	PMSegmentProgress *p;
+	int ret = 0;
+
+	if (!ctx->mds || !segment->segment_usage_count) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	p = progress_find(&ctx->mds->system_id, pmstore->handle,
+			  segment->instance_number);
+
+	if (p && p->complete && p->entries == segment->segment_usage_count &&
+	    same_time(&p->start_time, &segment->segment_start_abs_time)) {
+		ret = 1;
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	return ret;
+}
+
+/**
+ * Forgets the progress of a segment, e.g. after it was cleared
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param inst the segment instance number
+ */
+void pmstore_resume_forget(Context *ctx, struct PMStore *pmstore,
+				InstNumber inst)
+{
+	PMSegmentProgress *p;
+
+	if (!ctx->mds) {
+		return;
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	p = progress_find(&ctx->mds->system_id, pmstore->handle, inst);
+
+	if (p) {
+		progress_remove(p);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Forgets the progress of all segments
+ */
+void pmstore_resume_clear()
+{
+	pthread_mutex_lock(&mutex);
+
+	while (progress_count > 0) {
+		progress_remove(&progress[progress_count - 1]);
+	}
+
+	pthread_mutex_unlock(&mutex);
+}
+
+/** @} */
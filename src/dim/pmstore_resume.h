@@ -0,0 +1,112 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pmstore_resume.h
+ * \brief PM-Segment transfer progress header.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jul 10, 2012
+ */
+
+/**
+ * @addtogroup PMStore
+ * @{
+ */
+
+#ifndef PMSTORE_RESUME_H_
+#define PMSTORE_RESUME_H_
+
+#include <asn1/phd_types.h>
+#include <communication/context.h>
+#include <api/api_definitions.h>
+
+/**
+ * Maximum number of PM-Segments whose progress is remembered
+ */
+#define PMSTORE_RESUME_MAX 256
+
+/**
+ * Initial value of pmstore_resume_hash()
+ */
+#define PMSTORE_RESUME_HASH_INIT 14695981039346656037ULL
+
+/**
+ * Entries of a PM-Segment already delivered to the application
+ */
+typedef struct PMSegmentProgress {
+	/**
+	 * System id of the agent
+	 */
+	octet_string system_id;
+	ASN1_HANDLE handle;
+	InstNumber inst;
+	/**
+	 * Start time of the segment, telling it apart from a segment
+	 * that reuses the instance number after being cleared
+	 */
+	AbsoluteTime start_time;
+	intu32 entries;
+	/**
+	 * Hash of the delivered entries
+	 */
+	unsigned long long hash;
+	/**
+	 * Whether the whole segment was delivered
+	 */
+	int complete;
+	/**
+	 * Entries decoded for a segment delivered whole, if its
+	 * transfer was cut; NULL otherwise
+	 */
+	DataList *kept;
+	/**
+	 * When it was last updated, to forget the oldest
+	 */
+	unsigned long long stamp;
+} PMSegmentProgress;
+
+struct PMStore;
+struct PMSegment;
+
+unsigned long long pmstore_resume_hash(unsigned long long hash,
+					const intu8 *data, int length);
+
+void pmstore_resume_load(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment);
+
+void pmstore_resume_save(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment, int complete);
+
+void pmstore_resume_keep(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment);
+
+int pmstore_resume_delivered(Context *ctx, struct PMStore *pmstore,
+				struct PMSegment *segment);
+
+void pmstore_resume_forget(Context *ctx, struct PMStore *pmstore,
+				InstNumber inst);
+
+void pmstore_resume_clear();
+
+/** @} */
+
+#endif /* PMSTORE_RESUME_H_ */
@@ -0,0 +1,256 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pmstore_sched.c
+ * \brief PM-Segment bulk work scheduler.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jul 17, 2012
+ */
+
+/**
+ * \addtogroup PMStore
+ * @{
+ *
+ * Keeps the decoding and delivery of PM-Segment entries (bulk work)
+ * from delaying scan reports (live work) of the same or other agents.
+ *
+ * Live work is always done as soon as its APDU arrives. Once an
+ * application installs a wakeup function, Segment-Data-Events are
+ * only stored and confirmed when they arrive; their entries are
+ * decoded and delivered later by pmstore_sched_run(), in time slices,
+ * which the application calls when it is idle. Segments are served
+ * round robin, one slice each, so that several downloads share the
+ * time left by live work.
+ *
+ * Without a wakeup function, entries are decoded as they arrive.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "pmstore_sched.h"
+#include "pmstore.h"
+#include "pmsegment.h"
+#include "src/dim/mds.h"
+#include "src/communication/context_manager.h"
+#include "src/util/log.h"
+
+/**
+ * A segment with bulk work pending
+ */
+typedef struct PMStoreWork {
+	ContextId id;
+	ASN1_HANDLE handle;
+	InstNumber inst;
+} PMStoreWork;
+
+/**
+ * Pending work, a circular queue
+ */
+static PMStoreWork *queue = NULL;
+static int queue_size = 0;
+static int queue_head = 0;
+static int queue_count = 0;
+
+/**
+ * Installed by pmstore_sched_set()
+ */
+static pmstore_sched_wakeup wakeup_func = NULL;
+static unsigned long long slice_ns = PMSTORE_SCHED_SLICE_US * 1000ULL;
+
+/**
+ * Protects the variables above
+ */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Appends work to the queue. Must be called with mutex locked.
+ */
+static void queue_push(PMStoreWork work)
+{
+	if (queue_count >= queue_size) {
+		int size = queue_size ? queue_size * 2 : 16;
+		int i;
+
+		queue = realloc(queue, size * sizeof(PMStoreWork));
+
+		// unwrap the elements after the end of the old array
+		for (i = 0; i < queue_head + queue_count - queue_size; ++i) {
+			queue[queue_size + i] = queue[i];
+		}
+
+		queue_size = size;
+	}
+
+	queue[(queue_head + queue_count) % queue_size] = work;
+	++queue_count;
+}
+
+/**
+ * Enables time sliced bulk work, or disables it if wakeup is NULL.
+ *
+ * \param wakeup called when bulk work becomes pending
+ * \param slice_us length of each call of pmstore_sched_run(), in
+ *        microseconds, or 0 for PMSTORE_SCHED_SLICE_US
+ */
+void pmstore_sched_set(pmstore_sched_wakeup wakeup, unsigned int slice_us)
+{
+	pthread_mutex_lock(&mutex);
+	wakeup_func = wakeup;
+	slice_ns = (slice_us ? slice_us : PMSTORE_SCHED_SLICE_US) * 1000ULL;
+	pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Defers the bulk work of a segment to pmstore_sched_run().
+ *
+ * Must be called in a thread safe communication context.
+ *
+ * \param ctx the device context
+ * \param pmstore the PM-Store
+ * \param segment the PM-Segment
+ * \return 1 if the work was deferred, 0 if it must be done right away
+ */
+int pmstore_sched_add(Context *ctx, struct PMStore *pmstore,
+			struct PMSegment *segment)
+{
+	pmstore_sched_wakeup wakeup;
+	PMStoreWork work;
+
+	pthread_mutex_lock(&mutex);
+
+	wakeup = wakeup_func;
+
+	if (!wakeup) {
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+
+	if (segment->scheduled) {
+		pthread_mutex_unlock(&mutex);
+		return 1;
+	}
+
+	work.id = ctx->id;
+	work.handle = pmstore->handle;
+	work.inst = segment->instance_number;
+	queue_push(work);
+	segment->scheduled = 1;
+
+	if (queue_count > 1) {
+		wakeup = NULL;
+	}
+
+	pthread_mutex_unlock(&mutex);
+
+	if (wakeup) {
+		wakeup();
+	}
+
+	return 1;
+}
+
+/**
+ * Does one time slice of bulk work. Takes the context lock of the
+ * segment it works on, so it must not be called with a context locked.
+ *
+ * \return 1 if more work is pending, 0 otherwise
+ */
+int pmstore_sched_run()
+{
+	struct MDS_object *mds_obj;
+	struct PMSegment *segment;
+	unsigned long long budget;
+	PMStoreWork work;
+	Context *ctx;
+	int more = 0;
+
+	pthread_mutex_lock(&mutex);
+
+	if (!queue_count) {
+		pthread_mutex_unlock(&mutex);
+		return 0;
+	}
+
+	work = queue[queue_head];
+	queue_head = (queue_head + 1) % queue_size;
+	--queue_count;
+	budget = slice_ns;
+
+	pthread_mutex_unlock(&mutex);
+
+	ctx = context_get_and_lock(work.id);
+
+	if (ctx) {
+		mds_obj = ctx->mds ? mds_get_object_by_handle(ctx->mds, work.handle)
+			  : NULL;
+
+		if (mds_obj && mds_obj->choice == MDS_OBJ_PMSTORE) {
+			segment = pmstore_get_segment_by_inst_number(
+					&mds_obj->u.pmstore, work.inst);
+
+			if (segment && segment->scheduled) {
+				more = pmstore_segment_process(ctx,
+						&mds_obj->u.pmstore, segment,
+						budget);
+				segment->scheduled = more;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&mutex);
+
+	if (more) {
+		// to the back of the queue, after other segments
+		queue_push(work);
+	}
+
+	more = queue_count > 0;
+
+	pthread_mutex_unlock(&mutex);
+
+	if (ctx) {
+		context_unlock(ctx);
+	}
+
+	return more;
+}
+
+/**
+ * Drops all pending work and disables time slicing
+ */
+void pmstore_sched_clear()
+{
+	pthread_mutex_lock(&mutex);
+
+	free(queue);
+	queue = NULL;
+	queue_size = 0;
+	queue_head = 0;
+	queue_count = 0;
+	wakeup_func = NULL;
+	slice_ns = PMSTORE_SCHED_SLICE_US * 1000ULL;
+
+	pthread_mutex_unlock(&mutex);
+}
+
+/** @} */
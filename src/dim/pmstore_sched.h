@@ -0,0 +1,67 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file pmstore_sched.h
+ * \brief PM-Segment bulk work scheduler header.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jul 17, 2012
+ */
+
+/**
+ * @addtogroup PMStore
+ * @{
+ */
+
+#ifndef PMSTORE_SCHED_H_
+#define PMSTORE_SCHED_H_
+
+#include <asn1/phd_types.h>
+#include <communication/context.h>
+
+/**
+ * Default length of a time slice of bulk work, in microseconds
+ */
+#define PMSTORE_SCHED_SLICE_US 2000
+
+/**
+ * Called when bulk work becomes pending. The application must then
+ * call pmstore_sched_run() until it returns 0, whenever it has
+ * nothing more urgent to do.
+ */
+typedef void (*pmstore_sched_wakeup)();
+
+struct PMStore;
+struct PMSegment;
+
+void pmstore_sched_set(pmstore_sched_wakeup wakeup, unsigned int slice_us);
+
+int pmstore_sched_add(Context *ctx, struct PMStore *pmstore,
+			struct PMSegment *segment);
+
+int pmstore_sched_run();
+
+void pmstore_sched_clear();
+
+/** @} */
+
+#endif /* PMSTORE_SCHED_H_ */
@@ -28,6 +28,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "scanner.h"
 #include "src/communication/operating.h"
 #include "src/communication/parser/struct_cleaner.h"
@@ -63,6 +64,61 @@
 static const intu32 SCANNER_TO_SET = 3;
 
 
+/**
+ * Duplicates a memory block
+ *
+ * \param src block, may be NULL
+ * \param size block size
+ * \return copy, or NULL if the block is empty
+ */
+static void *scanner_memdup(const void *src, size_t size)
+{
+	void *dst;
+
+	if (src == NULL || size == 0) {
+		return NULL;
+	}
+
+	dst = malloc(size);
+
+	if (dst != NULL) {
+		memcpy(dst, src, size);
+	}
+
+	return dst;
+}
+
+/**
+ * Frees a shared block and its lists
+ *
+ * \param shared the block.
+ */
+static void scanner_free_shared(struct ScannerShared *shared)
+{
+	del_handlelist(&shared->scan_handle_list);
+	del_handleattrvalmap(&shared->scan_handle_attr_val_map);
+	free(shared);
+}
+
+/**
+ * Drops the reference of a scanner to its shared lists. The lists of
+ * the scanner are left empty.
+ *
+ * \param self the scanner.
+ */
+static void scanner_release_shared(struct Scanner *self)
+{
+	struct ScannerShared *shared = self->shared;
+
+	memset(&self->scan_handle_list, 0, sizeof(HANDLEList));
+	memset(&self->scan_handle_attr_val_map, 0, sizeof(HandleAttrValMap));
+	self->shared = NULL;
+
+	if (__sync_sub_and_fetch(&shared->ref, 1) == 0) {
+		scanner_free_shared(shared);
+	}
+}
+
 /**
  * Returns one instance of the Scanner structure.
  * The attributes must be defined through direct assignments, including
@@ -99,8 +155,89 @@ struct Scanner *scanner_instance(ASN1_HANDLE handle,
 void scanner_destroy(struct Scanner *self)
 {
 	if (self != NULL) {
-		del_handlelist(&self->scan_handle_list);
-		del_handleattrvalmap(&self->scan_handle_attr_val_map);
+		if (self->shared != NULL) {
+			scanner_release_shared(self);
+		} else {
+			del_handlelist(&self->scan_handle_list);
+			del_handleattrvalmap(&self->scan_handle_attr_val_map);
+		}
+	}
+}
+
+/**
+ * Moves the configuration lists of a scanner to a shared block, so
+ * that copies of the scanner made by value can use them too. Each such
+ * copy must take its own reference with scanner_addref().
+ *
+ * \param self the scanner.
+ */
+void scanner_share(struct Scanner *self)
+{
+	struct ScannerShared *shared;
+
+	if (self->shared != NULL) {
+		return;
+	}
+
+	shared = calloc(1, sizeof(struct ScannerShared));
+
+	if (shared == NULL) {
+		return;
+	}
+
+	shared->ref = 1;
+	shared->scan_handle_list = self->scan_handle_list;
+	shared->scan_handle_attr_val_map = self->scan_handle_attr_val_map;
+
+	self->shared = shared;
+}
+
+/**
+ * Takes one more reference to the shared lists of a scanner, for a
+ * copy of it made by value. Does nothing if the lists are not shared.
+ *
+ * \param self the copy.
+ */
+void scanner_addref(struct Scanner *self)
+{
+	if (self->shared != NULL) {
+		__sync_fetch_and_add(&self->shared->ref, 1);
+	}
+}
+
+/**
+ * Gives the scanner private copies of its configuration lists, so that
+ * they can be changed. Does nothing if the lists are not shared.
+ *
+ * \param self the scanner.
+ */
+void scanner_unshare(struct Scanner *self)
+{
+	struct ScannerShared *shared = self->shared;
+	HandleAttrValMap *map = &self->scan_handle_attr_val_map;
+	int i;
+
+	if (shared == NULL) {
+		return;
+	}
+
+	self->scan_handle_list.value =
+		scanner_memdup(shared->scan_handle_list.value,
+			       shared->scan_handle_list.count
+			       * sizeof(ASN1_HANDLE));
+	map->value = scanner_memdup(shared->scan_handle_attr_val_map.value,
+				    map->count * sizeof(HandleAttrValMapEntry));
+
+	for (i = 0; map->value != NULL && i < map->count; ++i) {
+		AttrValMap *entry = &map->value[i].attr_val_map;
+		entry->value = scanner_memdup(entry->value,
+					      entry->count * sizeof(AttrValMapEntry));
+	}
+
+	self->shared = NULL;
+
+	if (__sync_sub_and_fetch(&shared->ref, 1) == 0) {
+		scanner_free_shared(shared);
 	}
 }
 
@@ -36,6 +36,28 @@
 #include "nomenclature.h"
 #include "dim.h"
 
+/**
+ * Lists of a Scanner that come from the configuration. MDS instances
+ * built from the same configuration share one reference-counted copy
+ * of them, see scanner_share().
+ */
+struct ScannerShared {
+	/**
+	 * Number of scanners using the lists
+	 */
+	int ref;
+
+	/**
+	 * Shared Scan-Handle-List
+	 */
+	HANDLEList scan_handle_list;
+
+	/**
+	 * Shared Scan-Handle-Attr-Val-Map
+	 */
+	HandleAttrValMap scan_handle_attr_val_map;
+};
+
 /**
  * \brief The Scanner is an struct defining attributes that are common
  * for compose specialized Scanners.
@@ -93,6 +115,13 @@ struct Scanner {
 	 *
 	 */
 	HandleAttrValMap scan_handle_attr_val_map;
+
+	/**
+	 * When not NULL, scan_handle_list and scan_handle_attr_val_map
+	 * point to the lists held by this block and must not be freed or
+	 * changed in place; call scanner_unshare() before changing them.
+	 */
+	struct ScannerShared *shared;
 };
 
 struct Scanner *scanner_instance(ASN1_HANDLE handle,
@@ -100,6 +129,12 @@ struct Scanner *scanner_instance(ASN1_HANDLE handle,
 
 void scanner_destroy(struct Scanner *self);
 
+void scanner_share(struct Scanner *self);
+
+void scanner_addref(struct Scanner *self);
+
+void scanner_unshare(struct Scanner *self);
+
 Request *scanner_set_operational_state(Context *ctx, struct Scanner *scanner,
 				       OperationalState new_operational_state, service_request_callback callback);
 
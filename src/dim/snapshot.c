@@ -0,0 +1,441 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file snapshot.c
+ * \brief Latest observed values of numeric metrics.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 28, 2011
+ */
+
+/**
+ * \defgroup Snapshot Snapshot
+ * \ingroup Manager
+ * \brief Latest observed value of every numeric metric.
+ *
+ * Each numeric metric of an operating device owns a slot in a static
+ * table. Every decoded observation is written to the slot under a
+ * sequence lock, so applications can read a consistent copy of the
+ * latest values at any time without taking context locks and without
+ * allocating memory.
+ *
+ * A slot has a single writer, the thread that holds the context lock
+ * while decoding the event report. Readers never block the writer;
+ * they just retry when a write happened while they were copying.
+ *
+ * Observations may also be published to a shared memory ring, so
+ * that processes on the same host get every value, not only the
+ * latest one, without going through the IPC.
+ *
+ * @{
+ */
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include "src/dim/snapshot.h"
+#include "src/dim/mds.h"
+#include "src/dim/nomenclature.h"
+#include "src/util/log.h"
+#include "src/util/shmring.h"
+
+/**
+ * Latest-value slot
+ */
+typedef struct SnapshotSlot {
+	/**
+	 * Sequence counter, odd while a write is in progress
+	 */
+	volatile unsigned int seq;
+	/**
+	 * 1 if the slot belongs to a metric
+	 */
+	volatile int in_use;
+	/**
+	 * Values, only valid when read under seq
+	 */
+	MetricSnapshot data;
+} SnapshotSlot;
+
+/**
+ * Slot table, index 0 is never used
+ */
+static SnapshotSlot slots[SNAPSHOT_MAX_SLOTS + 1];
+
+/**
+ * Highest slot index ever claimed, bounds the scans
+ */
+static volatile int slots_high = 0;
+
+/**
+ * Ring every observation is published to, if any
+ */
+static ShmRing *volatile ring = NULL;
+
+/**
+ * Threads that may be writing to ring, which is not destroyed while
+ * there are any
+ */
+static volatile int ring_users = 0;
+
+/**
+ * Reads the wall clock.
+ *
+ * @return current time in nanoseconds since the epoch
+ */
+static unsigned long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Starts a write to a slot
+ */
+static void write_begin(SnapshotSlot *slot)
+{
+	slot->seq++;
+	__sync_synchronize();
+}
+
+/**
+ * Finishes a write to a slot
+ */
+static void write_end(SnapshotSlot *slot)
+{
+	__sync_synchronize();
+	slot->seq++;
+}
+
+/**
+ * Claims a free slot.
+ *
+ * @return slot index, 0 if table is full
+ */
+static int claim_slot()
+{
+	int i;
+
+	for (i = 1; i <= SNAPSHOT_MAX_SLOTS; ++i) {
+		if (!slots[i].in_use &&
+		    __sync_bool_compare_and_swap(&slots[i].in_use, 0, 1)) {
+			int high = slots_high;
+
+			while (high < i &&
+			       !__sync_bool_compare_and_swap(&slots_high, high, i)) {
+				high = slots_high;
+			}
+
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Assigns latest-value slots to the numeric metrics of an operating
+ * device. Metrics that already have a slot are left alone.
+ *
+ * @param ctx the context of the device
+ * @param mds the MDS of the device
+ */
+void snapshot_attach(Context *ctx, MDS *mds)
+{
+	int i;
+
+	for (i = 0; i < mds->objects_list_count; ++i) {
+		struct MDS_object *object = &mds->objects_list[i];
+		struct Numeric *numeric;
+		SnapshotSlot *slot;
+
+		if (object->choice != MDS_OBJ_METRIC ||
+		    object->u.metric.choice != METRIC_NUMERIC) {
+			continue;
+		}
+
+		numeric = &object->u.metric.u.numeric;
+
+		if (numeric->snapshot_slot) {
+			continue;
+		}
+
+		numeric->snapshot_slot = claim_slot();
+
+		if (!numeric->snapshot_slot) {
+			WARNING("snapshot: no free slot for handle %d",
+				object->obj_handle);
+			return;
+		}
+
+		slot = &slots[numeric->snapshot_slot];
+
+		write_begin(slot);
+		memset(&slot->data, 0, sizeof(MetricSnapshot));
+		slot->data.id = ctx->id;
+		slot->data.handle = object->obj_handle;
+		write_end(slot);
+	}
+}
+
+/**
+ * Releases the latest-value slot of a numeric metric.
+ *
+ * @param numeric the metric
+ */
+void snapshot_detach(struct Numeric *numeric)
+{
+	SnapshotSlot *slot;
+
+	if (!numeric->snapshot_slot) {
+		return;
+	}
+
+	slot = &slots[numeric->snapshot_slot];
+
+	write_begin(slot);
+	slot->data.count = 0;
+	write_end(slot);
+
+	__sync_lock_release(&slot->in_use);
+	numeric->snapshot_slot = 0;
+}
+
+/**
+ * Records the value of a numeric attribute that has just been decoded.
+ * Attributes that are not observed values are ignored.
+ *
+ * @param numeric the metric
+ * @param attr_id id of the attribute
+ */
+void snapshot_publish(struct Numeric *numeric, OID_Type attr_id)
+{
+	struct Metric *metric = &numeric->metric;
+	MetricSnapshot *data;
+	SnapshotSlot *slot;
+	OID_Type metric_id;
+	int count = 0;
+	int i;
+
+	if (!numeric->snapshot_slot) {
+		return;
+	}
+
+	switch (attr_id) {
+	case MDC_ATTR_NU_VAL_OBS_SIMP:
+	case MDC_ATTR_NU_VAL_OBS_BASIC:
+	case MDC_ATTR_NU_VAL_OBS:
+	case MDC_ATTR_NU_CMPD_VAL_OBS_SIMP:
+	case MDC_ATTR_NU_CMPD_VAL_OBS_BASIC:
+	case MDC_ATTR_NU_CMPD_VAL_OBS:
+		break;
+	default:
+		return;
+	}
+
+	slot = &slots[numeric->snapshot_slot];
+	data = &slot->data;
+
+	metric_id = metric->use_metric_id_field ? metric->metric_id
+			: metric->type.code;
+
+	write_begin(slot);
+
+	data->partition = metric->use_metric_id_partition_field ?
+			  metric->metric_id_partition : metric->type.partition;
+	data->unit_code = metric->unit_code;
+
+	switch (attr_id) {
+	case MDC_ATTR_NU_VAL_OBS_SIMP:
+		data->metric_ids[0] = metric_id;
+		data->values[0] = numeric->simple_nu_observed_value;
+		count = 1;
+		break;
+	case MDC_ATTR_NU_VAL_OBS_BASIC:
+		data->metric_ids[0] = metric_id;
+		data->values[0] = numeric->basic_nu_observed_value;
+		count = 1;
+		break;
+	case MDC_ATTR_NU_VAL_OBS:
+		data->metric_ids[0] = numeric->nu_observed_value.metric_id;
+		data->unit_code = numeric->nu_observed_value.unit_code;
+		data->values[0] = numeric->nu_observed_value.value;
+		count = 1;
+		break;
+	case MDC_ATTR_NU_CMPD_VAL_OBS_SIMP:
+		count = numeric->compound_simple_nu_observed_value.count;
+		for (i = 0; i < count && i < SNAPSHOT_MAX_VALUES; ++i) {
+			data->values[i] =
+				numeric->compound_simple_nu_observed_value.value[i];
+			data->metric_ids[i] = i < metric->metric_id_list.count ?
+					      metric->metric_id_list.value[i] : metric_id;
+		}
+		break;
+	case MDC_ATTR_NU_CMPD_VAL_OBS_BASIC:
+		count = numeric->compound_basic_nu_observed_value.count;
+		for (i = 0; i < count && i < SNAPSHOT_MAX_VALUES; ++i) {
+			data->values[i] =
+				numeric->compound_basic_nu_observed_value.value[i];
+			data->metric_ids[i] = i < metric->metric_id_list.count ?
+					      metric->metric_id_list.value[i] : metric_id;
+		}
+		break;
+	case MDC_ATTR_NU_CMPD_VAL_OBS:
+		count = numeric->compound_nu_observed_value.count;
+		for (i = 0; i < count && i < SNAPSHOT_MAX_VALUES; ++i) {
+			NuObsValue *value =
+				&numeric->compound_nu_observed_value.value[i];
+			data->values[i] = value->value;
+			data->metric_ids[i] = value->metric_id;
+		}
+		if (count > 0) {
+			data->unit_code =
+				numeric->compound_nu_observed_value.value[0].unit_code;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (count > SNAPSHOT_MAX_VALUES) {
+		count = SNAPSHOT_MAX_VALUES;
+	}
+
+	data->count = count;
+	data->timestamp = now_ns();
+
+	write_end(slot);
+
+	if (ring) {
+		ShmRing *r;
+
+		__sync_fetch_and_add(&ring_users, 1);
+		r = ring;
+
+		if (r) {
+			shmring_write(r, data);
+		}
+
+		__sync_fetch_and_sub(&ring_users, 1);
+	}
+}
+
+/**
+ * Copies one slot under its sequence lock.
+ *
+ * @param slot the slot
+ * @param out copy of slot values
+ * @return 1 if slot holds values, 0 otherwise
+ */
+static int read_slot(SnapshotSlot *slot, MetricSnapshot *out)
+{
+	unsigned int seq;
+
+	do {
+		seq = slot->seq;
+		__sync_synchronize();
+
+		if (seq & 1) {
+			continue;
+		}
+
+		if (!slot->in_use) {
+			return 0;
+		}
+
+		memcpy(out, (const void *) &slot->data, sizeof(MetricSnapshot));
+		__sync_synchronize();
+	} while ((seq & 1) || seq != slot->seq);
+
+	return out->count > 0;
+}
+
+/**
+ * Reads the latest observed values of one device, or of all devices.
+ * Never blocks the threads that receive data, and does not allocate.
+ *
+ * @param id context of the device, or NULL for all devices
+ * @param values output array
+ * @param max capacity of values
+ * @return number of entries written to values
+ */
+int snapshot_read(ContextId *id, MetricSnapshot *values, int max)
+{
+	int high = slots_high;
+	int n = 0;
+	int i;
+
+	for (i = 1; i <= high && n < max; ++i) {
+		if (!read_slot(&slots[i], &values[n])) {
+			continue;
+		}
+
+		if (id && (values[n].id.plugin != id->plugin ||
+			   values[n].id.connid != id->connid)) {
+			continue;
+		}
+
+		++n;
+	}
+
+	return n;
+}
+
+/**
+ * Starts publishing every observation, as a MetricSnapshot record, to
+ * a POSIX shared memory ring (see shmring_reader_open()).
+ *
+ * @param name shared memory object name, e.g. "/healthd"
+ * @param capacity number of records the ring holds
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int snapshot_shm_open(const char *name, intu32 capacity)
+{
+	if (ring) {
+		return 0;
+	}
+
+	ring = shmring_create(name, sizeof(MetricSnapshot), capacity);
+
+	return ring != NULL;
+}
+
+/**
+ * Stops publishing observations to shared memory and removes the ring.
+ */
+void snapshot_shm_close()
+{
+	ShmRing *old = ring;
+
+	ring = NULL;
+	__sync_synchronize();
+
+	// writers that got the ring before it was cleared
+	while (ring_users > 0) {
+		sched_yield();
+	}
+
+	shmring_destroy(old);
+}
+
+/** @} */
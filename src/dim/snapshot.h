@@ -0,0 +1,112 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file snapshot.h
+ * \brief Latest observed values header.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 28, 2011
+ */
+
+/**
+ * @addtogroup Snapshot
+ * @{
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <asn1/phd_types.h>
+#include <communication/context.h>
+
+/**
+ * Number of latest-value slots, i.e. numeric metrics of all
+ * associated devices that can be tracked at the same time
+ */
+#ifndef SNAPSHOT_MAX_SLOTS
+#define SNAPSHOT_MAX_SLOTS 1024
+#endif
+
+/**
+ * Values kept for compound observations (e.g. systolic, diastolic
+ * and mean blood pressure)
+ */
+#define SNAPSHOT_MAX_VALUES 4
+
+/**
+ * Latest observed value of a numeric metric
+ */
+typedef struct MetricSnapshot {
+	/**
+	 * Context of the device
+	 */
+	ContextId id;
+	/**
+	 * Handle of the metric object
+	 */
+	ASN1_HANDLE handle;
+	/**
+	 * Partition of metric_ids
+	 */
+	NomPartition partition;
+	/**
+	 * Unit code of the values
+	 */
+	OID_Type unit_code;
+	/**
+	 * Number of values; 0 if nothing was observed yet
+	 */
+	intu16 count;
+	/**
+	 * Metric id (type) of each value
+	 */
+	OID_Type metric_ids[SNAPSHOT_MAX_VALUES];
+	/**
+	 * Observed values
+	 */
+	FLOAT_Type values[SNAPSHOT_MAX_VALUES];
+	/**
+	 * Wall clock time when the values were received, in nanoseconds
+	 * since the epoch. Time stamps sent by the agent are reported
+	 * through the measurement DataList.
+	 */
+	unsigned long long timestamp;
+} MetricSnapshot;
+
+struct Numeric;
+struct MDS;
+
+void snapshot_attach(Context *ctx, struct MDS *mds);
+
+void snapshot_detach(struct Numeric *numeric);
+
+void snapshot_publish(struct Numeric *numeric, OID_Type attr_id);
+
+int snapshot_read(ContextId *id, MetricSnapshot *values, int max);
+
+int snapshot_shm_open(const char *name, intu32 capacity);
+
+void snapshot_shm_close();
+
+/** @} */
+
+#endif /* SNAPSHOT_H_ */
@@ -0,0 +1,306 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file subscription.c
+ * \brief Subscription filters of observations.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 28, 2011
+ */
+
+/**
+ * \defgroup Subscription Subscription
+ * \ingroup Manager
+ * \brief Filters of the observations delivered to the application.
+ *
+ * Without filters, every observation is converted to a DataList and
+ * delivered to the listeners. Once a filter is added, only the
+ * observations that match at least one filter are converted; the
+ * others still update the MDS objects but skip DataEntry construction.
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "src/dim/subscription.h"
+#include "src/dim/mds.h"
+#include "src/util/log.h"
+
+/**
+ * Registered filter
+ */
+typedef struct Subscription {
+	/**
+	 * Id returned to the application
+	 */
+	int id;
+	/**
+	 * Filter, owns its system id
+	 */
+	SubscriptionFilter filter;
+} Subscription;
+
+/**
+ * Registered filters, protected by lock
+ */
+static Subscription *subscriptions = NULL;
+
+/**
+ * Number of registered filters; read without lock as a shortcut
+ */
+static volatile int subscription_count = 0;
+
+/**
+ * Last id given to a filter
+ */
+static int subscription_last_id = 0;
+
+/**
+ * Protects the filters. Observations are checked with a context
+ * locked, so this lock is always the last one taken, and is never
+ * held while taking another; decoding threads only share it for
+ * reading.
+ */
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Adds a filter. Until the first filter is added all observations
+ * are delivered.
+ *
+ * \param filter the filter; system id is copied
+ * \return id of the filter, 0 if it could not be added
+ */
+int subscription_add(const SubscriptionFilter *filter)
+{
+	Subscription *list;
+	Subscription *entry;
+	int id = 0;
+
+	pthread_rwlock_wrlock(&lock);
+
+	list = realloc(subscriptions,
+		       (subscription_count + 1) * sizeof(Subscription));
+
+	if (list == NULL) {
+		goto exit;
+	}
+
+	subscriptions = list;
+	entry = &subscriptions[subscription_count];
+	entry->filter = *filter;
+	entry->filter.system_id.length = 0;
+	entry->filter.system_id.value = NULL;
+
+	if ((filter->fields & SUBSCRIPTION_SYSTEM_ID) &&
+	    filter->system_id.length > 0) {
+		entry->filter.system_id.value = malloc(filter->system_id.length);
+
+		if (entry->filter.system_id.value == NULL) {
+			goto exit;
+		}
+
+		memcpy(entry->filter.system_id.value, filter->system_id.value,
+		       filter->system_id.length);
+		entry->filter.system_id.length = filter->system_id.length;
+	}
+
+	id = entry->id = ++subscription_last_id;
+	subscription_count++;
+
+exit:
+	pthread_rwlock_unlock(&lock);
+
+	if (!id) {
+		ERROR("subscription: cannot add filter");
+	}
+
+	return id;
+}
+
+/**
+ * Removes a filter.
+ *
+ * \param id id returned by subscription_add()
+ * \return 1 if operation succeeds, 0 otherwise
+ */
+int subscription_remove(int id)
+{
+	int found = 0;
+	int i;
+
+	pthread_rwlock_wrlock(&lock);
+
+	for (i = 0; i < subscription_count; ++i) {
+		if (subscriptions[i].id == id) {
+			free(subscriptions[i].filter.system_id.value);
+			memmove(&subscriptions[i], &subscriptions[i + 1],
+				(subscription_count - i - 1) * sizeof(Subscription));
+			subscription_count--;
+			found = 1;
+			break;
+		}
+	}
+
+	pthread_rwlock_unlock(&lock);
+
+	return found;
+}
+
+/**
+ * Removes all filters, so all observations are delivered again.
+ */
+void subscription_clear()
+{
+	int i;
+
+	pthread_rwlock_wrlock(&lock);
+
+	for (i = 0; i < subscription_count; ++i) {
+		free(subscriptions[i].filter.system_id.value);
+	}
+
+	free(subscriptions);
+	subscriptions = NULL;
+	subscription_count = 0;
+
+	pthread_rwlock_unlock(&lock);
+}
+
+/**
+ * Checks whether a metric reports a given type.
+ */
+static int metric_has_type(struct Metric *metric, OID_Type type)
+{
+	int i;
+
+	if (metric->type.code == type) {
+		return 1;
+	}
+
+	if (metric->use_metric_id_field && metric->metric_id == type) {
+		return 1;
+	}
+
+	for (i = 0; i < metric->metric_id_list.count; ++i) {
+		if (metric->metric_id_list.value[i] == type) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Checks whether an object matches a filter.
+ */
+static int filter_matches(const SubscriptionFilter *filter, MDS *mds,
+			  ASN1_HANDLE handle, struct Metric *metric)
+{
+	if ((filter->fields & SUBSCRIPTION_HANDLE) && filter->handle != handle) {
+		return 0;
+	}
+
+	if (filter->fields & SUBSCRIPTION_SYSTEM_ID) {
+		if (filter->system_id.length != mds->system_id.length ||
+		    memcmp(filter->system_id.value, mds->system_id.value,
+			   filter->system_id.length) != 0) {
+			return 0;
+		}
+	}
+
+	if (filter->fields & SUBSCRIPTION_PARTITION) {
+		if (metric == NULL) {
+			return 0;
+		}
+
+		if (metric->type.partition != filter->partition &&
+		    !(metric->use_metric_id_partition_field &&
+		      metric->metric_id_partition == filter->partition)) {
+			return 0;
+		}
+	}
+
+	if (filter->fields & SUBSCRIPTION_TYPE) {
+		if (metric == NULL || !metric_has_type(metric, filter->type)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Returns the Metric part of an object, if any.
+ */
+static struct Metric *object_metric(struct MDS_object *object)
+{
+	if (object == NULL || object->choice != MDS_OBJ_METRIC) {
+		return NULL;
+	}
+
+	switch (object->u.metric.choice) {
+	case METRIC_NUMERIC:
+		return &object->u.metric.u.numeric.metric;
+	case METRIC_ENUM:
+		return &object->u.metric.u.enumeration.metric;
+	case METRIC_RTSA:
+		return &object->u.metric.u.rtsa.metric;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Tells whether observations of an object should be converted and
+ * delivered to the application.
+ *
+ * \param mds the MDS of the device
+ * \param handle handle of the observed object
+ * \return 1 if observation is wanted, 0 otherwise
+ */
+int subscription_wants(MDS *mds, ASN1_HANDLE handle)
+{
+	struct Metric *metric;
+	int wanted = 0;
+	int i;
+
+	if (subscription_count == 0) {
+		return 1;
+	}
+
+	metric = object_metric(mds_get_object_by_handle(mds, handle));
+
+	pthread_rwlock_rdlock(&lock);
+
+	for (i = 0; i < subscription_count && !wanted; ++i) {
+		wanted = filter_matches(&subscriptions[i].filter, mds,
+					handle, metric);
+	}
+
+	pthread_rwlock_unlock(&lock);
+
+	return wanted;
+}
+
+/** @} */
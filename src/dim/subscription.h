@@ -0,0 +1,89 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file subscription.h
+ * \brief Subscription filters header.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 28, 2011
+ */
+
+/**
+ * @addtogroup Subscription
+ * @{
+ */
+
+#ifndef SUBSCRIPTION_H_
+#define SUBSCRIPTION_H_
+
+#include <asn1/phd_types.h>
+
+/**
+ * Fields of a subscription filter that must match
+ */
+typedef enum {
+	SUBSCRIPTION_TYPE = 1,
+	SUBSCRIPTION_PARTITION = 2,
+	SUBSCRIPTION_HANDLE = 4,
+	SUBSCRIPTION_SYSTEM_ID = 8
+} SubscriptionField;
+
+/**
+ * Selects the observations delivered to the application. An
+ * observation matches when every field set in \b fields matches.
+ */
+typedef struct SubscriptionFilter {
+	/**
+	 * Bitmask of SubscriptionField
+	 */
+	int fields;
+	/**
+	 * Nomenclature partition of the metric type
+	 */
+	NomPartition partition;
+	/**
+	 * Metric type (MDC code), e.g. MDC_PULS_OXIM_SAT_O2
+	 */
+	OID_Type type;
+	/**
+	 * Object handle
+	 */
+	ASN1_HANDLE handle;
+	/**
+	 * System id of the device
+	 */
+	octet_string system_id;
+} SubscriptionFilter;
+
+struct MDS;
+
+int subscription_add(const SubscriptionFilter *filter);
+
+int subscription_remove(int id);
+
+void subscription_clear();
+
+int subscription_wants(struct MDS *mds, ASN1_HANDLE handle);
+
+/** @} */
+
+#endif /* SUBSCRIPTION_H_ */
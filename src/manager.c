@@ -95,6 +95,12 @@
 #include "src/communication/extconfigurations.h"
 #include "src/communication/configuring.h"
 #include "src/communication/stdconfigurations.h"
+#include "src/communication/stats.h"
+#include "src/dim/pmstore_download.h"
+#include "src/dim/pmstore_resume.h"
+#include "src/dim/pmstore_sched.h"
+#include "src/dim/snapshot.h"
+#include "src/dim/subscription.h"
 #include "src/specializations/blood_pressure_monitor.h"
 #include "src/specializations/pulse_oximeter.h"
 #include "src/specializations/weighing_scale.h"
@@ -169,7 +175,8 @@ void manager_init(CommunicationPlugin **plugins)
 
 	// Listen to all communication state transitions
 	communication_add_state_transition_listener(fsm_state_size, &manager_handle_transition_evt);
-	communication_set_connection_listeners(&manager_notify_evt_device_connected,
+	communication_set_connection_listeners(MANAGER_CONTEXT,
+						&manager_notify_evt_device_connected,
 						&manager_notify_evt_device_disconnected);
 
 	// Register standard configurations for each specialization.
@@ -202,6 +209,9 @@ void manager_finalize()
 	DEBUG("Manager Finalization");
 
 	manager_remove_all_listeners();
+	subscription_clear();
+	pmstore_resume_clear();
+	pmstore_sched_clear();
 	ext_configurations_destroy();
 	std_configurations_destroy();
 	communication_finalize();
@@ -258,6 +268,39 @@ void manager_remove_all_listeners()
 	}
 }
 
+/**
+ * Restricts the measurements delivered to listeners to the observations
+ * that match at least one of the added filters. Observations that do
+ * not match are not converted to DataList at all. Without filters, all
+ * observations are delivered.
+ *
+ * @param filter the filter, its system id is copied
+ * @return filter id, 0 if filter could not be added
+ */
+int manager_add_subscription(SubscriptionFilter filter)
+{
+	return subscription_add(&filter);
+}
+
+/**
+ * Removes a filter added by manager_add_subscription().
+ *
+ * @param id filter id
+ * @return 1 if operation succeeds, 0 if not.
+ */
+int manager_remove_subscription(int id)
+{
+	return subscription_remove(id);
+}
+
+/**
+ * Removes all filters, so that all observations are delivered.
+ */
+void manager_remove_all_subscriptions()
+{
+	subscription_clear();
+}
+
 /**
  * Notifies 'device available'  event.
  * This function should be visible to source layer of events.
@@ -375,6 +418,7 @@ int manager_notify_evt_measurement_data_updated(Context *ctx, DataList *data_lis
 {
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_now_ns();
 
 	for (i = 0; i < manager_listener_count; i++) {
 		ManagerListener *l = &manager_listener_list[i];
@@ -385,6 +429,8 @@ int manager_notify_evt_measurement_data_updated(Context *ctx, DataList *data_lis
 		}
 	}
 
+	stats_record_time(ctx, STATS_LISTENER_TIME, stats_now_ns() - start);
+
 	data_list_del(data_list);
 	return ret_val;
 
@@ -406,6 +452,7 @@ int manager_notify_evt_segment_data(Context *ctx, int handle, int instnumber,
 {
 	int ret_val = 0;
 	int i;
+	unsigned long long start = stats_now_ns();
 
 	for (i = 0; i < manager_listener_count; i++) {
 		ManagerListener *l = &manager_listener_list[i];
@@ -416,6 +463,8 @@ int manager_notify_evt_segment_data(Context *ctx, int handle, int instnumber,
 		}
 	}
 
+	stats_record_time(ctx, STATS_LISTENER_TIME, stats_now_ns() - start);
+
 	// Since encoding this may take a lot of time, we pass ownership to
 	// listeners. If there is more than one in app, it must make a deep
 	// copy of DataList or coordinate between listeners to free in time.
@@ -588,6 +637,91 @@ DataList *manager_get_configuration(ContextId id)
 	return list;
 }
 
+/**
+ * Returns runtime statistics of a connection: APDU and byte counts,
+ * errors, pending requests, state transitions and timings.
+ *
+ * @param id context id
+ * @return data list with statistics, NULL if context does not exist
+ */
+DataList *manager_get_stats(ContextId id)
+{
+	Context *ctx = context_get_and_lock(id);
+
+	if (!ctx)
+		return NULL;
+
+	DataList *list = stats_get_data_list(ctx);
+
+	context_unlock(ctx);
+
+	return list;
+}
+
+/**
+ * Returns runtime statistics accumulated over all connections,
+ * including the ones already closed.
+ *
+ * @return data list with statistics
+ */
+DataList *manager_get_global_stats()
+{
+	return stats_get_data_list(NULL);
+}
+
+/**
+ * Copies the latest observed value of each numeric metric of a
+ * device. Does not lock the context nor allocate memory, so it may
+ * be called often from any thread.
+ *
+ * @param id context id
+ * @param values array that receives the values
+ * @param max capacity of values
+ * @return number of values copied, 0 if device is unknown
+ */
+int manager_get_latest_values(ContextId id, MetricSnapshot *values, int max)
+{
+	return snapshot_read(&id, values, max);
+}
+
+/**
+ * Copies the latest observed value of each numeric metric of all
+ * connected devices, see manager_get_latest_values().
+ *
+ * @param values array that receives the values
+ * @param max capacity of values
+ * @return number of values copied
+ */
+int manager_get_all_latest_values(MetricSnapshot *values, int max)
+{
+	return snapshot_read(NULL, values, max);
+}
+
+/**
+ * Publishes every observed numeric value to a POSIX shared memory
+ * ring, as MetricSnapshot records. Processes on the same host attach
+ * with shmring_reader_open() and read the records straight from
+ * memory. Call before manager_start().
+ *
+ * @param name shared memory object name, e.g. "/healthd"
+ * @param capacity number of records the ring holds, from 1 to
+ *	  SHMRING_MAX_CAPACITY
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int manager_publish_shm(const char *name, unsigned int capacity)
+{
+	return snapshot_shm_open(name, capacity);
+}
+
+/**
+ * Stops publishing to shared memory, see manager_publish_shm(). Call
+ * once the manager is stopped.
+ */
+void manager_unpublish_shm()
+{
+	snapshot_shm_close();
+}
+
 /**
  * Returns attributes from medical device since last updated.
  *
@@ -822,6 +956,48 @@ Request *manager_request_clear_segment(ContextId id,
 	return NULL;
 }
 
+/**
+ * Downloads all PM-Segments of a PM-Store: gets the segment info,
+ * transfers each segment in turn and optionally clears it once
+ * delivered. Data goes to options->entries as it arrives or, if not
+ * set, to the segment_data_received listeners, one segment at a time.
+ *
+ * If the device disconnects, the next download of the same segments
+ * resumes where this one stopped: streamed entries are not delivered
+ * again and entries of a segment delivered whole are not decoded
+ * again.
+ *
+ * @param id context id
+ * @param handle PM-Store handle
+ * @param options download options
+ * @return 1 if the download started, 0 otherwise
+ */
+int manager_download_pmstore(ContextId id, int handle,
+				const PMStoreDownloadOptions *options)
+{
+	Context *ctx = context_get_and_lock(id);
+	int ret = 0;
+
+	if (ctx != NULL) {
+		// thread-safe block - start
+		struct MDS_object *mds_obj = NULL;
+
+		if (ctx->mds) {
+			mds_obj = mds_get_object_by_handle(ctx->mds, handle);
+		}
+
+		if (mds_obj && mds_obj->choice == MDS_OBJ_PMSTORE) {
+			ret = pmstore_download_start(ctx, &mds_obj->u.pmstore,
+						     options);
+		}
+
+		context_unlock(ctx);
+		// thread-safe block - end
+	}
+
+	return ret;
+}
+
 /**
  * Invokes Set-time on agent
  *
@@ -862,9 +1038,15 @@ Request *manager_set_time(ContextId id, time_t time, service_request_callback ca
  */
 void manager_handle_transition_evt(Context *ctx, fsm_states previous, fsm_states next)
 {
+	if (!(ctx->type & MANAGER_CONTEXT)) {
+		// agent context living in the same process
+		return;
+	}
+
 	if (previous == fsm_state_operating && next != previous) {
 		DEBUG(" manager: Notify device unavailable.\n");
 		// Exiting operating state
+		pmstore_download_cancel_all(ctx);
 		manager_notify_evt_device_unavailable(ctx);
 
 	}
@@ -890,6 +1072,72 @@ void manager_set_system_id(const intu8 *system_id, intu16 len)
 	memcpy(mgr_system_id, system_id, len);
 }
 
+/**
+ * Delivery mode of scan reports, see manager_set_coalesce_reports()
+ */
+static int coalesce_reports = 0;
+
+/**
+ * Selects how observations of multi-person and buffered scanner event
+ * reports are delivered to listeners. By default, one DataList is
+ * delivered for each person (or, for buffered periodic scanners, for
+ * each observation). When coalescing is enabled, all observations of
+ * an event report are delivered together in a single DataList; the
+ * entries keep their person-id metadata.
+ *
+ * @param enable 1 to deliver one DataList per event report, 0 otherwise
+ */
+void manager_set_coalesce_reports(int enable)
+{
+	coalesce_reports = enable;
+}
+
+/**
+ * Gives priority to live traffic (scan reports, configuration and
+ * state changes) over PM-Store downloads. Once enabled, PM-Segment
+ * entries are no longer decoded and delivered as they arrive: the
+ * manager calls wakeup when such bulk work is pending, and the
+ * application must then call manager_run_bulk_work() whenever it is
+ * idle, e.g. from a low priority idle handler of its main loop, until
+ * it returns 0. Each call works for about slice_us microseconds, so
+ * that data of any agent waits at most that long.
+ *
+ * Bulk work is done as data arrives if it falls too far behind, and
+ * by default, when wakeup is NULL. Pending work must be run before
+ * disabling.
+ *
+ * @param wakeup called, from any thread, when bulk work is pending
+ * @param slice_us length of each call of manager_run_bulk_work(), or 0
+ *        for the default of 2 milliseconds
+ */
+void manager_set_bulk_scheduler(manager_bulk_wakeup wakeup,
+				unsigned int slice_us)
+{
+	pmstore_sched_set(wakeup, slice_us);
+}
+
+/**
+ * Does one time slice of bulk work, see manager_set_bulk_scheduler().
+ * Must not be called from a listener or request callback.
+ *
+ * @return 1 if more bulk work is pending, 0 otherwise
+ */
+int manager_run_bulk_work()
+{
+	return pmstore_sched_run();
+}
+
+/**
+ * Tells whether event reports are delivered as a single DataList,
+ * see manager_set_coalesce_reports().
+ *
+ * @return 1 if reports are coalesced, 0 otherwise
+ */
+int manager_coalesce_reports()
+{
+	return coalesce_reports;
+}
+
 /**
  * Return length of manager system id
  *
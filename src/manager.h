@@ -37,6 +37,9 @@
 #include <communication/context.h>
 #include <communication/plugin/plugin.h>
 #include <communication/service.h>
+#include <dim/pmstore_download.h>
+#include <dim/snapshot.h>
+#include <dim/subscription.h>
 
 /**
  * Manager event listener definition
@@ -96,6 +99,12 @@ void manager_connection_loop(ContextId context_id);
 
 int manager_add_listener(ManagerListener listener);
 
+int manager_add_subscription(SubscriptionFilter filter);
+
+int manager_remove_subscription(int id);
+
+void manager_remove_all_subscriptions();
+
 DataList *manager_get_mds_attributes(ContextId id);
 
 Request *manager_request_measurement_data_transmission(ContextId id, service_request_callback callback);
@@ -120,14 +129,42 @@ Request *manager_request_clear_segment(ContextId id, int handle, int instnumber,
 
 Request *manager_request_clear_segments(ContextId id, int handle, service_request_callback callback);
 
+int manager_download_pmstore(ContextId id, int handle,
+				const PMStoreDownloadOptions *options);
+
 Request *manager_set_time(ContextId id, time_t time, service_request_callback callback);
 
 DataList *manager_get_configuration(ContextId id);
 
+DataList *manager_get_stats(ContextId id);
+
+DataList *manager_get_global_stats();
+
+int manager_get_latest_values(ContextId id, MetricSnapshot *values, int max);
+
+int manager_get_all_latest_values(MetricSnapshot *values, int max);
+
+int manager_publish_shm(const char *name, unsigned int capacity);
+
+void manager_unpublish_shm();
+
 void manager_request_association_release(ContextId id);
 
 void manager_request_association_abort(ContextId id);
 
 void manager_set_system_id(const intu8 *system_id, intu16 len);
 
+void manager_set_coalesce_reports(int enable);
+
+/**
+ * Called when PM-Store data waits to be decoded, see
+ * manager_set_bulk_scheduler()
+ */
+typedef void (*manager_bulk_wakeup)();
+
+void manager_set_bulk_scheduler(manager_bulk_wakeup wakeup,
+				unsigned int slice_us);
+
+int manager_run_bulk_work();
+
 #endif /* MANAGER_H_ */
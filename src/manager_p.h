@@ -39,6 +39,8 @@
 intu8 *manager_system_id();
 unsigned short int manager_system_id_length();
 
+int manager_coalesce_reports();
+
 void manager_remove_all_listeners();
 
 int manager_notify_evt_device_available(Context *ctx, DataList *data_list);
@@ -8,8 +8,11 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/.. $(LOCAL_PATH)/../..
 LOCAL_SRC_FILES = bytelib.c \
                     dateutil.c \
                     ioutil.c \
+                    journal.c \
                     linkedlist.c \
-                    strbuff.c
+                    shmring.c \
+                    strbuff.c \
+                    trace.c
 
 LOCAL_MODULE:= libantidoteutil
 LOCAL_MODULE_TAGS := debug eng
@@ -110,6 +110,76 @@ int round(double number)
 
 static const double reserved_float_values[5] = {INFINITY, NAN, NAN, NAN, -INFINITY};
 
+/**
+ * Powers of ten that are exact in double precision (10 ** 0 to 10 ** 22).
+ * Scaling a mantissa by one multiplication or division by these values
+ * gives the correctly rounded result.
+ */
+static const double exact_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define EXACT_POW10_MAX 22
+
+/**
+ * SFLOAT scale factors indexed by the 4-bit exponent field: a value is
+ * mantissa * sfloat_mul[e] / sfloat_div[e]
+ */
+static const double sfloat_mul[16] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+	1, 1, 1, 1, 1, 1, 1, 1
+};
+static const double sfloat_div[16] = {
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1e8, 1e7, 1e6, 1e5, 1e4, 1e3, 1e2, 1e1
+};
+
+/**
+ * Converts the MDER encoding of a FLOAT (Annex F.6).
+ *
+ * @param raw 32-bit encoded value
+ * @return converted value
+ */
+static FLOAT_Type float_value(intu32 raw)
+{
+	intu32 reserved = raw - (intu32) FIRST_RESERVED_VALUE;
+	int32 mantissa = ((int32) (raw << 8)) >> 8;
+	int exponent = (int8) (raw >> 24);
+
+	if (reserved <= MDER_NEGATIVE_INFINITY - FIRST_RESERVED_VALUE) {
+		return reserved_float_values[reserved];
+	}
+
+	if (exponent >= 0) {
+		if (exponent <= EXACT_POW10_MAX) {
+			return mantissa * exact_pow10[exponent];
+		}
+	} else if (-exponent <= EXACT_POW10_MAX) {
+		return mantissa / exact_pow10[-exponent];
+	}
+
+	return mantissa * pow(10.0, exponent);
+}
+
+/**
+ * Converts the MDER encoding of a SFLOAT (Annex F.7).
+ *
+ * @param raw 16-bit encoded value
+ * @return converted value
+ */
+static SFLOAT_Type sfloat_value(intu16 raw)
+{
+	intu32 reserved = raw - FIRST_S_RESERVED_VALUE;
+	int32 mantissa = ((int32) ((intu32) raw << 20)) >> 20;
+	int exponent = raw >> 12;
+
+	if (reserved <= MDER_S_NEGATIVE_INFINITY - FIRST_S_RESERVED_VALUE) {
+		return reserved_float_values[reserved];
+	}
+
+	return mantissa * sfloat_mul[exponent] / sfloat_div[exponent];
+}
+
 /**
  * Bytelib constructor.
  *
@@ -248,21 +318,7 @@ FLOAT_Type read_float(ByteStreamReader *stream, int *error)
 	if (*error)
 		return 0;
 
-	int32 mantissa = int_data & 0xFFFFFF;
-	int8 expoent = int_data >> 24;
-	double output = 0;
-
-	if (mantissa >= FIRST_RESERVED_VALUE &&
-					mantissa <= MDER_NEGATIVE_INFINITY) {
-		output = reserved_float_values[mantissa - FIRST_RESERVED_VALUE];
-	} else {
-		if (mantissa >= 0x800000) {
-			mantissa = -((0xFFFFFF + 1) - mantissa);
-		}
-		output = (mantissa * pow(10.0f, expoent));
-	}
-
-	return output;
+	return float_value(int_data);
 }
 
 /* round number n to d decimal points */
@@ -284,28 +340,90 @@ SFLOAT_Type read_sfloat(ByteStreamReader *stream, int *error)
 	if (*error)
 		return 0;
 
-	intu16 mantissa = int_data & 0x0FFF;
-	int8 expoent = int_data >> 12;
+	return sfloat_value(int_data);
+}
 
-	if (expoent >= 0x0008) {
-		expoent = -((0x000F + 1) - expoent);
+/**
+ * Converts an array of MDER FLOATs in network order, e.g. the
+ * contents of a compound observed value.
+ *
+ * @param data encoded values, 4 octets each
+ * @param buf converted values
+ * @param count number of values
+ */
+void decode_float_array(const intu8 *data, FLOAT_Type *buf, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		const intu8 *p = data + 4 * i;
+
+		buf[i] = float_value(((intu32) p[0] << 24) | ((intu32) p[1] << 16) |
+				     ((intu32) p[2] << 8) | p[3]);
 	}
+}
 
-	float output = 0;
+/**
+ * Converts an array of MDER SFLOATs in network order. The loop has no
+ * branches for regular values, so the compiler may vectorize it.
+ *
+ * @param data encoded values, 2 octets each
+ * @param buf converted values
+ * @param count number of values
+ */
+void decode_sfloat_array(const intu8 *data, SFLOAT_Type *buf, int count)
+{
+	int i;
 
-	if (mantissa >= FIRST_S_RESERVED_VALUE && mantissa
-	    <= MDER_S_NEGATIVE_INFINITY) {
-		output = reserved_float_values[mantissa
-					       - FIRST_S_RESERVED_VALUE];
+	for (i = 0; i < count; ++i) {
+		buf[i] = sfloat_value((data[2 * i] << 8) | data[2 * i + 1]);
+	}
+}
+
+/**
+ * Consumes a number of FLOATs from data.
+ *
+ * @param stream The current ByteStreamReader.
+ * @param buf The target buffer
+ * @param count The exact number of values that are to be consumed
+ * @param error A reference to a boolean to hold the error code.
+ */
+void read_float_many(ByteStreamReader *stream, FLOAT_Type *buf, int count, int *error)
+{
+	if (stream && count >= 0 && stream->unread_bytes >= 4 * (unsigned) count) {
+		decode_float_array(stream->buffer_cur, buf, count);
+		stream->buffer_cur += 4 * count;
+		stream->unread_bytes -= 4 * count;
 	} else {
-		if (mantissa >= 0x0800) {
-			mantissa = -((0x0FFF + 1) - mantissa);
+		if (error) {
+			*error = 1;
 		}
-		double magnitude = pow(10.0f, expoent);
-		output = (mantissa * magnitude);
+
+		ERROR("read_float_many");
 	}
+}
 
-	return output;
+/**
+ * Consumes a number of SFLOATs from data.
+ *
+ * @param stream The current ByteStreamReader.
+ * @param buf The target buffer
+ * @param count The exact number of values that are to be consumed
+ * @param error A reference to a boolean to hold the error code.
+ */
+void read_sfloat_many(ByteStreamReader *stream, SFLOAT_Type *buf, int count, int *error)
+{
+	if (stream && count >= 0 && stream->unread_bytes >= 2 * (unsigned) count) {
+		decode_sfloat_array(stream->buffer_cur, buf, count);
+		stream->buffer_cur += 2 * count;
+		stream->unread_bytes -= 2 * count;
+	} else {
+		if (error) {
+			*error = 1;
+		}
+
+		ERROR("read_sfloat_many");
+	}
 }
 
 
@@ -90,6 +90,14 @@ FLOAT_Type read_float(ByteStreamReader *stream, int *error);
 
 SFLOAT_Type read_sfloat(ByteStreamReader *stream, int *error);
 
+void read_float_many(ByteStreamReader *stream, FLOAT_Type *buf, int count, int *error);
+
+void read_sfloat_many(ByteStreamReader *stream, SFLOAT_Type *buf, int count, int *error);
+
+void decode_float_array(const intu8 *data, FLOAT_Type *buf, int count);
+
+void decode_sfloat_array(const intu8 *data, SFLOAT_Type *buf, int count);
+
 ByteStreamWriter *byte_stream_writer_instance(intu32 size);
 
 ByteStreamWriter *open_stream_writer(intu32 hint);
@@ -137,25 +137,32 @@ int ioutil_buffer_to_file(const char *file_path,
 }
 
 /**
- * Print buffer data
+ * Print buffer data at debug log level. Does nothing when debug
+ * messages are compiled out.
+ *
  * @param *buffer
  * @param size
  */
 void ioutil_print_buffer(intu8 *buffer, int size)
 {
-	char  *str = calloc(size*4, sizeof(char));
-
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+	static const char hex[] = "0123456789ABCDEF";
+	char *str = calloc(size * 3 + 1, sizeof(char));
 	int i;
 
+	if (!str)
+		return;
+
 	for (i = 0; i < size; i++) {
-		sprintf(str, "%s%.2X ", str, buffer[i]);
+		str[i * 3] = hex[buffer[i] >> 4];
+		str[i * 3 + 1] = hex[buffer[i] & 0x0f];
+		str[i * 3 + 2] = ' ';
 	}
 
 	DEBUG("%s", str);
 
-	fflush(stdout);
 	free(str);
-	str = NULL;
+#endif
 }
 
 #ifdef ANDROID
@@ -0,0 +1,797 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file journal.c
+ * \brief Append-only record journal.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jun 12, 2012
+ */
+
+/**
+ * \addtogroup Utility
+ * @{
+ *
+ * The journal is a directory of segment files. Each segment is named
+ * after the journal offset of its first record, in hex, and holds
+ * records back to back:
+ *
+ * <pre>
+ * u32 length       payload length
+ * u32 crc          CRC-32 of everything below, payload included
+ * u8  type
+ * u8  reserved[3]
+ * u32 plugin
+ * u64 connid
+ * u64 timestamp
+ * u32 handle
+ * u32 instnumber
+ * u8  payload[length]
+ * </pre>
+ *
+ * Integers are big-endian. Offsets grow continuously across segments,
+ * so a reader can resume from the offset after the last record it
+ * consumed. A record is durable once journal_sync() returns; records
+ * torn by a crash fail their CRC and are cut off when the journal is
+ * opened again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "journal.h"
+#include "log.h"
+
+#define SEGMENT_SUFFIX ".journal"
+#define SEGMENT_NAME_LENGTH 24
+
+static const intu32 crc_nibble[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+	0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+	0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/**
+ * Computes the CRC-32 (IEEE 802.3) of a buffer.
+ *
+ * @param crc CRC of the preceding data, 0 to start
+ * @param data the buffer
+ * @param length buffer length
+ * @return the CRC
+ */
+intu32 journal_crc32(intu32 crc, const intu8 *data, intu32 length)
+{
+	intu32 i;
+
+	crc = ~crc;
+
+	for (i = 0; i < length; ++i) {
+		crc ^= data[i];
+		crc = (crc >> 4) ^ crc_nibble[crc & 0x0f];
+		crc = (crc >> 4) ^ crc_nibble[crc & 0x0f];
+	}
+
+	return ~crc;
+}
+
+static void put32(intu8 *p, intu32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void put64(intu8 *p, unsigned long long v)
+{
+	put32(p, v >> 32);
+	put32(p + 4, v);
+}
+
+static intu32 get32(const intu8 *p)
+{
+	return ((intu32) p[0] << 24) | ((intu32) p[1] << 16) |
+	       ((intu32) p[2] << 8) | p[3];
+}
+
+static unsigned long long get64(const intu8 *p)
+{
+	return ((unsigned long long) get32(p) << 32) | get32(p + 4);
+}
+
+/**
+ * Parses the record at a position of a segment.
+ *
+ * @param buf segment contents
+ * @param size segment size
+ * @param pos position of the record
+ * @param record filled with the record; data points into buf
+ * @return record size, 0 if there is no complete, valid record at pos
+ */
+static intu32 parse_record(const intu8 *buf, intu32 size, intu32 pos,
+			   JournalRecord *record)
+{
+	const intu8 *h = buf + pos;
+	intu32 length;
+
+	if (pos > size || size - pos < JOURNAL_HEADER_SIZE) {
+		return 0;
+	}
+
+	length = get32(h);
+
+	if (length > size - pos - JOURNAL_HEADER_SIZE) {
+		return 0;
+	}
+
+	if (journal_crc32(0, h + 8, JOURNAL_HEADER_SIZE - 8 + length) !=
+	    get32(h + 4)) {
+		return 0;
+	}
+
+	record->type = h[8];
+	record->plugin = get32(h + 12);
+	record->connid = get64(h + 16);
+	record->timestamp = get64(h + 24);
+	record->handle = get32(h + 32);
+	record->instnumber = get32(h + 36);
+	record->data = (const char *) h + JOURNAL_HEADER_SIZE;
+	record->length = length;
+
+	return JOURNAL_HEADER_SIZE + length;
+}
+
+static int compare_offsets(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *) a;
+	unsigned long long y = *(const unsigned long long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Lists the segments of a journal.
+ *
+ * @param dir journal directory
+ * @param count filled with the number of segments
+ * @return sorted base offsets of the segments, to be freed by caller
+ */
+static unsigned long long *list_segments(const char *dir, int *count)
+{
+	unsigned long long *bases = NULL;
+	struct dirent *entry;
+	DIR *d;
+	int n = 0;
+	int capacity = 0;
+
+	*count = 0;
+
+	if (!(d = opendir(dir))) {
+		return NULL;
+	}
+
+	while ((entry = readdir(d))) {
+		unsigned long long base;
+		char *end;
+
+		if (strlen(entry->d_name) != SEGMENT_NAME_LENGTH ||
+		    strcmp(entry->d_name + 16, SEGMENT_SUFFIX) != 0) {
+			continue;
+		}
+
+		base = strtoull(entry->d_name, &end, 16);
+
+		if (end != entry->d_name + 16) {
+			continue;
+		}
+
+		if (n >= capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			bases = realloc(bases, capacity * sizeof(*bases));
+		}
+
+		bases[n++] = base;
+	}
+
+	closedir(d);
+
+	qsort(bases, n, sizeof(*bases), compare_offsets);
+	*count = n;
+
+	return bases;
+}
+
+/**
+ * Builds the path of a segment file.
+ *
+ * @return the path, to be freed by caller
+ */
+static char *segment_path(const char *dir, unsigned long long base)
+{
+	char *path;
+
+	if (asprintf(&path, "%s/%016llx" SEGMENT_SUFFIX, dir, base) < 0) {
+		return NULL;
+	}
+
+	return path;
+}
+
+/**
+ * Makes a new segment file durable in its directory.
+ */
+static void sync_dir(const char *dir)
+{
+	int fd = open(dir, O_RDONLY);
+
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+}
+
+/**
+ * Opens the segment file a journal appends to.
+ *
+ * @param journal the journal
+ * @param base offset of the segment
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int open_segment(Journal *journal, unsigned long long base)
+{
+	char *path = segment_path(journal->dir, base);
+
+	if (!path) {
+		return 0;
+	}
+
+	journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+
+	if (journal->fd < 0) {
+		ERROR("journal: cannot open %s: %s", path, strerror(errno));
+		free(path);
+		return 0;
+	}
+
+	free(path);
+	journal->base = base;
+	journal->size = 0;
+
+	return 1;
+}
+
+/**
+ * Finds the end of the valid records of the last segment, and cuts
+ * off whatever a crash may have left after it.
+ *
+ * @param journal the journal
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+static int recover_segment(Journal *journal)
+{
+	JournalRecord record;
+	struct stat st;
+	intu8 *map;
+	intu32 pos = 0;
+	intu32 len;
+
+	if (fstat(journal->fd, &st) < 0) {
+		return 0;
+	}
+
+	if (st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+			   journal->fd, 0);
+
+		if (map == MAP_FAILED) {
+			return 0;
+		}
+
+		while ((len = parse_record(map, st.st_size, pos, &record))) {
+			pos += len;
+		}
+
+		munmap(map, st.st_size);
+	}
+
+	if (pos < st.st_size) {
+		WARNING("journal: dropping %ld torn bytes at %016llx",
+			(long) (st.st_size - pos), journal->base + pos);
+
+		if (ftruncate(journal->fd, pos) < 0) {
+			return 0;
+		}
+	}
+
+	journal->size = pos;
+
+	return lseek(journal->fd, pos, SEEK_SET) == (off_t) pos;
+}
+
+/**
+ * Opens a journal for appending, creating its directory if needed.
+ *
+ * @param dir journal directory
+ * @param segment_size size of segment files, 0 for the default
+ * @return the journal, or NULL on error
+ */
+Journal *journal_open(const char *dir, intu32 segment_size)
+{
+	Journal *journal;
+	unsigned long long *bases;
+	int count;
+
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		ERROR("journal: cannot create %s: %s", dir, strerror(errno));
+		return NULL;
+	}
+
+	journal = calloc(1, sizeof(Journal));
+	journal->dir = strdup(dir);
+	journal->segment_size = segment_size ? segment_size
+				: JOURNAL_SEGMENT_SIZE;
+	journal->fd = -1;
+	pthread_mutex_init(&journal->mutex, NULL);
+
+	bases = list_segments(dir, &count);
+
+	if (!open_segment(journal, count ? bases[count - 1] : 0) ||
+	    !recover_segment(journal)) {
+		free(bases);
+		journal_close(journal);
+		return NULL;
+	}
+
+	journal->new_segment = !count;
+	free(bases);
+
+	DEBUG("journal: %s open at %016llx", dir, journal_end(journal));
+
+	return journal;
+}
+
+/**
+ * Appends a record. The record is written to the file right away but
+ * it is only durable after the next journal_sync(), so that many
+ * records share the cost of one flush.
+ *
+ * @param journal the journal
+ * @param record the record; offset and next are filled in
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int journal_append(Journal *journal, JournalRecord *record)
+{
+	intu8 header[JOURNAL_HEADER_SIZE];
+	struct iovec iov[2];
+	intu32 total = JOURNAL_HEADER_SIZE + record->length;
+	ssize_t written;
+	intu32 crc;
+
+	memset(header, 0, sizeof(header));
+	put32(header, record->length);
+	header[8] = record->type;
+	put32(header + 12, record->plugin);
+	put64(header + 16, record->connid);
+	put64(header + 24, record->timestamp);
+	put32(header + 32, record->handle);
+	put32(header + 36, record->instnumber);
+	crc = journal_crc32(0, header + 8, JOURNAL_HEADER_SIZE - 8);
+	crc = journal_crc32(crc, (const intu8 *) record->data, record->length);
+	put32(header + 4, crc);
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = JOURNAL_HEADER_SIZE;
+	iov[1].iov_base = (void *) record->data;
+	iov[1].iov_len = record->length;
+
+	pthread_mutex_lock(&journal->mutex);
+
+	if (journal->fd < 0) {
+		pthread_mutex_unlock(&journal->mutex);
+		return 0;
+	}
+
+	if (journal->size > 0 && journal->size + total > journal->segment_size) {
+		int fd = journal->fd;
+
+		if (!open_segment(journal, journal->base + journal->size)) {
+			journal->fd = fd;
+			pthread_mutex_unlock(&journal->mutex);
+			return 0;
+		}
+
+		/* flushed by journal_sync(), never by the appending thread */
+		journal->retired = realloc(journal->retired,
+					   (journal->retired_count + 1) *
+					   sizeof(int));
+		journal->retired[journal->retired_count++] = fd;
+		journal->new_segment = 1;
+	}
+
+	written = writev(journal->fd, iov, 2);
+
+	if (written != (ssize_t) total) {
+		ERROR("journal: write failed: %s", strerror(errno));
+
+		/* do not leave a partial record in the middle of the file */
+		if (ftruncate(journal->fd, journal->size) < 0 ||
+		    lseek(journal->fd, journal->size, SEEK_SET) < 0) {
+			close(journal->fd);
+			journal->fd = -1;
+		}
+
+		pthread_mutex_unlock(&journal->mutex);
+		return 0;
+	}
+
+	record->offset = journal->base + journal->size;
+	journal->size += total;
+	record->next = journal->base + journal->size;
+	journal->dirty = 1;
+
+	pthread_mutex_unlock(&journal->mutex);
+
+	return 1;
+}
+
+/**
+ * Flushes all appended records to disk (group commit). May be called
+ * from any thread; appends are not blocked while data is flushed.
+ *
+ * @param journal the journal
+ * @return 1 if operation succeeds, 0 otherwise
+ */
+int journal_sync(Journal *journal)
+{
+	int fd = -1;
+	int *retired;
+	int retired_count;
+	int new_segment;
+	int ok = 1;
+	int i;
+
+	pthread_mutex_lock(&journal->mutex);
+
+	if (journal->dirty && journal->fd >= 0) {
+		fd = dup(journal->fd);
+	}
+
+	retired = journal->retired;
+	retired_count = journal->retired_count;
+	new_segment = journal->new_segment;
+	journal->retired = NULL;
+	journal->retired_count = 0;
+	journal->new_segment = 0;
+	journal->dirty = 0;
+
+	pthread_mutex_unlock(&journal->mutex);
+
+	for (i = 0; i < retired_count; ++i) {
+		ok = fdatasync(retired[i]) == 0 && ok;
+		close(retired[i]);
+	}
+
+	free(retired);
+
+	if (fd >= 0) {
+		ok = fdatasync(fd) == 0 && ok;
+		close(fd);
+	}
+
+	if (new_segment) {
+		sync_dir(journal->dir);
+	}
+
+	return ok;
+}
+
+/**
+ * Gets the offset the next record will be written at.
+ *
+ * @param journal the journal
+ * @return the offset
+ */
+unsigned long long journal_end(Journal *journal)
+{
+	unsigned long long end;
+
+	pthread_mutex_lock(&journal->mutex);
+	end = journal->base + journal->size;
+	pthread_mutex_unlock(&journal->mutex);
+
+	return end;
+}
+
+/**
+ * Deletes segments that only hold records before an offset, e.g.
+ * once every client has consumed them.
+ *
+ * @param journal the journal
+ * @param offset records before this offset may be deleted
+ * @return number of segments deleted
+ */
+int journal_trim(Journal *journal, unsigned long long offset)
+{
+	unsigned long long *bases;
+	unsigned long long current;
+	int count;
+	int deleted = 0;
+	int i;
+
+	pthread_mutex_lock(&journal->mutex);
+	current = journal->base;
+	pthread_mutex_unlock(&journal->mutex);
+
+	bases = list_segments(journal->dir, &count);
+
+	/* a segment ends where the next one begins */
+	for (i = 0; i + 1 < count && bases[i + 1] <= offset; ++i) {
+		char *path;
+
+		if (bases[i] >= current) {
+			break;
+		}
+
+		if ((path = segment_path(journal->dir, bases[i]))) {
+			if (unlink(path) == 0) {
+				++deleted;
+			}
+			free(path);
+		}
+	}
+
+	free(bases);
+
+	return deleted;
+}
+
+/**
+ * Flushes and closes a journal.
+ *
+ * @param journal the journal
+ */
+void journal_close(Journal *journal)
+{
+	if (!journal) {
+		return;
+	}
+
+	journal_sync(journal);
+
+	if (journal->fd >= 0) {
+		close(journal->fd);
+	}
+
+	pthread_mutex_destroy(&journal->mutex);
+	free(journal->dir);
+	free(journal);
+}
+
+/**
+ * Unmaps and closes the segment a reader is on.
+ */
+static void reader_release(JournalReader *reader)
+{
+	if (reader->map) {
+		munmap((void *) reader->map, reader->map_size);
+		reader->map = NULL;
+		reader->map_size = 0;
+	}
+
+	if (reader->fd >= 0) {
+		close(reader->fd);
+		reader->fd = -1;
+	}
+}
+
+/**
+ * Maps the segment a reader is on again if it has grown.
+ *
+ * @return 1 if there is new data, 0 otherwise
+ */
+static int reader_remap(JournalReader *reader)
+{
+	struct stat st;
+	void *map;
+
+	if (reader->fd < 0) {
+		char *path = segment_path(reader->dir, reader->base);
+
+		if (!path) {
+			return 0;
+		}
+
+		reader->fd = open(path, O_RDONLY);
+		free(path);
+
+		if (reader->fd < 0) {
+			return 0;
+		}
+	}
+
+	if (fstat(reader->fd, &st) < 0 || st.st_size <= reader->map_size) {
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+
+	if (map == MAP_FAILED) {
+		return 0;
+	}
+
+	if (reader->map) {
+		munmap((void *) reader->map, reader->map_size);
+	}
+
+	reader->map = map;
+	reader->map_size = st.st_size;
+
+	return 1;
+}
+
+/**
+ * Moves a reader to the first segment after the current one, unless
+ * the current one grew meanwhile.
+ *
+ * @return 1 if there is such a segment, 0 otherwise
+ */
+static int reader_next_segment(JournalReader *reader)
+{
+	unsigned long long *bases;
+	unsigned long long next = 0;
+	int count;
+	int i;
+	int found = 0;
+
+	bases = list_segments(reader->dir, &count);
+
+	for (i = 0; i < count; ++i) {
+		if (bases[i] > reader->base) {
+			next = bases[i];
+			found = 1;
+			break;
+		}
+	}
+
+	free(bases);
+
+	if (!found) {
+		return 0;
+	}
+
+	/* The writer ends a segment before it creates the next one, so
+	 * the last records may have been appended after the reader last
+	 * looked; only move on once they are read. */
+	if (reader_remap(reader)) {
+		return 1;
+	}
+
+	reader_release(reader);
+	reader->base = next;
+	reader->pos = 0;
+
+	return 1;
+}
+
+/**
+ * Opens a reader that starts at a journal offset. Records are read
+ * straight from memory-mapped segment files, without asking healthd
+ * or the devices for anything.
+ *
+ * @param dir journal directory
+ * @param offset offset to start at, e.g. JournalRecord.next of the
+ *        last record consumed; 0 for the oldest record
+ * @return the reader, or NULL on error
+ */
+JournalReader *journal_reader_open(const char *dir, unsigned long long offset)
+{
+	JournalReader *reader;
+	unsigned long long *bases;
+	int count;
+	int i;
+
+	bases = list_segments(dir, &count);
+
+	if (!count) {
+		free(bases);
+		return NULL;
+	}
+
+	reader = calloc(1, sizeof(JournalReader));
+	reader->dir = strdup(dir);
+	reader->fd = -1;
+	reader->base = bases[0];
+
+	for (i = 0; i < count && bases[i] <= offset; ++i) {
+		reader->base = bases[i];
+	}
+
+	/* older records may have been trimmed */
+	reader->pos = offset > reader->base ? offset - reader->base : 0;
+
+	free(bases);
+
+	return reader;
+}
+
+/**
+ * Reads the next record.
+ *
+ * @param reader the reader
+ * @param record filled with the record; data points into the mapped
+ *        segment and is valid until the next call
+ * @return 1 if a record was read, 0 if the reader reached the end of
+ *         the journal (call again later to get new records)
+ */
+int journal_reader_next(JournalReader *reader, JournalRecord *record)
+{
+	intu32 len;
+
+	for (;;) {
+		len = parse_record(reader->map, reader->map_size, reader->pos,
+				   record);
+
+		if (len) {
+			record->offset = reader->base + reader->pos;
+			reader->pos += len;
+			record->next = reader->base + reader->pos;
+			return 1;
+		}
+
+		if (reader_remap(reader)) {
+			continue;
+		}
+
+		/* The rest of a segment that has a successor is garbage;
+		 * in the last one, a record may still be being written. */
+		if (!reader_next_segment(reader)) {
+			return 0;
+		}
+	}
+}
+
+/**
+ * Closes a reader.
+ *
+ * @param reader the reader
+ */
+void journal_reader_close(JournalReader *reader)
+{
+	if (!reader) {
+		return;
+	}
+
+	reader_release(reader);
+	free(reader->dir);
+	free(reader);
+}
+
+/** @} */
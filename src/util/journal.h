@@ -0,0 +1,164 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file journal.h
+ * \brief Append-only record journal definitions.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jun 12, 2012
+ */
+
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <pthread.h>
+#include <asn1/phd_types.h>
+
+/**
+ * \addtogroup Utility
+ * @{
+ */
+
+/**
+ * Default size a segment file grows to before a new one is started
+ */
+#define JOURNAL_SEGMENT_SIZE (16 * 1024 * 1024)
+
+/**
+ * Size of the record header on disk
+ */
+#define JOURNAL_HEADER_SIZE 40
+
+/**
+ * Record types used by healthd
+ */
+typedef enum {
+	JOURNAL_MEASUREMENT = 1,
+	JOURNAL_SEGMENT_DATA = 2
+} JournalRecordType;
+
+/**
+ * Journal record
+ */
+typedef struct JournalRecord {
+	/**
+	 * Record type, see JournalRecordType
+	 */
+	intu8 type;
+	/**
+	 * Plugin id of the device context
+	 */
+	intu32 plugin;
+	/**
+	 * Connection id of the device context
+	 */
+	unsigned long long connid;
+	/**
+	 * Wall clock time of the record, in nanoseconds since the epoch
+	 */
+	unsigned long long timestamp;
+	/**
+	 * PM-Store handle, for segment data
+	 */
+	intu32 handle;
+	/**
+	 * PM-Segment instance number, for segment data
+	 */
+	intu32 instnumber;
+	/**
+	 * Payload, e.g. the XML data list
+	 */
+	const char *data;
+	/**
+	 * Payload length
+	 */
+	intu32 length;
+	/**
+	 * Journal offset of the record
+	 */
+	unsigned long long offset;
+	/**
+	 * Journal offset of the record that follows it
+	 */
+	unsigned long long next;
+} JournalRecord;
+
+/**
+ * Journal writer
+ */
+typedef struct Journal {
+	char *dir;
+	intu32 segment_size;
+	/**
+	 * Offset of the first record of the current segment
+	 */
+	unsigned long long base;
+	/**
+	 * Bytes written to the current segment
+	 */
+	intu32 size;
+	int fd;
+	/**
+	 * Previous segments, still waiting for their last sync
+	 */
+	int *retired;
+	int retired_count;
+	int dirty;
+	int new_segment;
+	pthread_mutex_t mutex;
+} Journal;
+
+/**
+ * Journal reader
+ */
+typedef struct JournalReader {
+	char *dir;
+	unsigned long long base;
+	intu32 pos;
+	int fd;
+	const intu8 *map;
+	intu32 map_size;
+} JournalReader;
+
+intu32 journal_crc32(intu32 crc, const intu8 *data, intu32 length);
+
+Journal *journal_open(const char *dir, intu32 segment_size);
+
+int journal_append(Journal *journal, JournalRecord *record);
+
+int journal_sync(Journal *journal);
+
+unsigned long long journal_end(Journal *journal);
+
+int journal_trim(Journal *journal, unsigned long long offset);
+
+void journal_close(Journal *journal);
+
+JournalReader *journal_reader_open(const char *dir, unsigned long long offset);
+
+int journal_reader_next(JournalReader *reader, JournalRecord *record);
+
+void journal_reader_close(JournalReader *reader);
+
+/** @} */
+
+#endif /* JOURNAL_H_ */
@@ -61,32 +61,75 @@
 	}
 #endif
 
+/**
+ * \def LOG_LEVEL
+ * Most verbose level compiled in. Messages of less important levels
+ * are compiled out and cost nothing at run time. Usually set by
+ * configure --with-log-level.
+ */
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO    3
+#define LOG_LEVEL_DEBUG   4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/**
+ * @brief Discards a log message. Arguments are still type-checked
+ * but never evaluated.
+ */
+#define LOG_DISCARD(...) \
+	{ \
+		if (0) { \
+			fprintf(LOG_OUTPUT, __VA_ARGS__); \
+		} \
+	}
+
 /**
  * @brief Logs a debug level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
 #define DEBUG(...)   LOG("DEBUG   ", __VA_ARGS__)
+#else
+#define DEBUG(...)   LOG_DISCARD(__VA_ARGS__)
+#endif
 
 /**
  * @brief Logs a error level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
 #define ERROR(...)   LOG("ERROR   ", __VA_ARGS__)
+#else
+#define ERROR(...)   LOG_DISCARD(__VA_ARGS__)
+#endif
 
 /**
  * @brief Logs a warning level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
+#if LOG_LEVEL >= LOG_LEVEL_WARNING
 #define WARNING(...) LOG("WARNING ", __VA_ARGS__)
+#else
+#define WARNING(...) LOG_DISCARD(__VA_ARGS__)
+#endif
 
 /**
  * @brief Logs a information level message at the log output.
  * @param ... va_args like in printf.
  * @see printf
  */
+#if LOG_LEVEL >= LOG_LEVEL_INFO
 #define INFO(...)    LOG("INFO    ", __VA_ARGS__)
+#else
+#define INFO(...)    LOG_DISCARD(__VA_ARGS__)
+#endif
 
 #endif /* LOG_H_ */
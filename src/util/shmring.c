@@ -0,0 +1,360 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file shmring.c
+ * \brief Shared memory ring buffer.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jun 26, 2012
+ */
+
+/**
+ * \addtogroup Utility
+ * @{
+ *
+ * A ring of fixed-size records in a POSIX shared memory object, so
+ * that processes on the same host read records straight from memory,
+ * without a system call per record.
+ *
+ * Each slot starts with a sequence number: odd while record i is
+ * being written to it, 2i + 2 once it is complete. Writers never wait
+ * for readers; a reader that falls behind by more than the capacity
+ * of the ring finds newer records in its slots, skips ahead and
+ * counts the records it lost.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "shmring.h"
+#include "log.h"
+
+static const char ring_magic[8] = {'A', 'N', 'T', 'R', 'I', 'N', 'G', '1'};
+
+#ifdef ANDROID
+/* Bionic has no POSIX shared memory; rings just fail to open */
+static int shm_open(const char *name, int flags, mode_t mode)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+static int shm_unlink(const char *name)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
+
+/**
+ * Gets the sequence number of a slot
+ */
+static volatile unsigned long long *slot_seq(intu8 *slots, intu32 slot_size,
+					     unsigned long long index,
+					     intu32 capacity)
+{
+	return (volatile unsigned long long *)
+	       (slots + (index & (capacity - 1)) * slot_size);
+}
+
+/**
+ * Creates a ring, replacing any ring with the same name.
+ *
+ * @param name shared memory object name, e.g. "/healthd"
+ * @param record_size size of records
+ * @param capacity number of records kept, rounded up to a power of 2,
+ *	  from 1 to SHMRING_MAX_CAPACITY
+ * @return the ring, or NULL on error
+ */
+ShmRing *shmring_create(const char *name, intu32 record_size, intu32 capacity)
+{
+	ShmRing *ring;
+	intu32 slot_size;
+	intu32 slots = 1;
+	size_t size;
+	void *map;
+	int fd;
+
+	if (capacity == 0 || capacity > SHMRING_MAX_CAPACITY) {
+		ERROR("shmring: capacity %u out of range", capacity);
+		return NULL;
+	}
+
+	while (slots < capacity) {
+		slots <<= 1;
+	}
+
+	slot_size = (sizeof(unsigned long long) + record_size + 7) & ~7;
+	size = sizeof(ShmRingHeader) + (size_t) slots * slot_size;
+
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if (fd < 0) {
+		ERROR("shmring: cannot create %s: %s", name, strerror(errno));
+		return NULL;
+	}
+
+	if (ftruncate(fd, size) < 0) {
+		ERROR("shmring: cannot size %s: %s", name, strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		shm_unlink(name);
+		return NULL;
+	}
+
+	ring = calloc(1, sizeof(ShmRing));
+	ring->name = strdup(name);
+	ring->header = map;
+	ring->slots = (intu8 *) map + sizeof(ShmRingHeader);
+	ring->size = size;
+
+	ring->header->record_size = record_size;
+	ring->header->slot_size = slot_size;
+	ring->header->capacity = slots;
+
+	// readers check the magic last
+	__sync_synchronize();
+	memcpy(ring->header->magic, ring_magic, sizeof(ring_magic));
+
+	DEBUG("shmring: %s, %u records of %u bytes", name, slots, record_size);
+
+	return ring;
+}
+
+/**
+ * Appends a record. Never blocks; may be called from several threads.
+ *
+ * @param ring the ring
+ * @param record record of ring->header->record_size bytes
+ */
+void shmring_write(ShmRing *ring, const void *record)
+{
+	ShmRingHeader *header = ring->header;
+	unsigned long long index = __sync_fetch_and_add(&header->head, 1);
+	volatile unsigned long long *seq = slot_seq(ring->slots,
+						     header->slot_size, index,
+						     header->capacity);
+
+	*seq = 2 * index + 1;
+	__sync_synchronize();
+	memcpy((void *) (seq + 1), record, header->record_size);
+	__sync_synchronize();
+	*seq = 2 * index + 2;
+}
+
+/**
+ * Removes a ring. Attached readers are told the ring is closed.
+ *
+ * @param ring the ring
+ */
+void shmring_destroy(ShmRing *ring)
+{
+	if (!ring) {
+		return;
+	}
+
+	ring->header->closed = 1;
+	__sync_synchronize();
+
+	munmap(ring->header, ring->size);
+	shm_unlink(ring->name);
+	free(ring->name);
+	free(ring);
+}
+
+/**
+ * Claims a cursor for this process, taking over cursors of readers
+ * that died without closing.
+ *
+ * @return the cursor, or NULL if all are taken
+ */
+static ShmRingCursor *claim_cursor(ShmRingHeader *header)
+{
+	int pid = getpid();
+	int i;
+
+	for (i = 0; i < SHMRING_MAX_READERS; ++i) {
+		ShmRingCursor *cursor = &header->cursors[i];
+		int owner = cursor->pid;
+
+		if (owner && (kill(owner, 0) == 0 || errno != ESRCH)) {
+			continue;
+		}
+
+		if (__sync_bool_compare_and_swap(&cursor->pid, owner, pid)) {
+			return cursor;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Attaches to a ring. The reader starts at the next record written.
+ *
+ * @param name shared memory object name
+ * @return the reader, or NULL if there is no such ring
+ */
+ShmRingReader *shmring_reader_open(const char *name)
+{
+	ShmRingReader *reader;
+	ShmRingHeader *header;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = shm_open(name, O_RDWR, 0);
+
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(ShmRingHeader)) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	header = map;
+
+	if (memcmp(header->magic, ring_magic, sizeof(ring_magic)) != 0 ||
+	    st.st_size < (off_t) (sizeof(ShmRingHeader) +
+				  (size_t) header->capacity * header->slot_size)) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	__sync_synchronize();
+
+	reader = calloc(1, sizeof(ShmRingReader));
+	reader->header = header;
+	reader->slots = (intu8 *) map + sizeof(ShmRingHeader);
+	reader->size = st.st_size;
+	reader->position = header->head;
+	reader->cursor = claim_cursor(header);
+
+	if (!reader->cursor) {
+		WARNING("shmring: no free cursor in %s", name);
+		munmap(map, st.st_size);
+		free(reader);
+		return NULL;
+	}
+
+	reader->cursor->position = reader->position;
+
+	return reader;
+}
+
+/**
+ * Reads the next record, without blocking.
+ *
+ * @param reader the reader
+ * @param record buffer of header->record_size bytes
+ * @return 1 if a record was read, 0 if there is none yet, -1 if the
+ *         ring was closed by its writer
+ */
+int shmring_read(ShmRingReader *reader, void *record)
+{
+	ShmRingHeader *header = reader->header;
+
+	for (;;) {
+		unsigned long long position = reader->position;
+		unsigned long long expected = 2 * position + 2;
+		unsigned long long head;
+		volatile unsigned long long *seq;
+		unsigned long long s;
+
+		seq = slot_seq(reader->slots, header->slot_size, position,
+			       header->capacity);
+		s = *seq;
+		__sync_synchronize();
+
+		if (s == expected) {
+			memcpy(record, (const void *) (seq + 1),
+			       header->record_size);
+			__sync_synchronize();
+
+			if (*seq == s) {
+				reader->position = position + 1;
+				reader->cursor->position = reader->position;
+				return 1;
+			}
+
+			continue;
+		}
+
+		if (s < expected) {
+			return header->closed ? -1 : 0;
+		}
+
+		// Overwritten: skip to the oldest record still in the ring
+		head = header->head;
+		position = head > header->capacity ? head - header->capacity + 1
+			   : 0;
+
+		if (position <= reader->position) {
+			position = reader->position + 1;
+		}
+
+		reader->lost += position - reader->position;
+		reader->position = position;
+		reader->cursor->position = position;
+	}
+}
+
+/**
+ * Detaches from a ring.
+ *
+ * @param reader the reader
+ */
+void shmring_reader_close(ShmRingReader *reader)
+{
+	if (!reader) {
+		return;
+	}
+
+	__sync_lock_release(&reader->cursor->pid);
+	munmap(reader->header, reader->size);
+	free(reader);
+}
+
+/** @} */
@@ -0,0 +1,125 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file shmring.h
+ * \brief Shared memory ring buffer definitions.
+ *
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Jun 26, 2012
+ */
+
+#ifndef SHMRING_H_
+#define SHMRING_H_
+
+#include <stddef.h>
+#include <asn1/phd_types.h>
+
+/**
+ * \addtogroup Utility
+ * @{
+ */
+
+/**
+ * Number of readers that can be attached to a ring at the same time
+ */
+#define SHMRING_MAX_READERS 32
+
+/**
+ * Largest number of records a ring can hold
+ */
+#define SHMRING_MAX_CAPACITY (1u << 24)
+
+/**
+ * Cursor of an attached reader, kept in shared memory so that the
+ * lag of every reader can be seen from any process
+ */
+typedef struct ShmRingCursor {
+	/**
+	 * Process of the reader, 0 if the cursor is free
+	 */
+	volatile int pid;
+	intu32 reserved;
+	/**
+	 * Index of the next record the reader will read
+	 */
+	volatile unsigned long long position;
+} ShmRingCursor;
+
+/**
+ * Start of the shared memory object; record slots follow it
+ */
+typedef struct ShmRingHeader {
+	char magic[8];
+	intu32 record_size;
+	intu32 slot_size;
+	intu32 capacity;
+	/**
+	 * Set when the writer goes away
+	 */
+	volatile int closed;
+	/**
+	 * Index of the next record to be written
+	 */
+	volatile unsigned long long head;
+	ShmRingCursor cursors[SHMRING_MAX_READERS];
+} ShmRingHeader;
+
+/**
+ * Writer side of a ring
+ */
+typedef struct ShmRing {
+	char *name;
+	ShmRingHeader *header;
+	intu8 *slots;
+	size_t size;
+} ShmRing;
+
+/**
+ * Reader side of a ring
+ */
+typedef struct ShmRingReader {
+	ShmRingHeader *header;
+	intu8 *slots;
+	size_t size;
+	ShmRingCursor *cursor;
+	unsigned long long position;
+	/**
+	 * Records overwritten before the reader got to them
+	 */
+	unsigned long long lost;
+} ShmRingReader;
+
+ShmRing *shmring_create(const char *name, intu32 record_size, intu32 capacity);
+
+void shmring_write(ShmRing *ring, const void *record);
+
+void shmring_destroy(ShmRing *ring);
+
+ShmRingReader *shmring_reader_open(const char *name);
+
+int shmring_read(ShmRingReader *reader, void *record);
+
+void shmring_reader_close(ShmRingReader *reader);
+
+/** @} */
+
+#endif /* SHMRING_H_ */
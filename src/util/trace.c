@@ -0,0 +1,291 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file trace.c
+ * \brief Binary trace ring implementation.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 22, 2011
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+#include "log.h"
+
+/**
+ * \addtogroup Utility
+ * @{
+ */
+
+/**
+ * \def TRACE_RING_SIZE
+ * Number of records kept by each thread, must be a power of two.
+ */
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 4096
+#endif
+
+/**
+ * Ring of trace records. Each ring has a single writer, the thread
+ * that owns it, so recording an event takes no lock.
+ */
+typedef struct TraceRing {
+	/**
+	 * Next ring of the global list; rings are never freed
+	 */
+	struct TraceRing *next;
+	/**
+	 * 1 while owned by a living thread
+	 */
+	volatile int in_use;
+	/**
+	 * Ring identification, written to each record
+	 */
+	intu16 id;
+	/**
+	 * Number of records written so far
+	 */
+	volatile unsigned long long head;
+	/**
+	 * Records, indexed by head modulo TRACE_RING_SIZE
+	 */
+	TraceRecord records[TRACE_RING_SIZE];
+} TraceRing;
+
+/**
+ * All rings ever created
+ */
+static TraceRing *volatile rings = NULL;
+
+/**
+ * Number of rings ever created
+ */
+static int ring_count = 0;
+
+/**
+ * Key of the ring owned by each thread
+ */
+static pthread_key_t ring_key;
+
+/**
+ * Controls creation of ring_key
+ */
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Makes the ring of a finished thread available for reuse.
+ */
+static void ring_release(void *ring)
+{
+	__sync_synchronize();
+	((TraceRing *) ring)->in_use = 0;
+}
+
+/**
+ * Dumps the trace to the file named by ANTIDOTE_TRACE at exit.
+ */
+static void dump_at_exit()
+{
+	char *path = getenv("ANTIDOTE_TRACE");
+
+	if (path && *path) {
+		trace_dump(path);
+	}
+}
+
+/**
+ * Creates the ring key, once per process.
+ */
+static void ring_key_create()
+{
+	pthread_key_create(&ring_key, ring_release);
+
+	if (getenv("ANTIDOTE_TRACE")) {
+		atexit(dump_at_exit);
+	}
+}
+
+/**
+ * Returns the ring of the calling thread, taking an unused one
+ * or creating a new ring on first use.
+ *
+ * @return the ring, NULL if out of memory
+ */
+static TraceRing *ring_get()
+{
+	TraceRing *ring;
+
+	pthread_once(&ring_key_once, ring_key_create);
+	ring = pthread_getspecific(ring_key);
+
+	if (ring) {
+		return ring;
+	}
+
+	for (ring = rings; ring; ring = ring->next) {
+		if (__sync_bool_compare_and_swap(&ring->in_use, 0, 1)) {
+			break;
+		}
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(TraceRing));
+
+		if (!ring) {
+			return NULL;
+		}
+
+		ring->in_use = 1;
+		ring->id = __sync_add_and_fetch(&ring_count, 1);
+
+		do {
+			ring->next = rings;
+		} while (!__sync_bool_compare_and_swap(&rings, ring->next, ring));
+	}
+
+	pthread_setspecific(ring_key, ring);
+	return ring;
+}
+
+/**
+ * Records an event in the trace ring of the calling thread.
+ * Use the TRACE() macro instead, so tracing can be compiled out.
+ *
+ * @param code event code, see TraceCode
+ * @param plugin plugin id of the context
+ * @param connid connection id of the context
+ * @param data event data, may be NULL if length is 0
+ * @param length size of data; only its head is kept
+ */
+void trace_event(int code, unsigned int plugin, unsigned long long connid,
+		 const void *data, unsigned int length)
+{
+	TraceRing *ring = ring_get();
+	TraceRecord *record;
+	unsigned long long head;
+	struct timespec ts;
+	unsigned int kept = length;
+
+	if (!ring) {
+		return;
+	}
+
+	if (kept > TRACE_PAYLOAD_SIZE) {
+		kept = TRACE_PAYLOAD_SIZE;
+	}
+
+	if (!data) {
+		kept = 0;
+	}
+
+	head = ring->head;
+	record = &ring->records[head & (TRACE_RING_SIZE - 1)];
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	record->timestamp = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	record->connid = connid;
+	record->plugin = plugin;
+	record->ring = ring->id;
+	record->code = code;
+	record->length = length;
+	memcpy(record->payload, data, kept);
+	memset(record->payload + kept, 0, TRACE_PAYLOAD_SIZE - kept);
+
+	// publish the record only after it is complete
+	__sync_synchronize();
+	ring->head = head + 1;
+}
+
+/**
+ * Writes the records currently held by all trace rings to a file,
+ * to be decoded by the antidote_trace tool. Threads may keep
+ * recording while the dump is taken; records overwritten meanwhile
+ * are left out.
+ *
+ * @param path file to be written
+ * @return number of records written, -1 on error
+ */
+int trace_dump(const char *path)
+{
+	TraceRecord *copy;
+	TraceRing *ring;
+	intu32 record_size = sizeof(TraceRecord);
+	unsigned long long base;
+	unsigned long long first;
+	unsigned long long head;
+	unsigned long long i;
+	int count = 0;
+	FILE *f;
+
+	copy = malloc(sizeof(TraceRecord) * TRACE_RING_SIZE);
+
+	if (!copy) {
+		return -1;
+	}
+
+	f = fopen(path, "wb");
+
+	if (!f) {
+		ERROR("Cannot write trace file %s", path);
+		free(copy);
+		return -1;
+	}
+
+	fwrite(TRACE_FILE_MAGIC, 1, strlen(TRACE_FILE_MAGIC), f);
+	fwrite(&record_size, sizeof(record_size), 1, f);
+
+	for (ring = rings; ring; ring = ring->next) {
+		head = ring->head;
+		__sync_synchronize();
+		base = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+		for (i = base; i < head; i++) {
+			copy[i - base] = ring->records[i & (TRACE_RING_SIZE - 1)];
+		}
+
+		// drop records the owner thread may have overwritten meanwhile
+		__sync_synchronize();
+		first = ring->head + 1;
+		first = first > TRACE_RING_SIZE ? first - TRACE_RING_SIZE : 0;
+
+		if (first < base) {
+			first = base;
+		}
+
+		if (first < head) {
+			fwrite(&copy[first - base], sizeof(TraceRecord),
+			       head - first, f);
+			count += head - first;
+		}
+	}
+
+	fclose(f);
+	free(copy);
+
+	return count;
+}
+
+/** @} */
@@ -0,0 +1,112 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/**
+ * \file trace.h
+ * \brief Binary trace ring definitions.
+ *
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * \date Nov 22, 2011
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "src/asn1/phd_types.h"
+
+/**
+ * Trace event codes
+ */
+typedef enum {
+	TRACE_APDU_RECEIVED = 1, // !< payload: APDU head
+	TRACE_APDU_SENT, // !< payload: APDU head
+	TRACE_DECODE_ERROR, // !< payload: APDU head
+	TRACE_FSM_EVENT, // !< payload: intu8 state, intu8 event
+	TRACE_FSM_TRANSITION, // !< payload: intu8 from, intu8 to, intu8 event
+	TRACE_TIMEOUT, // !< no payload
+
+	TRACE_CODES // !< Number of codes, it does not represent an event
+} TraceCode;
+
+/**
+ * Number of payload bytes kept in a trace record
+ */
+#define TRACE_PAYLOAD_SIZE 20
+
+/**
+ * Compact trace record, 48 bytes
+ */
+typedef struct TraceRecord {
+	/**
+	 * Monotonic clock, in nanoseconds
+	 */
+	uint64_t timestamp;
+	/**
+	 * Connection ID of the context
+	 */
+	uint64_t connid;
+	/**
+	 * Plugin ID of the context
+	 */
+	intu32 plugin;
+	/**
+	 * Ring (i.e. thread) that recorded the event
+	 */
+	intu16 ring;
+	/**
+	 * Event code, see TraceCode
+	 */
+	intu16 code;
+	/**
+	 * Length of the traced data; only the first
+	 * TRACE_PAYLOAD_SIZE bytes are kept in payload
+	 */
+	intu32 length;
+	/**
+	 * Head of the traced data
+	 */
+	intu8 payload[TRACE_PAYLOAD_SIZE];
+} TraceRecord;
+
+/**
+ * Magic number at the start of trace dump files
+ */
+#define TRACE_FILE_MAGIC "ANTTRC01"
+
+/**
+ * \def TRACE(code, plugin, connid, data, length)
+ * Records a trace event. Compiles to nothing when TRACE_DISABLED
+ * is defined.
+ */
+#ifdef TRACE_DISABLED
+#define TRACE(code, plugin, connid, data, length) \
+	{ if (0) { trace_event(code, plugin, connid, data, length); } }
+#else
+#define TRACE(code, plugin, connid, data, length) \
+	trace_event(code, plugin, connid, data, length)
+#endif
+
+void trace_event(int code, unsigned int plugin, unsigned long long connid,
+		 const void *data, unsigned int length);
+
+int trace_dump(const char *path);
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,267 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testtimeseries.c
+ *
+ * Created on: Jun 19, 2012
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "Basic.h"
+#include "src/api/timeseries.h"
+#include "src/api/data_encoder.h"
+#include "src/dim/nomenclature.h"
+#include "testtimeseries.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <math.h>
+
+#define DEVICE 0x0011223344556677ULL
+#define MDC_PULS_OXIM_SAT_O2 19384
+#define MDC_PRESS_BLD_NONINV_SYS 18949
+#define MDC_PRESS_BLD_NONINV_DIA 18950
+
+int testtimeseries_init_suite(void)
+{
+	return 0;
+}
+
+int testtimeseries_finish_suite(void)
+{
+	return 0;
+}
+
+void testtimeseries_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Time Series Test Suite",
+				       testtimeseries_init_suite,
+				       testtimeseries_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_timeseries_roundtrip",
+		    test_timeseries_roundtrip);
+	CU_add_test(suite, "test_timeseries_query", test_timeseries_query);
+	CU_add_test(suite, "test_timeseries_data_list",
+		    test_timeseries_data_list);
+	CU_add_test(suite, "test_timeseries_save_load",
+		    test_timeseries_save_load);
+	/* Add tests here - End */
+}
+
+/* Irregular intervals and values that exercise every encoding */
+static const unsigned long long gaps[10] = {1000, 1000, 1001, 999, 1100,
+					    800, 4000, 1000, 5000000000ULL,
+					    1000};
+
+static unsigned long long sample_time(int i)
+{
+	unsigned long long t = 1339459200000ULL;
+	int j;
+
+	for (j = 0; j < i; ++j) {
+		t += gaps[j % 10];
+	}
+
+	return t;
+}
+
+static FLOAT_Type sample_value(int i)
+{
+	static const FLOAT_Type values[] = {36.5, 36.5, 36.6, 37.1, 0.0,
+					    -12.25, 1e300, 36.5, 36.5, 98.0};
+
+	return values[i % 10];
+}
+
+void test_timeseries_roundtrip(void)
+{
+	TimeSeriesDB *db = timeseries_new(64);
+	TimeSeriesPoint *points;
+	int count;
+	int i;
+
+	for (i = 0; i < 1000; ++i) {
+		CU_ASSERT_EQUAL(timeseries_append(db, DEVICE, MDC_TEMP_BODY,
+						  sample_time(i),
+						  sample_value(i)), 1);
+	}
+
+	points = timeseries_query(db, DEVICE, MDC_TEMP_BODY, 0, ~0ULL, &count);
+	CU_ASSERT_EQUAL(count, 1000);
+
+	for (i = 0; i < count; ++i) {
+		CU_ASSERT_EQUAL(points[i].timestamp,
+				sample_time(i));
+		CU_ASSERT_EQUAL(points[i].value, sample_value(i));
+	}
+
+	free(points);
+
+	/* out of order */
+	CU_ASSERT_EQUAL(timeseries_append(db, DEVICE, MDC_TEMP_BODY, 0, 1.0), 0);
+
+	/* unknown series */
+	CU_ASSERT_PTR_NULL(timeseries_query(db, DEVICE, MDC_PULS_OXIM_SAT_O2,
+					    0, ~0ULL, &count));
+	CU_ASSERT_EQUAL(count, 0);
+
+	timeseries_del(db);
+}
+
+void test_timeseries_query(void)
+{
+	TimeSeriesDB *db = timeseries_new(16);
+	TimeSeriesPoint *points;
+	unsigned long long t0 = 1339459200000ULL;
+	int count;
+	int i;
+
+	/* one point per second, slowly changing */
+	for (i = 0; i < 10000; ++i) {
+		timeseries_append(db, DEVICE, MDC_PULS_OXIM_SAT_O2, t0 + i * 1000,
+				  97 + (i / 100) % 3);
+		timeseries_append(db, DEVICE + 1, MDC_PULS_OXIM_SAT_O2,
+				  t0 + i * 1000, 90);
+	}
+
+	/* about 2 bits per point, against 16 bytes uncompressed */
+	CU_ASSERT(timeseries_size(db) < 20000 * 2);
+
+	points = timeseries_query(db, DEVICE, MDC_PULS_OXIM_SAT_O2,
+				  t0 + 4500, t0 + 7000, &count);
+	CU_ASSERT_EQUAL(count, 3);
+	CU_ASSERT_EQUAL(points[0].timestamp, t0 + 5000);
+	CU_ASSERT_EQUAL(points[2].timestamp, t0 + 7000);
+	free(points);
+
+	points = timeseries_query(db, DEVICE, MDC_PULS_OXIM_SAT_O2,
+				  t0 + 150000, t0 + 299000, &count);
+	CU_ASSERT_EQUAL(count, 150);
+	CU_ASSERT_EQUAL(points[0].value, 98);
+	CU_ASSERT_EQUAL(points[149].value, 99);
+	free(points);
+
+	CU_ASSERT_PTR_NULL(timeseries_query(db, DEVICE, MDC_PULS_OXIM_SAT_O2,
+					    0, t0 - 1, &count));
+
+	timeseries_del(db);
+}
+
+void test_timeseries_data_list(void)
+{
+	TimeSeriesDB *db = timeseries_new(0);
+	DataList *list = data_list_new(3);
+	TimeSeriesPoint *points;
+	SimpleNuObsValue temp = 36.6;
+	FLOAT_Type accuracy = 0.1;
+	NuObsValue nu[2];
+	NuObsValueCmp cmp = {2, 0, nu};
+	int count;
+
+	data_set_simple_nu_obs_value(&list->values[0],
+				     "Simple-Nu-Observed-Value", &temp);
+	data_set_meta_att(&list->values[0], data_strcp("metric-id"),
+			  data_strcp("19292"));
+
+	nu[0].metric_id = MDC_PRESS_BLD_NONINV_SYS;
+	nu[0].state = 0;
+	nu[0].unit_code = MDC_DIM_MMHG;
+	nu[0].value = 120;
+	nu[1].metric_id = MDC_PRESS_BLD_NONINV_DIA;
+	nu[1].state = 0;
+	nu[1].unit_code = MDC_DIM_MMHG;
+	nu[1].value = 80;
+	data_set_nu_obs_val_cmp(&list->values[1], "Compound-Nu-Observed-Value",
+				&cmp, MDC_PART_SCADA);
+
+	/* not an observation */
+	data_set_float(&list->values[2], "Accuracy", &accuracy);
+
+	CU_ASSERT_EQUAL(timeseries_append_data_list(db, DEVICE, 1000, list), 3);
+
+	points = timeseries_query(db, DEVICE, MDC_TEMP_BODY, 0, ~0ULL, &count);
+	CU_ASSERT_EQUAL(count, 1);
+	CU_ASSERT_DOUBLE_EQUAL(points[0].value, 36.6, 0.001);
+	free(points);
+
+	points = timeseries_query(db, DEVICE, MDC_PRESS_BLD_NONINV_DIA, 0, ~0ULL,
+				  &count);
+	CU_ASSERT_EQUAL(count, 1);
+	CU_ASSERT_DOUBLE_EQUAL(points[0].value, 80, 0.001);
+	free(points);
+
+	data_list_del(list);
+	timeseries_del(db);
+}
+
+void test_timeseries_save_load(void)
+{
+	TimeSeriesDB *db = timeseries_new(100);
+	TimeSeriesPoint *points;
+	char path[] = "/tmp/antidote-timeseries-XXXXXX";
+	int count;
+	int fd;
+	int i;
+
+	fd = mkstemp(path);
+	CU_ASSERT(fd >= 0);
+	close(fd);
+
+	for (i = 0; i < 250; ++i) {
+		timeseries_append(db, DEVICE, MDC_TEMP_BODY, i * 60, sample_value(i));
+		timeseries_append(db, DEVICE, MDC_MASS_BODY_ACTUAL, i * 3600, 70 + i);
+	}
+
+	CU_ASSERT_EQUAL(timeseries_save(db, path), 1);
+	timeseries_del(db);
+
+	db = timeseries_load(path);
+	CU_ASSERT_PTR_NOT_NULL(db);
+
+	/* appending continues the last block */
+	CU_ASSERT_EQUAL(timeseries_append(db, DEVICE, MDC_TEMP_BODY, 250 * 60,
+					  sample_value(250)), 1);
+
+	points = timeseries_query(db, DEVICE, MDC_TEMP_BODY, 0, ~0ULL, &count);
+	CU_ASSERT_EQUAL(count, 251);
+
+	for (i = 0; i < count; ++i) {
+		CU_ASSERT_EQUAL(points[i].timestamp, i * 60ULL);
+		CU_ASSERT_EQUAL(points[i].value, sample_value(i));
+	}
+
+	free(points);
+
+	points = timeseries_query(db, DEVICE, MDC_MASS_BODY_ACTUAL, 3600, 7200,
+				  &count);
+	CU_ASSERT_EQUAL(count, 2);
+	CU_ASSERT_EQUAL(points[1].value, 72);
+	free(points);
+
+	timeseries_del(db);
+	unlink(path);
+}
+
+#endif
@@ -0,0 +1,41 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testtimeseries.h
+ *
+ * Created on: Jun 19, 2012
+ **********************************************************************/
+
+#ifndef TESTTIMESERIES_H_
+#define TESTTIMESERIES_H_
+
+#ifdef TEST_ENABLED
+
+void testtimeseries_add_suite(void);
+void test_timeseries_roundtrip(void);
+void test_timeseries_query(void);
+void test_timeseries_data_list(void);
+void test_timeseries_save_load(void);
+
+#endif /* TEST_ENABLED */
+
+#endif /* TESTTIMESERIES_H_ */
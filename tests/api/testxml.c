@@ -30,6 +30,7 @@
 #include "Basic.h"
 #include "src/util/strbuff.h"
 #include "src/api/xml_encoder.h"
+#include "src/api/data_encoder.h"
 #include "tests/functional_test_cases/test_functional.h"
 #include "testxml.h"
 #include "src/util/log.h"
@@ -54,6 +55,7 @@ void testxml_add_suite()
 
 	/* Add tests here - Start */
 	CU_add_test(suite, "test_xml_1", test_xml_1);
+	CU_add_test(suite, "test_xml_copy", test_xml_copy);
 	/* Add tests here - End */
 }
 
@@ -170,4 +172,43 @@ void test_xml_1()
 	DEBUG("test_xml_1");
 }
 
+void test_xml_copy()
+{
+	DataList *list = data_list_new(2);
+	DataList *copy;
+	DataEntry *cmp;
+	char *a, *b;
+
+	data_set_meta_att(&list->values[0], data_strcp("HANDLE"),
+			  data_strcp("7"));
+	list->values[0].choice = SIMPLE_DATA_ENTRY;
+	list->values[0].u.simple.name = data_strcp("Simple");
+	list->values[0].u.simple.type = APIDEF_TYPE_FLOAT;
+	list->values[0].u.simple.value = data_strcp("98.5");
+
+	cmp = &list->values[1];
+	cmp->choice = COMPOUND_DATA_ENTRY;
+	cmp->u.compound.name = data_strcp("Compound");
+	cmp->u.compound.entries_count = 1;
+	cmp->u.compound.entries = calloc(1, sizeof(DataEntry));
+	cmp->u.compound.entries[0].choice = SIMPLE_DATA_ENTRY;
+	cmp->u.compound.entries[0].u.simple.name = data_strcp("code");
+	cmp->u.compound.entries[0].u.simple.type = APIDEF_TYPE_INTU16;
+	cmp->u.compound.entries[0].u.simple.value = data_strcp("19384");
+	data_set_meta_att(&cmp->u.compound.entries[0], data_strcp("unit"),
+			  data_strcp("%"));
+
+	copy = data_list_copy(list);
+	a = xml_encode_data_list(list);
+	data_list_del(list);
+	b = xml_encode_data_list(copy);
+
+	CU_ASSERT_STRING_EQUAL(a, b);
+	CU_ASSERT_PTR_NULL(data_list_copy(NULL));
+
+	data_list_del(copy);
+	free(a);
+	free(b);
+}
+
 #endif
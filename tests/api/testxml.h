@@ -34,6 +34,7 @@
 void testxml_add_suite(void);
 void testxml_test();
 void test_xml_1();
+void test_xml_copy();
 
 #endif /* TEST_ENABLED */
 
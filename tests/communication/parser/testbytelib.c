@@ -42,6 +42,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 int testbytelib_init_suite(void)
 {
@@ -67,6 +69,8 @@ void testbytelib_add_suite()
 	CU_add_test(suite, "test_read_intu32", test_read_intu32);
 
 	CU_add_test(suite, "test_float", test_float);
+	CU_add_test(suite, "test_sfloat_many", test_sfloat_many);
+	CU_add_test(suite, "test_float_many", test_float_many);
 	/* Add tests here - End */
 }
 
@@ -262,4 +266,89 @@ void test_float()
 	free(rstream);
 }
 
+void test_sfloat_many()
+{
+	int error = 0;
+	intu8 test_data[] = {
+		0xF3, 0xCF, // 97.5
+		0xFF, 0xFE, // -0.2
+		0x0F, 0xFE, // -2
+		0x27, 0xFD, // 204500
+		0x87, 0xFD, // 0.00002045
+		0x07, 0xFE, // +INF
+		0x07, 0xFF, // NaN
+		0x08, 0x00, // NRes
+		0x08, 0x01, // reserved
+		0x08, 0x02, // -INF
+		0x38, 0x00, // -2048000, reserved mantissa with an exponent
+		0xF8, 0x02, // -204.6
+		0x00
+	};
+	SFLOAT_Type values[12];
+	ByteStreamReader *stream = byte_stream_reader_instance(test_data, sizeof(test_data));
+	ByteStreamReader *single = byte_stream_reader_instance(test_data, sizeof(test_data));
+	int i;
+
+	read_sfloat_many(stream, values, 12, &error);
+	CU_ASSERT_FALSE(error);
+	CU_ASSERT_EQUAL(stream->unread_bytes, 1);
+
+	CU_ASSERT_EQUAL(values[0], 97.5);
+	CU_ASSERT_EQUAL(values[1], -0.2);
+	CU_ASSERT_EQUAL(values[2], -2);
+	CU_ASSERT_EQUAL(values[3], 204500);
+	CU_ASSERT_EQUAL(values[4], 2045e-8);
+	CU_ASSERT_TRUE(isinf(values[5]) && values[5] > 0);
+	CU_ASSERT_TRUE(isnan(values[6]));
+	CU_ASSERT_TRUE(isnan(values[7]));
+	CU_ASSERT_TRUE(isnan(values[8]));
+	CU_ASSERT_TRUE(isinf(values[9]) && values[9] < 0);
+	CU_ASSERT_EQUAL(values[10], -2048000);
+	CU_ASSERT_EQUAL(values[11], -204.6);
+
+	// batch and single conversions agree bit by bit
+	for (i = 0; i < 12; ++i) {
+		SFLOAT_Type value = read_sfloat(single, &error);
+		CU_ASSERT_EQUAL(memcmp(&value, &values[i], sizeof(value)), 0);
+	}
+
+	read_sfloat_many(stream, values, 1, &error);
+	CU_ASSERT_TRUE(error);
+
+	free(stream);
+	free(single);
+}
+
+void test_float_many()
+{
+	int error = 0;
+	intu8 test_data[] = {
+		0xFB, 0x12, 0xD6, 0x87, // 12.34567
+		0xFF, 0xFF, 0xFF, 0xFE, // -0.2
+		0x80, 0x00, 0x00, 0x01, // 1e-128
+		0x00, 0x7F, 0xFF, 0xFE, // +INF
+		0x00, 0x7F, 0xFF, 0xFF, // NaN
+		0x00, 0x80, 0x00, 0x00, // NRes
+		0x00, 0x80, 0x00, 0x02, // -INF
+		0x01, 0x7F, 0xFF, 0xFE  // 83886060, reserved mantissa with an exponent
+	};
+	FLOAT_Type values[8];
+	ByteStreamReader *stream = byte_stream_reader_instance(test_data, sizeof(test_data));
+
+	read_float_many(stream, values, 8, &error);
+	CU_ASSERT_FALSE(error);
+	CU_ASSERT_EQUAL(stream->unread_bytes, 0);
+
+	CU_ASSERT_EQUAL(values[0], 12.34567);
+	CU_ASSERT_EQUAL(values[1], -0.2);
+	CU_ASSERT_DOUBLE_EQUAL(values[2], 1e-128, 1e-140);
+	CU_ASSERT_TRUE(isinf(values[3]) && values[3] > 0);
+	CU_ASSERT_TRUE(isnan(values[4]));
+	CU_ASSERT_TRUE(isnan(values[5]));
+	CU_ASSERT_TRUE(isinf(values[6]) && values[6] < 0);
+	CU_ASSERT_EQUAL(values[7], 83886060);
+
+	free(stream);
+}
+
 #endif
@@ -39,6 +39,10 @@ void test_read_intu16();
 void test_read_intu32();
 void test_float();
 
+void test_sfloat_many();
+
+void test_float_many();
+
 #endif /* TEST_ENABLED */
 
 #endif /* TESTBYTELIB_H_ */
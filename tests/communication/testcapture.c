@@ -0,0 +1,225 @@
+/**********************************************************************
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testcapture.c
+ *
+ * Created on: Nov 23, 2011
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testcapture.h"
+#include "src/communication/capture.h"
+#include "Basic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CAPTURE_TEST_FILE "test_capture.cap"
+
+static int test_init_suite(void)
+{
+	return 0;
+}
+
+static int test_finish_suite(void)
+{
+	unlink(CAPTURE_TEST_FILE);
+	return 0;
+}
+
+void testcapture_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Capture Test Suite", test_init_suite,
+				       test_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "testcapture_write_read", testcapture_write_read);
+	CU_add_test(suite, "testcapture_seek", testcapture_seek);
+	CU_add_test(suite, "testcapture_seek_same_time",
+		    testcapture_seek_same_time);
+
+	/* Add tests here - End */
+}
+
+/**
+ * Captures count APDUs; APDU i has length i + 1, every byte set to i
+ */
+static void write_capture(int count)
+{
+	intu8 data[256];
+	ContextId id = {1, 6024};
+	int i;
+
+	CU_ASSERT_EQUAL(capture_start(CAPTURE_TEST_FILE), 1);
+	CU_ASSERT_EQUAL(capture_is_active(), 1);
+
+	for (i = 0; i < count; i++) {
+		memset(data, i, sizeof(data));
+		id.connid = 6024 + i % 3;
+		capture_apdu(id, i % 2 ? CAPTURE_OUT : CAPTURE_IN, data,
+			     (i % 255) + 1);
+	}
+
+	capture_stop();
+	CU_ASSERT_EQUAL(capture_is_active(), 0);
+	CU_ASSERT_EQUAL(capture_dropped(), 0);
+}
+
+void testcapture_write_read()
+{
+	CaptureReader *reader;
+	CaptureRecord record;
+	unsigned long long last = 0;
+	int i = 0;
+
+	// nothing is captured while capture is off
+	capture_apdu((ContextId) {1, 1}, CAPTURE_IN, (intu8 *) "x", 1);
+
+	write_capture(100);
+
+	reader = capture_reader_open(CAPTURE_TEST_FILE);
+	CU_ASSERT_PTR_NOT_NULL(reader);
+
+	if (reader == NULL) {
+		return;
+	}
+
+	CU_ASSERT_EQUAL(reader->index_count,
+			(intu32) (100 + CAPTURE_INDEX_INTERVAL - 1)
+			/ CAPTURE_INDEX_INTERVAL);
+
+	while (capture_reader_next(reader, &record)) {
+		CU_ASSERT_EQUAL(record.id.plugin, 1u);
+		CU_ASSERT_EQUAL(record.id.connid, 6024ULL + i % 3);
+		CU_ASSERT_EQUAL(record.direction, i % 2 ? CAPTURE_OUT : CAPTURE_IN);
+		CU_ASSERT_EQUAL(record.length, (intu32) (i % 255) + 1);
+		CU_ASSERT_EQUAL(record.data[0], i);
+		CU_ASSERT_EQUAL(record.data[record.length - 1], i);
+		CU_ASSERT(record.timestamp >= last);
+		last = record.timestamp;
+		i++;
+	}
+
+	CU_ASSERT_EQUAL(i, 100);
+
+	capture_reader_close(reader);
+}
+
+void testcapture_seek()
+{
+	CaptureReader *reader;
+	CaptureRecord record;
+	unsigned long long timestamps[200];
+	int i = 0;
+
+	write_capture(200);
+
+	reader = capture_reader_open(CAPTURE_TEST_FILE);
+	CU_ASSERT_PTR_NOT_NULL(reader);
+
+	if (reader == NULL) {
+		return;
+	}
+
+	while (i < 200 && capture_reader_next(reader, &record)) {
+		timestamps[i++] = record.timestamp;
+	}
+
+	CU_ASSERT_EQUAL(i, 200);
+
+	if (i != 200) {
+		capture_reader_close(reader);
+		return;
+	}
+
+	for (i = 0; i < 200; i += 13) {
+		CU_ASSERT_EQUAL(capture_reader_seek(reader, timestamps[i]), 1);
+		CU_ASSERT_EQUAL(capture_reader_next(reader, &record), 1);
+		CU_ASSERT_EQUAL(record.timestamp, timestamps[i]);
+	}
+
+	CU_ASSERT_EQUAL(capture_reader_seek(reader, timestamps[199] + 1), 0);
+	CU_ASSERT_EQUAL(capture_reader_next(reader, &record), 0);
+
+	capture_reader_close(reader);
+}
+
+void testcapture_seek_same_time()
+{
+	CaptureReader *reader;
+	CaptureRecord record;
+	long offset[CAPTURE_INDEX_INTERVAL + 1];
+	unsigned long long timestamp = 0;
+	intu8 header[8];
+	FILE *file;
+	int i;
+
+	write_capture(CAPTURE_INDEX_INTERVAL + 1);
+
+	reader = capture_reader_open(CAPTURE_TEST_FILE);
+	CU_ASSERT_PTR_NOT_NULL(reader);
+
+	if (reader == NULL) {
+		return;
+	}
+
+	for (i = 0; i <= CAPTURE_INDEX_INTERVAL; i++) {
+		offset[i] = ftell(reader->file);
+		CU_ASSERT_EQUAL(capture_reader_next(reader, &record), 1);
+		timestamp = record.timestamp;
+	}
+
+	capture_reader_close(reader);
+
+	// give the record before the second index entry its time
+	for (i = 0; i < 8; i++) {
+		header[i] = timestamp >> (56 - 8 * i);
+	}
+
+	file = fopen(CAPTURE_TEST_FILE, "r+b");
+	CU_ASSERT_PTR_NOT_NULL(file);
+
+	if (file == NULL) {
+		return;
+	}
+
+	fseek(file, offset[CAPTURE_INDEX_INTERVAL - 1], SEEK_SET);
+	CU_ASSERT_EQUAL(fwrite(header, 1, 8, file), 8);
+	fclose(file);
+
+	reader = capture_reader_open(CAPTURE_TEST_FILE);
+	CU_ASSERT_PTR_NOT_NULL(reader);
+
+	if (reader == NULL) {
+		return;
+	}
+
+	CU_ASSERT_EQUAL(reader->index_count, 2);
+	CU_ASSERT_EQUAL(capture_reader_seek(reader, timestamp), 1);
+	CU_ASSERT_EQUAL(capture_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.data[0], CAPTURE_INDEX_INTERVAL - 1);
+
+	capture_reader_close(reader);
+}
+
+#endif
@@ -59,6 +59,7 @@ void testextconfiguration_add_suite()
 
 	/* Add tests here - Start */
 	CU_add_test(suite, "test_extconfiguration_persistent_config", test_extconfiguration_persistent_config);
+	CU_add_test(suite, "test_extconfiguration_update_config", test_extconfiguration_update_config);
 
 	/* Add tests here - End */
 }
@@ -287,4 +288,56 @@ void test_extconfiguration_persistent_config()
 	free(glu_object_list);
 
 }
+void test_extconfiguration_update_config()
+{
+	struct StdConfiguration *bp_std_config = blood_pressure_monitor_create_std_config_ID02BC();
+	struct StdConfiguration *po_std_config = pulse_oximeter_create_std_config_ID0190();
+
+	intu8 sys_id_buffer[] = {0x00, 0x22, 0x09, 0x22, 0x58, 0x08, 0x03, 0xcc};
+
+	octet_string sys_id;
+	sys_id.length = 8;
+	sys_id.value = sys_id_buffer;
+
+	ConfigObjectList *bp_object_list = bp_std_config->configure_action();
+	ConfigObjectList *po_object_list = po_std_config->configure_action();
+
+	ext_configurations_remove_all_configs();
+	ext_configurations_load_configurations();
+
+	// Registering again replaces the configuration
+	ext_configurations_register_conf(&sys_id, 0x4000, bp_object_list);
+	ext_configurations_register_conf(&sys_id, 0x4000, po_object_list);
+
+	ConfigObjectList *result = ext_configurations_get_configuration_attributes(&sys_id, 0x4000);
+	CU_ASSERT(result != NULL);
+	CU_ASSERT(result->count == po_object_list->count);
+	CU_ASSERT(result->length == po_object_list->length);
+	del_configobjectlist(result);
+	free(result);
+
+	// Other config ids of the same system are not affected
+	CU_ASSERT(ext_configurations_is_supported_standard(&sys_id, 0x4001) == 0);
+
+	// The replacement survives a reload
+	ext_configurations_destroy();
+	ext_configurations_load_configurations();
+
+	result = ext_configurations_get_configuration_attributes(&sys_id, 0x4000);
+	CU_ASSERT(result != NULL);
+	CU_ASSERT(result->count == po_object_list->count);
+	CU_ASSERT(result->length == po_object_list->length);
+	del_configobjectlist(result);
+	free(result);
+
+	ext_configurations_remove_all_configs();
+
+	free(bp_std_config);
+	free(po_std_config);
+	del_configobjectlist(bp_object_list);
+	del_configobjectlist(po_object_list);
+	free(bp_object_list);
+	free(po_object_list);
+}
+
 #endif
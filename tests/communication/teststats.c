@@ -0,0 +1,148 @@
+/**********************************************************************
+ * Copyright (C) 2011 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * teststats.c
+ *
+ * Created on: Nov 21, 2011
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "teststats.h"
+#include "src/communication/context.h"
+#include "src/communication/stats.h"
+#include "src/api/api_definitions.h"
+#include "src/api/data_list.h"
+#include "Basic.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int test_init_suite(void)
+{
+	return 0;
+}
+
+static int test_finish_suite(void)
+{
+	return 0;
+}
+
+void teststats_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Stats Test Suite", test_init_suite,
+				       test_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "teststats_counters", teststats_counters);
+	CU_add_test(suite, "teststats_data_list", teststats_data_list);
+
+	/* Add tests here - End */
+}
+
+static DataEntry *find_entry(DataEntry *cmp, const char *name)
+{
+	int i;
+
+	for (i = 0; i < cmp->u.compound.entries_count; i++) {
+		DataEntry *entry = &cmp->u.compound.entries[i];
+
+		if (entry->choice == SIMPLE_DATA_ENTRY &&
+		    strcmp(entry->u.simple.name, name) == 0) {
+			return entry;
+		}
+
+		if (entry->choice == COMPOUND_DATA_ENTRY &&
+		    strcmp(entry->u.compound.name, name) == 0) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+void teststats_counters()
+{
+	Context *ctx = calloc(1, sizeof(Context));
+
+	stats_reset_global();
+
+	stats_count(ctx, STATS_APDUS_IN, 1);
+	stats_count(ctx, STATS_BYTES_IN, 120);
+	stats_count(NULL, STATS_BYTES_IN, 30);
+	stats_transition(ctx, fsm_state_operating);
+	stats_record_time(ctx, STATS_DECODE_TIME, 1000);
+	stats_record_time(ctx, STATS_DECODE_TIME, 3000);
+
+	CU_ASSERT_EQUAL(ctx->stats.counters[STATS_APDUS_IN], 1);
+	CU_ASSERT_EQUAL(ctx->stats.counters[STATS_BYTES_IN], 120);
+	CU_ASSERT_EQUAL(ctx->stats.counters[STATS_TRANSITIONS], 1);
+	CU_ASSERT_EQUAL(ctx->stats.state_entries[fsm_state_operating], 1);
+	CU_ASSERT_EQUAL(ctx->stats.timings[STATS_DECODE_TIME].count, 2);
+	CU_ASSERT_EQUAL(ctx->stats.timings[STATS_DECODE_TIME].sum, 4000);
+	CU_ASSERT_EQUAL(ctx->stats.timings[STATS_LISTENER_TIME].count, 0);
+
+	free(ctx);
+}
+
+void teststats_data_list()
+{
+	Context *ctx = calloc(1, sizeof(Context));
+	DataList *list;
+	DataEntry *entry;
+
+	ctx->id.plugin = 1;
+	ctx->id.connid = 7;
+	stats_reset_global();
+
+	stats_count(ctx, STATS_APDUS_OUT, 3);
+	stats_count(NULL, STATS_APDUS_OUT, 2);
+	stats_record_time(ctx, STATS_LISTENER_TIME, 1000);
+
+	list = stats_get_data_list(ctx);
+	CU_ASSERT_PTR_NOT_NULL(list);
+	CU_ASSERT_EQUAL(list->size, 1);
+	CU_ASSERT_STRING_EQUAL(list->values[0].u.compound.name, "Stats");
+	CU_ASSERT_STRING_EQUAL(list->values[0].meta_data.values[0].value, "1:7");
+
+	entry = find_entry(&list->values[0], "apdus-out");
+	CU_ASSERT_PTR_NOT_NULL(entry);
+	CU_ASSERT_STRING_EQUAL(entry->u.simple.value, "3");
+
+	entry = find_entry(&list->values[0], "listener-time");
+	CU_ASSERT_PTR_NOT_NULL(entry);
+	entry = find_entry(entry, "p50-ns");
+	CU_ASSERT_PTR_NOT_NULL(entry);
+	CU_ASSERT_STRING_EQUAL(entry->u.simple.value, "1024");
+
+	data_list_del(list);
+
+	list = stats_get_data_list(NULL);
+	CU_ASSERT_STRING_EQUAL(list->values[0].meta_data.values[0].value, "global");
+
+	entry = find_entry(&list->values[0], "apdus-out");
+	CU_ASSERT_STRING_EQUAL(entry->u.simple.value, "5");
+
+	data_list_del(list);
+	free(ctx);
+}
+
+#endif
@@ -0,0 +1,259 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testjournal.c
+ *
+ * Created on: Jun 12, 2012
+ **********************************************************************/
+
+#ifdef TEST_ENABLED
+
+#include "testjournal.h"
+#include "src/util/journal.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static char journal_dir[64];
+
+static void remove_journal_dir()
+{
+	struct dirent *entry;
+	char path[512];
+	DIR *d = opendir(journal_dir);
+
+	if (!d) {
+		return;
+	}
+
+	while ((entry = readdir(d))) {
+		if (entry->d_name[0] != '.') {
+			snprintf(path, sizeof(path), "%s/%s", journal_dir,
+				 entry->d_name);
+			unlink(path);
+		}
+	}
+
+	closedir(d);
+	rmdir(journal_dir);
+}
+
+int test_journal_init_suite(void)
+{
+	strcpy(journal_dir, "/tmp/antidote-journal-XXXXXX");
+	return mkdtemp(journal_dir) ? 0 : 1;
+}
+
+int test_journal_finish_suite(void)
+{
+	remove_journal_dir();
+	return 0;
+}
+
+void testjournal_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Journal Test Suite",
+				       test_journal_init_suite,
+				       test_journal_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_journal_crc32", test_journal_crc32);
+	CU_add_test(suite, "test_journal_append_read",
+		    test_journal_append_read);
+	CU_add_test(suite, "test_journal_segments", test_journal_segments);
+	CU_add_test(suite, "test_journal_torn_tail", test_journal_torn_tail);
+	/* Add tests here - End */
+}
+
+static int append(Journal *journal, const char *data, intu32 handle)
+{
+	JournalRecord record;
+
+	memset(&record, 0, sizeof(record));
+	record.type = JOURNAL_SEGMENT_DATA;
+	record.plugin = 1;
+	record.connid = 0x123456789ULL;
+	record.timestamp = 1339459200000000000ULL;
+	record.handle = handle;
+	record.instnumber = 7;
+	record.data = data;
+	record.length = strlen(data);
+
+	return journal_append(journal, &record);
+}
+
+void test_journal_crc32(void)
+{
+	CU_ASSERT_EQUAL(journal_crc32(0, (const intu8 *) "123456789", 9),
+			0xCBF43926);
+	CU_ASSERT_EQUAL(journal_crc32(journal_crc32(0, (const intu8 *) "1234", 4),
+				      (const intu8 *) "56789", 5), 0xCBF43926);
+}
+
+void test_journal_append_read(void)
+{
+	Journal *journal;
+	JournalReader *reader;
+	JournalRecord record;
+	unsigned long long resume;
+
+	remove_journal_dir();
+	journal = journal_open(journal_dir, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+	CU_ASSERT_EQUAL(append(journal, "<data>1</data>", 1), 1);
+	CU_ASSERT_EQUAL(append(journal, "<data>2</data>", 2), 1);
+	CU_ASSERT_EQUAL(journal_sync(journal), 1);
+
+	reader = journal_reader_open(journal_dir, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.type, JOURNAL_SEGMENT_DATA);
+	CU_ASSERT_EQUAL(record.plugin, 1);
+	CU_ASSERT_EQUAL(record.connid, 0x123456789ULL);
+	CU_ASSERT_EQUAL(record.timestamp, 1339459200000000000ULL);
+	CU_ASSERT_EQUAL(record.handle, 1);
+	CU_ASSERT_EQUAL(record.instnumber, 7);
+	CU_ASSERT_EQUAL(record.offset, 0);
+	CU_ASSERT_EQUAL(record.length, 14);
+	CU_ASSERT_NSTRING_EQUAL(record.data, "<data>1</data>", 14);
+	resume = record.next;
+
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.handle, 2);
+	CU_ASSERT_EQUAL(record.offset, resume);
+	CU_ASSERT_EQUAL(record.next, journal_end(journal));
+
+	/* caught up; new records show up on the next call */
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 0);
+	CU_ASSERT_EQUAL(append(journal, "<data>3</data>", 3), 1);
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.handle, 3);
+	journal_reader_close(reader);
+
+	/* resume from an offset */
+	reader = journal_reader_open(journal_dir, resume);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.handle, 2);
+	journal_reader_close(reader);
+
+	journal_close(journal);
+}
+
+void test_journal_segments(void)
+{
+	Journal *journal;
+	JournalReader *reader;
+	JournalRecord record;
+	unsigned long long third = 0;
+	intu32 i;
+
+	remove_journal_dir();
+	/* two 55-byte records per segment */
+	journal = journal_open(journal_dir, 120);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+
+	for (i = 0; i < 7; ++i) {
+		CU_ASSERT_EQUAL(append(journal, "<data>xx</data>", i), 1);
+	}
+
+	CU_ASSERT_EQUAL(journal->base, 6 * 55);
+	CU_ASSERT_EQUAL(journal_sync(journal), 1);
+
+	reader = journal_reader_open(journal_dir, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+
+	for (i = 0; i < 7; ++i) {
+		CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+		CU_ASSERT_EQUAL(record.handle, i);
+		CU_ASSERT_EQUAL(record.offset, i * 55);
+
+		if (i == 2) {
+			third = record.offset;
+		}
+	}
+
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 0);
+	journal_reader_close(reader);
+
+	/* drop the first segment only */
+	CU_ASSERT_EQUAL(journal_trim(journal, third), 1);
+
+	reader = journal_reader_open(journal_dir, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.handle, 2);
+	journal_reader_close(reader);
+
+	journal_close(journal);
+}
+
+void test_journal_torn_tail(void)
+{
+	Journal *journal;
+	JournalReader *reader;
+	JournalRecord record;
+	unsigned long long end;
+	char path[128];
+	int fd;
+
+	remove_journal_dir();
+	journal = journal_open(journal_dir, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+	CU_ASSERT_EQUAL(append(journal, "<data>1</data>", 1), 1);
+	end = journal_end(journal);
+	journal_close(journal);
+
+	/* a record cut short by a crash */
+	snprintf(path, sizeof(path), "%s/%016llx.journal", journal_dir, 0ULL);
+	fd = open(path, O_WRONLY | O_APPEND);
+	CU_ASSERT_FATAL(fd >= 0);
+	CU_ASSERT_EQUAL(write(fd, "\0\0\0\x20garbage", 11), 11);
+	close(fd);
+
+	reader = journal_reader_open(journal_dir, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 0);
+	journal_reader_close(reader);
+
+	journal = journal_open(journal_dir, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(journal);
+	CU_ASSERT_EQUAL(journal_end(journal), end);
+	CU_ASSERT_EQUAL(append(journal, "<data>2</data>", 2), 1);
+	journal_close(journal);
+
+	reader = journal_reader_open(journal_dir, end);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	CU_ASSERT_EQUAL(journal_reader_next(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.handle, 2);
+	CU_ASSERT_EQUAL(record.offset, end);
+	journal_reader_close(reader);
+}
+
+#endif
@@ -30,8 +30,16 @@
 #include "Basic.h"
 #include "src/asn1/phd_types.h"
 #include "src/dim/mds.h"
+#include "src/dim/mds_template.h"
+#include "src/dim/nomenclature.h"
+#include "src/dim/dimutil.h"
+#include "src/dim/snapshot.h"
+#include "src/dim/subscription.h"
+#include "src/manager_p.h"
+#include "src/util/bytelib.h"
 #include "testmds.h"
 #include <stdlib.h>
+#include <string.h>
 
 int test_mds_init_suite(void)
 {
@@ -51,6 +59,18 @@ void testmds_add_suite()
 	/* Add tests here - Start */
 	CU_add_test(suite, "test_mds_is_supported_data_request",
 		    test_mds_is_supported_data_request);
+	CU_add_test(suite, "test_mds_template_clone",
+		    test_mds_template_clone);
+	CU_add_test(suite, "test_mds_template_shared",
+		    test_mds_template_shared);
+	CU_add_test(suite, "test_mds_add_object",
+		    test_mds_add_object);
+	CU_add_test(suite, "test_mds_snapshot",
+		    test_mds_snapshot);
+	CU_add_test(suite, "test_mds_subscription",
+		    test_mds_subscription);
+	CU_add_test(suite, "test_mds_coalesce_reports",
+		    test_mds_coalesce_reports);
 	/* Add tests here - End */
 
 }
@@ -89,4 +109,418 @@ void test_mds_is_supported_data_request(void)
 	mds_destroy(mds);
 }
 
+void test_mds_template_clone(void)
+{
+	intu8 id[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	octet_string system_id = {8, id};
+	struct MDS_object object;
+	struct Metric *metric = metric_instance();
+	struct Numeric *numeric = numeric_instance(metric);
+	MDS *mds = mds_create();
+	MDS *copy;
+	struct Numeric *cloned;
+
+	mds_template_clear();
+
+	memset(&object, 0, sizeof(object));
+	object.choice = MDS_OBJ_METRIC;
+	object.obj_handle = 1;
+	object.u.metric.choice = METRIC_NUMERIC;
+	object.u.metric.u.numeric = *numeric;
+	object.u.metric.u.numeric.metric.handle = 1;
+	object.u.metric.u.numeric.metric.unit_code = MDC_DIM_KILO_G;
+	object.u.metric.u.numeric.metric.attribute_value_map.count = 1;
+	object.u.metric.u.numeric.metric.attribute_value_map.length = 4;
+	object.u.metric.u.numeric.metric.attribute_value_map.value =
+		calloc(1, sizeof(AttrValMapEntry));
+	object.u.metric.u.numeric.metric.attribute_value_map.value[0].attribute_id =
+		MDC_ATTR_NU_VAL_OBS_BASIC;
+	object.u.metric.u.numeric.metric.attribute_value_map.value[0].attribute_len = 2;
+	free(numeric);
+	free(metric);
+
+	mds_add_object(mds, object);
+
+	copy = mds_create();
+	CU_ASSERT_FALSE(mds_template_clone(&system_id, 0x4000, copy));
+
+	mds_template_store(&system_id, 0x4000, mds);
+	CU_ASSERT_EQUAL(mds_template_count(), 1);
+
+	// the template does not share memory with the source
+	mds_destroy(mds);
+
+	CU_ASSERT_TRUE(mds_template_clone(&system_id, 0x4000, copy));
+	CU_ASSERT_EQUAL(copy->objects_list_count, 1);
+
+	if (copy->objects_list_count == 1) {
+		cloned = &copy->objects_list[0].u.metric.u.numeric;
+		CU_ASSERT_EQUAL(copy->objects_list[0].obj_handle, 1);
+		CU_ASSERT_EQUAL(cloned->metric.unit_code, MDC_DIM_KILO_G);
+		CU_ASSERT_EQUAL(cloned->metric.attribute_value_map.count, 1);
+		CU_ASSERT_EQUAL(cloned->metric.attribute_value_map.value[0].attribute_id,
+				MDC_ATTR_NU_VAL_OBS_BASIC);
+	}
+
+	mds_destroy(copy);
+
+	// other agents do not get the template
+	id[0] = 9;
+	copy = mds_create();
+	CU_ASSERT_FALSE(mds_template_clone(&system_id, 0x4000, copy));
+	id[0] = 1;
+	CU_ASSERT_TRUE(mds_template_clone(&system_id, 0x4000, copy));
+	mds_destroy(copy);
+
+	mds_template_invalidate(&system_id, 0x4000);
+	CU_ASSERT_EQUAL(mds_template_count(), 0);
+
+	copy = mds_create();
+	CU_ASSERT_FALSE(mds_template_clone(&system_id, 0x4000, copy));
+	mds_destroy(copy);
+}
+
+void test_mds_template_shared(void)
+{
+	intu8 id[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	octet_string system_id = {8, id};
+	intu8 label[] = {0x00, 0x02, 'k', 'g'};
+	struct MDS_object object;
+	struct Metric *metric = metric_instance();
+	struct Numeric *numeric = numeric_instance(metric);
+	MDS *mds = mds_create();
+	MDS *first = mds_create();
+	MDS *second = mds_create();
+	struct Metric *a;
+	struct Metric *b;
+	ByteStreamReader *stream;
+
+	mds_template_clear();
+
+	memset(&object, 0, sizeof(object));
+	object.choice = MDS_OBJ_METRIC;
+	object.obj_handle = 1;
+	object.u.metric.choice = METRIC_NUMERIC;
+	object.u.metric.u.numeric = *numeric;
+	object.u.metric.u.numeric.metric.attribute_value_map.count = 1;
+	object.u.metric.u.numeric.metric.attribute_value_map.length = 4;
+	object.u.metric.u.numeric.metric.attribute_value_map.value =
+		calloc(1, sizeof(AttrValMapEntry));
+	free(numeric);
+	free(metric);
+
+	mds_add_object(mds, object);
+	mds_template_store(&system_id, 0x4000, mds);
+	mds_destroy(mds);
+
+	CU_ASSERT_TRUE(mds_template_clone(&system_id, 0x4000, first));
+	CU_ASSERT_TRUE(mds_template_clone(&system_id, 0x4000, second));
+
+	if (first->objects_list_count != 1 || second->objects_list_count != 1) {
+		CU_ASSERT(0);
+		return;
+	}
+
+	a = &first->objects_list[0].u.metric.u.numeric.metric;
+	b = &second->objects_list[0].u.metric.u.numeric.metric;
+
+	// both instances use the lists of the template
+	CU_ASSERT_PTR_NOT_NULL(a->shared);
+	CU_ASSERT_EQUAL(a->shared, b->shared);
+	CU_ASSERT_EQUAL(a->attribute_value_map.value, b->attribute_value_map.value);
+
+	// changing a shared list gives the instance its own copy
+	stream = byte_stream_reader_instance(label, sizeof(label));
+	dimutil_fill_metric_attr(a, MDC_ATTR_ID_LABEL_STRING, stream, NULL);
+	free(stream);
+
+	CU_ASSERT_PTR_NULL(a->shared);
+	CU_ASSERT_PTR_NOT_NULL(b->shared);
+	CU_ASSERT_NOT_EQUAL(a->attribute_value_map.value, b->attribute_value_map.value);
+	CU_ASSERT_EQUAL(a->attribute_value_map.count, 1);
+	CU_ASSERT_EQUAL(a->label_string.length, 2);
+	CU_ASSERT_EQUAL(b->label_string.length, 0);
+
+	// the lists outlive the template
+	mds_template_clear();
+	CU_ASSERT_EQUAL(b->attribute_value_map.count, 1);
+
+	mds_destroy(first);
+	mds_destroy(second);
+}
+
+void test_mds_add_object(void)
+{
+	MDS *mds = mds_create();
+	struct MDS_object object;
+	int i;
+
+	memset(&object, 0, sizeof(object));
+	object.choice = MDS_OBJ_PMSTORE;
+
+	CU_ASSERT_TRUE(mds_reserve_objects(mds, 3));
+	CU_ASSERT_EQUAL(mds->objects_list_size, 3);
+
+	for (i = 0; i < 100; ++i) {
+		object.obj_handle = i + 1;
+		mds_add_object(mds, object);
+	}
+
+	CU_ASSERT_EQUAL(mds->objects_list_count, 100);
+	CU_ASSERT_TRUE(mds->objects_list_size >= 100);
+	CU_ASSERT_TRUE(mds->objects_list_size < 200);
+
+	for (i = 0; i < 100; ++i) {
+		CU_ASSERT_EQUAL(mds_get_object_by_handle(mds, i + 1),
+				&mds->objects_list[i]);
+	}
+
+	mds_destroy(mds);
+}
+
+void test_mds_snapshot(void)
+{
+	intu8 value[] = {0x00, 0x32};
+	Context ctx;
+	ContextId other = {1, 2};
+	MetricSnapshot snapshot[4];
+	struct MDS_object object;
+	struct Metric *metric = metric_instance();
+	struct Numeric *numeric = numeric_instance(metric);
+	MDS *mds = mds_create();
+	ByteStreamReader *stream;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.id.plugin = 1;
+	ctx.id.connid = 1;
+
+	memset(&object, 0, sizeof(object));
+	object.choice = MDS_OBJ_METRIC;
+	object.obj_handle = 5;
+	object.u.metric.choice = METRIC_NUMERIC;
+	object.u.metric.u.numeric = *numeric;
+	object.u.metric.u.numeric.metric.type.partition = MDC_PART_SCADA;
+	object.u.metric.u.numeric.metric.type.code = MDC_MASS_BODY_ACTUAL;
+	object.u.metric.u.numeric.metric.unit_code = MDC_DIM_KILO_G;
+	free(numeric);
+	free(metric);
+
+	mds_add_object(mds, object);
+	snapshot_attach(&ctx, mds);
+
+	numeric = &mds->objects_list[0].u.metric.u.numeric;
+	CU_ASSERT_NOT_EQUAL(numeric->snapshot_slot, 0);
+
+	// nothing observed yet
+	CU_ASSERT_EQUAL(snapshot_read(&ctx.id, snapshot, 4), 0);
+
+	stream = byte_stream_reader_instance(value, sizeof(value));
+	dimutil_fill_numeric_attr(numeric, MDC_ATTR_NU_VAL_OBS_BASIC,
+				  stream, NULL);
+	free(stream);
+
+	CU_ASSERT_EQUAL(snapshot_read(&ctx.id, snapshot, 4), 1);
+	CU_ASSERT_EQUAL(snapshot[0].handle, 5);
+	CU_ASSERT_EQUAL(snapshot[0].count, 1);
+	CU_ASSERT_EQUAL(snapshot[0].metric_ids[0], MDC_MASS_BODY_ACTUAL);
+	CU_ASSERT_EQUAL(snapshot[0].unit_code, MDC_DIM_KILO_G);
+	CU_ASSERT_EQUAL(snapshot[0].values[0], 50);
+	CU_ASSERT_NOT_EQUAL(snapshot[0].timestamp, 0);
+
+	CU_ASSERT_EQUAL(snapshot_read(&other, snapshot, 4), 0);
+	CU_ASSERT_TRUE(snapshot_read(NULL, snapshot, 4) >= 1);
+
+	// slot is released with the device
+	mds_destroy(mds);
+	CU_ASSERT_EQUAL(snapshot_read(&ctx.id, snapshot, 4), 0);
+}
+
+static int subscription_entries = 0;
+
+static void subscription_data_updated(Context *ctx, DataList *list)
+{
+	subscription_entries += list->size;
+}
+
+static void add_numeric(MDS *mds, ASN1_HANDLE handle, OID_Type type)
+{
+	struct MDS_object object;
+	struct Metric *metric = metric_instance();
+	struct Numeric *numeric = numeric_instance(metric);
+
+	memset(&object, 0, sizeof(object));
+	object.choice = MDS_OBJ_METRIC;
+	object.obj_handle = handle;
+	object.u.metric.choice = METRIC_NUMERIC;
+	object.u.metric.u.numeric = *numeric;
+	object.u.metric.u.numeric.metric.type.partition = MDC_PART_SCADA;
+	object.u.metric.u.numeric.metric.type.code = type;
+	free(numeric);
+	free(metric);
+
+	mds_add_object(mds, object);
+}
+
+void test_mds_subscription(void)
+{
+	intu8 value[] = {0x00, 0x32};
+	intu8 id[4] = {1, 2, 3, 4};
+	ManagerListener listener = MANAGER_LISTENER_EMPTY;
+	SubscriptionFilter filter;
+	Context ctx;
+	ScanReportInfoVar report;
+	ObservationScan obs[2];
+	AVA_Type attr[2];
+	MetricSnapshot snapshot[4];
+	MDS *mds = mds_create();
+	int weight;
+	int i;
+
+	add_numeric(mds, 5, MDC_MASS_BODY_ACTUAL);
+	add_numeric(mds, 6, MDC_BODY_FAT);
+	mds->system_id.length = sizeof(id);
+	mds->system_id.value = malloc(sizeof(id));
+	memcpy(mds->system_id.value, id, sizeof(id));
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.id.plugin = 1;
+	ctx.id.connid = 2;
+	ctx.mds = mds;
+	snapshot_attach(&ctx, mds);
+
+	for (i = 0; i < 2; ++i) {
+		attr[i].attribute_id = MDC_ATTR_NU_VAL_OBS_BASIC;
+		attr[i].attribute_value.length = sizeof(value);
+		attr[i].attribute_value.value = value;
+		obs[i].obj_handle = 5 + i;
+		obs[i].attributes.count = 1;
+		obs[i].attributes.length = 6;
+		obs[i].attributes.value = &attr[i];
+	}
+
+	memset(&report, 0, sizeof(report));
+	report.obs_scan_var.count = 2;
+	report.obs_scan_var.value = obs;
+
+	listener.measurement_data_updated = &subscription_data_updated;
+	manager_add_listener(listener);
+	subscription_clear();
+
+	// no filters, everything is delivered
+	CU_ASSERT_TRUE(subscription_wants(mds, 5));
+	CU_ASSERT_TRUE(subscription_wants(mds, 6));
+	mds_event_report_dynamic_data_update_var(&ctx, &report);
+	CU_ASSERT_EQUAL(subscription_entries, 2);
+
+	memset(&filter, 0, sizeof(filter));
+	filter.fields = SUBSCRIPTION_TYPE | SUBSCRIPTION_PARTITION;
+	filter.partition = MDC_PART_SCADA;
+	filter.type = MDC_MASS_BODY_ACTUAL;
+	weight = subscription_add(&filter);
+	CU_ASSERT_NOT_EQUAL(weight, 0);
+
+	CU_ASSERT_TRUE(subscription_wants(mds, 5));
+	CU_ASSERT_FALSE(subscription_wants(mds, 6));
+	CU_ASSERT_FALSE(subscription_wants(mds, 7));
+
+	// filtered observation still updates the object
+	subscription_entries = 0;
+	value[1] = 0x33;
+	mds_event_report_dynamic_data_update_var(&ctx, &report);
+	CU_ASSERT_EQUAL(subscription_entries, 1);
+	CU_ASSERT_EQUAL(mds->objects_list[1].u.metric.u.numeric.basic_nu_observed_value, 51);
+	CU_ASSERT_EQUAL(snapshot_read(&ctx.id, snapshot, 4), 2);
+
+	// system id must match as well
+	filter.fields = SUBSCRIPTION_HANDLE | SUBSCRIPTION_SYSTEM_ID;
+	filter.handle = 6;
+	filter.system_id.length = sizeof(id);
+	filter.system_id.value = id;
+	CU_ASSERT_NOT_EQUAL(subscription_add(&filter), 0);
+	CU_ASSERT_TRUE(subscription_wants(mds, 6));
+
+	mds->system_id.value[0] = 9;
+	CU_ASSERT_FALSE(subscription_wants(mds, 6));
+
+	// nothing wanted, nothing delivered
+	CU_ASSERT_TRUE(subscription_remove(weight));
+	CU_ASSERT_FALSE(subscription_remove(weight));
+	subscription_entries = 0;
+	mds_event_report_dynamic_data_update_var(&ctx, &report);
+	CU_ASSERT_EQUAL(subscription_entries, 0);
+
+	subscription_clear();
+	CU_ASSERT_TRUE(subscription_wants(mds, 6));
+
+	manager_remove_all_listeners();
+	mds_destroy(mds);
+}
+
+static int coalesce_calls = 0;
+
+static void coalesce_data_updated(Context *ctx, DataList *list)
+{
+	coalesce_calls++;
+	subscription_entries += list->size;
+}
+
+void test_mds_coalesce_reports(void)
+{
+	intu8 value[] = {0x00, 0x32};
+	ManagerListener listener = MANAGER_LISTENER_EMPTY;
+	Context ctx;
+	ScanReportInfoMPVar report;
+	ScanReportPerVar persons[3];
+	ObservationScan obs[3];
+	AVA_Type attr;
+	MDS *mds = mds_create();
+	int i;
+
+	add_numeric(mds, 5, MDC_MASS_BODY_ACTUAL);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.mds = mds;
+
+	attr.attribute_id = MDC_ATTR_NU_VAL_OBS_BASIC;
+	attr.attribute_value.length = sizeof(value);
+	attr.attribute_value.value = value;
+
+	for (i = 0; i < 3; ++i) {
+		obs[i].obj_handle = 5;
+		obs[i].attributes.count = 1;
+		obs[i].attributes.length = 6;
+		obs[i].attributes.value = &attr;
+		persons[i].person_id = i + 1;
+		persons[i].obs_scan_var.count = 1;
+		persons[i].obs_scan_var.length = 10;
+		persons[i].obs_scan_var.value = &obs[i];
+	}
+
+	memset(&report, 0, sizeof(report));
+	report.scan_per_var.count = 3;
+	report.scan_per_var.value = persons;
+
+	listener.measurement_data_updated = &coalesce_data_updated;
+	manager_add_listener(listener);
+	subscription_clear();
+
+	// one list per person
+	subscription_entries = 0;
+	mds_event_report_dynamic_data_update_mp_var(&ctx, &report);
+	CU_ASSERT_EQUAL(coalesce_calls, 3);
+	CU_ASSERT_EQUAL(subscription_entries, 3);
+
+	// one list per report
+	manager_set_coalesce_reports(1);
+	coalesce_calls = 0;
+	subscription_entries = 0;
+	mds_event_report_dynamic_data_update_mp_var(&ctx, &report);
+	CU_ASSERT_EQUAL(coalesce_calls, 1);
+	CU_ASSERT_EQUAL(subscription_entries, 3);
+	manager_set_coalesce_reports(0);
+
+	manager_remove_all_listeners();
+	mds_destroy(mds);
+}
+
 #endif
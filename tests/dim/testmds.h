@@ -31,4 +31,16 @@ void testmds_add_suite(void);
 
 void test_mds_is_supported_data_request(void);
 
+void test_mds_template_clone(void);
+
+void test_mds_template_shared(void);
+
+void test_mds_add_object(void);
+
+void test_mds_snapshot(void);
+
+void test_mds_subscription(void);
+
+void test_mds_coalesce_reports(void);
+
 #endif
@@ -31,11 +31,17 @@
 #ifdef TEST_ENABLED
 
 #include <stdlib.h>
+#include <string.h>
 #include "testpmstore.h"
 #include "Basic.h"
 #include "src/dim/pmstore.h"
 #include "src/dim/pmstore.h"
 #include "src/dim/pmsegment.h"
+#include "src/dim/pmstore_resume.h"
+#include "src/dim/pmstore_sched.h"
+#include "src/dim/mds.h"
+#include "src/api/data_list.h"
+#include "src/manager.h"
 #include "testdateutil.h"
 #include "src/util/dateutil.h"
 
@@ -61,6 +67,21 @@ void testpmstore_add_suite()
 	CU_add_test(suite, "test_pmstore_date_selection",
 		    test_pmstore_date_selection);
 
+	CU_add_test(suite, "test_pmstore_streamed_download",
+		    test_pmstore_streamed_download);
+
+	CU_add_test(suite, "test_pmstore_aborted_download",
+		    test_pmstore_aborted_download);
+
+	CU_add_test(suite, "test_pmstore_resumed_download",
+		    test_pmstore_resumed_download);
+
+	CU_add_test(suite, "test_pmstore_resumed_whole_download",
+		    test_pmstore_resumed_whole_download);
+
+	CU_add_test(suite, "test_pmstore_sliced_download",
+		    test_pmstore_sliced_download);
+
 	/* Add tests here - End */
 
 }
@@ -259,4 +280,352 @@ void test_pmstore_date_selection(void)
 
 }
 
+static int streamed_calls;
+static int streamed_entries;
+static intu32 streamed_first[4];
+static char streamed_time[8][16];
+static int done_segments;
+static int done_failed;
+static intu32 streamed_shift;
+
+static void streamed_entries_cb(Context *ctx, int handle, int instnumber,
+				intu32 first_entry, DataList *list,
+				void *user_data)
+{
+	DataEntry *segment = &list->values[0];
+	int i;
+
+	CU_ASSERT_EQUAL(handle, 10);
+	CU_ASSERT_EQUAL(instnumber, 7);
+
+	if (streamed_calls < 4) {
+		streamed_first[streamed_calls] = first_entry;
+	}
+
+	++streamed_calls;
+
+	for (i = 0; i < segment->u.compound.entries_count; ++i) {
+		DataEntry *header = &segment->u.compound.entries[i].u.compound.entries[0];
+
+		if (streamed_entries < 8) {
+			strcpy(streamed_time[streamed_entries],
+			       header->u.compound.entries[0].u.simple.value);
+		}
+
+		++streamed_entries;
+	}
+
+	data_list_del(list);
+}
+
+static void streamed_done_cb(Context *ctx, int handle, int segments,
+				int failed, void *user_data)
+{
+	done_segments = segments;
+	done_failed = failed;
+}
+
+/**
+ * Creates a PM-Store with segment 7, whose entries are a relative
+ * time each, and a download of it as if it had been triggered
+ */
+static struct PMStore *streamed_pmstore(void)
+{
+	struct PMStore *pmstore = pmstore_instance();
+	struct PMSegment *segment = pmsegment_instance(7);
+	PMStoreDownload *download = calloc(1, sizeof(PMStoreDownload));
+
+	pmstore->handle = 10;
+	segment->pm_segment_entry_map.segm_entry_header = SEG_ELEM_HDR_RELATIVE_TIME;
+	pmstore_add_segment(pmstore, segment);
+
+	download->options.entries = streamed_entries_cb;
+	download->options.done = streamed_done_cb;
+	download->segments = calloc(1, sizeof(InstNumber));
+	download->segments[0] = 7;
+	download->count = 1;
+	download->next = 1;
+	download->current = 7;
+	download->retry = -1;
+	pmstore->download = download;
+
+	streamed_calls = 0;
+	streamed_entries = 0;
+	done_segments = -1;
+	done_failed = -1;
+
+	return pmstore;
+}
+
+/**
+ * Stores a Segment-Data-Event of relative times in a PM-Store, as it
+ * arrives from the agent
+ */
+static int streamed_store(Context *ctx, struct PMStore *pmstore, intu32 index,
+			  intu32 count, SegmEvtStatus status,
+			  SegmDataEventDescr *descr)
+{
+	SegmentDataEvent event;
+	intu8 data[256];
+	intu32 i;
+
+	for (i = 0; i < count; ++i) {
+		intu32 t = (index + i) * 100 + streamed_shift;
+		data[4 * i] = t >> 24;
+		data[4 * i + 1] = t >> 16;
+		data[4 * i + 2] = t >> 8;
+		data[4 * i + 3] = t;
+	}
+
+	event.segm_data_event_descr.segm_instance = 7;
+	event.segm_data_event_descr.segm_evt_entry_index = index;
+	event.segm_data_event_descr.segm_evt_entry_count = count;
+	event.segm_data_event_descr.segm_evt_status = status;
+	event.segm_data_event_entries.value = data;
+	event.segm_data_event_entries.length = 4 * count;
+	*descr = event.segm_data_event_descr;
+
+	return pmstore_segment_data_event(ctx, pmstore, event);
+}
+
+/**
+ * Feeds a Segment-Data-Event of relative times to a PM-Store
+ */
+static int streamed_event(Context *ctx, struct PMStore *pmstore, intu32 index,
+			  intu32 count, SegmEvtStatus status)
+{
+	SegmDataEventDescr descr;
+	int ok = streamed_store(ctx, pmstore, index, count, status, &descr);
+
+	pmstore_segment_data_decode(ctx, pmstore, descr, ok);
+
+	return ok;
+}
+
+void test_pmstore_streamed_download(void)
+{
+	Context ctx;
+	struct PMStore *pmstore = streamed_pmstore();
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 0, 3, SEVTSTA_FIRST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 1);
+	CU_ASSERT_EQUAL(streamed_entries, 3);
+	// streamed entries are not kept
+	CU_ASSERT_EQUAL(pmstore->segm_list[0]->fixed_segment_data.length, 0);
+	CU_ASSERT_EQUAL(done_segments, -1);
+
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 3, 2, SEVTSTA_LAST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 2);
+	CU_ASSERT_EQUAL(streamed_entries, 5);
+	CU_ASSERT_EQUAL(streamed_first[0], 0);
+	CU_ASSERT_EQUAL(streamed_first[1], 3);
+	CU_ASSERT_STRING_EQUAL(streamed_time[0], "0");
+	CU_ASSERT_STRING_EQUAL(streamed_time[2], "200");
+	CU_ASSERT_STRING_EQUAL(streamed_time[4], "400");
+
+	CU_ASSERT_EQUAL(done_segments, 1);
+	CU_ASSERT_EQUAL(done_failed, 0);
+	CU_ASSERT_PTR_NULL(pmstore->download);
+
+	pmstore_destroy(pmstore);
+	free(pmstore);
+}
+
+void test_pmstore_aborted_download(void)
+{
+	Context ctx;
+	struct PMStore *pmstore = streamed_pmstore();
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 0, 3, SEVTSTA_FIRST_ENTRY), 1);
+
+	// entries 3 and 4 missing
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 5, 2, SEVTSTA_LAST_ENTRY), 0);
+	CU_ASSERT_EQUAL(streamed_calls, 1);
+
+	CU_ASSERT_EQUAL(done_segments, 0);
+	CU_ASSERT_EQUAL(done_failed, 1);
+	CU_ASSERT_PTR_NULL(pmstore->download);
+
+	pmstore_destroy(pmstore);
+	free(pmstore);
+}
+
+void test_pmstore_resumed_download(void)
+{
+	Context ctx;
+	struct MDS *mds = calloc(1, sizeof(struct MDS));
+	intu8 system_id[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	struct PMStore *pmstore;
+	SegmDataEventDescr descr;
+
+	memset(&ctx, 0, sizeof(ctx));
+	mds->system_id.value = system_id;
+	mds->system_id.length = sizeof(system_id);
+	ctx.mds = mds;
+	streamed_shift = 0;
+	pmstore_resume_clear();
+
+	// first association delivers 3 entries, then drops
+	pmstore = streamed_pmstore();
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 0, 3, SEVTSTA_FIRST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_entries, 3);
+	pmstore_destroy(pmstore);
+	free(pmstore);
+
+	// agent sends the segment again from the start
+	pmstore = streamed_pmstore();
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 0, 2, SEVTSTA_FIRST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 0);
+
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 2, 3, SEVTSTA_LAST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 1);
+	CU_ASSERT_EQUAL(streamed_entries, 2);
+	CU_ASSERT_EQUAL(streamed_first[0], 3);
+	CU_ASSERT_STRING_EQUAL(streamed_time[0], "300");
+	CU_ASSERT_STRING_EQUAL(streamed_time[1], "400");
+	CU_ASSERT_EQUAL(done_segments, 1);
+	CU_ASSERT_EQUAL(done_failed, 0);
+
+	// whole segment delivered: nothing to transfer unless it grows
+	pmstore->segm_list[0]->segment_usage_count = 5;
+	CU_ASSERT_EQUAL(pmstore_resume_delivered(&ctx, pmstore, pmstore->segm_list[0]), 1);
+	pmstore->segm_list[0]->segment_usage_count = 6;
+	CU_ASSERT_EQUAL(pmstore_resume_delivered(&ctx, pmstore, pmstore->segm_list[0]), 0);
+	pmstore_destroy(pmstore);
+	free(pmstore);
+
+	// entries that differ from the ones delivered abort the transfer
+	// and make it start over
+	streamed_shift = 1;
+	pmstore = streamed_pmstore();
+	CU_ASSERT_EQUAL(streamed_store(&ctx, pmstore, 0, 5, SEVTSTA_FIRST_ENTRY,
+				       &descr), 0);
+	CU_ASSERT_EQUAL(pmstore->download->retry, 7);
+	pmstore_destroy(pmstore);
+	free(pmstore);
+
+	pmstore = streamed_pmstore();
+	pmstore->segm_list[0]->segment_usage_count = 5;
+	CU_ASSERT_EQUAL(pmstore_resume_delivered(&ctx, pmstore, pmstore->segm_list[0]), 0);
+	pmstore_destroy(pmstore);
+	free(pmstore);
+
+	streamed_shift = 0;
+	pmstore_resume_clear();
+	free(mds);
+}
+
+static void whole_received_cb(Context *ctx, int handle, int instnumber,
+				DataList *list)
+{
+	streamed_entries_cb(ctx, handle, instnumber, 0, list, NULL);
+}
+
+void test_pmstore_resumed_whole_download(void)
+{
+	Context ctx;
+	ManagerListener listener = MANAGER_LISTENER_EMPTY;
+	struct MDS *mds = calloc(1, sizeof(struct MDS));
+	intu8 system_id[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	struct PMStore *pmstore;
+
+	memset(&ctx, 0, sizeof(ctx));
+	mds->system_id.value = system_id;
+	mds->system_id.length = sizeof(system_id);
+	ctx.mds = mds;
+	pmstore_resume_clear();
+
+	listener.segment_data_received = &whole_received_cb;
+	manager_add_listener(listener);
+
+	// first association gets 3 entries, then drops
+	pmstore = streamed_pmstore();
+	pmstore->download->options.entries = NULL;
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 0, 3, SEVTSTA_FIRST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 0);
+	pmstore_segment_abandon(&ctx, pmstore, pmstore->segm_list[0]);
+	pmstore_destroy(pmstore);
+	free(pmstore);
+
+	// entries decoded by the first transfer are kept, not decoded again
+	pmstore = streamed_pmstore();
+	pmstore->download->options.entries = NULL;
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 0, 2, SEVTSTA_FIRST_ENTRY), 1);
+	CU_ASSERT_PTR_NOT_NULL(pmstore->segm_list[0]->decoded);
+	CU_ASSERT_EQUAL(pmstore->segm_list[0]->fixed_segment_data.length, 0);
+	CU_ASSERT_EQUAL(streamed_calls, 0);
+
+	// and delivered along with the rest of the segment
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 2, 3, SEVTSTA_LAST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 1);
+	CU_ASSERT_EQUAL(streamed_entries, 5);
+	CU_ASSERT_STRING_EQUAL(streamed_time[0], "0");
+	CU_ASSERT_STRING_EQUAL(streamed_time[2], "200");
+	CU_ASSERT_STRING_EQUAL(streamed_time[4], "400");
+	CU_ASSERT_EQUAL(done_segments, 1);
+	CU_ASSERT_EQUAL(done_failed, 0);
+
+	pmstore->segm_list[0]->segment_usage_count = 5;
+	CU_ASSERT_EQUAL(pmstore_resume_delivered(&ctx, pmstore, pmstore->segm_list[0]), 1);
+	pmstore_destroy(pmstore);
+	free(pmstore);
+
+	manager_remove_all_listeners();
+	pmstore_resume_clear();
+	free(mds);
+}
+
+static int sched_wakeups;
+
+static void sched_wakeup()
+{
+	++sched_wakeups;
+}
+
+void test_pmstore_sliced_download(void)
+{
+	Context ctx;
+	struct PMStore *pmstore = streamed_pmstore();
+	struct PMSegment *segment = pmstore->segm_list[0];
+
+	memset(&ctx, 0, sizeof(ctx));
+	sched_wakeups = 0;
+	pmstore_sched_set(sched_wakeup, 0);
+
+	// entries are only stored while they arrive
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 0, 40, SEVTSTA_FIRST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_event(&ctx, pmstore, 40, 10, SEVTSTA_LAST_ENTRY), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 0);
+	CU_ASSERT_EQUAL(sched_wakeups, 1);
+	CU_ASSERT_EQUAL(segment->scheduled, 1);
+	CU_ASSERT_EQUAL(segment->fixed_segment_data.length, 200);
+
+	// then decoded a batch at a time, as time allows
+	CU_ASSERT_EQUAL(pmstore_segment_process(&ctx, pmstore, segment, 0), 1);
+	CU_ASSERT_EQUAL(streamed_calls, 1);
+	CU_ASSERT_EQUAL(streamed_entries, 32);
+	CU_ASSERT_EQUAL(segment->fixed_segment_data.length, 72);
+	CU_ASSERT_EQUAL(done_segments, -1);
+
+	CU_ASSERT_EQUAL(pmstore_segment_process(&ctx, pmstore, segment, 0), 0);
+	CU_ASSERT_EQUAL(streamed_calls, 2);
+	CU_ASSERT_EQUAL(streamed_entries, 50);
+	CU_ASSERT_EQUAL(streamed_first[0], 0);
+	CU_ASSERT_EQUAL(streamed_first[1], 32);
+	CU_ASSERT_STRING_EQUAL(streamed_time[7], "700");
+
+	// the download ends once the last entries are delivered
+	CU_ASSERT_EQUAL(done_segments, 1);
+	CU_ASSERT_EQUAL(done_failed, 0);
+	CU_ASSERT_PTR_NULL(pmstore->download);
+
+	pmstore_sched_clear();
+	pmstore_destroy(pmstore);
+	free(pmstore);
+}
+
 #endif /* PMSTORE_C_ */
@@ -31,6 +31,11 @@
 void testpmstore_add_suite(void);
 void test_pmstore_add_and_clear_segment(void);
 void test_pmstore_date_selection(void);
+void test_pmstore_streamed_download(void);
+void test_pmstore_aborted_download(void);
+void test_pmstore_resumed_download(void);
+void test_pmstore_resumed_whole_download(void);
+void test_pmstore_sliced_download(void);
 
 
 #endif /* PMSTORE_H_ */
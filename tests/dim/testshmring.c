@@ -0,0 +1,189 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testshmring.c
+ *
+ * Created on: Jun 26, 2012
+ **********************************************************************/
+
+
+#ifdef TEST_ENABLED
+
+#include "testshmring.h"
+#include "src/util/shmring.h"
+#include "Basic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+	intu32 n;
+	char text[20];
+} Record;
+
+static char ring_name[64];
+
+int test_shmring_init_suite(void)
+{
+	snprintf(ring_name, sizeof(ring_name), "/antidote-test-%d", getpid());
+	return 0;
+}
+
+int test_shmring_finish_suite(void)
+{
+	return 0;
+}
+
+void testshmring_add_suite()
+{
+	CU_pSuite suite = CU_add_suite("Shared Memory Ring Test Suite",
+				       test_shmring_init_suite,
+				       test_shmring_finish_suite);
+
+	/* Add tests here - Start */
+	CU_add_test(suite, "test_shmring_read_write", test_shmring_read_write);
+	CU_add_test(suite, "test_shmring_overrun", test_shmring_overrun);
+	CU_add_test(suite, "test_shmring_close", test_shmring_close);
+	CU_add_test(suite, "test_shmring_capacity", test_shmring_capacity);
+	/* Add tests here - End */
+}
+
+static void write_record(ShmRing *ring, intu32 n)
+{
+	Record record;
+
+	record.n = n;
+	snprintf(record.text, sizeof(record.text), "record %u", n);
+	shmring_write(ring, &record);
+}
+
+void test_shmring_read_write(void)
+{
+	ShmRing *ring = shmring_create(ring_name, sizeof(Record), 10);
+	ShmRingReader *reader;
+	Record record;
+	intu32 i;
+
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ring);
+	CU_ASSERT_EQUAL(ring->header->capacity, 16);
+
+	/* readers only get what is written after they attach */
+	write_record(ring, 100);
+
+	reader = shmring_reader_open(ring_name);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	CU_ASSERT_EQUAL(reader->cursor->pid, getpid());
+	CU_ASSERT_EQUAL(shmring_read(reader, &record), 0);
+
+	/* more records than slots, read as they come */
+	for (i = 0; i < 40; ++i) {
+		write_record(ring, i);
+		CU_ASSERT_EQUAL(shmring_read(reader, &record), 1);
+		CU_ASSERT_EQUAL(record.n, i);
+	}
+
+	CU_ASSERT_STRING_EQUAL(record.text, "record 39");
+	CU_ASSERT_EQUAL(shmring_read(reader, &record), 0);
+
+	CU_ASSERT_EQUAL(reader->lost, 0);
+	CU_ASSERT_EQUAL(reader->cursor->position, ring->header->head);
+
+	shmring_reader_close(reader);
+	shmring_destroy(ring);
+
+	CU_ASSERT_PTR_NULL(shmring_reader_open(ring_name));
+}
+
+void test_shmring_overrun(void)
+{
+	ShmRing *ring = shmring_create(ring_name, sizeof(Record), 16);
+	ShmRingReader *reader;
+	Record record;
+	intu32 i;
+
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ring);
+	reader = shmring_reader_open(ring_name);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+
+	for (i = 0; i < 50; ++i) {
+		write_record(ring, i);
+	}
+
+	/* the oldest records were overwritten */
+	CU_ASSERT_EQUAL(shmring_read(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.n, 50 - 16 + 1);
+	CU_ASSERT_EQUAL(reader->lost, 50 - 16 + 1);
+
+	for (i = 50 - 16 + 2; i < 50; ++i) {
+		CU_ASSERT_EQUAL(shmring_read(reader, &record), 1);
+		CU_ASSERT_EQUAL(record.n, i);
+	}
+
+	CU_ASSERT_EQUAL(shmring_read(reader, &record), 0);
+
+	shmring_reader_close(reader);
+	shmring_destroy(ring);
+}
+
+void test_shmring_close(void)
+{
+	ShmRing *ring = shmring_create(ring_name, sizeof(Record), 16);
+	ShmRingReader *reader;
+	ShmRingReader *other;
+	Record record;
+
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ring);
+	reader = shmring_reader_open(ring_name);
+	other = shmring_reader_open(ring_name);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(other);
+	CU_ASSERT(reader->cursor != other->cursor);
+
+	write_record(ring, 1);
+	shmring_destroy(ring);
+
+	/* pending records are still delivered */
+	CU_ASSERT_EQUAL(shmring_read(reader, &record), 1);
+	CU_ASSERT_EQUAL(record.n, 1);
+	CU_ASSERT_EQUAL(shmring_read(reader, &record), -1);
+
+	shmring_reader_close(reader);
+	shmring_reader_close(other);
+}
+
+void test_shmring_capacity(void)
+{
+	ShmRing *ring;
+
+	CU_ASSERT_PTR_NULL(shmring_create(ring_name, sizeof(Record), 0));
+	CU_ASSERT_PTR_NULL(shmring_create(ring_name, sizeof(Record),
+					  SHMRING_MAX_CAPACITY + 1));
+	CU_ASSERT_PTR_NULL(shmring_create(ring_name, sizeof(Record),
+					  0x80000001u));
+
+	ring = shmring_create(ring_name, sizeof(Record), 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(ring);
+	CU_ASSERT_EQUAL(ring->header->capacity, 1);
+	shmring_destroy(ring);
+}
+
+#endif
@@ -0,0 +1,41 @@
+/**********************************************************************
+ * Copyright (C) 2012 Signove Tecnologia Corporation.
+ * All rights reserved.
+ * Contact: Signove Tecnologia Corporation (contact@signove.com)
+ *
+ * $LICENSE_TEXT:BEGIN$
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation and appearing
+ * in the file LICENSE included in the packaging of this file; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ * $LICENSE_TEXT:END$
+ *
+ * testshmring.h
+ *
+ * Created on: Jun 26, 2012
+ **********************************************************************/
+
+#ifndef TESTSHMRING_H_
+
+#ifdef TEST_ENABLED
+
+void testshmring_add_suite(void);
+void test_shmring_read_write(void);
+void test_shmring_overrun(void);
+void test_shmring_close(void);
+void test_shmring_capacity(void);
+
+#endif
+
+#define TESTSHMRING_H_
+#endif /* TESTSHMRING_H_ */
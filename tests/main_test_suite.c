@@ -43,16 +43,21 @@
 #include "communication/parser/testbytelib.h"
 #include "communication/encoder/testencoder.h"
 #include "api/testxml.h"
+#include "api/testtimeseries.h"
 #include "communication/testcontextmanager.h"
 #include "communication/testfsm.h"
 #include "communication/testservice.h"
 #include "communication/testextconfiguration.h"
+#include "communication/teststats.h"
+#include "communication/testcapture.h"
 #include "dim/testpmstore.h"
 #include "dim/testpmsegment.h"
 #include "dim/testdateutil.h"
 #include "dim/testdim.h"
 #include "dim/testmds.h"
 #include "dim/testioutil.h"
+#include "dim/testjournal.h"
+#include "dim/testshmring.h"
 #include "functional_test_cases/test_association.h"
 #include "functional_test_cases/test_operating.h"
 #include "functional_test_cases/test_configuring.h"
@@ -77,6 +82,7 @@ void add_test_suites()
 
 	// Unit tests
 	testxml_add_suite();
+	testtimeseries_add_suite();
 	testdim_add_suite();
 	testmds_add_suite();
 	testpmstore_add_suite();
@@ -86,11 +92,15 @@ void add_test_suites()
 	testencoder_add_suite();
 	testdateutil_add_suite();
 	testioutil_add_suite();
+	testjournal_add_suite();
+	testshmring_add_suite();
 	testfsm_add_suite();
 	testservice_add_suite();
 	testtimer_add_suite();
 	testextconfiguration_add_suite();
 	testctxmanager_add_suite();
+	teststats_add_suite();
+	testcapture_add_suite();
 	testllist_add_suite();
 
 	// Functional tests